@@ -0,0 +1,71 @@
+#ifndef ALERT_POLICY_H
+#define ALERT_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Alert levels come from a fixed table of rules (alert_policy.cpp), each
+// one raising a level while all of its conditions hold. The table is
+// validated at compile time and evaluated on SensorData's integer units,
+// so one evaluation costs the same bounded loop whatever the readings.
+
+enum AlertMetric : uint8_t {
+    ALERT_METRIC_NONE = 0,      // Unused condition slot
+    ALERT_METRIC_CO2,           // ppm
+    ALERT_METRIC_HUMIDITY,      // % * 10
+    ALERT_METRIC_TEMPERATURE    // C * 10
+};
+
+#define ALERT_RULE_CONDITIONS   2
+
+// Holds while the metric is above `threshold`; once the rule is active it
+// only counts as gone when the metric drops to threshold - hysteresis
+struct AlertCondition {
+    AlertMetric metric;
+    int32_t threshold;
+    int32_t hysteresis;
+};
+
+struct AlertRule {
+    AlertLevel level;
+    AlertCondition conditions[ALERT_RULE_CONDITIONS];   // All must hold
+    uint32_t dwellMs;       // Conditions must hold this long before the rule raises
+    uint32_t holdMs;        // Minimum time the rule stays raised
+};
+
+#define ALERT_MAX_RULES         8
+
+class AlertPolicy {
+private:
+    struct RuleState {
+        bool active;
+        bool pending;       // Conditions hold, dwell time running
+        uint32_t sinceMs;   // Start of the dwell, or when the rule raised
+    };
+
+    RuleState states[ALERT_MAX_RULES];
+    AlertLevel level;
+
+public:
+    AlertPolicy();
+    void reset();
+
+    // Highest level whose rules hold for this sample, ignoring hysteresis
+    // and dwell times. Stateless, so any task may call it.
+    static AlertLevel classify(const SensorData& data);
+
+    // Advances the rule states with a new sample and returns the current
+    // level. Invalid samples leave the level unchanged.
+    AlertLevel update(const SensorData& data);
+
+    // Marks the rules of `restored` as raised, e.g. after a warm boot,
+    // so the level does not drop and come back while dwell times rerun
+    void restore(AlertLevel restored, uint32_t nowMs);
+
+    AlertLevel current() const { return level; }
+};
+
+extern AlertPolicy alertPolicy;
+
+#endif // ALERT_POLICY_H
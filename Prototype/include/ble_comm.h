@@ -2,64 +2,166 @@
 #define BLE_COMM_H
 
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
 #include "config.h"
+#include "ble_transport.h"
+#include "packet_codec.h"
+#include "diagnostics.h"
+#include "spsc_queue.h"
 
-// BLE command types
+// BLE command opcodes (CommandFrame.opcode); the argument is 0 unless noted
 enum BLECommand {
     CMD_NONE = 0,
     CMD_MUTE_BUZZER = 1,
     CMD_FORCE_SLEEP = 2,
     CMD_REQUEST_DATA = 3,
-    CMD_RESET_ALERTS = 4
+    CMD_RESET_ALERTS = 4,
+    CMD_STREAM_BATCH = 5,
+    CMD_STREAM_DELTA = 6,
+    CMD_BACKFILL = 7,           // Argument: first sequence to resend
+    CMD_SET_SAMPLE_PERIOD = 8,  // Argument: fixed milliseconds between samples, 0 = adaptive
+    CMD_SET_BATCH_SIZE = 9,     // Argument: samples per batched notification
+    CMD_SET_PROFILE = 10,       // Argument: BLEProfile
+    CMD_STREAM_SUMMARY = 11,
+    CMD_REPLAY = 12,            // Argument: session number (0 = serial input) | ReplaySpeed << 16
+    CMD_STOP_REPLAY = 13,
+    CMD_BENCHMARK = 14,         // Argument: frame bytes (0 = fill the MTU) | frames per second << 16 (0 = unpaced)
+    CMD_STOP_BENCHMARK = 15,
+    CMD_CAPTURE = 16,           // Argument: seconds of raw waveform to record, 0 = fill the buffer
+    CMD_SEND_CAPTURE = 17,      // Argument: first sample to send (0, or where a transfer broke off)
+    CMD_STOP_CAPTURE = 18,      // Ends a running capture early and stops its transfer
+    CMD_TIME_SYNC = 19,         // 64-bit argument: the phone's Unix time in milliseconds
+    CMD_PING = 20,              // Argument: token echoed in the PongFrame
+    CMD_BROADCAST = 21,         // Argument: 1 = latest sample in every advertisement, 0 = off
+    CMD_COUNT
 };
 
-// Compact binary packet structure for BLE transmission (18 bytes total)
-struct SensorPacket {
-    uint16_t co2;           // CO2 in ppm (2 bytes)
-    int16_t humidity;       // Humidity * 10 (2 bytes) 
-    int16_t temperature;    // Temperature * 10 (2 bytes)
-    uint8_t alert;          // Alert level (1 byte)
-    uint8_t status;         // Status flags (1 byte)
-    uint32_t timestamp;     // Timestamp in seconds since boot (4 bytes)
-    uint32_t sequence;      // Sequence number (4 bytes)
-} __attribute__((packed));
+// Encoding used for streamed samples
+enum StreamFormat {
+    STREAM_FORMAT_BATCH = 0,    // BatchHeader + raw SensorPacket entries
+    STREAM_FORMAT_DELTA = 1,    // DeltaHeader + keyframe + varint deltas
+    STREAM_FORMAT_SUMMARY = 2   // One SummaryRecord per interval, no samples
+};
+
+// Streaming profiles, chosen by the app for what it is showing
+enum BLEProfile {
+    BLE_PROFILE_LIVE = 0,       // Foreground charts: short interval, every sample sent at once
+    BLE_PROFILE_BALANCED = 1,   // Default until the app picks one
+    BLE_PROFILE_BACKGROUND = 2, // App backgrounded: long interval, slave latency, large batches
+    BLE_PROFILE_COUNT
+};
+
+#define BLE_MAX_FRAME_SIZE      (BLE_PREFERRED_MTU - BLE_ATT_HEADER_SIZE)
+#define BLE_MAX_BATCH_SIZE      ((BLE_MAX_FRAME_SIZE - sizeof(BatchHeader)) / sizeof(SensorPacket))
 
-class BLEManager {
+// Monitor protocol over whichever BLETransport backend the build selects
+class BLEManager : public BLETransportListener {
 private:
-    BLEServer* server;
-    BLEService* service;
-    BLECharacteristic* dataCharacteristic;
-    BLECharacteristic* controlCharacteristic;
-    bool oldDeviceConnected;
+    BLETransport* transport;
     unsigned long bleStartTime;
-    uint32_t sequenceNumber;
+    uint8_t batchBuffer[BLE_MAX_FRAME_SIZE];
+    uint8_t backfillBuffer[BLE_MAX_FRAME_SIZE];
+    uint8_t diagBuffer[DIAG_SNAPSHOT_SIZE];
+    uint8_t benchBuffer[BLE_MAX_FRAME_SIZE];
+    DiagLinkStats linkStats;            // Transport task only
+    DiagLinkStats linkSnapshot;         // Read by diagnostics reads, under linkStatsLock
+    uint32_t benchStartMs;
+    bool benchBackoff;          // Last benchmark send was refused; wait a tick
+    uint8_t captureBuffer[BLE_MAX_FRAME_SIZE];
+    uint32_t captureCursor;     // Next capture sample to send
+    bool captureSending;
+    bool captureBackoff;        // Last capture frame was refused; resend it after a tick
+    bool broadcasting;
+    uint8_t broadcastBuffer[BLE_ADV_MAX_LENGTH];
+    uint32_t backfillCursor;
+    uint32_t backfillEnd;
+    uint8_t batchCount;
+    unsigned long batchStartTime;
+    DeltaEncoder deltaEncoder;
+    StreamFormat streamFormat;
+    uint16_t samplePeriodMs;
+    uint8_t batchLimit;
+    BLEProfile profile;
+    SpscQueue<CommandFrame, BLE_COMMAND_QUEUE_LENGTH> commands;     // Callback -> transport
+    SpscQueue<CommandResponse, BLE_RESPONSE_QUEUE_LENGTH> rejected; // Refused in the callback
+    
+    void queueDeltaPacket(const SensorPacket& packet, uint32_t timestampMs);
+    void sendDeltaFrame();
+    void sendBarePacket(const SensorPacket& packet);
+    void buildPacket(const SensorData& data, AlertLevel alertLevel, SensorPacket& packet);
+    BLENotifyResult notifyData(const uint8_t* data, size_t length);
+    void sendResponse(uint8_t opcode, uint8_t requestId, CommandStatus status);
+    uint8_t batchCapacity();
+    void applyProfile();
     
 public:
     bool deviceConnected;
-    BLECommand pendingCommand;
+    volatile uint16_t peerMtu;
 
     BLEManager();
     bool begin();
     void sendSensorData(const SensorData& data, AlertLevel alertLevel);
-    BLECommand getCommand();
-    void clearCommand();
+    void sendSummary(const SummaryRecord& record);
+    void queueSensorData(const SensorData& data, AlertLevel alertLevel);
+    void flushBatch();
+    TickType_t nextFlushDelay();
+    void setStreamFormat(StreamFormat format);
+    StreamFormat getStreamFormat();
+    void startBackfill(uint32_t fromSequence);
+    bool isBackfilling();
+    void cancelBackfill();
+    void sendBackfillFrame();
+    void setSamplePeriod(uint16_t periodMs);
+    uint16_t getSamplePeriod();
+    bool setBatchSize(uint8_t size);
+    bool setProfile(BLEProfile next);
+    BLEProfile getProfile();
+
+    // Link benchmark: synthetic frames instead of samples until stopped or
+    // disconnected, with results on the diagnostics characteristic
+    bool startBenchmark(uint16_t frameSize, uint16_t framesPerSecond);
+    void stopBenchmark();
+    bool isBenchmarking();
+    TickType_t nextBenchmarkDelay();
+    void sendBenchmarkFrame();
+    void noteQueueDepth(uint16_t depth);
+
+    // Bulk transfer of a completed raw waveform capture, one full-MTU frame
+    // per call. A frame the stack refuses is sent again, and a broken
+    // transfer is resumed by starting again at the app's next sample.
+    bool startCaptureTransfer(uint32_t fromSample);
+    void stopCaptureTransfer();
+    bool isSendingCapture();
+    TickType_t nextCaptureDelay();
+    void sendCaptureFrame();
+
+    // Called on the transport task: ends the transfers a dropped link
+    // leaves behind, and copies the link counters for diagnostics reads
+    void handleDisconnect();
+    void publishLinkStats();
+
+    // Commands: the write callback submits, the transport task takes each
+    // one, runs it and acknowledges it on the response characteristic
+    void submitCommand(const CommandFrame& frame);
+    bool nextCommand(CommandFrame& frame);
+    void acknowledge(const CommandFrame& frame, CommandStatus status);
+    void sendRejections();
+    void sendPong(const CommandFrame& frame);
+
+    // Connectionless monitoring: every sample replaces the advertised
+    // BroadcastSummary, connected or not
+    void setBroadcast(bool enabled);
+    bool isBroadcasting();
+    void updateBroadcast(const SensorData& data, AlertLevel alertLevel);
     bool isConnected();
     bool hasTimedOut();
     void stop();
-};
-
-// Callback classes
-class ServerCallbacks : public BLEServerCallbacks {
-    void onConnect(BLEServer* pServer);
-    void onDisconnect(BLEServer* pServer);
-};
 
-class ControlCallbacks : public BLECharacteristicCallbacks {
-    void onWrite(BLECharacteristic* pCharacteristic);
+    // BLETransportListener, called on the stack's task
+    void onConnected();
+    void onDisconnected();
+    void onMtuChanged(uint16_t mtu);
+    void onControlWrite(const uint8_t* data, size_t length);
+    void onDiagnosticsRead();
 };
 
 extern BLEManager bleManager;
@@ -0,0 +1,81 @@
+#ifndef BLE_TRANSPORT_H
+#define BLE_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Boundary between BLEManager, which owns the protocol (batching, commands,
+// profiles), and the host stack that carries it. The backend is chosen at
+// build time: Bluedroid by default, NimBLE when BLE_BACKEND_NIMBLE is defined
+// (see the esp32dev-nimble environment in platformio.ini).
+
+// Characteristics of the monitor service that the protocol writes to
+enum BLEChannel {
+    BLE_CHANNEL_DATA = 0,       // Samples and frames, notify
+    BLE_CHANNEL_RESPONSE,       // Command acknowledgements, notify
+    BLE_CHANNEL_DIAG            // Diagnostics snapshot, read
+};
+
+// Outcome of one notification
+enum BLENotifyResult {
+    BLE_NOTIFY_OK = 0,          // Accepted by the stack
+    BLE_NOTIFY_CONGESTED,       // Stack out of buffers; retry once it drains
+    BLE_NOTIFY_FAILED           // Not subscribed, not connected or a stack error
+};
+
+// Connection parameters in Bluetooth units (interval 1.25 ms, timeout 10 ms)
+struct BLEProfileParams {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;           // Connection events the device may skip when idle
+    uint16_t timeout;
+    uint16_t batchDeadlineMs;   // Oldest a queued sample may get before sending
+};
+
+// Stack events, delivered on the stack's own task. Implementations must not
+// block or notify from these; queue the work for the transport task instead.
+class BLETransportListener {
+public:
+    virtual void onConnected() = 0;
+    virtual void onDisconnected() = 0;
+    virtual void onMtuChanged(uint16_t mtu) = 0;
+    virtual void onControlWrite(const uint8_t* data, size_t length) = 0;
+    virtual void onDiagnosticsRead() = 0;
+
+protected:
+    ~BLETransportListener() {}
+};
+
+class BLETransport {
+public:
+    // Brings up the stack, creates the service and starts advertising
+    virtual bool begin(BLETransportListener* listener) = 0;
+
+    // Sends on a notify channel to the connected central
+    virtual BLENotifyResult notify(BLEChannel channel, const uint8_t* data, size_t length) = 0;
+
+    // Sets the value a central reads next
+    virtual void setValue(BLEChannel channel, const uint8_t* data, size_t length) = 0;
+
+    // Requests parameters for the current connection; a no-op when idle
+    virtual void updateConnParams(const BLEProfileParams& params) = 0;
+
+    virtual void stopAdvertising() = 0;
+
+    // Connectionless monitoring: advertises `data` (a complete advertising
+    // payload) in place of the service UUID and keeps advertising, not
+    // connectable, while a central is connected. Calling it again updates
+    // the payload without restarting advertising.
+    virtual void setBroadcastData(const uint8_t* data, size_t length) = 0;
+    virtual void stopBroadcast() = 0;
+    virtual const char* name() const = 0;
+
+protected:
+    ~BLETransport() {}
+};
+
+// The backend compiled into this build
+BLETransport& bleTransport();
+
+#endif // BLE_TRANSPORT_H
@@ -0,0 +1,63 @@
+#ifndef BREATH_DETECTOR_H
+#define BREATH_DETECTOR_H
+
+#include <stdint.h>
+
+// Filter and detector tuning. The pressure input is in Pa * 16 and all
+// filters are single-pole shift-based IIRs, so each sample costs a fixed
+// handful of integer operations and no memory beyond the detector itself.
+#define RESP_BASELINE_SHIFT     8       // High-pass corner ~0.03 Hz at 50 Hz
+#define RESP_SMOOTH_SHIFT       3       // Two low-pass stages, ~1 Hz each at 50 Hz
+#define RESP_ENVELOPE_SHIFT     6       // Amplitude envelope time constant
+#define RESP_MIN_AMPLITUDE      8       // Minimum hysteresis, Pa * 16 (0.5 Pa)
+#define RESP_MIN_BREATH_MS      1500    // Faster than 40 breaths/min is noise
+#define RESP_MAX_BREATH_MS      20000   // Slower than 3 breaths/min resets the rate
+
+// Latest respiration figures; zero until two breaths have been seen
+struct RespirationState {
+    uint16_t breathsPerMinuteX10;   // Smoothed breathing rate * 10
+    uint16_t inhaleMs;              // Duration of the last inhale (pressure falling)
+    uint16_t exhaleMs;              // Duration of the last exhale (pressure rising)
+    uint32_t breathCount;           // Breaths detected since reset
+};
+
+// Incremental band-pass filter plus peak/trough detector for mask pressure
+class BreathDetector {
+private:
+    enum Phase {
+        PHASE_RISING,
+        PHASE_FALLING
+    };
+
+    uint16_t periodMs;
+    uint32_t sampleIndex;
+    bool primed;
+    int32_t baselineQ8;             // Slow pressure baseline, Pa * 16 << 8
+    int32_t smoothQ4[2];            // Low-pass stages, Pa * 16 << 4
+    int32_t envelopeQ4;             // Mean |signal|, Pa * 16 << 4
+    int32_t filteredValue;          // Band-passed signal, Pa * 16
+    Phase phase;
+    int32_t extremeValue;
+    uint32_t extremeIndex;
+    uint32_t lastPeakIndex;
+    uint32_t lastTroughIndex;
+    bool havePeak;
+    bool haveTrough;
+    uint16_t pendingExhaleMs;
+    RespirationState current;
+
+    void onPeak(uint32_t index);
+    bool onTrough(uint32_t index);
+
+public:
+    explicit BreathDetector(uint16_t samplePeriodMs);
+    void reset();
+
+    // Feeds one pressure sample (Pa * 16); returns true when a breath completed
+    bool process(int32_t pressure);
+
+    const RespirationState& state() const { return current; }
+    int32_t filtered() const { return filteredValue; }
+};
+
+#endif // BREATH_DETECTOR_H
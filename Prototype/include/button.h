@@ -3,20 +3,57 @@
 
 #include <Arduino.h>
 #include "config.h"
+#include "spsc_queue.h"
 
+// Decoded gestures, returned by update() as a bitmask
+enum ButtonEvent {
+    BUTTON_EVENT_PRESS = 0x01,          // Single short press
+    BUTTON_EVENT_DOUBLE_PRESS = 0x02,   // Two short presses within BUTTON_DOUBLE_PRESS_MS
+    BUTTON_EVENT_HOLD = 0x04            // Held for BUTTON_HOLD_TIME_MS
+};
+
+// Raw edge captured by the ISR
+struct ButtonEdge {
+    uint32_t timeMs;
+    bool pressed;
+};
+
+// The ISR only timestamps edges into a lock-free queue; update() debounces
+// them and runs the gesture state machine in task context
 class ButtonManager {
 private:
-    static volatile bool wasPressed_flag;
-    static volatile bool wasHeld_flag;
-    static volatile unsigned long buttonPressTime;
-    static volatile unsigned long lastInterruptTime;
+    enum GestureState {
+        GESTURE_IDLE,
+        GESTURE_PRESSED,        // Down, hold deadline running
+        GESTURE_RELEASED,       // Short press done, waiting for a second one
+        GESTURE_SECOND_PRESSED,
+        GESTURE_HELD,           // Hold reported, waiting for release
+        GESTURE_IGNORE          // Down since boot (the wake press), wait for release
+    };
+
+    static SpscQueue<ButtonEdge, BUTTON_EDGE_QUEUE_LENGTH> edges;
+    static volatile bool armedForPress;     // Interrupt level currently waited for
+    static volatile bool overflowed;
     static void IRAM_ATTR buttonISR();
+
+    GestureState state;
+    bool stablePressed;
+    bool rawPressed;
+    bool rawPending;            // Raw level changed and is still debouncing
+    uint32_t rawChangeTime;
+    uint32_t pressTime;
+    uint32_t releaseTime;
+
+    uint8_t settle(uint32_t now);
+    uint8_t transition(bool pressed, uint32_t time);
+    uint8_t checkDeadlines(uint32_t time);
     
 public:
+    ButtonManager();
     bool begin();
-    void update();
-    bool wasPressed();
-    bool wasHeld();
+    uint8_t update();                   // Returns ButtonEvent bits
+    TickType_t nextUpdateDelay();
+    void enableWakeup();                // Light-sleep wake on the next edge
 };
 
 extern ButtonManager buttonManager;
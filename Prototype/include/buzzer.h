@@ -2,22 +2,56 @@
 #define BUZZER_H
 
 #include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
 #include "config.h"
 
+// One tone (or silence when frequencyHz or duty is 0) held for durationMs
+struct BuzzerStep {
+    uint16_t frequencyHz;
+    uint8_t duty;           // Out of 255
+    uint16_t durationMs;
+};
+
+// Steps played in order, `repeats` times; 0 repeats until stopped
+struct BuzzerPattern {
+    const BuzzerStep* steps;
+    uint8_t stepCount;
+    uint8_t repeats;
+};
+
+// Plays patterns from a one-shot esp_timer, so nothing polls or blocks
 class BuzzerManager {
 private:
     bool isMuted;
     AlertLevel currentAlert;
-    unsigned long lastToggleTime;
-    int currentRepeat;
+    const BuzzerPattern* pattern;
+    uint8_t stepIndex;
+    uint8_t repeatCount;
+    uint16_t currentFrequency;
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t lock;
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t pmLock;    // Held from play() until silence()
+    bool pmLockHeld;
+#endif
+
+    static void timerCallback(void* arg);
+    void play(const BuzzerPattern* next);
+    void advance();
+    void applyStep(const BuzzerStep& step);
+    void silence();
         
 public:
-    bool begin();
+    BuzzerManager();
+    bool begin(bool warmBoot = false);
     void startAlert(AlertLevel level);
     void stopAlert();
     void mute();
     void unmute();
-    void update();
     bool isBuzzerActive();
     void playWelcomeSound();
 
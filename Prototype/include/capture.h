@@ -0,0 +1,64 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "packet_codec.h"
+
+enum CaptureState : uint8_t {
+    CAPTURE_IDLE = 0,       // Nothing recorded since boot
+    CAPTURE_RUNNING = 1,    // The respiration task is filling the buffer
+    CAPTURE_COMPLETE = 2    // Buffer frozen, ready to transfer
+};
+
+// Burst capture of the raw pressure waveform at the full sampling rate.
+// The respiration task is the only writer and never waits: it stores one
+// CaptureSample per timer period into a buffer allocated at boot, marking
+// failed reads and overrun periods so timestamps stay implied by the index.
+// The transport task only reads a capture once it is complete, so the radio
+// can never hold up the sampling.
+class CaptureManager {
+private:
+    CaptureSample* samples;
+    uint32_t capacity;
+    uint32_t target;                    // Samples this burst records
+    uint32_t missing;                   // Periods recorded as CAPTURE_SAMPLE_MISSING
+    uint16_t captureId;
+    std::atomic<uint32_t> recorded;
+    std::atomic<uint8_t> state;
+    std::atomic<bool> stopRequested;
+    std::atomic<uint16_t> latestCo2;    // Acquisition -> respiration
+
+    void append(int32_t pressureX16);
+
+public:
+    CaptureManager();
+    bool begin();
+
+    // Control: a new capture replaces the previous one. 0 ms, or more than
+    // the buffer holds, records until the buffer is full.
+    bool start(uint32_t durationMs);
+    void stop();
+    CaptureState getState() const { return (CaptureState)state.load(); }
+    uint32_t size() const { return recorded.load(); }
+    uint32_t getCapacity() const { return capacity; }
+    uint32_t getMissing() const { return missing; }
+
+    // Respiration task, once per timer period
+    void record(int32_t pressureX16);
+    void recordMissing(uint32_t periods);
+
+    // Acquisition task, with every live reading
+    void noteCo2(uint16_t co2) { latestCo2.store(co2, std::memory_order_relaxed); }
+
+    // Builds the BLE_FRAME_CAPTURE frame that starts at sample `offset` in a
+    // buffer of `size` bytes. Returns the frame length and sets `count` to
+    // the samples it holds; 0 if the capture is not complete or `offset` is
+    // past its end.
+    size_t buildFrame(uint32_t offset, uint8_t* buffer, size_t size, uint32_t& count);
+};
+
+extern CaptureManager captureManager;
+
+#endif // CAPTURE_H
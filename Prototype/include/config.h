@@ -7,30 +7,58 @@
 #define BUTTON_PIN          14    // Push button pin (with internal pull-up)
 #define BUZZER_PIN          4     // Buzzer PWM pin
 
+// SD card on VSPI
+#define SD_MISO_PIN         19
+#define SD_MOSI_PIN         23
+#define SD_SCLK_PIN         18
+#define SD_CS_PIN           5
+
+// BMP280 pressure sensor (shares the I2C bus)
+#define BMP280_I2C_ADDRESS  0x76
+
+// Shared sensor bus
+#define I2C_CLOCK_HZ        400000  // Fast mode
+#define I2C_TIMEOUT_MS      20      // Per-transaction limit so a stuck device cannot hold the bus
+#define I2C_QUEUE_LENGTH    4       // Pending requests per priority level
+#define I2C_MAX_WRITE_SIZE  4       // Register address plus payload
+
+// ENS160 + AHT21 gas/humidity sensors
+#define ENS160_I2C_ADDRESS  0x53
+#define AHT21_I2C_ADDRESS   0x38
+#define ENS160_INT_PIN      27    // ENS160 data-ready interrupt, -1 to poll the status register
+
 // Wake up source
 #define BUTTON_PIN_BITMASK  (1ULL << BUTTON_PIN)
 
-// Alert thresholds (CO2 in ppm)
-#define CO2_THRESHOLD_LOW    1000
-#define CO2_THRESHOLD_MED    5000
-#define CO2_THRESHOLD_HIGH   10000
+// Alert thresholds (CO2 in ppm); the full policy with hysteresis and
+// dwell times is the rule table in alert_policy.cpp
+#define CO2_THRESHOLD_LOW       1000
+#define CO2_THRESHOLD_MED       5000
+#define CO2_THRESHOLD_HIGH      10000
+#define CO2_THRESHOLD_CRITICAL  40000   // Immediately dangerous to life and health
 
 // Alert levels
 enum AlertLevel {
     ALERT_NONE = 0,
-    ALERT_LOW = 1,     // CO2 > 1000 ppm
+    ALERT_LOW = 1,     // CO2 > 1000 ppm, or hot and humid air
     ALERT_MEDIUM = 2,  // CO2 > 5000 ppm
     ALERT_HIGH = 3,     // CO2 > 10000 ppm
-    ALERT_CRITICAL = 4  // Critical alert level
+    ALERT_CRITICAL = 4  // CO2 > 40000 ppm
 };
 
-// Sensor data structure
+// Sensor data structure, in the fixed-point units of SensorPacket
 struct SensorData {
-    float co2_ppm;
-    float humidity_percent;
-    float temperature_celsius;
+    uint16_t co2;           // CO2 in ppm
+    int16_t humidity;       // Humidity * 10
+    int16_t temperature;    // Temperature * 10
     bool valid;
+    bool replayed;          // Played back from a recorded session, not measured
     unsigned long timestamp;
+    int64_t captureUs;      // Device clock (esp_timer) at the sensor read, -1 if unknown
+    uint32_t sequence;      // Assigned when the sample enters the history
+    uint16_t breathRate;    // Breaths per minute * 10, 0 while no breathing pattern is detected
+    uint16_t inhale_ms;
+    uint16_t exhale_ms;
 };
 
 // System states
@@ -40,20 +68,170 @@ enum SystemState {
     STATE_READING_SENSORS,
     STATE_PROCESSING_ALERTS,
     STATE_BLE_COMMUNICATION,
-    STATE_PREPARING_SLEEP
+    STATE_PREPARING_SLEEP,
+    STATE_COUNT
 };
 
 // Timing constants
 #define BUTTON_DEBOUNCE_MS      50
 #define BUTTON_HOLD_TIME_MS     2000
-#define SENSOR_READ_INTERVAL_MS 1000
+#define BUTTON_DOUBLE_PRESS_MS  300     // Second press must start within this of the first release
+#define SENSOR_READ_INTERVAL_MS 1000    // Period at boot, before the sampler adapts it
+#define SAMPLE_PERIOD_MIN_MS    1000    // ENS160 standard mode yields one result per second
+#define SAMPLE_PERIOD_MAX_MS    60000
+
+// Adaptive sampling: slow while CO2 is low and steady, fast as an alert
+// develops. Speeding up is immediate; slowing down waits for calm samples.
+#define SAMPLE_PERIOD_IDLE_MS   5000    // Below CO2_THRESHOLD_LOW and steady
+#define SAMPLE_PERIOD_ACTIVE_MS 2000    // ALERT_LOW, or CO2 moving
+#define SAMPLER_NOISE_PPM       25      // Step changes below this are sensor noise
+#define SAMPLER_ACTIVE_SLOPE    60      // ppm/min that counts as moving
+#define SAMPLER_FAST_SLOPE      300     // ppm/min that samples at the minimum period
+#define SAMPLER_CALM_SAMPLES    5       // Consecutive samples before slowing down
 #define BLE_TIMEOUT_MS          30000
 #define BUZZER_TIMEOUT_MS       10000
+#define SENSOR_RETRY_DELAY_MS   500
+#define SLEEP_SETTLE_MS         1000
+#define TRANSPORT_STOP_TIMEOUT_MS 500   // Wait for the transport task to park before sleep
+#define RESPIRATION_PERIOD_MS   20      // 50 Hz pressure sampling
+#define AHT21_CONVERSION_MS     80      // AHT21 trigger to result
+#define ENS160_DATA_TIMEOUT_MS  1500    // ENS160 produces one result per second in standard mode
+#define ENS160_POLL_INTERVAL_MS 50      // Status polling period when no INT pin is wired
+
+// Power management (light-sleep builds only)
+#define POWER_MAX_CPU_MHZ       240
+#define POWER_MIN_CPU_MHZ       40      // XTAL frequency, lowest clock BLE tolerates while idle
+
+// Task configuration (stack sizes in bytes, higher number = higher priority)
+// Acquisition, alert and UI run on the application core; transport shares
+// the protocol core with the Bluedroid stack so notify() never stalls I2C
+#define TASK_ACQUISITION_STACK  4096
+#define TASK_ACQUISITION_PRIO   4
+#define TASK_ACQUISITION_CORE   APP_CPU_NUM
+#define TASK_ALERT_STACK        3072
+#define TASK_ALERT_PRIO         3
+#define TASK_ALERT_CORE         APP_CPU_NUM
+#define TASK_TRANSPORT_STACK    4096
+#define TASK_TRANSPORT_PRIO     2
+#define TASK_TRANSPORT_CORE     PRO_CPU_NUM
+#define TASK_UI_STACK           3072
+#define TASK_UI_PRIO            3
+#define TASK_UI_CORE            APP_CPU_NUM
+#define TASK_RESPIRATION_STACK  3072
+#define TASK_RESPIRATION_PRIO   5
+#define TASK_RESPIRATION_CORE   APP_CPU_NUM
+#define TASK_STORAGE_STACK      4096
+#define TASK_STORAGE_PRIO       1
+#define TASK_STORAGE_CORE       PRO_CPU_NUM
+#define TASK_FLASH_LOG_STACK    3072
+#define TASK_FLASH_LOG_PRIO     1
+#define TASK_FLASH_LOG_CORE     PRO_CPU_NUM
+#define TASK_I2C_STACK          3072
+#define TASK_I2C_PRIO           6       // Above its clients so queued requests run immediately
+#define TASK_I2C_CORE           APP_CPU_NUM
+#define SAMPLE_QUEUE_LENGTH     8       // Must be a power of two
+#define BUTTON_EDGE_QUEUE_LENGTH 32     // Must be a power of two; absorbs contact bounce
+#define TASK_LOG_STACK          3072
+#define TASK_LOG_PRIO           1       // Serial output only runs when nothing else needs the CPU
+#define TASK_LOG_CORE           PRO_CPU_NUM
+#define TASK_REPLAY_STACK       3072
+#define TASK_REPLAY_PRIO        1       // Reads ahead of playback whenever the CPU is free
+#define TASK_REPLAY_CORE        PRO_CPU_NUM
+#define TASK_WATCHDOG_STACK     2048
+#define TASK_WATCHDOG_PRIO      7       // Above every pipeline task, so a busy stage cannot starve it
+#define TASK_WATCHDOG_CORE      PRO_CPU_NUM
+
+// Stage deadlines: a stage that runs longer counts as a missed deadline in
+// the diagnostics snapshot and the SD log
+#define DEADLINE_SENSOR_READ_MS 500
+#define DEADLINE_ALERT_MS       5
+#define DEADLINE_PACKET_BUILD_MS 1
+#define DEADLINE_NOTIFY_MS      20
+#define DEADLINE_SAMPLE_LATE_MS 100     // Sample started this far behind the sampler's schedule
+
+// Deadline watchdog: a pipeline task busy for longer than the limit is
+// wedged, and the task watchdog restarts the chip
+#define WATCHDOG_STAGE_LIMIT_MS 15000
+#define WATCHDOG_CHECK_MS       1000
+#define WATCHDOG_TIMEOUT_S      5
+
+// Logging ring (see log.h for LOG_LEVEL)
+#define LOG_QUEUE_LENGTH        32      // Lines; must be a power of two
+#define LOG_LINE_SIZE           120     // Bytes per line including the prefix
+#define LOG_FLUSH_TIMEOUT_MS    500
+
+// Hot-path timing histograms: bucket i counts durations below
+// DIAG_HISTOGRAM_BASE_US << (2 * i), the last bucket everything longer
+#define DIAG_HISTOGRAM_BUCKETS  8
+#define DIAG_HISTOGRAM_BASE_US  16
 
 // BLE constants
 #define BLE_DEVICE_NAME         "RespirationMonitor"
 #define BLE_SERVICE_UUID        "12345678-1234-1234-1234-123456789abc"
 #define BLE_CHAR_DATA_UUID      "87654321-4321-4321-4321-cba987654321"
 #define BLE_CHAR_CONTROL_UUID   "11111111-2222-3333-4444-555555555555"
+#define BLE_CHAR_DIAG_UUID      "11111111-2222-3333-4444-666666666666"
+#define BLE_CHAR_RESPONSE_UUID  "11111111-2222-3333-4444-777777777777"
+
+// Control commands queued between the BLE callback and the transport task
+#define BLE_COMMAND_QUEUE_LENGTH    8   // Must be a power of two
+#define BLE_RESPONSE_QUEUE_LENGTH   8   // Must be a power of two
+
+// Connectionless monitoring: the latest sample in every advertisement, so
+// one scanner can watch many tags without connecting to any of them
+#define BLE_BROADCAST           0       // 1 = broadcast from boot, otherwise on command
+#define BLE_BROADCAST_COMPANY_ID 0xFFFF // Bluetooth SIG id reserved for unassigned use
+#define BLE_ADV_MAX_LENGTH      31      // Legacy advertising payload
+
+// BLE batching (a batch is flushed when full or when its oldest sample
+// reaches the deadline; the phone negotiates the MTU after connecting)
+#define BLE_PREFERRED_MTU       247
+#define BLE_DEFAULT_MTU         23
+#define BLE_ATT_HEADER_SIZE     3
+#define BLE_BATCH_SIZE          8
+#define BLE_BATCH_DEADLINE_MS   1000
+#define BLE_STREAM_FORMAT       0       // 0 = batched SensorPacket, 1 = delta/varint, 2 = summaries only
+#define BLE_DEFAULT_PROFILE     1       // 0 = live view, 1 = balanced, 2 = background logging
+
+// On-device sample history used for backfill after a reconnect. The RTC ring
+// survives deep sleep; a larger PSRAM ring is used instead when available.
+#define HISTORY_RTC_CAPACITY    256     // Must be a power of two
+#define HISTORY_PSRAM_CAPACITY  16384   // Must be a power of two
+
+// On-device statistics: sliding windows over the latest samples and one
+// summary record per interval, which summary streaming sends instead of samples
+#define STATS_WINDOW_SAMPLES    64      // Must be a power of two
+#define STATS_EWMA_SHIFT        2       // Smoothing weight 1/4; the EWMA feeds the alerts
+#define STATS_SUMMARY_PERIOD_MS 60000
+#define STATS_SUMMARY_QUEUE_LENGTH 4    // Must be a power of two
+
+// SD card session log
+#define STORAGE_BLOCK_SIZE      512     // One SD sector per write
+#define STORAGE_BLOCK_BUFFERS   2       // Must be a power of two
+#define STORAGE_HEADER_INTERVAL 8       // Rewrite the file header every N blocks
+#define STORAGE_SUMMARY_BUFFERS 4       // Summaries awaiting the flush task; must be a power of two
+
+// Circular session log on internal flash, used when no SD card is fitted.
+// Lives in the "sessionlog" partition of partitions.csv.
+#define FLASH_LOG_PARTITION     "sessionlog"
+#define FLASH_LOG_PAGE_SIZE     256     // One flash program operation
+#define FLASH_LOG_SECTOR_SIZE   4096    // One flash erase
+#define FLASH_LOG_MAX_SECTORS   512     // Sector index entries; a larger partition uses only this many
+#define FLASH_LOG_PAGE_BUFFERS  4       // Must be a power of two
+#define FLASH_LOG_ERASE_AHEAD   4       // Sectors erased at boot and before sleep instead of while sampling
+#define FLASH_LOG_SYNC_TIMEOUT_MS 1000  // sync() gives up rather than hold off deep sleep
+
+// Playback of recorded sessions through the alert and transport pipeline
+#define REPLAY_QUEUE_LENGTH     32      // Records read ahead of playback; must be a power of two
+#define REPLAY_READ_CHUNK       16      // Records read from the SD card at a time
+#define REPLAY_POLL_MS          20      // Recheck period while waiting for input or queue space
+#define REPLAY_DRAIN_TIMEOUT_MS 5000    // Wait for the last records to reach the transport
+#define REPLAY_SERIAL_SYNC      0xA5    // Precedes every SensorPacket streamed over serial
+#define REPLAY_SERIAL_END       0xA6    // Ends a streamed session
+
+// Raw waveform capture: every pressure sample of a burst, with the latest
+// CO2 reading, kept in a buffer allocated at boot and sent once it is full
+#define CAPTURE_PSRAM_SAMPLES   90000   // 30 minutes at 50 Hz, 540 KB of PSRAM
+#define CAPTURE_RAM_SAMPLES     1500    // 30 s in internal RAM without PSRAM
 
 #endif // CONFIG_H
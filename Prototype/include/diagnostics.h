@@ -0,0 +1,137 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "config.h"
+
+// Timed stages of the pipeline, followed by one residency stage per SystemState
+enum DiagStage {
+    DIAG_STAGE_SENSOR_READ = 0,     // startReading() until the sample is complete
+    DIAG_STAGE_ALERT,               // Alert evaluation, history and storage of one sample
+    DIAG_STAGE_PACKET_BUILD,        // Encoding one SensorPacket
+    DIAG_STAGE_NOTIFY,              // setValue() + notify() of one frame
+    DIAG_STAGE_SAMPLE_LATENESS,     // Live sample start behind the sampler's schedule
+    DIAG_STAGE_STATE_BASE,          // + SystemState: time spent in that state
+    DIAG_STAGE_COUNT = DIAG_STAGE_STATE_BASE + STATE_COUNT
+};
+
+// Tasks whose stack high-water mark is reported
+enum DiagTask {
+    DIAG_TASK_ACQUISITION = 0,
+    DIAG_TASK_ALERT,
+    DIAG_TASK_TRANSPORT,
+    DIAG_TASK_UI,
+    DIAG_TASK_RESPIRATION,
+    DIAG_TASK_STORAGE,
+    DIAG_TASK_I2C,
+    DIAG_TASK_LOG,
+    DIAG_TASK_COUNT
+};
+
+#define DIAG_SNAPSHOT_VERSION   5
+
+// Diagnostics characteristic layout: DiagHeader, then DIAG_STAGE_COUNT
+// DiagStageStats, then DIAG_TASK_COUNT uint16_t stack high-water marks in
+// bytes (0 for tasks that are not running), then DIAG_TASK_COUNT uint32_t
+// heap allocation counts (all 0 unless built with HEAP_MONITOR), then the
+// DiagLinkStats and DiagDeadlineStats appended by BLEManager
+struct DiagHeader {
+    uint8_t version;            // DIAG_SNAPSHOT_VERSION
+    uint8_t stageCount;
+    uint8_t taskCount;
+    uint8_t bucketCount;        // DIAG_HISTOGRAM_BUCKETS
+    uint16_t bucketBaseUs;      // DIAG_HISTOGRAM_BASE_US
+    uint16_t reserved;
+    uint32_t uptimeMs;
+    uint32_t heapFree;
+    uint32_t heapMinFree;       // Lowest free heap since boot
+    uint32_t heapLargestBlock;  // Largest free block; far below heapFree means fragmentation
+    uint32_t allocationsOther;  // Allocations by tasks outside DiagTask
+    uint32_t allocationsStack;  // Allocations inside BLE notify calls
+    uint32_t samplesAllocating; // Steady-state samples whose handling allocated
+} __attribute__((packed));
+
+struct DiagStageStats {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t meanUs;
+    uint16_t histogram[DIAG_HISTOGRAM_BUCKETS];     // Saturating counts
+} __attribute__((packed));
+
+// Data characteristic counters since boot, then the running or last link benchmark
+struct DiagLinkStats {
+    uint32_t framesSent;        // Notifications the stack accepted
+    uint32_t bytesSent;
+    uint32_t notifyFailures;    // Refused: not subscribed, or a stack error
+    uint32_t notifyCongested;   // Refused because the stack was out of buffers
+    uint16_t queueDepth;        // Samples waiting for the transport task at its last pass
+    uint16_t queueDepthMax;     // Peak since boot
+    uint8_t benchActive;
+    uint8_t reserved;
+    uint16_t benchFrameSize;    // Bytes per benchmark notification
+    uint16_t benchRate;         // Requested frames per second, 0 = as fast as the stack allows
+    uint16_t benchBacklogMax;   // Most frames a rate-limited run fell behind its schedule
+    uint32_t benchFrames;       // Benchmark frames the stack accepted
+    uint32_t benchCongested;    // Benchmark sends deferred by congestion
+    uint32_t benchElapsedMs;
+    uint32_t benchBytesPerSecond;
+    uint32_t samplesDropped;    // Samples no frame could carry, e.g. a delta keyframe larger than the MTU
+} __attribute__((packed));
+
+// Missed deadlines per timed stage since boot, and the deadline watchdog's
+// restarts
+struct DiagDeadlineStats {
+    uint8_t stageCount;         // DIAG_STAGE_STATE_BASE, entries in missed[]
+    uint8_t wedgedTask;         // DiagTask behind the last watchdog restart, DIAG_TASK_COUNT if none
+    uint16_t watchdogRestarts;  // Since power-on
+    uint32_t missed[DIAG_STAGE_STATE_BASE];
+} __attribute__((packed));
+
+#define DIAG_SNAPSHOT_SIZE (sizeof(DiagHeader) + DIAG_STAGE_COUNT * sizeof(DiagStageStats) + \
+                            DIAG_TASK_COUNT * (sizeof(uint16_t) + sizeof(uint32_t)) + \
+                            sizeof(DiagLinkStats) + sizeof(DiagDeadlineStats))
+
+// Collects stage timings from any task. Recording takes a spinlock for a
+// few instructions, so it is cheap enough for every sample. Timed stages
+// with a DEADLINE_* limit also count the durations that exceeded it.
+class DiagnosticsManager {
+private:
+    struct StageAccumulator {
+        uint32_t count;
+        uint32_t minUs;
+        uint32_t maxUs;
+        uint64_t totalUs;
+        uint16_t histogram[DIAG_HISTOGRAM_BUCKETS];
+    };
+
+    StageAccumulator stages[DIAG_STAGE_COUNT];
+    uint32_t missed[DIAG_STAGE_STATE_BASE];
+    uint32_t missedTotal;
+    TaskHandle_t tasks[DIAG_TASK_COUNT];
+    SystemState state;
+    int64_t stateStartUs;
+
+    static uint8_t bucketFor(uint32_t durationUs);
+
+public:
+    DiagnosticsManager();
+    static int64_t now() { return esp_timer_get_time(); }
+    void record(DiagStage stage, int64_t startUs);
+    void recordDuration(DiagStage stage, uint32_t durationUs);
+    void enterState(SystemState next);
+    void registerTask(DiagTask task, TaskHandle_t handle);
+
+    // DIAG_TASK_COUNT if `handle` is not registered; safe from any task
+    uint8_t findTask(TaskHandle_t handle);
+
+    // Missed deadlines since boot, over all stages
+    uint32_t getMissedDeadlines();
+    void getDeadlineStats(DiagDeadlineStats& stats);
+    size_t buildSnapshot(uint8_t* buffer, size_t capacity);
+};
+
+extern DiagnosticsManager diagnosticsManager;
+
+#endif // DIAGNOSTICS_H
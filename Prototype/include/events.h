@@ -0,0 +1,39 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include "config.h"
+#include "spsc_queue.h"
+
+// System event bits shared between tasks
+#define EVT_SAMPLE_READY     BIT0    // Alert task forwarded a sample to transport
+#define EVT_BLE_COMMAND      BIT1    // BLE control write is pending
+#define EVT_SLEEP_REQUEST    BIT2    // Button hold or command asked for deep sleep
+#define EVT_TRANSPORT_STOP   BIT3    // Sleep: transport task parks at its next safe point
+#define EVT_TRANSPORT_PARKED BIT4    // Transport task has parked, holding no locks
+#define EVT_BLE_DISCONNECT   BIT5    // Link dropped: transport task ends its transfers
+
+// Sample tagged with the alert level computed for it
+struct PipelineSample {
+    SensorData data;
+    AlertLevel alert;
+};
+
+extern EventGroupHandle_t systemEvents;
+typedef SpscQueue<SensorData, SAMPLE_QUEUE_LENGTH> SampleQueue;
+typedef SpscQueue<PipelineSample, SAMPLE_QUEUE_LENGTH> TransportQueue;
+
+extern SampleQueue alertQueue;          // Acquisition -> alert (same core)
+extern TransportQueue transportQueue;   // Alert -> transport (cross core)
+
+extern TaskHandle_t acquisitionTaskHandle;
+extern TaskHandle_t alertTaskHandle;
+extern TaskHandle_t transportTaskHandle;
+extern TaskHandle_t uiTaskHandle;
+
+bool eventsBegin();
+void signalEvent(EventBits_t bits);
+
+#endif // EVENTS_H
@@ -0,0 +1,93 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "packet_codec.h"
+#include "history.h"
+#include "spsc_queue.h"
+
+#define FLASH_LOG_PAGE_MAGIC    0xA7
+#define FLASH_LOG_ERASED        0xFFFFFFFF
+
+// Every page describes itself, so the log can be rebuilt by scanning after
+// a power loss; a page whose write was cut short fails its CRC and is skipped
+struct FlashLogPageHeader {
+    uint32_t firstSequence;     // Sequence number of records[0]; FLASH_LOG_ERASED if never written
+    uint8_t magic;              // FLASH_LOG_PAGE_MAGIC
+    uint8_t count;              // Valid records, consecutive sequence numbers
+    uint16_t crc;               // CRC-16 of count and the records
+} __attribute__((packed));
+
+#define FLASH_LOG_RECORDS_PER_PAGE \
+    ((FLASH_LOG_PAGE_SIZE - sizeof(FlashLogPageHeader)) / sizeof(HistorySample))
+
+#define FLASH_LOG_PAGE_PADDING \
+    (FLASH_LOG_PAGE_SIZE - sizeof(FlashLogPageHeader) - FLASH_LOG_RECORDS_PER_PAGE * sizeof(HistorySample))
+
+#define FLASH_LOG_PAGES_PER_SECTOR  (FLASH_LOG_SECTOR_SIZE / FLASH_LOG_PAGE_SIZE)
+
+struct FlashLogPage {
+    FlashLogPageHeader header;
+    HistorySample records[FLASH_LOG_RECORDS_PER_PAGE];
+    uint8_t padding[FLASH_LOG_PAGE_PADDING];
+} __attribute__((packed));
+
+static_assert(sizeof(FlashLogPage) == FLASH_LOG_PAGE_SIZE, "Pages must fill one flash page");
+
+// Circular sample log on the internal flash for tags without an SD card.
+// append() only copies into a RAM page; full pages are programmed by a
+// low-priority task and the log wraps sector by sector, so every sector is
+// erased once per pass and wear spreads over the whole partition. An erase
+// stalls the flash cache on both cores for tens of milliseconds, so sectors
+// are erased ahead at boot and before deep sleep, leaving the sampling run
+// to program pages only until that supply runs out. A RAM index of each
+// sector's first sequence number makes seeking for a backfill one lookup
+// plus a few page reads.
+class FlashLogManager {
+private:
+    const esp_partition_t* partition;
+    bool ready;
+    uint32_t sectorCount;
+    uint32_t sectorFirst[FLASH_LOG_MAX_SECTORS];    // First sequence per sector, FLASH_LOG_ERASED if empty
+    uint32_t headPage;                              // Next page to program
+    uint32_t erasedPages;                           // Erased pages from headPage on
+    uint32_t nextSequence;                          // After the newest record on flash
+    FlashLogPage pages[FLASH_LOG_PAGE_BUFFERS] __attribute__((aligned(4)));
+    FlashLogPage scratch __attribute__((aligned(4)));
+    FlashLogPage* active;                                           // Owned by the appender
+    SpscQueue<FlashLogPage*, FLASH_LOG_PAGE_BUFFERS> freePages;     // Flush task -> appender
+    SpscQueue<FlashLogPage*, FLASH_LOG_PAGE_BUFFERS> fullPages;     // Appender -> flush task
+    volatile uint32_t droppedRecords;
+    uint32_t runtimeErases;
+    SemaphoreHandle_t flashLock;
+    TaskHandle_t flushTaskHandle;
+
+    static void flushTask(void* param);
+    void scan();
+    bool isSectorErased(uint32_t sector);
+    bool eraseAhead(uint32_t sectors);
+    bool writePage(FlashLogPage* page);
+    void sealActive();
+    bool readPage(uint32_t page, FlashLogPage& out);
+
+public:
+    FlashLogManager();
+    bool begin();
+    bool isReady();
+    bool append(const SensorData& data, AlertLevel alertLevel);
+    void sync();
+
+    // Records from `fromSequence` on; pages still waiting in RAM are not
+    // included (the history ring holds them)
+    size_t readRange(uint32_t fromSequence, SensorPacket* out, size_t maxRecords);
+    uint32_t oldestSequence();
+    uint32_t endSequence();
+    uint32_t getDroppedRecords();
+};
+
+extern FlashLogManager flashLogManager;
+
+#endif // FLASH_LOG_H
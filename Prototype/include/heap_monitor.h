@@ -0,0 +1,54 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "diagnostics.h"
+
+// Counts heap allocations per task. Builds with HEAP_MONITOR defined link
+// with --wrap for the ESP-IDF allocator entry points (see platformio.ini),
+// so every malloc, calloc, realloc, new and heap_caps_* call lands in
+// record(); without it the counters stay at zero.
+//
+// Once streaming has started the pipeline should not allocate at all.
+// checkSample() runs after each forwarded sample and counts the samples
+// whose handling allocated, including whatever the BLE stack allocated to
+// send them.
+class HeapMonitor {
+private:
+    std::atomic<uint32_t> counts[DIAG_TASK_COUNT + 1];  // Last slot: every other task
+    std::atomic<uint32_t> stackAllocations;             // Inside BLE notify calls
+    std::atomic<uint32_t> totalBytes;
+    uint32_t lastPipeline;
+    uint32_t samplesWithAllocations;
+    bool steady;
+
+    uint32_t pipelineTotal();
+
+public:
+    HeapMonitor();
+
+    // Called from the allocator wrappers; must not allocate or block
+    void record(size_t size);
+
+    uint32_t count(DiagTask task);
+    uint32_t otherCount();
+
+    // Brackets a call into the BLE stack so the diagnostics can show how many
+    // of the allocations were the stack's own
+    uint32_t stackMark();
+    void stackDone(uint32_t mark);
+
+    // Starts the zero-allocation check from the next sample on
+    void beginSteadyState();
+    bool isSteady() { return steady; }
+    void checkSample();
+    uint32_t getSamplesWithAllocations() { return samplesWithAllocations; }
+    uint32_t getStackAllocations() { return stackAllocations.load(std::memory_order_relaxed); }
+    uint32_t getTotalBytes() { return totalBytes.load(std::memory_order_relaxed); }
+};
+
+extern HeapMonitor heapMonitor;
+
+#endif // HEAP_MONITOR_H
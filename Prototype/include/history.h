@@ -0,0 +1,47 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "packet_codec.h"
+
+// Compact history entry; the sequence number is implied by its slot
+struct HistorySample {
+    uint16_t co2;           // CO2 in ppm
+    int16_t humidity;       // Humidity * 10
+    int16_t temperature;    // Temperature * 10
+    uint8_t alert;          // Alert level
+    uint8_t status;         // Status flags
+    uint32_t timestamp;     // Seconds since boot
+    uint16_t breathRate;    // Breaths per minute * 10
+    uint16_t inhaleMs;
+    uint16_t exhaleMs;
+} __attribute__((packed));
+
+// Conversions to and from the wire format; a history entry keeps whole
+// seconds only, so the capture micros come back unknown
+void packHistorySample(const SensorPacket& packet, HistorySample& entry);
+void unpackHistorySample(const HistorySample& entry, uint32_t sequence, SensorPacket& packet);
+
+// Fixed-size ring of recent samples keyed by sequence number. Written by the
+// alert task and read by the transport task for backfill after a reconnect.
+class HistoryManager {
+private:
+    HistorySample* entries;
+    uint32_t capacityMask;
+    bool retained;                  // Backed by RTC memory (survives deep sleep)
+
+public:
+    HistoryManager();
+    bool begin();
+    uint32_t record(SensorData& data, AlertLevel alertLevel);
+    bool read(uint32_t sequence, SensorPacket& packet);
+    uint32_t oldestSequence();
+    uint32_t nextSequence();
+    void continueFrom(uint32_t sequence);
+    size_t capacity();
+};
+
+extern HistoryManager historyManager;
+
+#endif // HISTORY_H
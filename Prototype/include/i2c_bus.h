@@ -0,0 +1,74 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+// Request priority; the bus task always serves the highest pending level first
+enum I2CPriority {
+    I2C_PRIORITY_HIGH = 0,      // 50 Hz pressure stream
+    I2C_PRIORITY_NORMAL = 1,    // Humidity/temperature
+    I2C_PRIORITY_LOW = 2,       // CO2
+    I2C_PRIORITY_COUNT = 3
+};
+
+// One bus transaction: optional write (register address and/or payload),
+// then an optional read, joined by a repeated start
+struct I2CRequest {
+    uint8_t address;
+    uint8_t writeLength;
+    uint8_t writeData[I2C_MAX_WRITE_SIZE];
+    uint8_t readLength;
+    uint8_t* readBuffer;
+    bool success;
+    SemaphoreHandle_t done;
+};
+
+// Handle a driver uses to reach one device on the shared bus. Each device
+// has a single outstanding request; calls block until the bus task has run it.
+class I2CDevice {
+private:
+    I2CRequest request;
+    StaticSemaphore_t doneBuffer;
+    I2CPriority priority;
+
+    bool submit();
+
+public:
+    I2CDevice(uint8_t address, I2CPriority priority);
+    bool begin();
+    bool write(const uint8_t* data, uint8_t length);
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool read(uint8_t* buffer, uint8_t length);
+    bool readRegisters(uint8_t reg, uint8_t* buffer, uint8_t length);   // Burst read
+};
+
+// Owns Wire once the tasks are running. Drivers may only touch Wire directly
+// during setup, before sampling starts.
+class I2CBusManager {
+private:
+    QueueHandle_t queues[I2C_PRIORITY_COUNT];
+    TaskHandle_t taskHandle;
+    bool initialized;
+    volatile uint32_t transactions;
+    volatile uint32_t errors;
+
+    static void busTask(void* param);
+    bool nextRequest(I2CRequest*& request);
+    void execute(I2CRequest* request);
+
+public:
+    I2CBusManager();
+    bool begin();
+    bool enqueue(I2CRequest* request, I2CPriority priority);
+    uint32_t getTransactions();
+    uint32_t getErrors();
+};
+
+extern I2CBusManager i2cBusManager;
+
+#endif // I2C_BUS_H
@@ -0,0 +1,64 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Log levels; anything above LOG_LEVEL compiles to nothing
+#define LOG_LEVEL_NONE      0
+#define LOG_LEVEL_ERROR     1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_INFO      3
+#define LOG_LEVEL_DEBUG     4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL           LOG_LEVEL_INFO
+#endif
+
+// Formats into a lock-free slot ring; a low-priority task writes the ring to
+// Serial, so callers never wait on the UART. Not for use from ISRs.
+void logWrite(uint8_t level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(tag, ...)     logWrite(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#else
+#define LOG_E(tag, ...)     do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(tag, ...)     logWrite(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define LOG_W(tag, ...)     do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(tag, ...)     logWrite(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define LOG_I(tag, ...)     do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(tag, ...)     logWrite(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_D(tag, ...)     do {} while (0)
+#endif
+
+class LogManager {
+private:
+    TaskHandle_t taskHandle;
+
+    static void drainTask(void* param);
+    void drain();
+
+public:
+    LogManager();
+    bool begin();
+    void notify();
+    void flush();                       // Waits until the ring is written out
+    uint32_t getDropped();
+};
+
+extern LogManager logManager;
+
+#endif // LOG_H
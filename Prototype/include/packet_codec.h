@@ -0,0 +1,284 @@
+#ifndef PACKET_CODEC_H
+#define PACKET_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Wire formats shared by the BLE transport and anything that logs or
+// replays packets. This header has no Arduino dependencies.
+
+// Compact binary packet structure for BLE transmission (26 bytes total).
+// The first 16 bytes match the original packet so older apps that ignore
+// the respiration and timing fields keep working.
+struct SensorPacket {
+    uint16_t co2;           // CO2 in ppm (2 bytes)
+    int16_t humidity;       // Humidity * 10 (2 bytes) 
+    int16_t temperature;    // Temperature * 10 (2 bytes)
+    uint8_t alert;          // Alert level (1 byte)
+    uint8_t status;         // SENSOR_STATUS_* flags (1 byte)
+    uint32_t timestamp;     // Timestamp in seconds since boot (4 bytes)
+    uint32_t sequence;      // Sequence number (4 bytes)
+    uint16_t breathRate;    // Breaths per minute * 10, 0 if unknown (2 bytes)
+    uint16_t inhaleMs;      // Last inhale duration (2 bytes)
+    uint16_t exhaleMs;      // Last exhale duration (2 bytes)
+    uint32_t captureMicros; // Microseconds past `timestamp` of the sensor read, or SENSOR_MICROS_UNKNOWN (4 bytes)
+} __attribute__((packed));
+
+#define SENSOR_MICROS_UNKNOWN   UINT32_MAX
+
+// SensorPacket.status; delta frames carry the low nibble
+#define SENSOR_STATUS_VALID     0x01    // Sensors answered
+#define SENSOR_STATUS_REPLAYED  0x02    // Played back from a recording, not measured
+
+// A bare SensorPacket, cut after the respiration fields or after the
+// sequence number, is sent when the MTU is too small for a frame
+#define SENSOR_PACKET_LEGACY_SIZE       16
+#define SENSOR_PACKET_RESPIRATION_SIZE  22
+
+static_assert(SENSOR_PACKET_LEGACY_SIZE <= BLE_DEFAULT_MTU - BLE_ATT_HEADER_SIZE, "Legacy packets must fit the default MTU");
+
+// Frame types carried in the first byte of multi-sample notifications.
+#define BLE_FRAME_BATCH         0xB1
+#define BLE_FRAME_BACKFILL      0xB2
+#define BLE_FRAME_DELTA         0xC1
+
+// Header of a batched notification, followed by `count` SensorPacket entries
+struct BatchHeader {
+    uint8_t type;           // BLE_FRAME_BATCH
+    uint8_t count;          // Number of entries that follow
+    uint8_t entrySize;      // sizeof(SensorPacket), lets the app skip unknown fields
+    uint8_t flags;          // Reserved, 0
+    uint32_t firstSequence; // Sequence number of the first entry
+} __attribute__((packed));
+
+#define LIVE_FRAME_MAX_SIZE     (sizeof(BatchHeader) + sizeof(SensorPacket))
+
+// Header of a backfill notification: a batch of historical samples plus the
+// device clock at send time, so the app can place them on its own timeline
+struct BackfillHeader {
+    BatchHeader batch;      // batch.type is BLE_FRAME_BACKFILL
+    uint32_t deviceTime;    // Seconds since boot when the frame was sent
+} __attribute__((packed));
+
+// Header of a delta-compressed notification. It is followed by one
+// DeltaKeyframe and then, for every further sample, the zigzag varint
+// deltas of co2, humidity, temperature, breathRate, inhaleMs and exhaleMs
+// plus one raw flags byte (alert | status << 4). Sequence numbers increase by one per sample and
+// timestamps are implied as firstTimestampMs + i * periodMs.
+struct DeltaHeader {
+    uint8_t type;               // BLE_FRAME_DELTA
+    uint8_t count;              // Samples in the frame, keyframe included
+    uint16_t periodMs;          // Sample period used to imply timestamps
+    uint32_t firstSequence;     // Sequence number of the keyframe
+    uint32_t firstTimestampMs;  // Capture time of the keyframe, ms since boot
+} __attribute__((packed));
+
+struct DeltaKeyframe {
+    uint16_t co2;
+    int16_t humidity;
+    int16_t temperature;
+    uint8_t alert;
+    uint8_t status;
+    uint16_t breathRate;
+    uint16_t inhaleMs;
+    uint16_t exhaleMs;
+} __attribute__((packed));
+
+#define DELTA_FRAME_MIN_SIZE    (sizeof(DeltaHeader) + sizeof(DeltaKeyframe))
+
+#define BLE_FRAME_BENCH         0xF1
+
+// Synthetic frame of the link benchmark: this header, then filler bytes
+// (byte i holds i & 0xFF) up to the requested frame size
+struct BenchHeader {
+    uint8_t type;               // BLE_FRAME_BENCH
+    uint8_t flags;              // Reserved, 0
+    uint16_t length;            // Whole frame, header included
+    uint32_t sequence;          // Frames the stack accepted before this one
+    uint32_t sentUs;            // Device clock when the frame was handed to the stack
+} __attribute__((packed));
+
+#define BLE_FRAME_CAPTURE       0xF2
+#define CAPTURE_FLAG_LAST       0x01        // Frame ends with the last sample of the capture
+#define CAPTURE_SAMPLE_MISSING  INT32_MIN   // Period whose sensor read failed or was overrun
+
+// One period of a raw waveform capture; timestamps are implied by the index
+struct CaptureSample {
+    int32_t pressureX16;    // Mask pressure in Pa * 16, or CAPTURE_SAMPLE_MISSING
+    uint16_t co2;           // Latest CO2 reading in ppm when the sample was taken
+} __attribute__((packed));
+
+// Header of a capture transfer notification, followed by `count`
+// CaptureSample entries starting at sample `offset`
+struct CaptureHeader {
+    uint8_t type;               // BLE_FRAME_CAPTURE
+    uint8_t count;              // Entries that follow
+    uint8_t entrySize;          // sizeof(CaptureSample)
+    uint8_t flags;              // CAPTURE_FLAG_*
+    uint16_t captureId;         // Changes with every capture, so a resume cannot mix two
+    uint16_t periodMs;          // Spacing of the samples
+    uint32_t offset;            // Index of the first entry
+    uint32_t total;             // Samples in the capture
+} __attribute__((packed));
+
+#define BLE_FRAME_SUMMARY       0xE1
+
+// Aggregate of the samples captured in one STATS_SUMMARY_PERIOD_MS interval.
+// Humidity and temperature are * 10 like SensorPacket; the rate is the CO2
+// trend over the sliding window when the interval closed.
+struct SummaryRecord {
+    uint8_t type;               // BLE_FRAME_SUMMARY
+    uint8_t count;              // Samples aggregated (saturates at 255)
+    uint8_t peakAlert;          // Highest alert level in the interval
+    uint8_t flags;              // Reserved, 0
+    uint32_t startTime;         // Seconds since boot at the start of the interval
+    uint32_t firstSequence;     // Sequence number of the first sample
+    uint16_t co2Mean;
+    uint16_t co2Min;
+    uint16_t co2Max;
+    int16_t co2Rate;            // ppm per minute
+    int16_t humidityMean;
+    int16_t humidityMin;
+    int16_t humidityMax;
+    int16_t temperatureMean;
+    int16_t temperatureMin;
+    int16_t temperatureMax;
+} __attribute__((packed));
+
+// Control characteristic write: opcode, request id, then an optional
+// little-endian argument (a shorter write leaves it 0). Commands that take
+// a 64-bit argument send its upper half after the lower one. Legacy ASCII
+// commands ("3", "7:<sequence>") start with a digit and are still accepted
+// with request id 0.
+struct CommandFrame {
+    uint8_t opcode;         // BLECommand
+    uint8_t requestId;      // Echoed in the response so the app can match it
+    uint32_t argument;
+    uint32_t argumentHigh;  // Upper half of a 64-bit argument
+    int64_t receivedUs;     // Device clock when the write arrived; not on the wire
+} __attribute__((packed));
+
+#define COMMAND_FRAME_MAX_LENGTH    10  // Longest binary control write
+
+#define BLE_FRAME_RESPONSE      0xD1
+
+enum CommandStatus {
+    COMMAND_OK = 0,
+    COMMAND_UNKNOWN = 1,            // Opcode not supported by this firmware
+    COMMAND_INVALID_ARGUMENT = 2,   // Argument out of range, nothing changed
+    COMMAND_BUSY = 3                // Command queue full, retry later
+};
+
+// Notified on the response characteristic once a command ran or was rejected
+struct CommandResponse {
+    uint8_t type;           // BLE_FRAME_RESPONSE
+    uint8_t opcode;
+    uint8_t requestId;
+    uint8_t status;         // CommandStatus
+} __attribute__((packed));
+
+#define BLE_FRAME_PONG          0xD2
+#define PONG_FLAG_EPOCH_SET     0x01    // epochOffsetUs is valid
+
+// Answer to CMD_PING on the response characteristic, sent before the
+// command's CommandResponse. The app estimates the clock offset and round
+// trip from its own send and receive times, NTP style, taking out the time
+// the device held the ping.
+struct PongFrame {
+    uint8_t type;               // BLE_FRAME_PONG
+    uint8_t requestId;
+    uint8_t flags;              // PONG_FLAG_*
+    uint8_t reserved;
+    uint32_t token;             // The ping's argument
+    int64_t receivedUs;         // Device clock when the ping was written
+    int64_t sentUs;             // Device clock when this frame was handed to the stack
+    int64_t epochOffsetUs;      // Unix time minus the device clock, in microseconds
+} __attribute__((packed));
+
+#define BROADCAST_VERSION           1
+#define BROADCAST_FLAG_CONNECTED    0x10    // A central is connected; the advertisement is not connectable
+#define BROADCAST_MAX_LENGTH        (3 + 4 + sizeof(BroadcastSummary))
+
+// Manufacturer data of a broadcast advertisement, after the company id.
+// The sequence number tells a scanner whether it has seen this sample.
+struct BroadcastSummary {
+    uint8_t version;        // BROADCAST_VERSION
+    uint8_t flags;          // AlertLevel in the low nibble, BROADCAST_FLAG_* above it
+    uint16_t co2;           // CO2 in ppm
+    uint16_t breathRate;    // Breaths per minute * 10, 0 if not measured
+    int16_t temperature;    // Temperature * 10
+    int16_t humidity;       // Humidity * 10
+    uint32_t sequence;
+} __attribute__((packed));
+
+static_assert(BROADCAST_MAX_LENGTH <= BLE_ADV_MAX_LENGTH, "Broadcast must fit a legacy advertisement");
+
+// Parses a control write in either format; false if it is malformed
+bool decodeCommandFrame(const uint8_t* data, size_t length, CommandFrame& frame);
+
+// Converts a reading to its wire representation
+void encodeSensorPacket(const SensorData& data, AlertLevel alertLevel, SensorPacket& packet);
+
+// Inverse of encodeSensorPacket for recorded packets; the timestamp comes
+// back in whole seconds (as milliseconds) and the alert level is dropped
+void decodeSensorPacket(const SensorPacket& packet, SensorData& data);
+
+// Writes the longest bare packet that fits `payload` bytes and returns its
+// length, 0 if not even the legacy packet fits
+size_t encodeBarePacket(const SensorPacket& packet, size_t payload, uint8_t* out);
+
+// Frames one live sample for a notification of `payload` bytes: a one-entry
+// batch, which keeps the capture micros, when it fits, otherwise a bare
+// packet. `out` holds LIVE_FRAME_MAX_SIZE bytes; returns 0 if nothing fits.
+size_t encodeLiveFrame(const SensorPacket& packet, size_t payload, uint8_t* out);
+
+// Builds a complete advertising payload (flags, then the summary as
+// manufacturer data) from a packet; returns its length
+size_t encodeBroadcast(const SensorPacket& packet, bool connected, uint8_t* out);
+
+inline uint32_t zigzagEncode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Writes `value` as a LEB128 varint, returns the number of bytes used
+size_t writeVarint(uint8_t* out, uint32_t value);
+
+// Reads a LEB128 varint, returns bytes consumed or 0 if truncated
+size_t readVarint(const uint8_t* in, size_t length, uint32_t& value);
+
+// Builds one BLE_FRAME_DELTA frame in a caller-provided buffer
+class DeltaEncoder {
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t used;
+    uint8_t sampleCount;
+    uint16_t periodMs;
+    uint32_t firstSequence;
+    uint32_t firstTimestampMs;
+    SensorPacket previous;
+
+public:
+    // Largest encoding of one non-keyframe sample (six 3-byte varints + flags)
+    static const size_t MAX_SAMPLE_SIZE = 19;
+
+    DeltaEncoder();
+    void begin(uint8_t* frameBuffer, size_t frameCapacity, uint16_t samplePeriodMs);
+    void reset();
+
+    // Returns false if the sample does not fit, breaks the sequence or
+    // drifts more than half a period from its implied timestamp; the caller
+    // should then finish the frame and start a new one with this sample.
+    bool append(const SensorPacket& packet, uint32_t timestampMs);
+
+    const uint8_t* data() const { return buffer; }
+    size_t length() const { return used; }
+    uint8_t count() const { return sampleCount; }
+};
+
+#endif // PACKET_CODEC_H
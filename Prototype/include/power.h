@@ -0,0 +1,24 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Automatic light sleep between samples. Needs a build with power
+// management and tickless idle (see the esp32dev-lowpower environment);
+// stock builds keep running at full clock.
+class PowerManager {
+private:
+    bool lightSleepEnabled;
+
+    void enableWakeSources();
+
+public:
+    PowerManager();
+    bool begin();
+    bool isLightSleepEnabled();
+};
+
+extern PowerManager powerManager;
+
+#endif // POWER_H
@@ -0,0 +1,123 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "packet_codec.h"
+#include "sensor_source.h"
+#include "spsc_queue.h"
+
+// Playback pace of a recorded session
+enum ReplaySpeed : uint8_t {
+    REPLAY_REALTIME = 0,    // Records released at their recorded spacing
+    REPLAY_FAST = 1         // As fast as the pipeline takes them
+};
+
+#define REPLAY_LEVELS   (ALERT_CRITICAL + 1)
+
+struct ReplayReport {
+    uint32_t played;            // Records handed to the pipeline
+    uint32_t delivered;         // Of those, records that reached the transport task
+    uint32_t underruns;         // Polls that found no record read yet
+    uint32_t elapsedMs;         // Wall time from the first record to the last delivery
+    // Recorded time from a level's conditions first holding to the pipeline
+    // reporting it, UINT32_MAX if it never did
+    uint32_t alertLatencyMs[REPLAY_LEVELS];
+};
+
+// Plays SensorPackets recorded by the SD log (or streamed in) through the
+// acquisition task in place of the sensors. Records arrive from one feeder
+// task; timestamps come from the recording, so the alert, statistics and
+// transport stages see the same input on every run.
+class ReplaySource : public SensorSource {
+private:
+    SpscQueue<SensorPacket, REPLAY_QUEUE_LENGTH> records;   // Feeder -> acquisition
+    std::atomic<bool> active;
+    std::atomic<bool> inputDone;        // Feeder has no more records
+    std::atomic<bool> abandoned;        // Stopped early, discard what is queued
+    ReplaySpeed speed;
+    uint16_t periodMs;                  // Spreads records that share a recorded second
+
+    // Acquisition side
+    SensorPacket next;
+    bool havePending;
+    bool started;
+    uint32_t nextRecordMs;
+    uint32_t firstRecordMs;
+    uint32_t startedMs;
+    uint32_t lastSecond;
+    uint32_t subsecondMs;
+    uint32_t releaseAtMs;
+    uint32_t underruns;
+    uint32_t conditionMs[REPLAY_LEVELS];
+    std::atomic<uint32_t> played;
+
+    // Transport side
+    uint32_t raisedMs[REPLAY_LEVELS];
+    uint32_t lastDeliveryMs;
+    std::atomic<uint32_t> delivered;
+
+    bool takeNext();
+    uint32_t recordTimeMs(const SensorPacket& packet);
+
+public:
+    ReplaySource();
+
+    // Control: a new session can only open once the previous one has drained
+    bool open(ReplaySpeed pace, uint16_t samplePeriodMs);
+    void stop();
+    bool isActive() const { return active.load(); }
+
+    // Feeder side
+    bool feed(const SensorPacket& packet);
+    bool canFeed() const { return records.size() < records.capacity(); }
+    void finish() { inputDone.store(true); }
+
+    // SensorSource, called by the acquisition task
+    bool startReading();
+    ReadStatus pollReading(SensorData& data);
+    TickType_t nextPollDelay();
+    bool isLive() const { return false; }
+
+    // Transport task: a replayed sample and the alert level the pipeline gave it
+    void noteDelivered(const SensorData& data, AlertLevel alertLevel);
+
+    // True once the session has ended and every played record was delivered
+    bool isDrained() const { return !active.load() && delivered.load() >= played.load(); }
+    ReplayReport getReport() const;
+};
+
+extern ReplaySource replaySource;
+
+// Where a replay reads its records from
+enum ReplayInput : uint8_t {
+    REPLAY_INPUT_SD = 0,        // A /session_NNNN.bin file from the SD log
+    REPLAY_INPUT_SERIAL = 1     // REPLAY_SERIAL_SYNC + SensorPacket frames on Serial
+};
+
+// Feeds replaySource from a low-priority task, so card and UART reads never
+// block the acquisition task
+class ReplayManager {
+private:
+    TaskHandle_t taskHandle;
+    ReplayInput input;
+    char path[24];
+    volatile bool stopRequested;
+
+    static void readerTask(void* param);
+    void readSession();
+    void readSerial();
+
+public:
+    ReplayManager();
+    bool begin();
+
+    // Session 0 reads from serial; sessions read from the card need the SD log
+    bool start(uint16_t session, ReplaySpeed speed);
+    void stop();
+};
+
+extern ReplayManager replayManager;
+
+#endif // REPLAY_H
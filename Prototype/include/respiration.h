@@ -0,0 +1,51 @@
+#ifndef RESPIRATION_H
+#define RESPIRATION_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "breath_detector.h"
+#include "i2c_bus.h"
+
+// BMP280 factory trim, registers 0x88..0x9F
+struct Bmp280Calibration {
+    uint16_t t1;
+    int16_t t2, t3;
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+};
+
+// Samples mask pressure at RESPIRATION_PERIOD_MS from a hardware timer and
+// runs the breath detector on every sample in a dedicated task. The BMP280
+// is read with one burst per sample at the highest bus priority.
+class RespirationEngine {
+private:
+    I2CDevice bmp;
+    Bmp280Calibration calibration;
+    BreathDetector detector;
+    esp_timer_handle_t timer;
+    TaskHandle_t taskHandle;
+    bool initialized;
+    RespirationState published;
+    volatile uint32_t overruns;     // Timer periods missed by the task
+    volatile uint32_t readErrors;
+
+    static void timerCallback(void* arg);
+    static void samplingTask(void* param);
+    bool readCalibration();
+    bool configureSensor(bool warmBoot);
+    bool readPressure(int32_t& pressureX16);
+
+public:
+    RespirationEngine();
+    bool begin(bool warmBoot = false);
+    bool isReady();
+    RespirationState getState();
+    void fillSensorData(SensorData& data);
+    uint32_t getOverruns();
+    void stop();
+};
+
+extern RespirationEngine respirationEngine;
+
+#endif // RESPIRATION_H
@@ -0,0 +1,36 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Chooses the acquisition period from the alert level and how fast CO2 is
+// changing. Feed it every completed sample; it has no hardware dependencies.
+class AdaptiveSampler {
+private:
+    volatile uint16_t fixedPeriodMs;    // Non-zero overrides adaptation
+    uint16_t periodMs;
+    bool primed;
+    uint16_t lastCo2;
+    uint32_t lastTimeMs;
+    uint16_t slopePpmPerMin;            // Smoothed |dCO2/dt| above the noise floor, saturating
+    uint8_t calmSamples;
+
+    uint16_t targetPeriod(AlertLevel level);
+
+public:
+    AdaptiveSampler();
+    void reset();
+
+    // Returns the period to wait before the next sample
+    uint16_t update(uint16_t co2Ppm, AlertLevel level, uint32_t timestampMs);
+
+    // 0 resumes adaptive sampling
+    void setFixedPeriod(uint16_t period);
+    uint16_t period() const { return periodMs; }
+    uint16_t slope() const { return slopePpmPerMin; }
+};
+
+extern AdaptiveSampler adaptiveSampler;
+
+#endif // SAMPLER_H
@@ -6,23 +6,49 @@
 #include <Adafruit_AHTX0.h>
 #include "ScioSense_ENS160.h"
 #include "config.h"
+#include "i2c_bus.h"
+#include "sensor_source.h"
 
-class SensorManager {
+class SensorManager : public SensorSource {
 private:
     Adafruit_AHTX0 aht;
     ScioSense_ENS160 ens160;
+    I2CDevice ahtDevice;
+    I2CDevice ens160Device;
     bool initialized;
     unsigned long lastReadTime;
     SensorData lastReading;
 
+    // Asynchronous reading state
+    bool readInProgress;
+    bool dataReadyInterrupt;    // INT wired and configured, otherwise poll
+    bool ahtDone;
+    unsigned long ahtTriggerTime;
+    unsigned long readStartTime;
+    int16_t ahtHumidity;        // * 10, as in SensorData
+    int16_t ahtTemperature;
+    static volatile bool ens160DataReady;
+
+    static void IRAM_ATTR ens160ISR();
+    bool configureDataReadyInterrupt();
+    bool configureSensors();
+    bool resumeFromSleep();
+    bool triggerAht();
+    ReadStatus readAht(int16_t& humidity, int16_t& temperature);
+    ReadStatus pendingOrTimeout(unsigned long now, SensorData& data);
+
 public:
     SensorManager();
-    bool begin();
-    bool readSensors(SensorData& data);
+    bool begin(bool warmBoot = false);
+    bool readSensors(SensorData& data);     // Blocking wrapper around the calls below
+
+    // SensorSource
+    bool startReading();
+    ReadStatus pollReading(SensorData& data);
+    TickType_t nextPollDelay();
     bool isReady();
     void reset();
     SensorData getLastReading();
-    AlertLevel getAlertLevel(float co2_ppm);
 };
 
 extern SensorManager sensorManager;
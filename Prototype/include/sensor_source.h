@@ -0,0 +1,31 @@
+#ifndef SENSOR_SOURCE_H
+#define SENSOR_SOURCE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Progress of an asynchronous reading started with startReading()
+enum ReadStatus {
+    READ_PENDING = 0,   // Conversions still running
+    READ_COMPLETE = 1,  // Data filled in
+    READ_FAILED = 2     // Bus error or the ENS160 never signalled data-ready
+};
+
+// Where the acquisition task gets its samples: the sensors themselves, or
+// a recorded session played back through the same pipeline
+class SensorSource {
+public:
+    virtual ~SensorSource() {}
+
+    // Non-blocking acquisition: trigger, wait for the acquisition task to be
+    // notified (or nextPollDelay() to elapse), then poll until complete
+    virtual bool startReading() = 0;
+    virtual ReadStatus pollReading(SensorData& data) = 0;
+    virtual TickType_t nextPollDelay() = 0;
+
+    // Live sources are paced by the adaptive sampler and get their respiration
+    // fields from the engine; recorded ones carry both with the sample
+    virtual bool isLive() const { return true; }
+};
+
+#endif // SENSOR_SOURCE_H
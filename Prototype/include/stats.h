@@ -0,0 +1,150 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "packet_codec.h"
+#include "spsc_queue.h"
+
+// Statistics over the last N fixed-point values, each update O(1) amortised:
+// the mean from a running sum, min and max from monotonic deques of slot
+// indices, an EWMA and the rate of change between the oldest and newest
+// sample. Owned by a single task.
+template <size_t N>
+class SlidingWindow {
+    static_assert(N > 1 && (N & (N - 1)) == 0, "SlidingWindow size must be a power of two");
+
+private:
+    int32_t values[N];
+    uint32_t times[N];
+    uint32_t minQueue[N];       // Indices of increasing values, oldest first
+    uint32_t maxQueue[N];       // Indices of decreasing values, oldest first
+    uint32_t minHead, minTail;
+    uint32_t maxHead, maxTail;
+    uint32_t pushed;            // Values ever pushed; the newest has index pushed - 1
+    int32_t sum;
+    int32_t ewmaScaled;         // EWMA << ewmaShift
+    uint8_t ewmaShift;
+
+    static uint32_t slot(uint32_t index) { return index & (N - 1); }
+
+public:
+    explicit SlidingWindow(uint8_t shift = STATS_EWMA_SHIFT) : ewmaShift(shift) {
+        reset();
+    }
+
+    void reset() {
+        minHead = minTail = 0;
+        maxHead = maxTail = 0;
+        pushed = 0;
+        sum = 0;
+        ewmaScaled = 0;
+    }
+
+    void push(int32_t value, uint32_t timeMs) {
+        uint32_t index = pushed;
+
+        if (index >= N) {
+            uint32_t evicted = index - N;
+            sum -= values[slot(evicted)];
+            if (minQueue[slot(minHead)] == evicted) {
+                minHead++;
+            }
+            if (maxQueue[slot(maxHead)] == evicted) {
+                maxHead++;
+            }
+        }
+
+        values[slot(index)] = value;
+        times[slot(index)] = timeMs;
+        sum += value;
+
+        // Drop entries the new value dominates; each index is removed at most once
+        while (minTail != minHead && values[slot(minQueue[slot(minTail - 1)])] >= value) {
+            minTail--;
+        }
+        minQueue[slot(minTail++)] = index;
+        while (maxTail != maxHead && values[slot(maxQueue[slot(maxTail - 1)])] <= value) {
+            maxTail--;
+        }
+        maxQueue[slot(maxTail++)] = index;
+
+        if (index == 0) {
+            ewmaScaled = value * (1 << ewmaShift);
+        } else {
+            ewmaScaled += value - (ewmaScaled >> ewmaShift);
+        }
+        pushed++;
+    }
+
+    uint32_t count() const { return pushed < N ? pushed : N; }
+    bool empty() const { return pushed == 0; }
+
+    // The accessors below are only meaningful when the window is not empty
+    int32_t newest() const { return values[slot(pushed - 1)]; }
+    int32_t mean() const { return sum / (int32_t)count(); }
+    int32_t min() const { return values[slot(minQueue[slot(minHead)])]; }
+    int32_t max() const { return values[slot(maxQueue[slot(maxHead)])]; }
+    int32_t ewma() const { return ewmaScaled >> ewmaShift; }
+
+    // Change per minute between the oldest and newest sample, 0 until two
+    // samples are at least a millisecond apart
+    int32_t ratePerMinute() const {
+        if (count() < 2) {
+            return 0;
+        }
+        uint32_t oldest = pushed - count();
+        uint32_t span = times[slot(pushed - 1)] - times[slot(oldest)];
+        if (span == 0) {
+            return 0;
+        }
+        int64_t change = (int64_t)(newest() - values[slot(oldest)]);
+        return (int32_t)(change * 60000 / (int64_t)span);
+    }
+};
+
+typedef SlidingWindow<STATS_WINDOW_SAMPLES> SampleWindow;
+
+// Windows over CO2, humidity and temperature (in SensorData units) and
+// the per-interval summaries built from them. The alert task feeds it; the
+// transport task takes the finished summaries.
+class StatsManager {
+private:
+    SampleWindow co2Window;
+    SampleWindow humidityWindow;
+    SampleWindow temperatureWindow;
+
+    SummaryRecord summary;              // Interval being accumulated
+    uint32_t summaryInterval;
+    uint32_t summaryCount;
+    int32_t co2Sum;
+    int32_t humiditySum;
+    int32_t temperatureSum;
+    SpscQueue<SummaryRecord, STATS_SUMMARY_QUEUE_LENGTH> summaries;     // Alert -> transport
+
+    void closeSummary();
+
+public:
+    StatsManager();
+    void reset();
+
+    // Adds a valid reading to the windows; invalid readings are ignored
+    void add(const SensorData& data);
+
+    // Adds a reading that has its sequence number to the current summary.
+    // An interval closes when the first sample of the next one arrives.
+    void summarise(const SensorData& data, AlertLevel alertLevel);
+    bool nextSummary(SummaryRecord& record);
+
+    const SampleWindow& co2() const { return co2Window; }
+    const SampleWindow& humidity() const { return humidityWindow; }
+    const SampleWindow& temperature() const { return temperatureWindow; }
+
+    // CO2 EWMA in ppm; falls back to `fallback` before the first valid sample
+    uint16_t smoothedCo2(uint16_t fallback) const;
+};
+
+extern StatsManager statsManager;
+
+#endif // STATS_H
@@ -0,0 +1,117 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SD.h>
+#include <SPI.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "packet_codec.h"
+#include "spsc_queue.h"
+
+#define STORAGE_FILE_MAGIC      0x474C4D52  // "RMLG"
+#define STORAGE_BLOCK_MAGIC     0x4B4C4252  // "RBLK"
+#define STORAGE_FORMAT_VERSION  4   // 2: missed-deadline and watchdog counters, 3: capture micros and epoch offset,
+                                    // 4: summary file
+
+// Session files are one header sector followed by fixed-size data blocks,
+// so block N always starts at byte STORAGE_BLOCK_SIZE * (N + 1). Each
+// session also has a summary file of the same name ending in .sum: the
+// interval SummaryRecords back to back, with no header of its own.
+
+// First sector of every session file
+struct StorageFileHeader {
+    uint32_t magic;             // STORAGE_FILE_MAGIC
+    uint16_t version;           // STORAGE_FORMAT_VERSION
+    uint16_t blockSize;         // STORAGE_BLOCK_SIZE
+    uint16_t recordSize;        // sizeof(SensorPacket)
+    uint16_t recordsPerBlock;   // STORAGE_RECORDS_PER_BLOCK
+    uint32_t firstSequence;     // Sequence number of the first record
+    uint32_t blockCount;        // Blocks written when the header was last updated
+    uint32_t recordCount;       // Records written when the header was last updated
+    uint32_t samplePeriodMs;    // Nominal sample period of the session
+    uint32_t missedDeadlines;   // Since boot, when the header was last updated
+    uint16_t watchdogRestarts;  // Deadline watchdog restarts since power-on
+    uint8_t wedgedTask;         // DiagTask behind the last of them, DIAG_TASK_COUNT if none
+    uint8_t reserved0;
+    int64_t epochOffsetUs;      // Unix time minus the device clock in microseconds, 0 if never synced
+    uint32_t summaryCount;      // Records in the summary file when the header was last updated
+    uint8_t reserved[STORAGE_BLOCK_SIZE - 48];
+} __attribute__((packed));
+
+// Start of every data block; lets a reader binary search by sequence
+struct StorageBlockHeader {
+    uint32_t magic;             // STORAGE_BLOCK_MAGIC
+    uint32_t firstSequence;     // Sequence number of records[0]
+    uint32_t firstTimestamp;    // Seconds since boot of records[0]
+    uint16_t count;             // Valid records in this block
+    uint16_t missedDeadlines;   // Deadlines missed while the block filled (saturates)
+} __attribute__((packed));
+
+#define STORAGE_RECORDS_PER_BLOCK \
+    ((STORAGE_BLOCK_SIZE - sizeof(StorageBlockHeader)) / sizeof(SensorPacket))
+
+#define STORAGE_BLOCK_PADDING \
+    (STORAGE_BLOCK_SIZE - sizeof(StorageBlockHeader) - STORAGE_RECORDS_PER_BLOCK * sizeof(SensorPacket))
+
+struct StorageBlock {
+    StorageBlockHeader header;
+    SensorPacket records[STORAGE_RECORDS_PER_BLOCK];
+    uint8_t padding[STORAGE_BLOCK_PADDING];
+} __attribute__((packed));
+
+static_assert(sizeof(StorageFileHeader) == STORAGE_BLOCK_SIZE, "File header must fill one sector");
+static_assert(sizeof(StorageBlock) == STORAGE_BLOCK_SIZE, "Blocks must fill one sector");
+
+// Appends samples to a binary session log on the SD card. append() only
+// copies into a sector buffer, and appendSummary() only queues; the
+// low-priority flush task does the writing, so the pipeline never waits on
+// the card.
+class StorageManager {
+private:
+    SPIClass spi;
+    File file;
+    File summaryFile;
+    bool ready;
+    char path[24];
+    char summaryPath[24];
+    StorageFileHeader fileHeader;
+    StorageBlock blocks[STORAGE_BLOCK_BUFFERS] __attribute__((aligned(4)));
+    StorageBlock scratch __attribute__((aligned(4)));
+    StorageBlock* active;                                           // Owned by the appender
+    uint32_t activeMissedBase;                                      // Missed deadlines when it was started
+    SpscQueue<StorageBlock*, STORAGE_BLOCK_BUFFERS> freeBlocks;     // Flush task -> appender
+    SpscQueue<StorageBlock*, STORAGE_BLOCK_BUFFERS> fullBlocks;     // Appender -> flush task
+    SpscQueue<SummaryRecord, STORAGE_SUMMARY_BUFFERS> summaries;    // Transport task -> flush task
+    uint32_t blocksWritten;
+    uint32_t recordsWritten;
+    uint32_t summariesWritten;
+    volatile uint32_t droppedRecords;
+    SemaphoreHandle_t fileLock;
+    TaskHandle_t flushTaskHandle;
+
+    static void flushTask(void* param);
+    bool openSession();
+    void sealActive();
+    bool writeBlock(const StorageBlock* block);
+    bool writeHeader();
+    void writeSummaries();
+
+public:
+    StorageManager();
+    bool begin();
+    bool isReady();
+    bool append(const SensorData& data, AlertLevel alertLevel);
+    bool appendSummary(const SummaryRecord& record);
+    void sync();
+    uint32_t getDroppedRecords();
+    const char* sessionPath();
+    size_t readRange(const char* sessionFile, uint32_t fromSequence,
+                     SensorPacket* out, size_t maxRecords);
+    bool readHeader(const char* sessionFile, StorageFileHeader& header);
+};
+
+extern StorageManager storageManager;
+
+#endif // STORAGE_H
@@ -0,0 +1,22 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Unix time set by the phone. The ESP32 system time keeps running on the
+// RTC through deep sleep, so samples from later boots still line up; the
+// offset to the esp_timer clock that stamps captures is taken afresh when
+// it is needed, since esp_timer restarts at every boot.
+class TimeSyncManager {
+public:
+    // Sets Unix time to `epochMs` now
+    void setEpoch(uint64_t epochMs);
+
+    // Unix time minus esp_timer_get_time(), in microseconds; 0 until synced
+    int64_t epochOffsetUs();
+};
+
+extern TimeSyncManager timeSyncManager;
+
+#endif // TIME_SYNC_H
@@ -0,0 +1,38 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "diagnostics.h"
+
+// Deadline watchdog over the pipeline tasks. Each task marks itself busy
+// when it wakes for work and idle before it blocks again; a supervisor task
+// feeds the ESP-IDF task watchdog only while no task has been busy for
+// longer than WATCHDOG_STAGE_LIMIT_MS. A wedged stage therefore stops the
+// feeding and the task watchdog restarts the chip, instead of the device
+// sitting frozen. The wedged task is kept in RTC memory across the restart.
+class WatchdogManager {
+private:
+    volatile uint32_t busySinceMs[DIAG_TASK_COUNT];     // 0 while blocked
+    TaskHandle_t taskHandle;
+    uint8_t wedged;             // Task that stopped the feeding, DIAG_TASK_COUNT if none
+
+    static void supervisorTask(void* param);
+
+public:
+    WatchdogManager();
+    bool begin();
+    void stop();
+
+    // Called by the supervised task itself
+    void busy(DiagTask task) { busySinceMs[task] = millis() | 1; }
+    void idle(DiagTask task) { busySinceMs[task] = 0; }
+
+    // Watchdog restarts since power-on and the task behind the last one
+    uint16_t getRestarts();
+    uint8_t getLastWedgedTask();
+};
+
+extern WatchdogManager watchdogManager;
+
+#endif // WATCHDOG_H
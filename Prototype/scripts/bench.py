@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Runs the native benchmarks and records them in benchmarks.csv.
+
+Every run appends one row per benchmark (date, commit, host, name, ns per
+sample). Each result is compared with the latest earlier row for the same
+benchmark on the same host; the script exits with status 1 if any is slower
+by more than the threshold, so it can gate a merge or a release build.
+
+    scripts/bench.py                  # run, compare, record
+    scripts/bench.py --no-record      # run and compare only
+    scripts/bench.py --threshold 5    # fail above +5 % instead of +15 %
+"""
+
+import argparse
+import csv
+import datetime
+import os
+import platform
+import re
+import subprocess
+import sys
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+HISTORY_FILE = os.path.join(PROJECT_DIR, "benchmarks.csv")
+FIELDS = ["date", "commit", "host", "name", "ns_per_sample"]
+BENCH_LINE = re.compile(r"^BENCH (\S+) ([0-9.]+)$", re.MULTILINE)
+
+
+def run_benchmarks():
+    result = subprocess.run(
+        ["pio", "test", "-e", "native", "-f", "test_benchmark", "-v"],
+        cwd=PROJECT_DIR, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True)
+    if result.returncode != 0:
+        sys.stdout.write(result.stdout)
+        sys.exit("benchmark run failed")
+    return {name: float(value) for name, value in BENCH_LINE.findall(result.stdout)}
+
+
+def current_commit():
+    try:
+        return subprocess.check_output(
+            ["git", "rev-parse", "--short", "HEAD"], cwd=PROJECT_DIR,
+            universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def load_history():
+    if not os.path.exists(HISTORY_FILE):
+        return []
+    with open(HISTORY_FILE, newline="") as f:
+        return list(csv.DictReader(f))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--threshold", type=float, default=15.0,
+                        help="allowed slowdown in percent (default 15)")
+    parser.add_argument("--no-record", action="store_true",
+                        help="compare without appending to benchmarks.csv")
+    args = parser.parse_args()
+
+    results = run_benchmarks()
+    if not results:
+        sys.exit("no BENCH lines in the test output")
+
+    host = platform.node()
+    baseline = {}
+    for row in load_history():
+        if row["host"] == host:
+            baseline[row["name"]] = float(row["ns_per_sample"])
+
+    regressed = False
+    for name, value in sorted(results.items()):
+        previous = baseline.get(name)
+        if previous is None:
+            print("%-20s %10.1f ns  (new)" % (name, value))
+            continue
+        change = (value - previous) / previous * 100.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressed = True
+        print("%-20s %10.1f ns  %+6.1f %%%s" % (name, value, change, flag))
+
+    if not args.no_record:
+        new_file = not os.path.exists(HISTORY_FILE)
+        date = datetime.datetime.now().strftime("%Y-%m-%d %H:%M")
+        commit = current_commit()
+        with open(HISTORY_FILE, "a", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=FIELDS)
+            if new_file:
+                writer.writeheader()
+            for name, value in sorted(results.items()):
+                writer.writerow({"date": date, "commit": commit, "host": host,
+                                 "name": name, "ns_per_sample": "%.1f" % value})
+
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Streams a recorded session to the device's serial replay input.
+
+Start the replay first with the CMD_REPLAY control command and session 0
+(text command "12:0" for real time, "12:65536" for as fast as possible),
+then run this script against a session_NNNN.bin copied off the SD card:
+
+    scripts/replay.py /dev/ttyUSB0 session_0003.bin
+
+Records are sent as REPLAY_SERIAL_SYNC followed by the 22-byte SensorPacket
+exactly as logged; the device paces playback itself.
+"""
+
+import argparse
+import struct
+import sys
+
+import serial
+
+BLOCK_SIZE = 512
+FILE_MAGIC = 0x474C4D52
+BLOCK_MAGIC = 0x4B4C4252
+RECORD_SIZE = 22
+SYNC = b"\xA5"
+END = b"\xA6"
+
+
+def records(path):
+    with open(path, "rb") as session:
+        header = session.read(BLOCK_SIZE)
+        magic, _, block_size, record_size = struct.unpack_from("<IHHH", header)
+        if magic != FILE_MAGIC or block_size != BLOCK_SIZE or record_size != RECORD_SIZE:
+            sys.exit("%s is not a session log" % path)
+        while True:
+            block = session.read(BLOCK_SIZE)
+            if len(block) < BLOCK_SIZE:
+                return
+            magic, _, _, count = struct.unpack_from("<IIIH", block)
+            if magic != BLOCK_MAGIC:
+                return
+            for i in range(count):
+                offset = 16 + i * RECORD_SIZE
+                yield block[offset:offset + RECORD_SIZE]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("session")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    sent = 0
+    with serial.Serial(args.port, args.baud) as port:
+        for record in records(args.session):
+            port.write(SYNC + record)
+            sent += 1
+        port.write(END)
+        port.flush()
+    print("sent %d records" % sent)
+
+
+if __name__ == "__main__":
+    main()
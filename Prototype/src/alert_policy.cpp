@@ -0,0 +1,175 @@
+#include "alert_policy.h"
+
+AlertPolicy alertPolicy;
+
+#define CO2_RULE(level, threshold, hysteresis, dwellMs, holdMs) \
+    {level, {{ALERT_METRIC_CO2, threshold, hysteresis}, {ALERT_METRIC_NONE, 0, 0}}, dwellMs, holdMs}
+
+// Higher levels need less dwell: a short spike should not beep, a large one
+// should not wait. Hysteresis bands keep readings that hover at a threshold
+// from toggling the buzzer and the radio.
+static constexpr AlertRule rules[] = {
+    CO2_RULE(ALERT_LOW,      CO2_THRESHOLD_LOW,      100,  10000, 30000),
+    CO2_RULE(ALERT_MEDIUM,   CO2_THRESHOLD_MED,      500,  5000,  30000),
+    CO2_RULE(ALERT_HIGH,     CO2_THRESHOLD_HIGH,     1000, 2000,  30000),
+    CO2_RULE(ALERT_CRITICAL, CO2_THRESHOLD_CRITICAL, 2000, 0,     60000),
+
+    // Hot, humid air at the sensor: above 32 C and 70 % RH together
+    {ALERT_LOW, {{ALERT_METRIC_TEMPERATURE, 320, 10}, {ALERT_METRIC_HUMIDITY, 700, 50}}, 30000, 60000},
+};
+
+static constexpr size_t RULE_COUNT = sizeof(rules) / sizeof(rules[0]);
+
+// Compile-time checks over the table (C++11 constexpr, so recursive)
+
+static constexpr bool conditionValid(const AlertCondition& c) {
+    return c.metric == ALERT_METRIC_NONE ||
+           (c.metric <= ALERT_METRIC_TEMPERATURE && c.hysteresis >= 0 &&
+            (c.metric != ALERT_METRIC_CO2 || (c.threshold > 0 && c.threshold <= UINT16_MAX)) &&
+            (c.metric != ALERT_METRIC_HUMIDITY || (c.threshold >= 0 && c.threshold < 1000)));
+}
+
+static constexpr bool ruleValid(const AlertRule& r) {
+    return r.level > ALERT_NONE && r.level <= ALERT_CRITICAL &&
+           r.conditions[0].metric != ALERT_METRIC_NONE &&
+           conditionValid(r.conditions[0]) && conditionValid(r.conditions[1]);
+}
+
+static constexpr bool allValid(size_t i) {
+    return i == RULE_COUNT || (ruleValid(rules[i]) && allValid(i + 1));
+}
+
+static constexpr bool isCo2Only(const AlertRule& r) {
+    return r.conditions[0].metric == ALERT_METRIC_CO2 && r.conditions[1].metric == ALERT_METRIC_NONE;
+}
+
+// CO2-only rules form a ladder: listed by level and with rising thresholds
+static constexpr bool co2LadderFrom(size_t i, int level, int32_t threshold) {
+    return i == RULE_COUNT ||
+           (!isCo2Only(rules[i]) ? co2LadderFrom(i + 1, level, threshold) :
+            rules[i].level > level && rules[i].conditions[0].threshold > threshold &&
+            co2LadderFrom(i + 1, rules[i].level, rules[i].conditions[0].threshold));
+}
+
+// Each CO2 rule must clear above the threshold of the level below it
+static constexpr bool bandsSeparateFrom(size_t i, int32_t previousThreshold) {
+    return i == RULE_COUNT ||
+           (!isCo2Only(rules[i]) ? bandsSeparateFrom(i + 1, previousThreshold) :
+            rules[i].conditions[0].threshold - rules[i].conditions[0].hysteresis > previousThreshold &&
+            bandsSeparateFrom(i + 1, rules[i].conditions[0].threshold));
+}
+
+static constexpr bool raisesLevel(size_t i, AlertLevel level) {
+    return i < RULE_COUNT && (rules[i].level == level || raisesLevel(i + 1, level));
+}
+
+static_assert(RULE_COUNT > 0 && RULE_COUNT <= ALERT_MAX_RULES, "Alert rule table size out of range");
+static_assert(allValid(0), "Alert rule has an invalid level, metric or threshold");
+static_assert(co2LadderFrom(0, ALERT_NONE, 0), "CO2 alert rules must rise in level and threshold");
+static_assert(bandsSeparateFrom(0, 0), "CO2 hysteresis band overlaps the level below");
+static_assert(raisesLevel(0, ALERT_CRITICAL), "No rule produces ALERT_CRITICAL");
+
+static int32_t metricValue(const SensorData& data, AlertMetric metric) {
+    switch (metric) {
+        case ALERT_METRIC_CO2:          return data.co2;
+        case ALERT_METRIC_HUMIDITY:     return data.humidity;
+        case ALERT_METRIC_TEMPERATURE:  return data.temperature;
+        default:                        return 0;
+    }
+}
+
+// All conditions above their thresholds
+static bool conditionsHold(const AlertRule& rule, const SensorData& data) {
+    for (int i = 0; i < ALERT_RULE_CONDITIONS; i++) {
+        const AlertCondition& c = rule.conditions[i];
+        if (c.metric != ALERT_METRIC_NONE && metricValue(data, c.metric) <= c.threshold) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Any condition back down through its hysteresis band
+static bool conditionsCleared(const AlertRule& rule, const SensorData& data) {
+    for (int i = 0; i < ALERT_RULE_CONDITIONS; i++) {
+        const AlertCondition& c = rule.conditions[i];
+        if (c.metric != ALERT_METRIC_NONE &&
+            metricValue(data, c.metric) <= c.threshold - c.hysteresis) {
+            return true;
+        }
+    }
+    return false;
+}
+
+AlertPolicy::AlertPolicy() {
+    reset();
+}
+
+void AlertPolicy::reset() {
+    for (size_t i = 0; i < ALERT_MAX_RULES; i++) {
+        states[i].active = false;
+        states[i].pending = false;
+        states[i].sinceMs = 0;
+    }
+    level = ALERT_NONE;
+}
+
+AlertLevel AlertPolicy::classify(const SensorData& data) {
+    AlertLevel highest = ALERT_NONE;
+    for (size_t i = 0; i < RULE_COUNT; i++) {
+        if (rules[i].level > highest && conditionsHold(rules[i], data)) {
+            highest = rules[i].level;
+        }
+    }
+    return highest;
+}
+
+AlertLevel AlertPolicy::update(const SensorData& data) {
+    if (!data.valid) {
+        return level;
+    }
+
+    uint32_t now = (uint32_t)data.timestamp;
+    AlertLevel highest = ALERT_NONE;
+
+    for (size_t i = 0; i < RULE_COUNT; i++) {
+        const AlertRule& rule = rules[i];
+        RuleState& state = states[i];
+
+        if (state.active) {
+            if (now - state.sinceMs >= rule.holdMs && conditionsCleared(rule, data)) {
+                state.active = false;
+            }
+        } else if (conditionsHold(rule, data)) {
+            if (!state.pending) {
+                state.pending = true;
+                state.sinceMs = now;
+            }
+            if (now - state.sinceMs >= rule.dwellMs) {
+                state.active = true;
+                state.pending = false;
+                state.sinceMs = now;
+            }
+        } else {
+            state.pending = false;
+        }
+
+        if (state.active && rule.level > highest) {
+            highest = rule.level;
+        }
+    }
+
+    level = highest;
+    return level;
+}
+
+void AlertPolicy::restore(AlertLevel restored, uint32_t nowMs) {
+    reset();
+    for (size_t i = 0; i < RULE_COUNT; i++) {
+        if (rules[i].level == restored) {
+            states[i].active = true;
+            states[i].sinceMs = nowMs;
+        }
+    }
+    level = restored;
+}
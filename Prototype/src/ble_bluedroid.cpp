@@ -0,0 +1,277 @@
+#if !defined(BLE_BACKEND_NIMBLE)
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLEUtils.h>
+#include <BLE2902.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
+#include "ble_transport.h"
+
+// Transport on the Arduino BLE library, which wraps Bluedroid
+class BluedroidTransport : public BLETransport,
+                           public BLEServerCallbacks,
+                           public BLECharacteristicCallbacks {
+private:
+    BLEServer* server;
+    BLECharacteristic* characteristics[BLE_CHANNEL_DIAG + 1];
+    uint16_t handles[BLE_CHANNEL_DIAG + 1];     // Attribute handles, cached once the service starts
+    BLE2902* cccds[BLE_CHANNEL_DIAG + 1];
+    BLECharacteristic* controlCharacteristic;
+    BLE2902 dataCccd;               // Static so no descriptor is heap allocated
+    BLE2902 responseCccd;
+    BLETransportListener* listener;
+    esp_bd_addr_t peerAddress;
+    esp_gatt_if_t gattsIf;              // Both from ESP_GATTS_CONNECT_EVT
+    uint16_t connId;
+    bool connected;
+    volatile bool congested;            // Between ESP_GATTS_CONGEST_EVT on and off
+    volatile bool broadcasting;         // Advertising carries a sensor summary
+    BLEAdvertisementData defaultAdvData;
+
+    static void gattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                           esp_ble_gatts_cb_param_t* param);
+
+public:
+    BluedroidTransport();
+    bool begin(BLETransportListener* eventListener);
+    BLENotifyResult notify(BLEChannel channel, const uint8_t* data, size_t length);
+    void setValue(BLEChannel channel, const uint8_t* data, size_t length);
+    void updateConnParams(const BLEProfileParams& params);
+    void stopAdvertising();
+    void setBroadcastData(const uint8_t* data, size_t length);
+    void stopBroadcast();
+    const char* name() const { return "Bluedroid"; }
+
+    // BLEServerCallbacks
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param);
+    void onDisconnect(BLEServer* pServer);
+    void onMtuChanged(BLEServer* pServer, esp_ble_gatts_cb_param_t* param);
+
+    // BLECharacteristicCallbacks, shared by all characteristics
+    void onWrite(BLECharacteristic* pCharacteristic);
+    void onRead(BLECharacteristic* pCharacteristic);
+};
+
+static BluedroidTransport transport;
+
+BLETransport& bleTransport() {
+    return transport;
+}
+
+BluedroidTransport::BluedroidTransport() {
+    server = nullptr;
+    for (int i = 0; i <= BLE_CHANNEL_DIAG; i++) {
+        characteristics[i] = nullptr;
+        handles[i] = 0;
+        cccds[i] = nullptr;
+    }
+    controlCharacteristic = nullptr;
+    listener = nullptr;
+    memset(peerAddress, 0, sizeof(peerAddress));
+    gattsIf = 0;
+    connId = 0;
+    connected = false;
+    congested = false;
+    broadcasting = false;
+}
+
+bool BluedroidTransport::begin(BLETransportListener* eventListener) {
+    listener = eventListener;
+
+    BLEDevice::init(BLE_DEVICE_NAME);
+
+    // Accept a larger MTU when the phone requests one so batches fit
+    BLEDevice::setMTU(BLE_PREFERRED_MTU);
+
+    server = BLEDevice::createServer();
+    server->setCallbacks(this);
+    BLEDevice::setCustomGattsHandler(gattsEvent);
+
+    BLEService* service = server->createService(BLE_SERVICE_UUID);
+
+    BLECharacteristic* data = service->createCharacteristic(
+        BLE_CHAR_DATA_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    data->addDescriptor(&dataCccd);
+    data->setCallbacks(this);
+    characteristics[BLE_CHANNEL_DATA] = data;
+    cccds[BLE_CHANNEL_DATA] = &dataCccd;
+
+    controlCharacteristic = service->createCharacteristic(
+        BLE_CHAR_CONTROL_UUID,
+        BLECharacteristic::PROPERTY_WRITE
+    );
+    controlCharacteristic->setCallbacks(this);
+
+    // Command acknowledgements
+    BLECharacteristic* response = service->createCharacteristic(
+        BLE_CHAR_RESPONSE_UUID,
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    response->addDescriptor(&responseCccd);
+    response->setCallbacks(this);
+    characteristics[BLE_CHANNEL_RESPONSE] = response;
+    cccds[BLE_CHANNEL_RESPONSE] = &responseCccd;
+
+    // Timing, heap and stack counters, refreshed on every read
+    BLECharacteristic* diag = service->createCharacteristic(
+        BLE_CHAR_DIAG_UUID,
+        BLECharacteristic::PROPERTY_READ
+    );
+    diag->setCallbacks(this);
+    characteristics[BLE_CHANNEL_DIAG] = diag;
+
+    service->start();
+    for (int i = 0; i <= BLE_CHANNEL_DIAG; i++) {
+        handles[i] = characteristics[i]->getHandle();
+    }
+
+    // The name goes in the scan response so the advertisement itself has
+    // room for either the service UUID or a broadcast summary
+    BLEAdvertisementData scanResponse;
+    scanResponse.setName(BLE_DEVICE_NAME);
+    defaultAdvData.setFlags(ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT);
+    defaultAdvData.setCompleteServices(BLEUUID(BLE_SERVICE_UUID));
+
+    BLEAdvertising* advertising = BLEDevice::getAdvertising();
+    advertising->setScanResponseData(scanResponse);
+    advertising->setAdvertisementData(defaultAdvData);
+    advertising->setScanResponse(true);
+    BLEDevice::startAdvertising();
+    return true;
+}
+
+// Sends straight from the caller's buffer. BLECharacteristic::notify()
+// would first copy the frame into the characteristic's std::string value,
+// a heap allocation per notification; the value only matters for reads.
+// Bluedroid queues notifications until the link reports congestion.
+BLENotifyResult BluedroidTransport::notify(BLEChannel channel, const uint8_t* data, size_t length) {
+    BLE2902* cccd = cccds[channel];
+    if (cccd == nullptr || !connected || !cccd->getNotifications()) {
+        return BLE_NOTIFY_FAILED;
+    }
+    if (congested) {
+        return BLE_NOTIFY_CONGESTED;
+    }
+    esp_err_t err = esp_ble_gatts_send_indicate(gattsIf, connId, handles[channel],
+                                                length, (uint8_t*)data, false);
+    return err == ESP_OK ? BLE_NOTIFY_OK : BLE_NOTIFY_FAILED;
+}
+
+// Runs before the library's own handling of the same event, so the
+// connection is known by the time onConnect() tells the listener
+void BluedroidTransport::gattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                                    esp_ble_gatts_cb_param_t* param) {
+    if (event == ESP_GATTS_CONNECT_EVT) {
+        transport.gattsIf = gattsIf;
+        transport.connId = param->connect.conn_id;
+    } else if (event == ESP_GATTS_CONGEST_EVT) {
+        transport.congested = param->congest.congested;
+    }
+}
+
+void BluedroidTransport::setValue(BLEChannel channel, const uint8_t* data, size_t length) {
+    if (characteristics[channel] != nullptr) {
+        characteristics[channel]->setValue((uint8_t*)data, length);
+    }
+}
+
+void BluedroidTransport::updateConnParams(const BLEProfileParams& params) {
+    if (!connected || !server) {
+        return;
+    }
+    server->updateConnParams(peerAddress, params.minInterval, params.maxInterval,
+                             params.latency, params.timeout);
+}
+
+void BluedroidTransport::stopAdvertising() {
+    if (server) {
+        server->getAdvertising()->stop();
+    }
+}
+
+// Replaces the advertising payload in place; the controller picks it up
+// from the next advertising event without a restart. While connected the
+// summary goes out in scannable, non-connectable advertisements.
+void BluedroidTransport::setBroadcastData(const uint8_t* data, size_t length) {
+    if (!server) {
+        return;
+    }
+    if (!broadcasting) {
+        broadcasting = true;
+        if (connected) {
+            BLEAdvertising* advertising = server->getAdvertising();
+            advertising->stop();
+            advertising->setAdvertisementType(ADV_TYPE_SCAN_IND);
+            advertising->start();
+        }
+    }
+    esp_ble_gap_config_adv_data_raw((uint8_t*)data, length);
+}
+
+void BluedroidTransport::stopBroadcast() {
+    if (!server) {
+        return;
+    }
+    broadcasting = false;
+    BLEAdvertising* advertising = server->getAdvertising();
+    advertising->setAdvertisementData(defaultAdvData);
+    if (connected) {
+        advertising->stop();
+    }
+}
+
+void BluedroidTransport::onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    memcpy(peerAddress, param->connect.remote_bda, sizeof(peerAddress));
+    connected = true;
+    BLEAdvertising* advertising = pServer->getAdvertising();
+    advertising->stop();
+    if (broadcasting) {
+        advertising->setAdvertisementType(ADV_TYPE_SCAN_IND);
+        advertising->start();
+    }
+
+#if defined(CONFIG_BT_BLE_50_FEATURES_SUPPORTED)
+    // Half the airtime per packet where both ends support it; the
+    // controllers fall back to 1M otherwise
+    esp_ble_gap_set_preferred_phy(peerAddress, 0,
+                                  ESP_BLE_GAP_PHY_1M_PREF_MASK | ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                  ESP_BLE_GAP_PHY_1M_PREF_MASK | ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                  ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+#endif
+
+    listener->onConnected();
+}
+
+void BluedroidTransport::onDisconnect(BLEServer* pServer) {
+    connected = false;
+    congested = false;
+    listener->onDisconnected();
+    BLEAdvertising* advertising = pServer->getAdvertising();
+    advertising->stop();
+    advertising->setAdvertisementType(ADV_TYPE_IND);
+    pServer->startAdvertising();
+}
+
+void BluedroidTransport::onMtuChanged(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    listener->onMtuChanged(param->mtu.mtu);
+}
+
+// Passes the characteristic's own buffer on; nothing is copied here
+void BluedroidTransport::onWrite(BLECharacteristic* pCharacteristic) {
+    if (pCharacteristic == controlCharacteristic) {
+        listener->onControlWrite(pCharacteristic->getData(), pCharacteristic->getLength());
+    }
+}
+
+void BluedroidTransport::onRead(BLECharacteristic* pCharacteristic) {
+    if (pCharacteristic == characteristics[BLE_CHANNEL_DIAG]) {
+        listener->onDiagnosticsRead();
+    }
+}
+
+#endif // !BLE_BACKEND_NIMBLE
@@ -1,89 +1,114 @@
 #include "ble_comm.h"
+#include "log.h"
+#include "events.h"
+#include "history.h"
+#include "flash_log.h"
+#include "capture.h"
+#include "watchdog.h"
+#include "time_sync.h"
+#include "diagnostics.h"
+#include "heap_monitor.h"
+
+// Guards linkSnapshot between the transport task and the stack's task
+static portMUX_TYPE linkStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char TAG[] = "ble";
 
 BLEManager bleManager;
 
-// Global variables for callbacks
-BLEManager* g_bleManager = nullptr;
+// Intervals keep within the iOS accessory limits (min >= 15 ms, max >=
+// min + 15 ms, max * (latency + 1) * 3 < timeout <= 6 s)
+static const BLEProfileParams profiles[BLE_PROFILE_COUNT] = {
+    {12, 24, 0, 400, 0},                        // Live: 15-30 ms
+    {40, 80, 0, 400, BLE_BATCH_DEADLINE_MS},    // Balanced: 50-100 ms
+    {320, 400, 2, 600, 10000},                  // Background: 400-500 ms, 10 s batches
+};
 
 BLEManager::BLEManager() {
-    server = nullptr;
-    service = nullptr;
-    dataCharacteristic = nullptr;
-    controlCharacteristic = nullptr;
+    transport = nullptr;
     deviceConnected = false;
-    oldDeviceConnected = false;
-    pendingCommand = CMD_NONE;
     bleStartTime = 0;
-    sequenceNumber = 0;
-    
-    // Set global pointer in constructor
-    g_bleManager = this;
+    backfillCursor = 0;
+    backfillEnd = 0;
+    batchCount = 0;
+    batchStartTime = 0;
+    peerMtu = BLE_DEFAULT_MTU;
+    streamFormat = (StreamFormat)BLE_STREAM_FORMAT;
+    samplePeriodMs = SENSOR_READ_INTERVAL_MS;
+    batchLimit = BLE_BATCH_SIZE;
+    profile = (BLEProfile)BLE_DEFAULT_PROFILE;
+    memset(&linkStats, 0, sizeof(linkStats));
+    memset(&linkSnapshot, 0, sizeof(linkSnapshot));
+    benchStartMs = 0;
+    benchBackoff = false;
+    captureCursor = 0;
+    captureSending = false;
+    captureBackoff = false;
+    broadcasting = false;
 }
 
 bool BLEManager::begin() {
-    // Ensure global pointer is set
-    g_bleManager = this;
-    
-    // Initialize BLE
-    BLEDevice::init(BLE_DEVICE_NAME);
-    
-    // Create BLE Server
-    server = BLEDevice::createServer();
-    server->setCallbacks(new ServerCallbacks());
-    
-    // Create BLE Service
-    service = server->createService(BLE_SERVICE_UUID);
-    
-    // Create BLE Characteristics
-    dataCharacteristic = service->createCharacteristic(
-        BLE_CHAR_DATA_UUID,
-        BLECharacteristic::PROPERTY_READ |
-        BLECharacteristic::PROPERTY_NOTIFY
-    );
-    dataCharacteristic->addDescriptor(new BLE2902());
-    
-    controlCharacteristic = service->createCharacteristic(
-        BLE_CHAR_CONTROL_UUID,
-        BLECharacteristic::PROPERTY_WRITE
-    );
-    controlCharacteristic->setCallbacks(new ControlCallbacks());
-    
-    // Start the service
-    service->start();
-    
-    // Start advertising
-    BLEAdvertising* advertising = BLEDevice::getAdvertising();
-    advertising->addServiceUUID(BLE_SERVICE_UUID);
-    advertising->setScanResponse(false);
-    advertising->setMinPreferred(0x0);
-    BLEDevice::startAdvertising();
+    transport = &bleTransport();
+    if (!transport->begin(this)) {
+        LOG_E(TAG, "%s BLE stack failed to start", transport->name());
+        return false;
+    }
     
     bleStartTime = millis();
-    Serial.println("BLE service started and advertising...");
+    LOG_I(TAG, "BLE service started on %s and advertising...", transport->name());
+    if (BLE_BROADCAST) {
+        setBroadcast(true);
+    }
     
     return true;
 }
 
+void BLEManager::buildPacket(const SensorData& data, AlertLevel alertLevel, SensorPacket& packet) {
+    int64_t start = DiagnosticsManager::now();
+    encodeSensorPacket(data, alertLevel, packet);
+    diagnosticsManager.record(DIAG_STAGE_PACKET_BUILD, start);
+}
+
+// Every frame on the data characteristic goes out through here. Whatever
+// the stack allocates to send it counts against the sample, and is also
+// totalled on its own for the diagnostics.
+BLENotifyResult BLEManager::notifyData(const uint8_t* data, size_t length) {
+    int64_t start = DiagnosticsManager::now();
+    uint32_t heapMark = heapMonitor.stackMark();
+    BLENotifyResult result = transport->notify(BLE_CHANNEL_DATA, data, length);
+    heapMonitor.stackDone(heapMark);
+    diagnosticsManager.record(DIAG_STAGE_NOTIFY, start);
+
+    if (result == BLE_NOTIFY_OK) {
+        linkStats.framesSent++;
+        linkStats.bytesSent += length;
+    } else if (result == BLE_NOTIFY_CONGESTED) {
+        linkStats.notifyCongested++;
+    } else {
+        linkStats.notifyFailures++;
+    }
+    return result;
+}
+
 void BLEManager::sendSensorData(const SensorData& data, AlertLevel alertLevel) {
-    if (!deviceConnected || !dataCharacteristic) {
+    if (!deviceConnected || !transport) {
         return;
     }
 
     // Create compact binary packet
     SensorPacket packet;
-    packet.co2 = (uint16_t)data.co2_ppm;
-    packet.humidity = (int16_t)(data.humidity_percent * 10);
-    packet.temperature = (int16_t)(data.temperature_celsius * 10);
-    packet.alert = (uint8_t)alertLevel;
-    packet.status = data.valid ? 0x01 : 0x00;
-    packet.timestamp = (uint32_t)(millis() / 1000); // seconds since boot
-    packet.sequence = sequenceNumber++;
-
-    // Send binary data
-    dataCharacteristic->setValue((uint8_t*)&packet, sizeof(packet));
-    dataCharacteristic->notify();
-
-    Serial.printf("Sent binary packet - CO2: %d ppm, Temp: %d.%d°C, Hum: %d.%d%%, Alert: %d, Seq: %d\n", 
+    buildPacket(data, alertLevel, packet);
+
+    // Sized to the negotiated MTU; the default one only takes a bare packet
+    uint8_t frame[LIVE_FRAME_MAX_SIZE];
+    size_t length = encodeLiveFrame(packet, peerMtu - BLE_ATT_HEADER_SIZE, frame);
+    if (length == 0) {
+        linkStats.samplesDropped++;
+        return;
+    }
+    notifyData(frame, length);
+
+    LOG_D(TAG, "Sent binary packet - CO2: %d ppm, Temp: %d.%d°C, Hum: %d.%d%%, Alert: %d, Seq: %d", 
                   packet.co2, 
                   packet.temperature / 10, abs(packet.temperature % 10),
                   packet.humidity / 10, abs(packet.humidity % 10),
@@ -91,12 +116,419 @@ void BLEManager::sendSensorData(const SensorData& data, AlertLevel alertLevel) {
                   packet.sequence);
 }
 
-BLECommand BLEManager::getCommand() {
-    return pendingCommand;
+void BLEManager::sendSummary(const SummaryRecord& record) {
+    if (!deviceConnected || !transport) {
+        return;
+    }
+    if ((size_t)(peerMtu - BLE_ATT_HEADER_SIZE) < sizeof(record)) {
+        LOG_W(TAG, "MTU %u too small for summaries", peerMtu);
+        return;
+    }
+
+    notifyData((const uint8_t*)&record, sizeof(record));
+
+    LOG_D(TAG, "Sent summary - %u samples from Seq: %u", record.count, record.firstSequence);
 }
 
-void BLEManager::clearCommand() {
-    pendingCommand = CMD_NONE;
+// Number of samples that fit one notification at the negotiated MTU
+uint8_t BLEManager::batchCapacity() {
+    size_t payload = min((size_t)(peerMtu - BLE_ATT_HEADER_SIZE), sizeof(batchBuffer));
+    if (payload < sizeof(BatchHeader) + sizeof(SensorPacket)) {
+        return 0;
+    }
+    size_t entries = (payload - sizeof(BatchHeader)) / sizeof(SensorPacket);
+    return (uint8_t)min(entries, (size_t)batchLimit);
+}
+
+// Adds a sample to the pending batch, sending it once full. Falls back to
+// one sample per notification while the MTU is too small for a batch of two.
+void BLEManager::queueSensorData(const SensorData& data, AlertLevel alertLevel) {
+    if (!deviceConnected || !transport) {
+        batchCount = 0;
+        deltaEncoder.reset();
+        return;
+    }
+
+    // The benchmark has the link to itself; history keeps the samples for a backfill
+    if (isBenchmarking()) {
+        return;
+    }
+
+    // Summary streaming sends only the records the transport task forwards
+    if (streamFormat == STREAM_FORMAT_SUMMARY) {
+        return;
+    }
+
+    if (streamFormat == STREAM_FORMAT_DELTA) {
+        SensorPacket packet;
+        buildPacket(data, alertLevel, packet);
+        queueDeltaPacket(packet, data.timestamp);
+        return;
+    }
+
+    uint8_t capacity = batchCapacity();
+    if (capacity <= 1) {
+        flushBatch();
+        sendSensorData(data, alertLevel);
+        return;
+    }
+
+    if (batchCount >= capacity) {
+        flushBatch();
+    }
+
+    if (batchCount == 0) {
+        batchStartTime = millis();
+    }
+
+    SensorPacket packet;
+    buildPacket(data, alertLevel, packet);
+    memcpy(batchBuffer + sizeof(BatchHeader) + batchCount * sizeof(SensorPacket),
+           &packet, sizeof(packet));
+    batchCount++;
+
+    if (batchCount >= capacity) {
+        flushBatch();
+    }
+}
+
+// Appends to the current delta frame, starting a new frame (with this
+// sample as keyframe) when it no longer fits or breaks the implied timing
+void BLEManager::queueDeltaPacket(const SensorPacket& packet, uint32_t timestampMs) {
+    size_t capacity = min((size_t)(peerMtu - BLE_ATT_HEADER_SIZE), sizeof(batchBuffer));
+
+    // Until the MTU is negotiated a keyframe does not fit
+    if (capacity < DELTA_FRAME_MIN_SIZE) {
+        sendDeltaFrame();
+        sendBarePacket(packet);
+        return;
+    }
+
+    if (deltaEncoder.count() == 0) {
+        deltaEncoder.begin(batchBuffer, capacity, samplePeriodMs);
+        batchStartTime = millis();
+    }
+
+    if (!deltaEncoder.append(packet, timestampMs)) {
+        sendDeltaFrame();
+        deltaEncoder.begin(batchBuffer, capacity, samplePeriodMs);
+        batchStartTime = millis();
+        if (!deltaEncoder.append(packet, timestampMs)) {
+            linkStats.samplesDropped++;
+            LOG_W(TAG, "Sample %u does not fit a delta frame, dropped", packet.sequence);
+        }
+    }
+}
+
+void BLEManager::sendBarePacket(const SensorPacket& packet) {
+    uint8_t bare[SENSOR_PACKET_RESPIRATION_SIZE];
+    size_t length = encodeBarePacket(packet, peerMtu - BLE_ATT_HEADER_SIZE, bare);
+    if (length == 0) {
+        linkStats.samplesDropped++;
+        return;
+    }
+    notifyData(bare, length);
+}
+
+void BLEManager::sendDeltaFrame() {
+    if (deltaEncoder.count() == 0) {
+        return;
+    }
+
+    notifyData(batchBuffer, deltaEncoder.length());
+
+    LOG_D(TAG, "Sent delta frame - %d samples, %d bytes",
+                  deltaEncoder.count(), (int)deltaEncoder.length());
+    deltaEncoder.reset();
+}
+
+void BLEManager::flushBatch() {
+    if (!deviceConnected || !transport) {
+        batchCount = 0;
+        deltaEncoder.reset();
+        return;
+    }
+
+    if (deltaEncoder.count() > 0) {
+        sendDeltaFrame();
+    }
+
+    if (batchCount == 0) {
+        return;
+    }
+
+    SensorPacket first;
+    memcpy(&first, batchBuffer + sizeof(BatchHeader), sizeof(first));
+
+    BatchHeader header;
+    header.type = BLE_FRAME_BATCH;
+    header.count = batchCount;
+    header.entrySize = sizeof(SensorPacket);
+    header.flags = 0;
+    header.firstSequence = first.sequence;
+    memcpy(batchBuffer, &header, sizeof(header));
+
+    size_t length = sizeof(BatchHeader) + batchCount * sizeof(SensorPacket);
+    notifyData(batchBuffer, length);
+
+    LOG_D(TAG, "Sent batch - %d samples, Seq: %u-%u, %d bytes",
+                  batchCount, header.firstSequence,
+                  header.firstSequence + batchCount - 1, (int)length);
+    batchCount = 0;
+}
+
+// Ticks until the pending batch reaches its deadline, portMAX_DELAY if empty
+TickType_t BLEManager::nextFlushDelay() {
+    if (batchCount == 0 && deltaEncoder.count() == 0) {
+        return portMAX_DELAY;
+    }
+
+    uint16_t deadline = profiles[profile].batchDeadlineMs;
+    unsigned long age = millis() - batchStartTime;
+    if (age >= deadline) {
+        return 0;
+    }
+    return pdMS_TO_TICKS(deadline - age);
+}
+
+// Switches the streaming encoding; anything pending goes out in the old one
+void BLEManager::setStreamFormat(StreamFormat format) {
+    flushBatch();
+    streamFormat = format;
+}
+
+StreamFormat BLEManager::getStreamFormat() {
+    return streamFormat;
+}
+
+// Queues every stored sample from `fromSequence` up to the newest one
+void BLEManager::startBackfill(uint32_t fromSequence) {
+    uint32_t oldest = historyManager.oldestSequence();
+    uint32_t next = historyManager.nextSequence();
+    if (flashLogManager.isReady() && (int32_t)(flashLogManager.oldestSequence() - oldest) < 0) {
+        oldest = flashLogManager.oldestSequence();
+    }
+
+    // Clamp to what the ring and the flash log still hold (wrap-safe comparison)
+    if ((int32_t)(fromSequence - oldest) < 0) {
+        fromSequence = oldest;
+    }
+    if ((int32_t)(fromSequence - next) > 0) {
+        fromSequence = next;
+    }
+
+    backfillCursor = fromSequence;
+    backfillEnd = next;
+    LOG_I(TAG, "Backfill requested: %u samples from sequence %u",
+                  backfillEnd - backfillCursor, backfillCursor);
+}
+
+bool BLEManager::isBackfilling() {
+    return deviceConnected && backfillCursor != backfillEnd;
+}
+
+void BLEManager::cancelBackfill() {
+    backfillCursor = backfillEnd;
+}
+
+// Sends the next frame of the backlog, filling the whole MTU
+void BLEManager::sendBackfillFrame() {
+    if (!isBackfilling() || !transport) {
+        cancelBackfill();
+        return;
+    }
+
+    size_t payload = min((size_t)(peerMtu - BLE_ATT_HEADER_SIZE), sizeof(backfillBuffer));
+    if (payload < sizeof(BackfillHeader) + sizeof(SensorPacket)) {
+        cancelBackfill();
+        LOG_W(TAG, "Backfill needs a larger MTU, skipped");
+        return;
+    }
+    size_t capacity = min((payload - sizeof(BackfillHeader)) / sizeof(SensorPacket), (size_t)UINT8_MAX);
+
+    BackfillHeader header;
+    header.batch.type = BLE_FRAME_BACKFILL;
+    header.batch.count = 0;
+    header.batch.entrySize = sizeof(SensorPacket);
+    header.batch.flags = 0;
+    header.batch.firstSequence = backfillCursor;
+    header.deviceTime = (uint32_t)(millis() / 1000);
+
+    uint8_t* entry = backfillBuffer + sizeof(BackfillHeader);
+
+    // Samples older than the ring come from the flash log
+    uint32_t ringOldest = historyManager.oldestSequence();
+    if (flashLogManager.isReady() && (int32_t)(backfillCursor - ringOldest) < 0) {
+        SensorPacket* packets = (SensorPacket*)entry;
+        size_t count = flashLogManager.readRange(backfillCursor, packets,
+                                                 min(capacity, (size_t)(ringOldest - backfillCursor)));
+        while (count > 0 && (int32_t)(packets[count - 1].sequence - ringOldest) >= 0) {
+            count--;
+        }
+        if (count > 0) {
+            header.batch.firstSequence = packets[0].sequence;
+            header.batch.count = count;
+            entry += count * sizeof(SensorPacket);
+            backfillCursor = packets[count - 1].sequence + 1;
+        } else {
+            backfillCursor = ringOldest;    // Nothing left on flash before the ring
+        }
+    }
+
+    while (header.batch.count < capacity && backfillCursor != backfillEnd) {
+        SensorPacket packet;
+        if (historyManager.read(backfillCursor, packet)) {
+            if (header.batch.count == 0) {
+                header.batch.firstSequence = backfillCursor;
+            }
+            memcpy(entry, &packet, sizeof(packet));
+            entry += sizeof(packet);
+            header.batch.count++;
+        }
+        backfillCursor++;
+    }
+
+    if (header.batch.count == 0) {
+        return;
+    }
+
+    memcpy(backfillBuffer, &header, sizeof(header));
+    notifyData(backfillBuffer, entry - backfillBuffer);
+
+    LOG_D(TAG, "Sent backfill frame - %d samples from sequence %u, %u remaining",
+                  header.batch.count, header.batch.firstSequence, backfillEnd - backfillCursor);
+}
+
+// Changes the period delta frames imply; the open frame used the old one
+void BLEManager::setSamplePeriod(uint16_t periodMs) {
+    flushBatch();
+    samplePeriodMs = periodMs;
+}
+
+uint16_t BLEManager::getSamplePeriod() {
+    return samplePeriodMs;
+}
+
+bool BLEManager::setBatchSize(uint8_t size) {
+    if (size == 0 || size > BLE_MAX_BATCH_SIZE) {
+        return false;
+    }
+    flushBatch();
+    batchLimit = size;
+    return true;
+}
+
+bool BLEManager::setProfile(BLEProfile next) {
+    if (next >= BLE_PROFILE_COUNT) {
+        return false;
+    }
+    profile = next;
+    applyProfile();
+    return true;
+}
+
+BLEProfile BLEManager::getProfile() {
+    return profile;
+}
+
+// Asks the central for the profile's connection parameters; the phone may
+// settle on different ones, which only changes latency, not correctness
+void BLEManager::applyProfile() {
+    if (!deviceConnected || !transport) {
+        return;
+    }
+    const BLEProfileParams& params = profiles[profile];
+    transport->updateConnParams(params);
+    LOG_I(TAG, "BLE profile %d: interval %u-%u, latency %u", (int)profile,
+                  params.minInterval, params.maxInterval, params.latency);
+}
+
+// Called from the BLE callback, which must not block on a notification, so
+// refusals are queued for the transport task to send
+void BLEManager::submitCommand(const CommandFrame& frame) {
+    CommandStatus status = COMMAND_OK;
+    if (frame.opcode == CMD_NONE || frame.opcode >= CMD_COUNT) {
+        status = COMMAND_UNKNOWN;
+    } else if (!commands.push(frame)) {
+        status = COMMAND_BUSY;
+    }
+
+    if (status != COMMAND_OK) {
+        CommandResponse response = {BLE_FRAME_RESPONSE, frame.opcode, frame.requestId, (uint8_t)status};
+        if (!rejected.push(response)) {
+            LOG_W(TAG, "Response queue full, dropping rejection of command %d", frame.opcode);
+        }
+    }
+    signalEvent(EVT_BLE_COMMAND);
+}
+
+bool BLEManager::nextCommand(CommandFrame& frame) {
+    return commands.pop(frame);
+}
+
+void BLEManager::acknowledge(const CommandFrame& frame, CommandStatus status) {
+    sendResponse(frame.opcode, frame.requestId, status);
+}
+
+void BLEManager::sendRejections() {
+    CommandResponse response;
+    while (rejected.pop(response)) {
+        sendResponse(response.opcode, response.requestId, (CommandStatus)response.status);
+    }
+}
+
+// Stamped as late as possible so the app can take the hold time out of the
+// round trip
+void BLEManager::sendPong(const CommandFrame& frame) {
+    if (!deviceConnected || !transport) {
+        return;
+    }
+    PongFrame pong;
+    pong.type = BLE_FRAME_PONG;
+    pong.requestId = frame.requestId;
+    pong.reserved = 0;
+    pong.token = frame.argument;
+    pong.receivedUs = frame.receivedUs;
+    pong.epochOffsetUs = timeSyncManager.epochOffsetUs();
+    pong.flags = pong.epochOffsetUs != 0 ? PONG_FLAG_EPOCH_SET : 0;
+    pong.sentUs = DiagnosticsManager::now();
+    transport->notify(BLE_CHANNEL_RESPONSE, (const uint8_t*)&pong, sizeof(pong));
+}
+
+// The first summary goes out with the next sample
+void BLEManager::setBroadcast(bool enabled) {
+    if (enabled == broadcasting) {
+        return;
+    }
+    broadcasting = enabled;
+    if (!enabled && transport) {
+        transport->stopBroadcast();
+    }
+    LOG_I(TAG, "Broadcast %s", enabled ? "on" : "off");
+}
+
+bool BLEManager::isBroadcasting() {
+    return broadcasting;
+}
+
+void BLEManager::updateBroadcast(const SensorData& data, AlertLevel alertLevel) {
+    if (!broadcasting || !transport) {
+        return;
+    }
+    SensorPacket packet;
+    encodeSensorPacket(data, alertLevel, packet);
+    size_t length = encodeBroadcast(packet, deviceConnected, broadcastBuffer);
+    uint32_t heapMark = heapMonitor.stackMark();
+    transport->setBroadcastData(broadcastBuffer, length);
+    heapMonitor.stackDone(heapMark);
+}
+
+void BLEManager::sendResponse(uint8_t opcode, uint8_t requestId, CommandStatus status) {
+    if (!deviceConnected || !transport) {
+        return;
+    }
+    CommandResponse response = {BLE_FRAME_RESPONSE, opcode, requestId, (uint8_t)status};
+    transport->notify(BLE_CHANNEL_RESPONSE, (const uint8_t*)&response, sizeof(response));
 }
 
 bool BLEManager::isConnected() {
@@ -108,70 +540,247 @@ bool BLEManager::hasTimedOut() {
 }
 
 void BLEManager::stop() {
-    if (server) {
-        server->getAdvertising()->stop();
-        Serial.println("BLE advertising stopped");
+    if (transport) {
+        transport->stopAdvertising();
+        LOG_I(TAG, "BLE advertising stopped");
     }
 }
 
-// Server callback implementations
-void ServerCallbacks::onConnect(BLEServer* pServer) {
-    if (g_bleManager != nullptr) {
-        g_bleManager->deviceConnected = true;
-        Serial.println("BLE client connected");
-        pServer->getAdvertising()->stop();
-    } else {
-        Serial.println("Error: g_bleManager is null in onConnect");
+bool BLEManager::startBenchmark(uint16_t frameSize, uint16_t framesPerSecond) {
+    size_t payload = min((size_t)(peerMtu - BLE_ATT_HEADER_SIZE), sizeof(benchBuffer));
+    if (frameSize == 0) {
+        frameSize = (uint16_t)payload;
+    }
+    if (!deviceConnected || !transport || frameSize < sizeof(BenchHeader) || frameSize > payload) {
+        return false;
+    }
+
+    // The filler never changes; only the header is rewritten per frame
+    for (size_t i = sizeof(BenchHeader); i < frameSize; i++) {
+        benchBuffer[i] = (uint8_t)i;
+    }
+
+    linkStats.benchFrameSize = frameSize;
+    linkStats.benchRate = framesPerSecond;
+    linkStats.benchBacklogMax = 0;
+    linkStats.benchFrames = 0;
+    linkStats.benchCongested = 0;
+    linkStats.benchElapsedMs = 0;
+    linkStats.benchBytesPerSecond = 0;
+    benchStartMs = millis();
+    benchBackoff = false;
+    linkStats.benchActive = 1;
+
+    LOG_I(TAG, "Link benchmark: %u-byte frames, %u/s", frameSize, framesPerSecond);
+    return true;
+}
+
+void BLEManager::stopBenchmark() {
+    if (!linkStats.benchActive) {
+        return;
+    }
+    linkStats.benchActive = 0;
+    LOG_I(TAG, "Link benchmark: %u frames in %u ms, %u B/s, %u congested",
+          linkStats.benchFrames, linkStats.benchElapsedMs,
+          linkStats.benchBytesPerSecond, linkStats.benchCongested);
+}
+
+bool BLEManager::isBenchmarking() {
+    return linkStats.benchActive && deviceConnected;
+}
+
+// Unpaced runs send whenever the stack takes another frame; paced runs keep
+// to benchStartMs + n / rate, catching up after congestion
+TickType_t BLEManager::nextBenchmarkDelay() {
+    if (!isBenchmarking()) {
+        return portMAX_DELAY;
     }
+    if (benchBackoff) {
+        return 1;
+    }
+    if (linkStats.benchRate == 0) {
+        return 0;
+    }
+    uint32_t due = benchStartMs + (uint32_t)((uint64_t)linkStats.benchFrames * 1000 / linkStats.benchRate);
+    int32_t wait = (int32_t)(due - millis());
+    return wait > 0 ? pdMS_TO_TICKS(wait) : 0;
 }
 
-void ServerCallbacks::onDisconnect(BLEServer* pServer) {
-    if (g_bleManager != nullptr) {
-        g_bleManager->deviceConnected = false;
-        Serial.println("BLE client disconnected");
+void BLEManager::sendBenchmarkFrame() {
+    if (!isBenchmarking()) {
+        stopBenchmark();
+        return;
+    }
+    benchBackoff = false;
+    if (nextBenchmarkDelay() > 0) {
+        return;
+    }
+
+    uint32_t elapsed = millis() - benchStartMs;
+    if (linkStats.benchRate > 0) {
+        uint32_t scheduled = (uint32_t)((uint64_t)elapsed * linkStats.benchRate / 1000);
+        uint32_t behind = scheduled > linkStats.benchFrames ? scheduled - linkStats.benchFrames : 0;
+        linkStats.benchBacklogMax = (uint16_t)min(max(behind, (uint32_t)linkStats.benchBacklogMax),
+                                                  (uint32_t)UINT16_MAX);
+    }
 
-        pServer->startAdvertising();
+    BenchHeader header;
+    header.type = BLE_FRAME_BENCH;
+    header.flags = 0;
+    header.length = linkStats.benchFrameSize;
+    header.sequence = linkStats.benchFrames;
+    header.sentUs = (uint32_t)DiagnosticsManager::now();
+    memcpy(benchBuffer, &header, sizeof(header));
+
+    BLENotifyResult result = notifyData(benchBuffer, linkStats.benchFrameSize);
+    if (result == BLE_NOTIFY_OK) {
+        linkStats.benchFrames++;
     } else {
-        Serial.println("Error: g_bleManager is null in onDisconnect");
+        if (result == BLE_NOTIFY_CONGESTED) {
+            linkStats.benchCongested++;
+        }
+        benchBackoff = true;
+    }
+
+    linkStats.benchElapsedMs = elapsed;
+    if (elapsed > 0) {
+        linkStats.benchBytesPerSecond = (uint32_t)((uint64_t)linkStats.benchFrames *
+                                                   linkStats.benchFrameSize * 1000 / elapsed);
+    }
+}
+
+void BLEManager::noteQueueDepth(uint16_t depth) {
+    linkStats.queueDepth = depth;
+    if (depth > linkStats.queueDepthMax) {
+        linkStats.queueDepthMax = depth;
+    }
+}
+
+bool BLEManager::startCaptureTransfer(uint32_t fromSample) {
+    size_t payload = min((size_t)(peerMtu - BLE_ATT_HEADER_SIZE), sizeof(captureBuffer));
+    if (!deviceConnected || captureManager.getState() != CAPTURE_COMPLETE ||
+        fromSample >= captureManager.size() ||
+        payload < sizeof(CaptureHeader) + sizeof(CaptureSample)) {
+        return false;
+    }
+
+    captureCursor = fromSample;
+    captureSending = true;
+    captureBackoff = false;
+    LOG_I(TAG, "Capture transfer: %u samples from %u",
+          captureManager.size() - fromSample, fromSample);
+    return true;
+}
+
+void BLEManager::stopCaptureTransfer() {
+    captureSending = false;
+    captureBackoff = false;
+}
+
+bool BLEManager::isSendingCapture() {
+    return captureSending && deviceConnected;
+}
+
+TickType_t BLEManager::nextCaptureDelay() {
+    if (!isSendingCapture()) {
+        return portMAX_DELAY;
     }
+    return captureBackoff ? 1 : 0;
 }
 
+// The cursor only moves past samples the stack accepted, so nothing is lost
+// to congestion
+void BLEManager::sendCaptureFrame() {
+    if (!isSendingCapture() || !transport) {
+        stopCaptureTransfer();
+        return;
+    }
 
-// Control characteristic callback implementation
-void ControlCallbacks::onWrite(BLECharacteristic* pCharacteristic) {
-    if (g_bleManager == nullptr) {
-        Serial.println("Error: g_bleManager is null in onWrite");
+    size_t payload = min((size_t)(peerMtu - BLE_ATT_HEADER_SIZE), sizeof(captureBuffer));
+    uint32_t count;
+    size_t length = captureManager.buildFrame(captureCursor, captureBuffer, payload, count);
+    if (length == 0) {
+        stopCaptureTransfer();
+        LOG_I(TAG, "Capture transfer finished at sample %u", captureCursor);
         return;
     }
+
+    // Congestion clears as the stack drains; a refusal does not, so the
+    // transfer stops there and the app resumes it from its next sample
+    BLENotifyResult result = notifyData(captureBuffer, length);
+    if (result == BLE_NOTIFY_FAILED) {
+        stopCaptureTransfer();
+        LOG_W(TAG, "Capture transfer refused at sample %u, stopped", captureCursor);
+        return;
+    }
+    captureBackoff = result == BLE_NOTIFY_CONGESTED;
+    if (!captureBackoff) {
+        captureCursor += count;
+    }
+}
+
+void BLEManager::onConnected() {
+    deviceConnected = true;
+    LOG_I(TAG, "BLE client connected");
+    applyProfile();
+}
+
+// The transfers belong to the transport task, which ends them when it
+// sees EVT_BLE_DISCONNECT; until then their sends fail harmlessly
+void BLEManager::onDisconnected() {
+    deviceConnected = false;
+    peerMtu = BLE_DEFAULT_MTU;
+    signalEvent(EVT_BLE_DISCONNECT);
+    LOG_I(TAG, "BLE client disconnected");
+}
+
+void BLEManager::handleDisconnect() {
+    cancelBackfill();
+    stopBenchmark();
+    benchBackoff = false;
+    stopCaptureTransfer();
+}
+
+void BLEManager::publishLinkStats() {
+    portENTER_CRITICAL(&linkStatsLock);
+    linkSnapshot = linkStats;
+    portEXIT_CRITICAL(&linkStatsLock);
+}
+
+void BLEManager::onMtuChanged(uint16_t mtu) {
+    peerMtu = mtu;
+    LOG_I(TAG, "BLE MTU negotiated: %d", mtu);
+}
+
+// Decodes in place from the stack's buffer; nothing is copied or allocated here
+void BLEManager::onControlWrite(const uint8_t* data, size_t length) {
+    CommandFrame frame;
+    if (!decodeCommandFrame(data, length, frame)) {
+        LOG_W(TAG, "Malformed BLE command (%d bytes)", (int)length);
+        return;
+    }
+    frame.receivedUs = DiagnosticsManager::now();
     
-    std::string value = pCharacteristic->getValue();
-    
-    if (value.length() > 0) {
-        Serial.print("Received BLE command: ");
-        Serial.println(value.c_str());
-        
-        // Parse command
-        int command = atoi(value.c_str());
-        switch (command) {
-            case 1:
-                g_bleManager->pendingCommand = CMD_MUTE_BUZZER;
-                Serial.println("Command: Mute buzzer");
-                break;
-            case 2:
-                g_bleManager->pendingCommand = CMD_FORCE_SLEEP;
-                Serial.println("Command: Force sleep");
-                break;
-            case 3:
-                g_bleManager->pendingCommand = CMD_REQUEST_DATA;
-                Serial.println("Command: Request data");
-                break;
-            case 4:
-                g_bleManager->pendingCommand = CMD_RESET_ALERTS;
-                Serial.println("Command: Reset alerts");
-                break;
-            default:
-                Serial.println("Unknown command");
-                break;
-        }
+    LOG_D(TAG, "Received BLE command %d (id %d, argument %u)",
+                  frame.opcode, frame.requestId, frame.argument);
+    submitCommand(frame);
+}
+
+// Refreshes the diagnostics value just before the stack answers the read
+void BLEManager::onDiagnosticsRead() {
+    size_t length = diagnosticsManager.buildSnapshot(diagBuffer, sizeof(diagBuffer));
+    if (length > 0) {
+        portENTER_CRITICAL(&linkStatsLock);
+        memcpy(diagBuffer + length, &linkSnapshot, sizeof(linkSnapshot));
+        portEXIT_CRITICAL(&linkStatsLock);
+        length += sizeof(linkSnapshot);
+
+        DiagDeadlineStats deadlines;
+        diagnosticsManager.getDeadlineStats(deadlines);
+        deadlines.watchdogRestarts = watchdogManager.getRestarts();
+        deadlines.wedgedTask = watchdogManager.getLastWedgedTask();
+        memcpy(diagBuffer + length, &deadlines, sizeof(deadlines));
+        length += sizeof(deadlines);
     }
-}
\ No newline at end of file
+    transport->setValue(BLE_CHANNEL_DIAG, diagBuffer, length);
+}
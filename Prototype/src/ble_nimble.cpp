@@ -0,0 +1,251 @@
+#if defined(BLE_BACKEND_NIMBLE)
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <soc/soc_caps.h>
+#include "ble_transport.h"
+
+// Transport on NimBLE-Arduino. The NimBLE host needs far less RAM and flash
+// than Bluedroid and starts faster, which every wake from deep sleep pays for.
+class NimBLETransport : public BLETransport,
+                        public NimBLEServerCallbacks,
+                        public NimBLECharacteristicCallbacks {
+private:
+    NimBLEServer* server;
+    NimBLECharacteristic* characteristics[BLE_CHANNEL_DIAG + 1];
+    NimBLECharacteristic* controlCharacteristic;
+    BLETransportListener* listener;
+    uint16_t connHandle;
+    bool connected;
+    BLENotifyResult lastResult;         // Set by onStatus() during notify()
+    volatile bool broadcasting;         // Advertising carries a sensor summary
+    NimBLEAdvertisementData defaultAdvData;
+
+public:
+    NimBLETransport();
+    bool begin(BLETransportListener* eventListener);
+    BLENotifyResult notify(BLEChannel channel, const uint8_t* data, size_t length);
+    void setValue(BLEChannel channel, const uint8_t* data, size_t length);
+    void updateConnParams(const BLEProfileParams& params);
+    void stopAdvertising();
+    void setBroadcastData(const uint8_t* data, size_t length);
+    void stopBroadcast();
+    const char* name() const { return "NimBLE"; }
+
+    // NimBLEServerCallbacks
+    void onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc);
+    void onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc);
+    void onMTUChange(uint16_t mtu, ble_gap_conn_desc* desc);
+
+    // NimBLECharacteristicCallbacks, shared by all characteristics
+    void onWrite(NimBLECharacteristic* pCharacteristic);
+    void onRead(NimBLECharacteristic* pCharacteristic);
+    void onStatus(NimBLECharacteristic* pCharacteristic, Status s, int code);
+};
+
+static NimBLETransport transport;
+
+BLETransport& bleTransport() {
+    return transport;
+}
+
+NimBLETransport::NimBLETransport() {
+    server = nullptr;
+    for (int i = 0; i <= BLE_CHANNEL_DIAG; i++) {
+        characteristics[i] = nullptr;
+    }
+    controlCharacteristic = nullptr;
+    listener = nullptr;
+    connHandle = 0;
+    connected = false;
+    lastResult = BLE_NOTIFY_OK;
+    broadcasting = false;
+}
+
+bool NimBLETransport::begin(BLETransportListener* eventListener) {
+    listener = eventListener;
+
+    NimBLEDevice::init(BLE_DEVICE_NAME);
+
+    // Accept a larger MTU when the phone requests one so batches fit
+    NimBLEDevice::setMTU(BLE_PREFERRED_MTU);
+
+    // Advertising restarts by itself after a disconnect
+    server = NimBLEDevice::createServer();
+    server->setCallbacks(this, false);
+
+    NimBLEService* service = server->createService(BLE_SERVICE_UUID);
+
+    // NimBLE adds the CCCD (0x2902) to notify characteristics itself
+    characteristics[BLE_CHANNEL_DATA] = service->createCharacteristic(
+        BLE_CHAR_DATA_UUID,
+        NIMBLE_PROPERTY::READ |
+        NIMBLE_PROPERTY::NOTIFY
+    );
+    characteristics[BLE_CHANNEL_DATA]->setCallbacks(this);
+
+    controlCharacteristic = service->createCharacteristic(
+        BLE_CHAR_CONTROL_UUID,
+        NIMBLE_PROPERTY::WRITE
+    );
+    controlCharacteristic->setCallbacks(this);
+
+    // Command acknowledgements
+    characteristics[BLE_CHANNEL_RESPONSE] = service->createCharacteristic(
+        BLE_CHAR_RESPONSE_UUID,
+        NIMBLE_PROPERTY::NOTIFY
+    );
+    characteristics[BLE_CHANNEL_RESPONSE]->setCallbacks(this);
+
+    // Timing, heap and stack counters, refreshed on every read
+    NimBLECharacteristic* diag = service->createCharacteristic(
+        BLE_CHAR_DIAG_UUID,
+        NIMBLE_PROPERTY::READ
+    );
+    diag->setCallbacks(this);
+    characteristics[BLE_CHANNEL_DIAG] = diag;
+
+    if (!service->start()) {
+        return false;
+    }
+
+    // The name goes in the scan response so the advertisement itself has
+    // room for either the service UUID or a broadcast summary
+    NimBLEAdvertisementData scanResponse;
+    scanResponse.setName(BLE_DEVICE_NAME);
+    defaultAdvData.setFlags(BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP);
+    defaultAdvData.setCompleteServices(NimBLEUUID(BLE_SERVICE_UUID));
+
+    NimBLEAdvertising* advertising = NimBLEDevice::getAdvertising();
+    advertising->setScanResponseData(scanResponse);
+    advertising->setAdvertisementData(defaultAdvData);
+    advertising->setScanResponse(true);
+    return advertising->start();
+}
+
+// Sends from the caller's buffer into an mbuf from NimBLE's static pool;
+// notify() without arguments would copy the frame into the characteristic's
+// value first. NimBLE reports each outcome through onStatus() before
+// notify() returns.
+BLENotifyResult NimBLETransport::notify(BLEChannel channel, const uint8_t* data, size_t length) {
+    NimBLECharacteristic* characteristic = characteristics[channel];
+    if (characteristic == nullptr || !connected) {
+        return BLE_NOTIFY_FAILED;
+    }
+    lastResult = BLE_NOTIFY_OK;
+    characteristic->notify(data, length);
+    return lastResult;
+}
+
+void NimBLETransport::setValue(BLEChannel channel, const uint8_t* data, size_t length) {
+    if (characteristics[channel] != nullptr) {
+        characteristics[channel]->setValue(data, length);
+    }
+}
+
+void NimBLETransport::updateConnParams(const BLEProfileParams& params) {
+    if (!connected || !server) {
+        return;
+    }
+    server->updateConnParams(connHandle, params.minInterval, params.maxInterval,
+                             params.latency, params.timeout);
+}
+
+void NimBLETransport::stopAdvertising() {
+    NimBLEDevice::getAdvertising()->stop();
+}
+
+// Replaces the advertising payload in place; the controller picks it up
+// from the next advertising event without a restart. While connected the
+// summary goes out in non-connectable advertisements.
+void NimBLETransport::setBroadcastData(const uint8_t* data, size_t length) {
+    if (!broadcasting) {
+        broadcasting = true;
+        if (connected) {
+            NimBLEAdvertising* advertising = NimBLEDevice::getAdvertising();
+            advertising->setAdvertisementType(BLE_GAP_CONN_MODE_NON);
+            advertising->start();
+        }
+    }
+    ble_gap_adv_set_data(data, length);
+}
+
+void NimBLETransport::stopBroadcast() {
+    broadcasting = false;
+    NimBLEAdvertising* advertising = NimBLEDevice::getAdvertising();
+    advertising->setAdvertisementData(defaultAdvData);
+    if (connected) {
+        advertising->stop();
+        advertising->setAdvertisementType(BLE_GAP_CONN_MODE_UND);
+    }
+}
+
+void NimBLETransport::onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+    connHandle = desc->conn_handle;
+    connected = true;
+
+#if SOC_BLE_50_SUPPORTED
+    // Half the airtime per packet where both ends support it
+    ble_gap_set_prefered_le_phy(connHandle,
+                                BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK,
+                                BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK,
+                                BLE_GAP_LE_PHY_CODED_ANY);
+#endif
+
+    // Connectable advertising ends with the connection
+    if (broadcasting) {
+        NimBLEAdvertising* advertising = NimBLEDevice::getAdvertising();
+        advertising->setAdvertisementType(BLE_GAP_CONN_MODE_NON);
+        advertising->start();
+    }
+
+    listener->onConnected();
+}
+
+// The server restarts advertising after this returns, so the broadcast is
+// stopped and made connectable again first
+void NimBLETransport::onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+    connected = false;
+    if (broadcasting) {
+        NimBLEAdvertising* advertising = NimBLEDevice::getAdvertising();
+        advertising->stop();
+        advertising->setAdvertisementType(BLE_GAP_CONN_MODE_UND);
+    }
+    listener->onDisconnected();
+}
+
+void NimBLETransport::onMTUChange(uint16_t mtu, ble_gap_conn_desc* desc) {
+    listener->onMtuChanged(mtu);
+}
+
+// Control writes fit the default ATT payload
+struct ControlWrite {
+    uint8_t bytes[BLE_DEFAULT_MTU - BLE_ATT_HEADER_SIZE];
+};
+
+// getValue() would duplicate the value on the heap; the typed overload
+// copies into this stack buffer instead. The value buffer is allocated
+// with at least this many bytes, so a short write is never overread.
+void NimBLETransport::onWrite(NimBLECharacteristic* pCharacteristic) {
+    if (pCharacteristic == controlCharacteristic) {
+        size_t length = min(pCharacteristic->getDataLength(), sizeof(ControlWrite));
+        ControlWrite value = pCharacteristic->getValue<ControlWrite>(nullptr, true);
+        listener->onControlWrite(value.bytes, length);
+    }
+}
+
+void NimBLETransport::onRead(NimBLECharacteristic* pCharacteristic) {
+    if (pCharacteristic == characteristics[BLE_CHANNEL_DIAG]) {
+        listener->onDiagnosticsRead();
+    }
+}
+
+// Out of mbufs means the controller has not sent the earlier notifications yet
+void NimBLETransport::onStatus(NimBLECharacteristic* pCharacteristic, Status s, int code) {
+    if (s == SUCCESS_NOTIFY || s == SUCCESS_INDICATE) {
+        return;
+    }
+    lastResult = (code == BLE_HS_ENOMEM || code == BLE_HS_EBUSY) ? BLE_NOTIFY_CONGESTED : BLE_NOTIFY_FAILED;
+}
+
+#endif // BLE_BACKEND_NIMBLE
@@ -0,0 +1,128 @@
+#include "breath_detector.h"
+
+BreathDetector::BreathDetector(uint16_t samplePeriodMs) {
+    periodMs = samplePeriodMs;
+    reset();
+}
+
+void BreathDetector::reset() {
+    sampleIndex = 0;
+    primed = false;
+    baselineQ8 = 0;
+    smoothQ4[0] = 0;
+    smoothQ4[1] = 0;
+    envelopeQ4 = 0;
+    filteredValue = 0;
+    phase = PHASE_RISING;
+    extremeValue = 0;
+    extremeIndex = 0;
+    lastPeakIndex = 0;
+    lastTroughIndex = 0;
+    havePeak = false;
+    haveTrough = false;
+    pendingExhaleMs = 0;
+    current.breathsPerMinuteX10 = 0;
+    current.inhaleMs = 0;
+    current.exhaleMs = 0;
+    current.breathCount = 0;
+}
+
+bool BreathDetector::process(int32_t pressure) {
+    if (!primed) {
+        baselineQ8 = pressure << 8;
+        primed = true;
+    }
+
+    // Band-pass: subtract the slow baseline, then two low-pass stages
+    baselineQ8 += ((pressure << 8) - baselineQ8) >> RESP_BASELINE_SHIFT;
+    int32_t highPassed = pressure - (baselineQ8 >> 8);
+    smoothQ4[0] += ((highPassed << 4) - smoothQ4[0]) >> RESP_SMOOTH_SHIFT;
+    smoothQ4[1] += (smoothQ4[0] - smoothQ4[1]) >> RESP_SMOOTH_SHIFT;
+    int32_t value = smoothQ4[1] >> 4;
+    filteredValue = value;
+
+    // Hysteresis follows the breathing amplitude so shallow and deep
+    // breathing are both detected without reacting to sensor noise
+    int32_t magnitude = value < 0 ? -value : value;
+    envelopeQ4 += ((magnitude << 4) - envelopeQ4) >> RESP_ENVELOPE_SHIFT;
+    int32_t hysteresis = envelopeQ4 >> 5;
+    if (hysteresis < RESP_MIN_AMPLITUDE) {
+        hysteresis = RESP_MIN_AMPLITUDE;
+    }
+
+    bool completed = false;
+    if (phase == PHASE_RISING) {
+        if (value > extremeValue) {
+            extremeValue = value;
+            extremeIndex = sampleIndex;
+        } else if (value < extremeValue - hysteresis) {
+            onPeak(extremeIndex);
+            phase = PHASE_FALLING;
+            extremeValue = value;
+            extremeIndex = sampleIndex;
+        }
+    } else {
+        if (value < extremeValue) {
+            extremeValue = value;
+            extremeIndex = sampleIndex;
+        } else if (value > extremeValue + hysteresis) {
+            completed = onTrough(extremeIndex);
+            phase = PHASE_RISING;
+            extremeValue = value;
+            extremeIndex = sampleIndex;
+        }
+    }
+
+    // No breath for too long: the rate is no longer meaningful
+    if (haveTrough && (sampleIndex - lastTroughIndex) * periodMs > RESP_MAX_BREATH_MS) {
+        current.breathsPerMinuteX10 = 0;
+        haveTrough = false;
+        havePeak = false;
+    }
+
+    sampleIndex++;
+    return completed;
+}
+
+// End of an exhale: pressure stopped rising
+void BreathDetector::onPeak(uint32_t index) {
+    if (haveTrough) {
+        pendingExhaleMs = (uint16_t)((index - lastTroughIndex) * periodMs);
+    }
+    lastPeakIndex = index;
+    havePeak = true;
+}
+
+// End of an inhale and of a full breath cycle: pressure stopped falling
+bool BreathDetector::onTrough(uint32_t index) {
+    if (!haveTrough) {
+        lastTroughIndex = index;
+        haveTrough = true;
+        return false;
+    }
+
+    uint32_t breathMs = (index - lastTroughIndex) * periodMs;
+    if (breathMs < RESP_MIN_BREATH_MS) {
+        // Ripple within one breath; keep measuring from the earlier trough
+        return false;
+    }
+
+    lastTroughIndex = index;
+    if (breathMs > RESP_MAX_BREATH_MS) {
+        return false;
+    }
+
+    uint16_t rate = (uint16_t)(600000UL / breathMs);
+    if (current.breathsPerMinuteX10 == 0) {
+        current.breathsPerMinuteX10 = rate;
+    } else {
+        current.breathsPerMinuteX10 = (uint16_t)((3 * current.breathsPerMinuteX10 + rate) / 4);
+    }
+
+    if (havePeak) {
+        current.inhaleMs = (uint16_t)((index - lastPeakIndex) * periodMs);
+    }
+    current.exhaleMs = pendingExhaleMs;
+    current.breathCount++;
+    return true;
+}
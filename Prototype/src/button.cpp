@@ -1,50 +1,183 @@
 #include "button.h"
+#include "events.h"
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
 
 ButtonManager buttonManager;
 
-volatile bool ButtonManager::wasPressed_flag = false;
-volatile bool ButtonManager::wasHeld_flag = false;
-volatile unsigned long ButtonManager::buttonPressTime = 0;
-volatile unsigned long ButtonManager::lastInterruptTime = 0;
+SpscQueue<ButtonEdge, BUTTON_EDGE_QUEUE_LENGTH> ButtonManager::edges;
+volatile bool ButtonManager::armedForPress = true;
+volatile bool ButtonManager::overflowed = false;
+
+static inline uint32_t nowMs() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+ButtonManager::ButtonManager() {
+    state = GESTURE_IDLE;
+    stablePressed = false;
+    rawPressed = false;
+    rawPending = false;
+    rawChangeTime = 0;
+    pressTime = 0;
+    releaseTime = 0;
+}
 
 bool ButtonManager::begin() {
     pinMode(BUTTON_PIN, INPUT);
-    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonISR, RISING);
+
+    // A press that woke us from deep sleep is not a gesture
+    stablePressed = rawPressed = digitalRead(BUTTON_PIN) == HIGH;
+    state = stablePressed ? GESTURE_IGNORE : GESTURE_IDLE;
+    armedForPress = !stablePressed;
+
+    // Both edges are caught with level interrupts that flip polarity each time
+    // they fire, which also lets the button wake the chip from light sleep
+    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonISR, armedForPress ? ONHIGH : ONLOW);
     return true;
 }
 
-void ButtonManager::update() {
-    if (buttonPressTime > 0 && !wasHeld_flag) {
-        if (digitalRead(BUTTON_PIN) == HIGH && 
-            (esp_timer_get_time() / 1000 - buttonPressTime) >= BUTTON_HOLD_TIME_MS) {
-            wasHeld_flag = true;
+void ButtonManager::enableWakeup() {
+    gpio_wakeup_enable((gpio_num_t)BUTTON_PIN,
+                       armedForPress ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+}
+
+void IRAM_ATTR ButtonManager::buttonISR() {
+    ButtonEdge edge = {nowMs(), armedForPress};
+    if (!edges.push(edge)) {
+        overflowed = true;
+    }
+
+    // Wait for the opposite level; the wake level follows the interrupt type
+    armedForPress = !armedForPress;
+    gpio_ll_set_intr_type(&GPIO, (gpio_num_t)BUTTON_PIN,
+                          armedForPress ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+
+    if (uiTaskHandle != nullptr) {
+        BaseType_t higherPriorityWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(uiTaskHandle, &higherPriorityWoken);
+        portYIELD_FROM_ISR(higherPriorityWoken);
+    }
+}
+
+// Consumes queued edges and expired deadlines; call from the UI task
+uint8_t ButtonManager::update() {
+    uint8_t events = 0;
+
+    ButtonEdge edge;
+    while (edges.pop(edge)) {
+        // A level that held until this edge may have outlasted the debounce
+        events |= settle(edge.timeMs);
+        rawPressed = edge.pressed;
+        rawChangeTime = edge.timeMs;
+        rawPending = true;
+    }
+
+    uint32_t now = nowMs();
+    if (overflowed) {
+        // Edges were lost to bouncing; resynchronise from the pin
+        overflowed = false;
+        rawPressed = digitalRead(BUTTON_PIN) == HIGH;
+        rawChangeTime = now;
+        rawPending = true;
+    }
+
+    return events | settle(now);
+}
+
+// Commits the raw level once it has been stable for BUTTON_DEBOUNCE_MS
+uint8_t ButtonManager::settle(uint32_t now) {
+    uint8_t events = 0;
+    if (rawPending && now - rawChangeTime >= BUTTON_DEBOUNCE_MS) {
+        rawPending = false;
+        if (rawPressed != stablePressed) {
+            events |= checkDeadlines(rawChangeTime);
+            stablePressed = rawPressed;
+            events |= transition(stablePressed, rawChangeTime);
         }
     }
+    return events | checkDeadlines(now);
 }
 
-bool ButtonManager::wasPressed() {
-    if (wasPressed_flag) {
-        wasPressed_flag = false;
-        return true;
+uint8_t ButtonManager::transition(bool pressed, uint32_t time) {
+    switch (state) {
+        case GESTURE_IDLE:
+            if (pressed) {
+                state = GESTURE_PRESSED;
+                pressTime = time;
+            }
+            break;
+        case GESTURE_PRESSED:
+            if (!pressed) {
+                state = GESTURE_RELEASED;
+                releaseTime = time;
+            }
+            break;
+        case GESTURE_RELEASED:
+            if (pressed) {
+                state = GESTURE_SECOND_PRESSED;
+                pressTime = time;
+            }
+            break;
+        case GESTURE_SECOND_PRESSED:
+            if (!pressed) {
+                state = GESTURE_IDLE;
+                return BUTTON_EVENT_DOUBLE_PRESS;
+            }
+            break;
+        case GESTURE_HELD:
+        case GESTURE_IGNORE:
+            if (!pressed) {
+                state = GESTURE_IDLE;
+            }
+            break;
     }
-    return false;
+    return 0;
 }
 
-bool ButtonManager::wasHeld() {
-    if (wasHeld_flag) {
-        wasHeld_flag = false;
-        return true;
+uint8_t ButtonManager::checkDeadlines(uint32_t time) {
+    switch (state) {
+        case GESTURE_PRESSED:
+        case GESTURE_SECOND_PRESSED:
+            if (time - pressTime >= BUTTON_HOLD_TIME_MS) {
+                state = GESTURE_HELD;
+                return BUTTON_EVENT_HOLD;
+            }
+            break;
+        case GESTURE_RELEASED:
+            if (time - releaseTime >= BUTTON_DOUBLE_PRESS_MS) {
+                state = GESTURE_IDLE;
+                return BUTTON_EVENT_PRESS;
+            }
+            break;
+        default:
+            break;
     }
-    return false;
+    return 0;
 }
 
-void IRAM_ATTR ButtonManager::buttonISR() {
-    unsigned long currentTime = esp_timer_get_time() / 1000;
-    
-    if (currentTime - lastInterruptTime > BUTTON_DEBOUNCE_MS) {
-        Serial.println("Button pressed interrupt");
-        wasPressed_flag = true;
-        buttonPressTime = currentTime;
-        lastInterruptTime = currentTime;
+// Ticks until the next debounce or gesture deadline, portMAX_DELAY while idle
+TickType_t ButtonManager::nextUpdateDelay() {
+    if (!edges.empty() || overflowed) {
+        return 0;
+    }
+
+    uint32_t now = nowMs();
+    uint32_t wait = UINT32_MAX;
+    if (rawPending) {
+        uint32_t elapsed = now - rawChangeTime;
+        wait = elapsed >= BUTTON_DEBOUNCE_MS ? 0 : BUTTON_DEBOUNCE_MS - elapsed;
     }
+
+    uint32_t deadline = UINT32_MAX;
+    if (state == GESTURE_PRESSED || state == GESTURE_SECOND_PRESSED) {
+        uint32_t elapsed = now - pressTime;
+        deadline = elapsed >= BUTTON_HOLD_TIME_MS ? 0 : BUTTON_HOLD_TIME_MS - elapsed;
+    } else if (state == GESTURE_RELEASED) {
+        uint32_t elapsed = now - releaseTime;
+        deadline = elapsed >= BUTTON_DOUBLE_PRESS_MS ? 0 : BUTTON_DOUBLE_PRESS_MS - elapsed;
+    }
+
+    wait = min(wait, deadline);
+    return wait == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(wait);
 }
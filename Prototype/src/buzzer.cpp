@@ -1,111 +1,236 @@
 #include "buzzer.h"
+#include "log.h"
+
+static const char TAG[] = "buzzer";
 
 BuzzerManager buzzerManager;
 
-bool BuzzerManager::begin() {
-    ledcSetup(0, 1000, 8); // Channel 0, 1000 Hz, 8-bit resolution
-    ledcAttachPin(BUZZER_PIN, 0);
-    ledcWrite(0, 0);
+#define BUZZER_CHANNEL      0
+
+// Arduino-ESP32 3.x addresses LEDC by pin and picks the channel itself
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+#define BUZZER_LEDC         BUZZER_PIN
+#else
+#define BUZZER_LEDC         BUZZER_CHANNEL
+#endif
+#define BUZZER_RESOLUTION   8
+#define BUZZER_HALF_DUTY    128
+
+// Pattern tables: step lists per sound, stepped through by the timer
+static const BuzzerStep welcomeSteps[] = {
+    {800, BUZZER_HALF_DUTY, 150},       // Low tone
+    {1200, BUZZER_HALF_DUTY, 150},      // Mid tone
+    {1600, BUZZER_HALF_DUTY, 200},      // High tone
+};
+
+static const BuzzerStep lowSteps[] = {
+    {800, BUZZER_HALF_DUTY, 500},
+    {0, 0, 500},
+};
+
+static const BuzzerStep mediumSteps[] = {
+    {1200, BUZZER_HALF_DUTY, 250},
+    {0, 0, 250},
+    {1200, BUZZER_HALF_DUTY, 250},
+    {0, 0, 750},
+};
+
+static const BuzzerStep highSteps[] = {
+    {1800, BUZZER_HALF_DUTY, 150},
+    {0, 0, 100},
+    {1800, BUZZER_HALF_DUTY, 150},
+    {0, 0, 100},
+    {1800, BUZZER_HALF_DUTY, 150},
+    {0, 0, 350},
+};
+
+static const BuzzerStep criticalSteps[] = {
+    {2500, BUZZER_HALF_DUTY, 200},
+    {2000, BUZZER_HALF_DUTY, 200},
+};
+
+#define PATTERN(steps, repeats) {steps, sizeof(steps) / sizeof(steps[0]), repeats}
+
+static const BuzzerPattern welcomePattern = PATTERN(welcomeSteps, 1);
+
+// Indexed by AlertLevel; critical keeps sounding until acknowledged
+static const BuzzerPattern alertPatterns[] = {
+    {nullptr, 0, 0},                    // ALERT_NONE
+    PATTERN(lowSteps, 5),               // ALERT_LOW
+    PATTERN(mediumSteps, 3),            // ALERT_MEDIUM
+    PATTERN(highSteps, 5),              // ALERT_HIGH
+    PATTERN(criticalSteps, 0),          // ALERT_CRITICAL
+};
+
+static_assert(sizeof(alertPatterns) / sizeof(alertPatterns[0]) == ALERT_CRITICAL + 1,
+              "alertPatterns must cover every AlertLevel");
+
+BuzzerManager::BuzzerManager() {
+    isMuted = false;
+    currentAlert = ALERT_NONE;
+    pattern = nullptr;
+    stepIndex = 0;
+    repeatCount = 0;
+    currentFrequency = 0;
+    timer = nullptr;
+    lock = nullptr;
+#ifdef CONFIG_PM_ENABLE
+    pmLock = nullptr;
+    pmLockHeld = false;
+#endif
+}
+
+bool BuzzerManager::begin(bool warmBoot) {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    ledcAttach(BUZZER_PIN, 1000, BUZZER_RESOLUTION);    // 1000 Hz, 8-bit resolution
+#else
+    ledcSetup(BUZZER_CHANNEL, 1000, BUZZER_RESOLUTION); // 1000 Hz, 8-bit resolution
+    ledcAttachPin(BUZZER_PIN, BUZZER_CHANNEL);
+#endif
+    ledcWrite(BUZZER_LEDC, 0);
+    currentFrequency = 1000;
+
+    lock = xSemaphoreCreateMutex();
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = timerCallback;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "buzzer";
+    if (lock == nullptr || esp_timer_create(&timerArgs, &timer) != ESP_OK) {
+        LOG_E(TAG, "Failed to create buzzer timer!");
+        return false;
+    }
+
+#ifdef CONFIG_PM_ENABLE
+    // LEDC runs from the APB clock, which automatic light sleep gates and
+    // frequency scaling slows down. The APB lock also rules out light sleep.
+    if (esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "buzzer", &pmLock) != ESP_OK) {
+        LOG_E(TAG, "Failed to create buzzer PM lock!");
+        return false;
+    }
+#endif
     
-    playWelcomeSound();    
-    Serial.println("Buzzer initialized");
+    // Skipped on a button wake
+    if (!warmBoot) {
+        playWelcomeSound();
+    }
+    LOG_I(TAG, "Buzzer initialized");
     return true;
 }
 
+// Returns immediately; the jingle plays from the timer
 void BuzzerManager::playWelcomeSound() {
-    // Low tone
-    ledcSetup(0, 800, 8);
-    ledcWrite(0, 128);
-    delay(150);
-    
-    // Mid tone
-    ledcSetup(0, 1200, 8);
-    delay(150);
-    
-    // High tone
-    ledcSetup(0, 1600, 8);
-    delay(200);
-
-    ledcSetup(0, 1000, 8); // Reset to default 1000 Hz
-    
-    // Turn off
-    ledcWrite(0, 0);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    play(&welcomePattern);
+    xSemaphoreGive(lock);
 }
 
 void BuzzerManager::startAlert(AlertLevel level) {
-    if (isMuted || level == ALERT_NONE) {
+    if (isMuted || level <= ALERT_NONE || level > ALERT_CRITICAL) {
         return;
     }
 
+    xSemaphoreTake(lock, portMAX_DELAY);
     currentAlert = level;
-    currentRepeat = 0;
-    lastToggleTime = millis();
-
-    // Configure buzzer pattern
-    switch (level) {
-        case ALERT_LOW:
-            ledcSetup(0, 800, 8);
-            break;
-        case ALERT_MEDIUM:
-            ledcSetup(0, 1200, 8);
-            break;
-        case ALERT_HIGH:
-            ledcSetup(0, 1800, 8);
-            break;
-        case ALERT_CRITICAL:
-            ledcSetup(0, 2500, 8);
-            break;
-        default:
-            ledcWrite(0, 0);
-            return;
-    }
-
-    ledcWrite(0, 128); // Start buzzer with 50% duty cycle
-    Serial.printf("Started buzzer alert level %d\n", (int)level);
+    play(&alertPatterns[level]);
+    xSemaphoreGive(lock);
+    LOG_D(TAG, "Started buzzer alert level %d", (int)level);
 }
 
 void BuzzerManager::stopAlert() {
+    xSemaphoreTake(lock, portMAX_DELAY);
     currentAlert = ALERT_NONE;
-    currentRepeat = 0;
-    ledcWrite(0, 0); // Turn off buzzer
-    Serial.println("Stopped buzzer alert");
+    silence();
+    xSemaphoreGive(lock);
+    LOG_D(TAG, "Stopped buzzer alert");
 }
 
 void BuzzerManager::mute() {
+    xSemaphoreTake(lock, portMAX_DELAY);
     isMuted = true;
-    ledcWrite(0, 0); // Turn off buzzer
-    Serial.println("Buzzer muted");
+    silence();
+    xSemaphoreGive(lock);
+    LOG_I(TAG, "Buzzer muted");
 }
 
 void BuzzerManager::unmute() {
     isMuted = false;
-    Serial.println("Buzzer unmuted");
+    LOG_I(TAG, "Buzzer unmuted");
 }
 
-void BuzzerManager::update() {
-    if (currentAlert == ALERT_NONE || isMuted) {
-        return;
-    }
+bool BuzzerManager::isBuzzerActive() {
+    return (currentAlert != ALERT_NONE && !isMuted);
+}
 
-    unsigned long currentTime = millis();
+void BuzzerManager::timerCallback(void* arg) {
+    BuzzerManager* self = (BuzzerManager*)arg;
+    xSemaphoreTake(self->lock, portMAX_DELAY);
+    self->advance();
+    xSemaphoreGive(self->lock);
+}
 
-    if (currentTime - lastToggleTime >= 500) {
-        lastToggleTime = currentTime;
-        currentRepeat++;
+// Callers hold the lock. The clocks stay up until silence(), so the tone
+// keeps sounding while the CPU idles between steps.
+void BuzzerManager::play(const BuzzerPattern* next) {
+    esp_timer_stop(timer);
+#ifdef CONFIG_PM_ENABLE
+    if (!pmLockHeld) {
+        esp_pm_lock_acquire(pmLock);
+        pmLockHeld = true;
+    }
+#endif
+    pattern = next;
+    stepIndex = 0;
+    repeatCount = 0;
+    applyStep(pattern->steps[0]);
+}
+
+void BuzzerManager::advance() {
+    // A stop can race with a timer that already fired
+    if (pattern == nullptr) {
+        return;
+    }
 
-        if (currentRepeat % 2 == 0) {
-            ledcWrite(0, 128); // Turn buzzer on
-        } else {
-            ledcWrite(0, 0); // Turn buzzer off
+    if (++stepIndex >= pattern->stepCount) {
+        stepIndex = 0;
+        if (pattern->repeats != 0 && ++repeatCount >= pattern->repeats) {
+            if (pattern != &welcomePattern) {
+                currentAlert = ALERT_NONE;
+            }
+            silence();
+            return;
         }
+    }
+    applyStep(pattern->steps[stepIndex]);
+}
 
-        // Stop after a fixed number of repeats
-        if (currentRepeat >= 10) {
-            stopAlert();
+void BuzzerManager::applyStep(const BuzzerStep& step) {
+    if (step.frequencyHz == 0 || step.duty == 0) {
+        ledcWrite(BUZZER_LEDC, 0);
+    } else {
+        if (step.frequencyHz != currentFrequency) {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+            ledcChangeFrequency(BUZZER_PIN, step.frequencyHz, BUZZER_RESOLUTION);
+#else
+            ledcSetup(BUZZER_CHANNEL, step.frequencyHz, BUZZER_RESOLUTION);
+#endif
+            currentFrequency = step.frequencyHz;
         }
+        ledcWrite(BUZZER_LEDC, step.duty);
     }
+    esp_timer_start_once(timer, step.durationMs * 1000ULL);
 }
 
-bool BuzzerManager::isBuzzerActive() {
-    return (currentAlert != ALERT_NONE && !isMuted);
-}
\ No newline at end of file
+void BuzzerManager::silence() {
+    pattern = nullptr;
+    if (timer != nullptr) {
+        esp_timer_stop(timer);
+    }
+    ledcWrite(BUZZER_LEDC, 0);
+#ifdef CONFIG_PM_ENABLE
+    if (pmLockHeld) {
+        esp_pm_lock_release(pmLock);
+        pmLockHeld = false;
+    }
+#endif
+}
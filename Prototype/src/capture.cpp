@@ -0,0 +1,121 @@
+#include "capture.h"
+#include "log.h"
+
+static const char TAG[] = "capture";
+
+CaptureManager captureManager;
+
+// Used when the board has no PSRAM
+static CaptureSample ramSamples[CAPTURE_RAM_SAMPLES];
+
+CaptureManager::CaptureManager() : recorded(0), state(CAPTURE_IDLE), stopRequested(false),
+                                   latestCo2(0) {
+    samples = ramSamples;
+    capacity = CAPTURE_RAM_SAMPLES;
+    target = 0;
+    missing = 0;
+    captureId = 0;
+}
+
+// The buffer is claimed once here so a capture never allocates
+bool CaptureManager::begin() {
+    if (psramFound()) {
+        CaptureSample* buffer = (CaptureSample*)ps_malloc(CAPTURE_PSRAM_SAMPLES * sizeof(CaptureSample));
+        if (buffer != nullptr) {
+            samples = buffer;
+            capacity = CAPTURE_PSRAM_SAMPLES;
+        }
+    }
+
+    LOG_I(TAG, "Capture buffer: %u samples (%u s) in %s", capacity,
+          capacity * RESPIRATION_PERIOD_MS / 1000, samples == ramSamples ? "RAM" : "PSRAM");
+    return true;
+}
+
+bool CaptureManager::start(uint32_t durationMs) {
+    if (state.load() == CAPTURE_RUNNING) {
+        return false;
+    }
+
+    uint32_t periods = durationMs / RESPIRATION_PERIOD_MS;
+    target = (periods == 0 || periods > capacity) ? capacity : periods;
+    missing = 0;
+    captureId++;
+    recorded.store(0);
+    stopRequested.store(false);
+    state.store(CAPTURE_RUNNING);
+
+    LOG_I(TAG, "Capture %u started: %u samples", captureId, target);
+    return true;
+}
+
+// The respiration task freezes the buffer on its next period, so the
+// transfer never sees a sample being written
+void CaptureManager::stop() {
+    if (state.load() == CAPTURE_RUNNING) {
+        stopRequested.store(true);
+    }
+}
+
+void CaptureManager::append(int32_t pressureX16) {
+    if (state.load(std::memory_order_acquire) != CAPTURE_RUNNING) {
+        return;
+    }
+
+    uint32_t n = recorded.load(std::memory_order_relaxed);
+    if (!stopRequested.load(std::memory_order_relaxed) && n < target) {
+        samples[n].pressureX16 = pressureX16;
+        samples[n].co2 = latestCo2.load(std::memory_order_relaxed);
+        if (pressureX16 == CAPTURE_SAMPLE_MISSING) {
+            missing++;
+        }
+        recorded.store(++n, std::memory_order_release);
+    }
+
+    if (n >= target || stopRequested.load(std::memory_order_relaxed)) {
+        state.store(CAPTURE_COMPLETE, std::memory_order_release);
+        LOG_I(TAG, "Capture %u complete: %u samples, %u missing", captureId, n, missing);
+    }
+}
+
+void CaptureManager::record(int32_t pressureX16) {
+    // A real reading can never be the marker value; keep it in range
+    append(pressureX16 == CAPTURE_SAMPLE_MISSING ? pressureX16 + 1 : pressureX16);
+}
+
+void CaptureManager::recordMissing(uint32_t periods) {
+    while (periods-- > 0 && state.load(std::memory_order_acquire) == CAPTURE_RUNNING) {
+        append(CAPTURE_SAMPLE_MISSING);
+    }
+}
+
+size_t CaptureManager::buildFrame(uint32_t offset, uint8_t* buffer, size_t size, uint32_t& count) {
+    count = 0;
+    if (state.load(std::memory_order_acquire) != CAPTURE_COMPLETE || size < sizeof(CaptureHeader)) {
+        return 0;
+    }
+    uint32_t total = recorded.load(std::memory_order_relaxed);
+    if (offset >= total) {
+        return 0;
+    }
+
+    uint32_t room = (uint32_t)((size - sizeof(CaptureHeader)) / sizeof(CaptureSample));
+    count = min(min(room, total - offset), (uint32_t)UINT8_MAX);
+    if (count == 0) {
+        return 0;
+    }
+
+    CaptureHeader header;
+    header.type = BLE_FRAME_CAPTURE;
+    header.count = (uint8_t)count;
+    header.entrySize = sizeof(CaptureSample);
+    header.flags = offset + count == total ? CAPTURE_FLAG_LAST : 0;
+    header.captureId = captureId;
+    header.periodMs = RESPIRATION_PERIOD_MS;
+    header.offset = offset;
+    header.total = total;
+
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), samples + offset, count * sizeof(CaptureSample));
+    return sizeof(header) + count * sizeof(CaptureSample);
+}
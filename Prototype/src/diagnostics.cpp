@@ -0,0 +1,181 @@
+#include "diagnostics.h"
+#include "heap_monitor.h"
+#include <esp_heap_caps.h>
+
+DiagnosticsManager diagnosticsManager;
+
+static_assert(DIAG_SNAPSHOT_SIZE <= 512, "Diagnostics snapshot exceeds the ATT attribute limit");
+
+static portMUX_TYPE diagLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Per timed stage, 0 = no deadline
+static const uint32_t deadlinesUs[DIAG_STAGE_STATE_BASE] = {
+    DEADLINE_SENSOR_READ_MS * 1000,
+    DEADLINE_ALERT_MS * 1000,
+    DEADLINE_PACKET_BUILD_MS * 1000,
+    DEADLINE_NOTIFY_MS * 1000,
+    DEADLINE_SAMPLE_LATE_MS * 1000,
+};
+
+DiagnosticsManager::DiagnosticsManager() {
+    for (int i = 0; i < DIAG_TASK_COUNT; i++) {
+        tasks[i] = nullptr;
+    }
+    for (int i = 0; i < DIAG_STAGE_COUNT; i++) {
+        memset(&stages[i], 0, sizeof(stages[i]));
+        stages[i].minUs = UINT32_MAX;
+    }
+    for (int i = 0; i < DIAG_STAGE_STATE_BASE; i++) {
+        missed[i] = 0;
+    }
+    missedTotal = 0;
+    state = STATE_SLEEPING;
+    stateStartUs = 0;
+}
+
+uint8_t DiagnosticsManager::bucketFor(uint32_t durationUs) {
+    uint32_t limit = DIAG_HISTOGRAM_BASE_US;
+    uint8_t bucket = 0;
+    while (bucket < DIAG_HISTOGRAM_BUCKETS - 1 && durationUs >= limit) {
+        limit <<= 2;
+        bucket++;
+    }
+    return bucket;
+}
+
+void DiagnosticsManager::record(DiagStage stage, int64_t startUs) {
+    int64_t elapsed = now() - startUs;
+    recordDuration(stage, elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+}
+
+void DiagnosticsManager::recordDuration(DiagStage stage, uint32_t durationUs) {
+    if (stage >= DIAG_STAGE_COUNT) {
+        return;
+    }
+    uint8_t bucket = bucketFor(durationUs);
+
+    portENTER_CRITICAL(&diagLock);
+    StageAccumulator& acc = stages[stage];
+    acc.count++;
+    acc.totalUs += durationUs;
+    if (durationUs < acc.minUs) {
+        acc.minUs = durationUs;
+    }
+    if (durationUs > acc.maxUs) {
+        acc.maxUs = durationUs;
+    }
+    if (acc.histogram[bucket] < UINT16_MAX) {
+        acc.histogram[bucket]++;
+    }
+    if (stage < DIAG_STAGE_STATE_BASE && deadlinesUs[stage] != 0 && durationUs > deadlinesUs[stage]) {
+        missed[stage]++;
+        missedTotal++;
+    }
+    portEXIT_CRITICAL(&diagLock);
+}
+
+// Closes the residency interval of the current state. Several tasks move the
+// state, so this measures how long the system label stayed unchanged.
+void DiagnosticsManager::enterState(SystemState next) {
+    int64_t timestamp = now();
+
+    portENTER_CRITICAL(&diagLock);
+    SystemState previous = state;
+    int64_t startUs = stateStartUs;
+    state = next;
+    stateStartUs = timestamp;
+    portEXIT_CRITICAL(&diagLock);
+
+    if (previous != next && previous < STATE_COUNT) {
+        int64_t elapsed = timestamp - startUs;
+        recordDuration((DiagStage)(DIAG_STAGE_STATE_BASE + previous),
+                       elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+    }
+}
+
+void DiagnosticsManager::registerTask(DiagTask task, TaskHandle_t handle) {
+    if (task < DIAG_TASK_COUNT) {
+        tasks[task] = handle;
+    }
+}
+
+uint8_t DiagnosticsManager::findTask(TaskHandle_t handle) {
+    uint8_t i = 0;
+    while (i < DIAG_TASK_COUNT && (handle == nullptr || tasks[i] != handle)) {
+        i++;
+    }
+    return i;
+}
+
+uint32_t DiagnosticsManager::getMissedDeadlines() {
+    portENTER_CRITICAL(&diagLock);
+    uint32_t total = missedTotal;
+    portEXIT_CRITICAL(&diagLock);
+    return total;
+}
+
+// Fills the deadline counters; the watchdog fields are left to the caller
+void DiagnosticsManager::getDeadlineStats(DiagDeadlineStats& stats) {
+    stats.stageCount = DIAG_STAGE_STATE_BASE;
+    portENTER_CRITICAL(&diagLock);
+    memcpy(stats.missed, missed, sizeof(stats.missed));
+    portEXIT_CRITICAL(&diagLock);
+}
+
+// Serialises the current counters; returns the length written, 0 if the
+// buffer is too small
+size_t DiagnosticsManager::buildSnapshot(uint8_t* buffer, size_t capacity) {
+    if (capacity < DIAG_SNAPSHOT_SIZE) {
+        return 0;
+    }
+
+    DiagHeader header;
+    header.version = DIAG_SNAPSHOT_VERSION;
+    header.stageCount = DIAG_STAGE_COUNT;
+    header.taskCount = DIAG_TASK_COUNT;
+    header.bucketCount = DIAG_HISTOGRAM_BUCKETS;
+    header.bucketBaseUs = DIAG_HISTOGRAM_BASE_US;
+    header.reserved = 0;
+    header.uptimeMs = millis();
+    header.heapFree = esp_get_free_heap_size();
+    header.heapMinFree = esp_get_minimum_free_heap_size();
+    header.heapLargestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    header.allocationsOther = heapMonitor.otherCount();
+    header.allocationsStack = heapMonitor.getStackAllocations();
+    header.samplesAllocating = heapMonitor.getSamplesWithAllocations();
+    memcpy(buffer, &header, sizeof(header));
+    uint8_t* out = buffer + sizeof(header);
+
+    for (int i = 0; i < DIAG_STAGE_COUNT; i++) {
+        DiagStageStats stats;
+        portENTER_CRITICAL(&diagLock);
+        const StageAccumulator& acc = stages[i];
+        stats.count = acc.count;
+        stats.minUs = acc.count > 0 ? acc.minUs : 0;
+        stats.maxUs = acc.maxUs;
+        stats.meanUs = acc.count > 0 ? (uint32_t)(acc.totalUs / acc.count) : 0;
+        memcpy(stats.histogram, acc.histogram, sizeof(stats.histogram));
+        portEXIT_CRITICAL(&diagLock);
+
+        memcpy(out, &stats, sizeof(stats));
+        out += sizeof(stats);
+    }
+
+    for (int i = 0; i < DIAG_TASK_COUNT; i++) {
+        // The ESP-IDF port reports the high-water mark in bytes
+        uint16_t highWater = 0;
+        if (tasks[i] != nullptr) {
+            highWater = (uint16_t)min(uxTaskGetStackHighWaterMark(tasks[i]), (UBaseType_t)UINT16_MAX);
+        }
+        memcpy(out, &highWater, sizeof(highWater));
+        out += sizeof(highWater);
+    }
+
+    for (int i = 0; i < DIAG_TASK_COUNT; i++) {
+        uint32_t allocations = heapMonitor.count((DiagTask)i);
+        memcpy(out, &allocations, sizeof(allocations));
+        out += sizeof(allocations);
+    }
+
+    return out - buffer;
+}
@@ -0,0 +1,22 @@
+#include "events.h"
+
+EventGroupHandle_t systemEvents = nullptr;
+SampleQueue alertQueue;
+TransportQueue transportQueue;
+
+TaskHandle_t acquisitionTaskHandle = nullptr;
+TaskHandle_t alertTaskHandle = nullptr;
+TaskHandle_t transportTaskHandle = nullptr;
+TaskHandle_t uiTaskHandle = nullptr;
+
+bool eventsBegin() {
+    systemEvents = xEventGroupCreate();
+    return systemEvents != nullptr;
+}
+
+void signalEvent(EventBits_t bits) {
+    if (systemEvents != nullptr) {
+        xEventGroupSetBits(systemEvents, bits);
+    }
+}
+
@@ -0,0 +1,376 @@
+#include "flash_log.h"
+#include "log.h"
+#include <esp32/rom/crc.h>
+
+static const char TAG[] = "flashlog";
+
+FlashLogManager flashLogManager;
+
+static_assert((FLASH_LOG_PAGE_BUFFERS & (FLASH_LOG_PAGE_BUFFERS - 1)) == 0,
+              "FLASH_LOG_PAGE_BUFFERS must be a power of two");
+static_assert(FLASH_LOG_SECTOR_SIZE % FLASH_LOG_PAGE_SIZE == 0, "Sectors must hold whole pages");
+
+#define FLASH_LOG_NONE  UINT32_MAX      // No sector
+
+static uint16_t pageCrc(const FlashLogPage& page) {
+    return crc16_le(page.header.count, (const uint8_t*)page.records,
+                    page.header.count * sizeof(HistorySample));
+}
+
+static bool isErased(const FlashLogPage& page) {
+    const uint8_t* bytes = (const uint8_t*)&page;
+    for (size_t i = 0; i < sizeof(page); i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+FlashLogManager::FlashLogManager() {
+    partition = nullptr;
+    ready = false;
+    sectorCount = 0;
+    headPage = 0;
+    erasedPages = 0;
+    nextSequence = 0;
+    active = nullptr;
+    droppedRecords = 0;
+    runtimeErases = 0;
+    flashLock = nullptr;
+    flushTaskHandle = nullptr;
+}
+
+bool FlashLogManager::begin() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         FLASH_LOG_PARTITION);
+    if (partition == nullptr) {
+        LOG_W(TAG, "No %s partition, flash logging disabled", FLASH_LOG_PARTITION);
+        return false;
+    }
+
+    sectorCount = min((uint32_t)(partition->size / FLASH_LOG_SECTOR_SIZE), (uint32_t)FLASH_LOG_MAX_SECTORS);
+    if (sectorCount <= FLASH_LOG_ERASE_AHEAD) {
+        LOG_E(TAG, "Partition %s is too small", FLASH_LOG_PARTITION);
+        return false;
+    }
+
+    flashLock = xSemaphoreCreateMutex();
+    if (flashLock == nullptr) {
+        return false;
+    }
+
+    scan();
+    eraseAhead(FLASH_LOG_ERASE_AHEAD);
+
+    for (int i = 0; i < FLASH_LOG_PAGE_BUFFERS; i++) {
+        freePages.push(&pages[i]);
+    }
+
+    if (xTaskCreatePinnedToCore(flushTask, "flashlog", TASK_FLASH_LOG_STACK, this,
+                                TASK_FLASH_LOG_PRIO, &flushTaskHandle,
+                                TASK_FLASH_LOG_CORE) != pdPASS) {
+        LOG_E(TAG, "Failed to create flash log task!");
+        return false;
+    }
+
+    ready = true;
+    LOG_I(TAG, "Logging to flash: %u sectors, %d records per page, sequences %u-%u",
+          sectorCount, (int)FLASH_LOG_RECORDS_PER_PAGE, oldestSequence(), nextSequence);
+    return true;
+}
+
+// Rebuilds the sector index and finds the write position. The newest
+// sector is the one with the latest first sequence, compared wrap-safe;
+// the head is the page after the last one written in it. A sector whose
+// first page fails its CRC (cut off mid-write) is left out of the index
+// and gets erased before it is reused.
+void FlashLogManager::scan() {
+    uint32_t newest = FLASH_LOG_NONE;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        bool used = readPage(sector * FLASH_LOG_PAGES_PER_SECTOR, scratch);
+        sectorFirst[sector] = used ? scratch.header.firstSequence : FLASH_LOG_ERASED;
+        if (used && (newest == FLASH_LOG_NONE ||
+                     (int32_t)(sectorFirst[sector] - sectorFirst[newest]) > 0)) {
+            newest = sector;
+        }
+    }
+
+    headPage = 0;
+    erasedPages = 0;
+    nextSequence = 0;
+    if (newest == FLASH_LOG_NONE) {
+        return;
+    }
+
+    uint32_t page = 0;
+    for (; page < FLASH_LOG_PAGES_PER_SECTOR; page++) {
+        uint32_t index = newest * FLASH_LOG_PAGES_PER_SECTOR + page;
+        if (readPage(index, scratch)) {
+            nextSequence = scratch.header.firstSequence + scratch.header.count;
+        } else if (isErased(scratch)) {
+            break;      // Never written; a cut-off page is skipped instead
+        }
+    }
+    headPage = (newest * FLASH_LOG_PAGES_PER_SECTOR + page) % (sectorCount * FLASH_LOG_PAGES_PER_SECTOR);
+    if (page < FLASH_LOG_PAGES_PER_SECTOR) {
+        erasedPages = FLASH_LOG_PAGES_PER_SECTOR - page;
+    }
+}
+
+// True only for a sector that reads back all ones, so a sector that is
+// already erased never costs another erase cycle
+bool FlashLogManager::isSectorErased(uint32_t sector) {
+    if (sectorFirst[sector] != FLASH_LOG_ERASED) {
+        return false;
+    }
+    for (uint32_t offset = 0; offset < FLASH_LOG_SECTOR_SIZE; offset += sizeof(scratch)) {
+        esp_partition_read(partition, sector * FLASH_LOG_SECTOR_SIZE + offset, &scratch, sizeof(scratch));
+        if (!isErased(scratch)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes sure `sectors` whole sectors past the head are erased, dropping the
+// oldest records when the log is full. Caller holds flashLock (or runs
+// before the flush task starts).
+bool FlashLogManager::eraseAhead(uint32_t sectors) {
+    uint32_t totalPages = sectorCount * FLASH_LOG_PAGES_PER_SECTOR;
+    uint32_t wanted = min(sectors, sectorCount - 1) * FLASH_LOG_PAGES_PER_SECTOR;
+
+    while (erasedPages < wanted || erasedPages == 0) {
+        uint32_t sector = ((headPage + erasedPages) % totalPages) / FLASH_LOG_PAGES_PER_SECTOR;
+        if (!isSectorErased(sector)) {
+            if (esp_partition_erase_range(partition, sector * FLASH_LOG_SECTOR_SIZE,
+                                          FLASH_LOG_SECTOR_SIZE) != ESP_OK) {
+                LOG_E(TAG, "Erase of sector %u failed, flash logging disabled", sector);
+                ready = false;
+                return false;
+            }
+            sectorFirst[sector] = FLASH_LOG_ERASED;
+        }
+        erasedPages += FLASH_LOG_PAGES_PER_SECTOR;
+    }
+    return true;
+}
+
+// Copies one record into the active page; never blocks. Records are
+// dropped (and counted) if the flush task falls behind by every buffer.
+bool FlashLogManager::append(const SensorData& data, AlertLevel alertLevel) {
+    if (!ready) {
+        return false;
+    }
+
+    SensorPacket packet;
+    encodeSensorPacket(data, alertLevel, packet);
+
+    // A page holds consecutive sequences only; records dropped for want of
+    // a free page leave gaps
+    if (active != nullptr &&
+        active->header.firstSequence + active->header.count != packet.sequence) {
+        sealActive();
+    }
+
+    if (active == nullptr) {
+        if (!freePages.pop(active)) {
+            droppedRecords++;
+            return false;
+        }
+        memset(active, 0xFF, sizeof(FlashLogPage));     // Unused bytes stay erased
+        active->header.firstSequence = packet.sequence;
+        active->header.magic = FLASH_LOG_PAGE_MAGIC;
+        active->header.count = 0;
+    }
+
+    packHistorySample(packet, active->records[active->header.count]);
+    active->header.count++;
+
+    if (active->header.count >= FLASH_LOG_RECORDS_PER_PAGE) {
+        sealActive();
+    }
+    return true;
+}
+
+// Hands the active page to the flush task
+void FlashLogManager::sealActive() {
+    active->header.crc = pageCrc(*active);
+    fullPages.push(active);
+    active = nullptr;
+    xTaskNotifyGive(flushTaskHandle);
+}
+
+void FlashLogManager::flushTask(void* param) {
+    FlashLogManager* self = (FlashLogManager*)param;
+    FlashLogPage* page;
+
+    // sync() drains the same queues, so each page is popped, written and
+    // handed back under flashLock; that keeps one consumer and one
+    // producer at a time
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            xSemaphoreTake(self->flashLock, portMAX_DELAY);
+            bool popped = self->fullPages.pop(page);
+            if (popped) {
+                self->writePage(page);
+                self->freePages.push(page);
+            }
+            xSemaphoreGive(self->flashLock);
+            if (!popped) {
+                break;
+            }
+        }
+    }
+}
+
+// Caller holds flashLock (or runs before the flush task starts)
+bool FlashLogManager::writePage(FlashLogPage* page) {
+    if (!ready) {
+        return false;
+    }
+
+    // Out of pre-erased sectors: this erase lands while sampling
+    if (erasedPages == 0) {
+        if (!eraseAhead(1)) {
+            return false;
+        }
+        runtimeErases++;
+        LOG_D(TAG, "Erased a sector while sampling (%u so far)", runtimeErases);
+    }
+
+    if (esp_partition_write(partition, headPage * FLASH_LOG_PAGE_SIZE, page, FLASH_LOG_PAGE_SIZE) != ESP_OK) {
+        LOG_E(TAG, "Flash write failed, flash logging disabled");
+        ready = false;
+        return false;
+    }
+
+    if (headPage % FLASH_LOG_PAGES_PER_SECTOR == 0) {
+        sectorFirst[headPage / FLASH_LOG_PAGES_PER_SECTOR] = page->header.firstSequence;
+    }
+    nextSequence = page->header.firstSequence + page->header.count;
+    headPage = (headPage + 1) % (sectorCount * FLASH_LOG_PAGES_PER_SECTOR);
+    erasedPages--;
+    return true;
+}
+
+// Writes everything buffered, including a partial page, and erases ahead
+// for the next wake. Only call once the appending task has stopped (e.g.
+// before deep sleep); the flush task may still be running, and flashLock
+// keeps it off the page queues meanwhile. A reader stuck holding the lock costs the pages still
+// in RAM, not the sleep.
+void FlashLogManager::sync() {
+    if (!ready) {
+        return;
+    }
+
+    if (xSemaphoreTake(flashLock, pdMS_TO_TICKS(FLASH_LOG_SYNC_TIMEOUT_MS)) != pdTRUE) {
+        LOG_E(TAG, "Flash log busy, unsynced pages lost");
+        return;
+    }
+
+    if (active != nullptr && active->header.count > 0) {
+        active->header.crc = pageCrc(*active);
+        fullPages.push(active);
+        active = nullptr;
+    }
+    FlashLogPage* page;
+    while (fullPages.pop(page)) {
+        writePage(page);
+        freePages.push(page);
+    }
+    eraseAhead(FLASH_LOG_ERASE_AHEAD);
+
+    xSemaphoreGive(flashLock);
+}
+
+// False for a page that was never written or whose write was cut short
+bool FlashLogManager::readPage(uint32_t page, FlashLogPage& out) {
+    if (esp_partition_read(partition, page * FLASH_LOG_PAGE_SIZE, &out, sizeof(out)) != ESP_OK) {
+        return false;
+    }
+    return out.header.magic == FLASH_LOG_PAGE_MAGIC && out.header.firstSequence != FLASH_LOG_ERASED &&
+           out.header.count <= FLASH_LOG_RECORDS_PER_PAGE && out.header.crc == pageCrc(out);
+}
+
+// Starts at the newest sector whose first sequence is <= fromSequence
+// (or the oldest sector) and reads pages forward up to the head. Sequences
+// are compared wrap-safe, like scan().
+size_t FlashLogManager::readRange(uint32_t fromSequence, SensorPacket* out, size_t maxRecords) {
+    if (!ready) {
+        return 0;
+    }
+
+    xSemaphoreTake(flashLock, portMAX_DELAY);
+
+    uint32_t start = FLASH_LOG_NONE;
+    uint32_t oldest = FLASH_LOG_NONE;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        uint32_t first = sectorFirst[sector];
+        if (first == FLASH_LOG_ERASED) {
+            continue;
+        }
+        if ((int32_t)(first - fromSequence) <= 0 &&
+            (start == FLASH_LOG_NONE || (int32_t)(first - sectorFirst[start]) > 0)) {
+            start = sector;
+        }
+        if (oldest == FLASH_LOG_NONE || (int32_t)(first - sectorFirst[oldest]) < 0) {
+            oldest = sector;
+        }
+    }
+    if (start == FLASH_LOG_NONE) {
+        start = oldest;
+    }
+
+    size_t copied = 0;
+    if (start != FLASH_LOG_NONE) {
+        uint32_t totalPages = sectorCount * FLASH_LOG_PAGES_PER_SECTOR;
+        uint32_t page = start * FLASH_LOG_PAGES_PER_SECTOR;
+        do {
+            if (readPage(page, scratch) &&
+                (int32_t)(scratch.header.firstSequence + scratch.header.count - fromSequence) > 0) {
+                for (uint8_t i = 0; i < scratch.header.count && copied < maxRecords; i++) {
+                    uint32_t sequence = scratch.header.firstSequence + i;
+                    if ((int32_t)(sequence - fromSequence) >= 0) {
+                        unpackHistorySample(scratch.records[i], sequence, out[copied++]);
+                    }
+                }
+            }
+            page = (page + 1) % totalPages;
+        } while (copied < maxRecords && page != headPage);
+    }
+
+    xSemaphoreGive(flashLock);
+    return copied;
+}
+
+uint32_t FlashLogManager::oldestSequence() {
+    if (flashLock == nullptr) {
+        return nextSequence;
+    }
+
+    xSemaphoreTake(flashLock, portMAX_DELAY);
+    uint32_t oldest = nextSequence;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        if (sectorFirst[sector] != FLASH_LOG_ERASED && (int32_t)(sectorFirst[sector] - oldest) < 0) {
+            oldest = sectorFirst[sector];
+        }
+    }
+    xSemaphoreGive(flashLock);
+    return oldest;
+}
+
+// Sequence after the newest record on flash
+uint32_t FlashLogManager::endSequence() {
+    return nextSequence;
+}
+
+bool FlashLogManager::isReady() {
+    return ready;
+}
+
+uint32_t FlashLogManager::getDroppedRecords() {
+    return droppedRecords;
+}
@@ -0,0 +1,103 @@
+#include "heap_monitor.h"
+#include "log.h"
+
+static const char TAG[] = "heap";
+
+HeapMonitor heapMonitor;
+
+HeapMonitor::HeapMonitor() : stackAllocations(0), totalBytes(0) {
+    for (int i = 0; i <= DIAG_TASK_COUNT; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    lastPipeline = 0;
+    samplesWithAllocations = 0;
+    steady = false;
+}
+
+void HeapMonitor::record(size_t size) {
+    // Before the scheduler starts there is no current task; count it as other
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    counts[diagnosticsManager.findTask(task)].fetch_add(1, std::memory_order_relaxed);
+    totalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+uint32_t HeapMonitor::count(DiagTask task) {
+    return task < DIAG_TASK_COUNT ? counts[task].load(std::memory_order_relaxed) : 0;
+}
+
+uint32_t HeapMonitor::otherCount() {
+    return counts[DIAG_TASK_COUNT].load(std::memory_order_relaxed);
+}
+
+uint32_t HeapMonitor::pipelineTotal() {
+    return count(DIAG_TASK_ACQUISITION) + count(DIAG_TASK_ALERT) + count(DIAG_TASK_TRANSPORT);
+}
+
+uint32_t HeapMonitor::stackMark() {
+    return counts[diagnosticsManager.findTask(xTaskGetCurrentTaskHandle())].load(std::memory_order_relaxed);
+}
+
+void HeapMonitor::stackDone(uint32_t mark) {
+    uint32_t now = stackMark();
+    if (now != mark) {
+        stackAllocations.fetch_add(now - mark, std::memory_order_relaxed);
+    }
+}
+
+void HeapMonitor::beginSteadyState() {
+    lastPipeline = pipelineTotal();
+    steady = true;
+    LOG_I(TAG, "Streaming started, %u allocations so far, %u bytes free",
+          lastPipeline + otherCount(), esp_get_free_heap_size());
+}
+
+// Transport task only
+void HeapMonitor::checkSample() {
+    if (!steady) {
+        return;
+    }
+    uint32_t pipeline = pipelineTotal();
+    uint32_t allocations = pipeline - lastPipeline;
+    lastPipeline = pipeline;
+
+    if (allocations > 0) {
+        if (samplesWithAllocations == 0) {
+            LOG_W(TAG, "Pipeline allocated %u times for one sample in steady state", allocations);
+        }
+        samplesWithAllocations++;
+    }
+}
+
+#if defined(HEAP_MONITOR)
+// Every allocator entry the firmware, the Arduino core and the prebuilt IDF
+// libraries reach: newlib's malloc/calloc/realloc and operator new end up
+// in the *_default functions, drivers and PSRAM users call heap_caps_*
+extern "C" {
+void* __real_heap_caps_malloc_default(size_t size);
+void* __real_heap_caps_realloc_default(void* ptr, size_t size);
+void* __real_heap_caps_malloc(size_t size, uint32_t caps);
+void* __real_heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+
+void* __wrap_heap_caps_malloc_default(size_t size) {
+    heapMonitor.record(size);
+    return __real_heap_caps_malloc_default(size);
+}
+
+void* __wrap_heap_caps_realloc_default(void* ptr, size_t size) {
+    if (size > 0) {
+        heapMonitor.record(size);
+    }
+    return __real_heap_caps_realloc_default(ptr, size);
+}
+
+void* __wrap_heap_caps_malloc(size_t size, uint32_t caps) {
+    heapMonitor.record(size);
+    return __real_heap_caps_malloc(size, caps);
+}
+
+void* __wrap_heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    heapMonitor.record(n * size);
+    return __real_heap_caps_calloc(n, size, caps);
+}
+}
+#endif // HEAP_MONITOR
@@ -0,0 +1,147 @@
+#include "history.h"
+#include "log.h"
+
+static const char TAG[] = "history";
+
+HistoryManager historyManager;
+
+#define HISTORY_MAGIC 0x48495354    // "HIST"
+
+static_assert((HISTORY_RTC_CAPACITY & (HISTORY_RTC_CAPACITY - 1)) == 0,
+              "HISTORY_RTC_CAPACITY must be a power of two");
+static_assert((HISTORY_PSRAM_CAPACITY & (HISTORY_PSRAM_CAPACITY - 1)) == 0,
+              "HISTORY_PSRAM_CAPACITY must be a power of two");
+
+// Ring position survives deep sleep so sequence numbers keep increasing
+// across wakes and the RTC ring can still be backfilled afterwards
+struct HistoryState {
+    uint32_t magic;
+    uint32_t next;          // Sequence number of the next sample
+    uint32_t count;         // Valid entries in the active ring
+};
+
+RTC_DATA_ATTR static HistoryState rtcState;
+RTC_DATA_ATTR static HistorySample rtcEntries[HISTORY_RTC_CAPACITY];
+
+// Entries are written on the application core and read on the protocol core
+static portMUX_TYPE historyLock = portMUX_INITIALIZER_UNLOCKED;
+
+HistoryManager::HistoryManager() {
+    entries = rtcEntries;
+    capacityMask = HISTORY_RTC_CAPACITY - 1;
+    retained = true;
+}
+
+bool HistoryManager::begin() {
+    if (rtcState.magic != HISTORY_MAGIC) {
+        rtcState.magic = HISTORY_MAGIC;
+        rtcState.next = 0;
+        rtcState.count = 0;
+    }
+
+    // PSRAM holds far more history but does not survive deep sleep
+    if (psramFound()) {
+        HistorySample* buffer = (HistorySample*)ps_malloc(HISTORY_PSRAM_CAPACITY * sizeof(HistorySample));
+        if (buffer != nullptr) {
+            entries = buffer;
+            capacityMask = HISTORY_PSRAM_CAPACITY - 1;
+            retained = false;
+            rtcState.count = 0;
+        }
+    }
+
+    LOG_I(TAG, "History ring: %d samples in %s, next sequence %u",
+                  (int)capacity(), retained ? "RTC memory" : "PSRAM", rtcState.next);
+    return true;
+}
+
+void packHistorySample(const SensorPacket& packet, HistorySample& entry) {
+    entry.co2 = packet.co2;
+    entry.humidity = packet.humidity;
+    entry.temperature = packet.temperature;
+    entry.alert = packet.alert;
+    entry.status = packet.status;
+    entry.timestamp = packet.timestamp;
+    entry.breathRate = packet.breathRate;
+    entry.inhaleMs = packet.inhaleMs;
+    entry.exhaleMs = packet.exhaleMs;
+}
+
+void unpackHistorySample(const HistorySample& entry, uint32_t sequence, SensorPacket& packet) {
+    packet.co2 = entry.co2;
+    packet.humidity = entry.humidity;
+    packet.temperature = entry.temperature;
+    packet.alert = entry.alert;
+    packet.status = entry.status;
+    packet.timestamp = entry.timestamp;
+    packet.sequence = sequence;
+    packet.breathRate = entry.breathRate;
+    packet.inhaleMs = entry.inhaleMs;
+    packet.exhaleMs = entry.exhaleMs;
+    packet.captureMicros = SENSOR_MICROS_UNKNOWN;
+}
+
+// Stores a sample and assigns its sequence number. Only measured samples
+// are kept; a replayed one is left with its recorded sequence number.
+uint32_t HistoryManager::record(SensorData& data, AlertLevel alertLevel) {
+    if (data.replayed) {
+        return data.sequence;
+    }
+
+    portENTER_CRITICAL(&historyLock);
+    uint32_t sequence = rtcState.next;
+    data.sequence = sequence;
+
+    SensorPacket packet;
+    encodeSensorPacket(data, alertLevel, packet);
+
+    packHistorySample(packet, entries[sequence & capacityMask]);
+
+    rtcState.next = sequence + 1;
+    if (rtcState.count <= capacityMask) {
+        rtcState.count++;
+    }
+    portEXIT_CRITICAL(&historyLock);
+
+    return sequence;
+}
+
+// Returns false if the sample was never recorded or has been overwritten
+bool HistoryManager::read(uint32_t sequence, SensorPacket& packet) {
+    bool found = false;
+
+    portENTER_CRITICAL(&historyLock);
+    if (sequence - (rtcState.next - rtcState.count) < rtcState.count) {
+        unpackHistorySample(entries[sequence & capacityMask], sequence, packet);
+        found = true;
+    }
+    portEXIT_CRITICAL(&historyLock);
+
+    return found;
+}
+
+uint32_t HistoryManager::oldestSequence() {
+    portENTER_CRITICAL(&historyLock);
+    uint32_t oldest = rtcState.next - rtcState.count;
+    portEXIT_CRITICAL(&historyLock);
+    return oldest;
+}
+
+uint32_t HistoryManager::nextSequence() {
+    return rtcState.next;
+}
+
+size_t HistoryManager::capacity() {
+    return capacityMask + 1;
+}
+
+// After a power loss the RTC counter restarts at 0; a persistent log that
+// already holds later sequences moves it on so numbers never repeat
+void HistoryManager::continueFrom(uint32_t sequence) {
+    portENTER_CRITICAL(&historyLock);
+    if ((int32_t)(sequence - rtcState.next) > 0) {
+        rtcState.next = sequence;
+        rtcState.count = 0;
+    }
+    portEXIT_CRITICAL(&historyLock);
+}
@@ -0,0 +1,161 @@
+#include "i2c_bus.h"
+#include "log.h"
+#include "diagnostics.h"
+
+static const char TAG[] = "i2c";
+
+I2CBusManager i2cBusManager;
+
+I2CDevice::I2CDevice(uint8_t address, I2CPriority priority) {
+    memset(&request, 0, sizeof(request));
+    request.address = address;
+    this->priority = priority;
+}
+
+bool I2CDevice::begin() {
+    request.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+    return request.done != nullptr;
+}
+
+bool I2CDevice::submit() {
+    if (request.done == nullptr || !i2cBusManager.enqueue(&request, priority)) {
+        return false;
+    }
+    // Wire's own timeout bounds the transaction, so the bus task always answers
+    xSemaphoreTake(request.done, portMAX_DELAY);
+    return request.success;
+}
+
+bool I2CDevice::write(const uint8_t* data, uint8_t length) {
+    if (length > I2C_MAX_WRITE_SIZE) {
+        return false;
+    }
+    memcpy(request.writeData, data, length);
+    request.writeLength = length;
+    request.readLength = 0;
+    request.readBuffer = nullptr;
+    return submit();
+}
+
+bool I2CDevice::writeRegister(uint8_t reg, uint8_t value) {
+    uint8_t data[2] = {reg, value};
+    return write(data, sizeof(data));
+}
+
+bool I2CDevice::read(uint8_t* buffer, uint8_t length) {
+    request.writeLength = 0;
+    request.readLength = length;
+    request.readBuffer = buffer;
+    return submit();
+}
+
+// Reads `length` consecutive registers in one transaction
+bool I2CDevice::readRegisters(uint8_t reg, uint8_t* buffer, uint8_t length) {
+    request.writeData[0] = reg;
+    request.writeLength = 1;
+    request.readLength = length;
+    request.readBuffer = buffer;
+    return submit();
+}
+
+I2CBusManager::I2CBusManager() {
+    for (int i = 0; i < I2C_PRIORITY_COUNT; i++) {
+        queues[i] = nullptr;
+    }
+    taskHandle = nullptr;
+    initialized = false;
+    transactions = 0;
+    errors = 0;
+}
+
+bool I2CBusManager::begin() {
+    if (!Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, I2C_CLOCK_HZ)) {
+        LOG_E(TAG, "Failed to start I2C bus!");
+        return false;
+    }
+    Wire.setTimeOut(I2C_TIMEOUT_MS);
+
+    for (int i = 0; i < I2C_PRIORITY_COUNT; i++) {
+        queues[i] = xQueueCreate(I2C_QUEUE_LENGTH, sizeof(I2CRequest*));
+        if (queues[i] == nullptr) {
+            LOG_E(TAG, "Failed to create I2C queues!");
+            return false;
+        }
+    }
+
+    if (xTaskCreatePinnedToCore(busTask, "i2c", TASK_I2C_STACK, this,
+                                TASK_I2C_PRIO, &taskHandle, TASK_I2C_CORE) != pdPASS) {
+        LOG_E(TAG, "Failed to create I2C task!");
+        return false;
+    }
+
+    diagnosticsManager.registerTask(DIAG_TASK_I2C, taskHandle);
+
+    initialized = true;
+    LOG_I(TAG, "I2C bus running at %u Hz", (unsigned)I2C_CLOCK_HZ);
+    return true;
+}
+
+bool I2CBusManager::enqueue(I2CRequest* request, I2CPriority priority) {
+    if (!initialized || xQueueSend(queues[priority], &request, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    xTaskNotifyGive(taskHandle);
+    return true;
+}
+
+// Highest priority first; lower levels only run when nothing above is waiting
+bool I2CBusManager::nextRequest(I2CRequest*& request) {
+    for (int i = 0; i < I2C_PRIORITY_COUNT; i++) {
+        if (xQueueReceive(queues[i], &request, 0) == pdTRUE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void I2CBusManager::execute(I2CRequest* request) {
+    bool ok = true;
+
+    if (request->writeLength > 0) {
+        Wire.beginTransmission(request->address);
+        Wire.write(request->writeData, request->writeLength);
+        // Keep the bus for a repeated start when a read follows
+        ok = Wire.endTransmission(request->readLength == 0) == 0;
+    }
+
+    if (ok && request->readLength > 0) {
+        size_t received = Wire.requestFrom((uint16_t)request->address,
+                                           (size_t)request->readLength, true);
+        ok = received == request->readLength &&
+             Wire.readBytes(request->readBuffer, request->readLength) == request->readLength;
+    }
+
+    transactions++;
+    if (!ok) {
+        errors++;
+    }
+    request->success = ok;
+}
+
+void I2CBusManager::busTask(void* param) {
+    I2CBusManager* self = (I2CBusManager*)param;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        I2CRequest* request;
+        while (self->nextRequest(request)) {
+            self->execute(request);
+            xSemaphoreGive(request->done);
+        }
+    }
+}
+
+uint32_t I2CBusManager::getTransactions() {
+    return transactions;
+}
+
+uint32_t I2CBusManager::getErrors() {
+    return errors;
+}
@@ -0,0 +1,125 @@
+#include "log.h"
+#include "diagnostics.h"
+#include <atomic>
+#include <stdarg.h>
+
+LogManager logManager;
+
+static_assert((LOG_QUEUE_LENGTH & (LOG_QUEUE_LENGTH - 1)) == 0,
+              "LOG_QUEUE_LENGTH must be a power of two");
+
+// Producers on either core claim a slot by advancing head, format into it,
+// then publish it with `ready`; the drain task consumes slots in order
+struct LogSlot {
+    std::atomic<bool> ready;
+    uint16_t length;
+    char text[LOG_LINE_SIZE];
+};
+
+static LogSlot slots[LOG_QUEUE_LENGTH];
+static std::atomic<uint32_t> head(0);
+static std::atomic<uint32_t> tail(0);
+static std::atomic<uint32_t> dropped(0);
+static std::atomic<uint32_t> droppedTotal(0);
+
+static const char levelChars[] = "-EWID";
+
+void logWrite(uint8_t level, const char* tag, const char* format, ...) {
+    uint32_t index = head.load(std::memory_order_relaxed);
+    do {
+        if (index - tail.load(std::memory_order_acquire) >= LOG_QUEUE_LENGTH) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!head.compare_exchange_weak(index, index + 1, std::memory_order_acq_rel,
+                                         std::memory_order_relaxed));
+
+    LogSlot& slot = slots[index & (LOG_QUEUE_LENGTH - 1)];
+    int length = snprintf(slot.text, sizeof(slot.text), "[%lu][%c][%s] ",
+                          millis(), levelChars[level <= LOG_LEVEL_DEBUG ? level : 0], tag);
+    if (length < 0 || length >= (int)sizeof(slot.text) - 1) {
+        length = 0;
+    }
+
+    // Keep one byte for the newline; long lines are truncated
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(slot.text + length, sizeof(slot.text) - length - 1, format, args);
+    va_end(args);
+    if (written > 0) {
+        length += min(written, (int)sizeof(slot.text) - length - 2);
+    }
+    slot.text[length++] = '\n';
+    slot.length = length;
+    slot.ready.store(true, std::memory_order_release);
+
+    logManager.notify();
+}
+
+LogManager::LogManager() {
+    taskHandle = nullptr;
+}
+
+bool LogManager::begin() {
+    if (xTaskCreatePinnedToCore(drainTask, "log", TASK_LOG_STACK, this,
+                                TASK_LOG_PRIO, &taskHandle, TASK_LOG_CORE) != pdPASS) {
+        Serial.println("Failed to create log task!");
+        return false;
+    }
+    diagnosticsManager.registerTask(DIAG_TASK_LOG, taskHandle);
+    return true;
+}
+
+void LogManager::notify() {
+    if (taskHandle != nullptr) {
+        xTaskNotifyGive(taskHandle);
+    }
+}
+
+void LogManager::drainTask(void* param) {
+    LogManager* self = (LogManager*)param;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->drain();
+    }
+}
+
+// Only the drain task calls this, so tail has a single writer
+void LogManager::drain() {
+    for (;;) {
+        uint32_t index = tail.load(std::memory_order_relaxed);
+        if (index == head.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        // A producer that claimed this slot may still be formatting; its
+        // notification brings us back
+        LogSlot& slot = slots[index & (LOG_QUEUE_LENGTH - 1)];
+        if (!slot.ready.load(std::memory_order_acquire)) {
+            break;
+        }
+        Serial.write((const uint8_t*)slot.text, slot.length);
+        slot.ready.store(false, std::memory_order_relaxed);
+        tail.store(index + 1, std::memory_order_release);
+    }
+
+    uint32_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost > 0) {
+        droppedTotal.fetch_add(lost, std::memory_order_relaxed);
+        Serial.printf("[log] %u lines dropped\n", (unsigned)lost);
+    }
+}
+
+void LogManager::flush() {
+    notify();
+    for (int i = 0; i < LOG_FLUSH_TIMEOUT_MS &&
+                    tail.load(std::memory_order_acquire) != head.load(std::memory_order_acquire); i++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    Serial.flush();
+}
+
+uint32_t LogManager::getDropped() {
+    return droppedTotal.load(std::memory_order_relaxed) + dropped.load(std::memory_order_relaxed);
+}
@@ -3,213 +3,684 @@
 #include <esp_bt.h>
 
 #include "config.h"
+#include "events.h"
+#include "log.h"
+#include "diagnostics.h"
+#include "i2c_bus.h"
 #include "sensor.h"
+#include "alert_policy.h"
+#include "history.h"
+#include "storage.h"
+#include "flash_log.h"
+#include "respiration.h"
+#include "power.h"
 #include "ble_comm.h"
 #include "buzzer.h"
 #include "button.h"
+#include "sampler.h"
+#include "stats.h"
+#include "heap_monitor.h"
+#include "replay.h"
+#include "capture.h"
+#include "watchdog.h"
+#include "time_sync.h"
 
-SystemState currentState = STATE_SLEEPING;
+static const char TAG[] = "main";
+
+volatile SystemState currentState = STATE_SLEEPING;
 SensorData currentSensorData;
-AlertLevel currentAlert = ALERT_NONE;
-unsigned long lastSensorRead = 0;
+volatile AlertLevel currentAlert = ALERT_NONE;
+volatile uint16_t samplePeriodMs = SENSOR_READ_INTERVAL_MS;    // Chosen by the sampler
 bool systemInitialized = false;
 
+#define SYSTEM_STATE_MAGIC 0x5741524D   // "WARM"
+
+// Alert state and last reading carried across deep sleep for warm boots
+struct RetainedSystemState {
+    uint32_t magic;
+    AlertLevel alert;
+    SensorData lastReading;
+};
+
+RTC_DATA_ATTR static RetainedSystemState retainedState;
+
 // Function declarations
-void setupSystem();
+void setState(SystemState state);
+void setupSystem(bool warmBoot);
+bool startTasks();
+void acquisitionTask(void* param);
+void alertTask(void* param);
+void transportTask(void* param);
+void uiTask(void* param);
+void prepareSleep();
 void enterDeepSleep();
-void wakeupFromSleep();
-void handleSystemStates();
-void processAlerts();
+void processAlerts(const SensorData& data);
 void handleBLECommands();
+CommandStatus executeCommand(const CommandFrame& frame);
 
 void setup() {
+    // A button wake from deep sleep with retained state takes the warm path,
+    // which skips the serial-monitor wait, the jingle and sensor setup
+    esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+    bool warmBoot = wakeup_reason == ESP_SLEEP_WAKEUP_EXT0 &&
+                    retainedState.magic == SYSTEM_STATE_MAGIC;
+    
     Serial.begin(115200);
-    delay(1000);
+    if (!warmBoot) {
+        delay(1000);
+    }
+    logManager.begin();
     
-    setupSystem();
+    if (!eventsBegin()) {
+        LOG_E(TAG, "Failed to create system events!");
+        return;
+    }
     
-    // Determine initial state based on wakeup reason
-    esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+    if (warmBoot) {
+        currentAlert = retainedState.alert;
+        currentSensorData = retainedState.lastReading;
+        alertPolicy.restore(retainedState.alert, millis());
+        LOG_I(TAG, "Warm boot from deep sleep");
+    }
+    
+    setupSystem(warmBoot);
     
-    currentState = STATE_WAKING_UP;
-    systemInitialized = true;
+    setState(STATE_WAKING_UP);
+    systemInitialized = startTasks();
 }
 
 void loop() {
     if (!systemInitialized) {
+        vTaskDelay(portMAX_DELAY);
         return;
     }
     
-    buttonManager.update();
-    buzzerManager.update();
-    
-    // Handle button interrupts (stop buzzer, sleep control)
-    if (buttonManager.wasPressed()) {
-        if (buzzerManager.isBuzzerActive()) {
-            buzzerManager.stopAlert();
-            Serial.println("Buzzer stopped by button press");
-        }
-    }
-    
-    if (buttonManager.wasHeld()) {
-        if (currentState != STATE_SLEEPING) {
-            Serial.println("Button held - preparing for sleep");
-            currentState = STATE_PREPARING_SLEEP;
-        }
-    }
-    
-    // Handle BLE commands
-    handleBLECommands();
-    
-    // Handle system state machine
-    handleSystemStates();
-    
-    // Small delay to prevent excessive CPU usage
-    delay(10);
+    // The loop task only supervises sleep; everything else runs in the
+    // pipeline tasks and is woken by events, so block until asked to sleep
+    xEventGroupWaitBits(systemEvents, EVT_SLEEP_REQUEST, pdTRUE, pdFALSE, portMAX_DELAY);
+    prepareSleep();
 }
 
-void setupSystem() {
+// Every state change goes through here so residency is timed
+void setState(SystemState state) {
+    diagnosticsManager.enterState(state);
+    currentState = state;
+}
+
+void setupSystem(bool warmBoot) {
+    
+    // Restart the chip if a pipeline stage wedges, and report the last time it did
+    watchdogManager.begin();
     
     // Initialize button manager first (for interrupts)
     if (!buttonManager.begin()) {
-        Serial.println("Failed to initialize button manager!");
+        LOG_E(TAG, "Failed to initialize button manager!");
         return;
     }
     
     // Initialize buzzer
-    if (!buzzerManager.begin()) {
-        Serial.println("Failed to initialize buzzer manager!");
+    if (!buzzerManager.begin(warmBoot)) {
+        LOG_E(TAG, "Failed to initialize buzzer manager!");
+        return;
+    }
+    
+    // Start the shared sensor bus before any driver uses it
+    if (!i2cBusManager.begin()) {
+        LOG_E(TAG, "Failed to initialize I2C bus!");
         return;
     }
     
     // Initialize sensors
-    if (!sensorManager.begin()) {
-        Serial.println("Failed to initialize sensor manager!");
+    if (!sensorManager.begin(warmBoot)) {
+        LOG_E(TAG, "Failed to initialize sensor manager!");
+        return;
+    }
+    
+    // Respiration needs the BMP280, which older boards do not have
+    respirationEngine.begin(warmBoot);
+    
+    // Restore the sample history (and sequence counter) kept across sleep
+    if (!historyManager.begin()) {
+        LOG_E(TAG, "Failed to initialize history!");
         return;
     }
     
     // Initialize BLE
     if (!bleManager.begin()) {
-        Serial.println("Failed to initialize BLE manager!");
+        LOG_E(TAG, "Failed to initialize BLE manager!");
         return;
     }
     
+    // SD logging is optional; most tags have no card fitted and log to
+    // flash instead. Flash sequences outlive a power loss, the RTC ring's do not.
+    if (!storageManager.begin() && flashLogManager.begin()) {
+        historyManager.continueFrom(flashLogManager.endSequence());
+    }
+    
+    // Plays recorded sessions through the pipeline on request
+    replayManager.begin();
+    
+    // Raw waveform capture buffer, allocated once so a capture never does
+    captureManager.begin();
+    
     // Configure deep sleep wakeup source
     esp_sleep_enable_ext0_wakeup(GPIO_NUM_14, 1);
+    
+    // Light sleep between samples where the build supports it; BLE stays up
+    powerManager.begin();
 }
 
-void handleSystemStates() {
-    unsigned long currentTime = millis();
+bool startTasks() {
+    bool ok = true;
     
-    switch (currentState) {
-        case STATE_WAKING_UP:
-            currentState = STATE_READING_SENSORS;
-            break;
+    ok &= xTaskCreatePinnedToCore(acquisitionTask, "acquisition", TASK_ACQUISITION_STACK,
+                                  nullptr, TASK_ACQUISITION_PRIO, &acquisitionTaskHandle,
+                                  TASK_ACQUISITION_CORE) == pdPASS;
+    ok &= xTaskCreatePinnedToCore(alertTask, "alert", TASK_ALERT_STACK,
+                                  nullptr, TASK_ALERT_PRIO, &alertTaskHandle,
+                                  TASK_ALERT_CORE) == pdPASS;
+    ok &= xTaskCreatePinnedToCore(transportTask, "transport", TASK_TRANSPORT_STACK,
+                                  nullptr, TASK_TRANSPORT_PRIO, &transportTaskHandle,
+                                  TASK_TRANSPORT_CORE) == pdPASS;
+    ok &= xTaskCreatePinnedToCore(uiTask, "ui", TASK_UI_STACK,
+                                  nullptr, TASK_UI_PRIO, &uiTaskHandle,
+                                  TASK_UI_CORE) == pdPASS;
+    
+    if (!ok) {
+        LOG_E(TAG, "Failed to create system tasks!");
+    }
+    
+    diagnosticsManager.registerTask(DIAG_TASK_ACQUISITION, acquisitionTaskHandle);
+    diagnosticsManager.registerTask(DIAG_TASK_ALERT, alertTaskHandle);
+    diagnosticsManager.registerTask(DIAG_TASK_TRANSPORT, transportTaskHandle);
+    diagnosticsManager.registerTask(DIAG_TASK_UI, uiTaskHandle);
+    return ok;
+}
+
+// Logs throughput and alert latency once the last replayed sample has been
+// delivered (or the drain timeout passed)
+static void reportReplay() {
+    uint32_t waited = 0;
+    while (!replaySource.isDrained() && waited < REPLAY_DRAIN_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(REPLAY_POLL_MS));
+        waited += REPLAY_POLL_MS;
+    }
+    
+    ReplayReport report = replaySource.getReport();
+    uint32_t rate = report.elapsedMs ? (uint32_t)((uint64_t)report.delivered * 1000 / report.elapsedMs) : 0;
+    LOG_I(TAG, "Replay done: %u/%u samples delivered in %u ms (%u/s), %u underruns",
+          report.delivered, report.played, report.elapsedMs, rate, report.underruns);
+    for (int level = ALERT_LOW; level < REPLAY_LEVELS; level++) {
+        if (report.alertLatencyMs[level] != UINT32_MAX) {
+            LOG_I(TAG, "Replay alert %d raised %u ms after its conditions first held",
+                  level, report.alertLatencyMs[level]);
+        }
+    }
+}
+
+// Reads the sensors at the adaptive sampler's period and hands samples to the alert task.
+// Conversions run while the task is blocked; the ENS160 data-ready interrupt
+// wakes it to collect the result. While a replay is open the recorded session
+// stands in for the sensors and sets its own pace.
+void acquisitionTask(void* param) {
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t dueUs = 0;      // Scheduled start of the next live sample, 0 after a break in the schedule
+    
+    for (;;) {
+        watchdogManager.busy(DIAG_TASK_ACQUISITION);
+        setState(STATE_READING_SENSORS);
+        LOG_D(TAG, "State: Reading Sensors");
+        
+        SensorSource& source = replaySource.isActive() ? (SensorSource&)replaySource : sensorManager;
+        SensorData data;
+        ReadStatus status = READ_FAILED;
+        int64_t readStart = DiagnosticsManager::now();
+        if (source.isLive() && dueUs != 0) {
+            diagnosticsManager.recordDuration(DIAG_STAGE_SAMPLE_LATENESS,
+                                              readStart > dueUs ? (uint32_t)(readStart - dueUs) : 0);
+        }
+        if (source.startReading()) {
+            while ((status = source.pollReading(data)) == READ_PENDING) {
+                ulTaskNotifyTake(pdTRUE, source.nextPollDelay());
+            }
+        }
+
+        if (!source.isLive()) {
+            // Nothing is dropped during a replay, so the pipeline sets the pace
+            if (status == READ_COMPLETE) {
+                while (!alertQueue.push(data)) {
+                    vTaskDelay(1);
+                }
+                xTaskNotifyGive(alertTaskHandle);
+            } else {
+                reportReplay();
+            }
+            lastWake = xTaskGetTickCount();
+            dueUs = 0;
+        } else if (status == READ_COMPLETE) {
+            diagnosticsManager.record(DIAG_STAGE_SENSOR_READ, readStart);
+            respirationEngine.fillSensorData(data);
+            captureManager.noteCo2(data.co2);
+            if (alertQueue.push(data)) {
+                xTaskNotifyGive(alertTaskHandle);
+            } else {
+                LOG_W(TAG, "Alert queue full, dropping sample");
+            }
             
-        case STATE_READING_SENSORS:
-            if (currentTime - lastSensorRead >= SENSOR_READ_INTERVAL_MS) {
-                Serial.println("State: Reading Sensors");
-                
-                if (sensorManager.readSensors(currentSensorData)) {
-                    lastSensorRead = currentTime;
-                    currentState = STATE_PROCESSING_ALERTS;
-                } else {
-                    Serial.println("Failed to read sensors, retrying...");
-                    delay(500);
+            AlertLevel level = AlertPolicy::classify(data);
+            uint16_t period = adaptiveSampler.update(data.co2, level, data.timestamp);
+            if (period != samplePeriodMs) {
+                LOG_D(TAG, "Sample period %u ms (%u ppm/min)", period, adaptiveSampler.slope());
+                samplePeriodMs = period;
+            }
+            
+            // Mirrors vTaskDelayUntil, which keeps to the schedule after a late sample
+            dueUs = (dueUs != 0 ? dueUs : readStart) + period * 1000LL;
+            watchdogManager.idle(DIAG_TASK_ACQUISITION);
+            vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(period));
+        } else {
+            LOG_E(TAG, "Failed to read sensors, retrying...");
+            watchdogManager.idle(DIAG_TASK_ACQUISITION);
+            vTaskDelay(pdMS_TO_TICKS(SENSOR_RETRY_DELAY_MS));
+            lastWake = xTaskGetTickCount();
+            dueUs = 0;
+        }
+    }
+}
+
+void alertTask(void* param) {
+    SensorData data;
+    bool replaying = false;
+    
+    for (;;) {
+        watchdogManager.idle(DIAG_TASK_ALERT);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        watchdogManager.busy(DIAG_TASK_ALERT);
+        
+        while (alertQueue.pop(data)) {
+            setState(STATE_PROCESSING_ALERTS);
+            LOG_D(TAG, "State: Processing Alerts");
+            
+            // Replayed timestamps come from the recording, so windows and
+            // dwell timers restart whenever the source changes
+            if (data.replayed != replaying) {
+                replaying = data.replayed;
+                statsManager.reset();
+                alertPolicy.reset();
+            }
+            
+            int64_t alertStart = DiagnosticsManager::now();
+            statsManager.add(data);
+            processAlerts(data);
+            
+            // Replays keep their recording's sequence numbers and stay out of
+            // the history, so they cannot push unsent live samples out
+            statsManager.summarise(data, currentAlert);
+            if (!data.replayed) {
+                historyManager.record(data, currentAlert);
+                storageManager.append(data, currentAlert);
+                flashLogManager.append(data, currentAlert);
+            }
+            diagnosticsManager.record(DIAG_STAGE_ALERT, alertStart);
+            
+            PipelineSample sample;
+            sample.data = data;
+            sample.alert = currentAlert;
+            bool queued = true;
+            if (data.replayed) {
+                while (!transportQueue.push(sample)) {
+                    vTaskDelay(1);
                 }
+            } else {
+                queued = transportQueue.push(sample);
             }
-            break;
+            if (queued) {
+                signalEvent(EVT_SAMPLE_READY);
+            } else {
+                LOG_W(TAG, "Transport queue full, dropping sample");
+            }
+        }
+    }
+}
+
+// Sends samples and executes BLE commands as they arrive
+void transportTask(void* param) {
+    PipelineSample sample;
+    
+    for (;;) {
+        // Wake on a new sample, a command or the pending batch deadline;
+        // while a backfill is running, only check for events between frames
+        TickType_t wait = bleManager.isBackfilling() ? 0 : bleManager.nextFlushDelay();
+        wait = min(wait, bleManager.nextBenchmarkDelay());
+        wait = min(wait, bleManager.nextCaptureDelay());
+        watchdogManager.idle(DIAG_TASK_TRANSPORT);
+        EventBits_t bits = xEventGroupWaitBits(systemEvents,
+                                               EVT_SAMPLE_READY | EVT_BLE_COMMAND |
+                                               EVT_BLE_DISCONNECT | EVT_TRANSPORT_STOP,
+                                               pdTRUE, pdFALSE, wait);
+        watchdogManager.busy(DIAG_TASK_TRANSPORT);
+        
+        // First, so a command or sample handled below starts from a clean link
+        if (bits & EVT_BLE_DISCONNECT) {
+            bleManager.handleDisconnect();
+        }
+        
+        // Before sleep: park here, between frames, so no flash log read is
+        // left holding its lock
+        if (bits & EVT_TRANSPORT_STOP) {
+            bleManager.cancelBackfill();
+            xEventGroupSetBits(systemEvents, EVT_TRANSPORT_PARKED);
+            vTaskSuspend(nullptr);
+        }
+        
+        if (bits & EVT_BLE_COMMAND) {
+            handleBLECommands();
+        }
+        
+        bleManager.noteQueueDepth((uint16_t)transportQueue.size());
+        while ((bits & EVT_SAMPLE_READY) && transportQueue.pop(sample)) {
+            setState(STATE_BLE_COMMUNICATION);
+            currentSensorData = sample.data;
             
-        case STATE_PROCESSING_ALERTS:
-            Serial.println("State: Processing Alerts");
-            processAlerts();
-            currentState = STATE_BLE_COMMUNICATION;
-            break;
+            // Delta frames imply timestamps from the period, so follow the sampler
+            if (bleManager.getSamplePeriod() != samplePeriodMs) {
+                bleManager.setSamplePeriod(samplePeriodMs);
+            }
+            
+            bleManager.updateBroadcast(sample.data, sample.alert);
             
-        case STATE_BLE_COMMUNICATION:
             // Send data via BLE if connected or within timeout
             if (bleManager.isConnected() || !bleManager.hasTimedOut()) {
-                bleManager.sendSensorData(currentSensorData, currentAlert);
+                bleManager.queueSensorData(sample.data, sample.alert);
             }
             
-            //Check if we should continue or sleep
-            if (bleManager.hasTimedOut() && !bleManager.isConnected()) {
-                Serial.println("BLE timeout reached");
-                // currentState = STATE_PREPARING_SLEEP;
-                currentState = STATE_READING_SENSORS;
-            } else {
-                // Continue monitoring
-                currentState = STATE_READING_SENSORS;
+            // Everything the pipeline needs exists by the first streamed sample
+            if (!heapMonitor.isSteady() && bleManager.isConnected()) {
+                heapMonitor.beginSteadyState();
             }
-            break;
-            
-        case STATE_PREPARING_SLEEP:
-            Serial.println("State: Preparing for Sleep");
-            buzzerManager.stopAlert();
-            bleManager.stop();
+            heapMonitor.checkSample();
             
-            delay(1000);
-            enterDeepSleep();
-            break;
+            if (sample.data.replayed) {
+                replaySource.noteDelivered(sample.data, sample.alert);
+            }
             
-        default:
-            currentState = STATE_WAKING_UP;
-            break;
+            if (bleManager.hasTimedOut() && !bleManager.isConnected()) {
+                LOG_W(TAG, "BLE timeout reached");
+            }
+        }
+        
+        SummaryRecord summary;
+        while (statsManager.nextSummary(summary)) {
+            storageManager.appendSummary(summary);
+            if (bleManager.getStreamFormat() == STREAM_FORMAT_SUMMARY) {
+                bleManager.sendSummary(summary);
+            }
+        }
+        
+        if (bleManager.nextFlushDelay() == 0) {
+            bleManager.flushBatch();
+        }
+        
+        if (bleManager.isBackfilling()) {
+            bleManager.sendBackfillFrame();
+        }
+        
+        if (bleManager.isBenchmarking()) {
+            bleManager.sendBenchmarkFrame();
+        }
+        
+        if (bleManager.isSendingCapture()) {
+            bleManager.sendCaptureFrame();
+        }
+        
+        bleManager.publishLinkStats();
+    }
+}
+
+// Decodes button gestures; sleeps until the next button edge or
+// debounce/gesture deadline
+void uiTask(void* param) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, buttonManager.nextUpdateDelay());
+        
+        uint8_t events = buttonManager.update();
+        
+        // Press stops the current alert, double press mutes, hold sleeps
+        if (events & BUTTON_EVENT_PRESS) {
+            if (buzzerManager.isBuzzerActive()) {
+                buzzerManager.stopAlert();
+                LOG_I(TAG, "Buzzer stopped by button press");
+            }
+        }
+        
+        if (events & BUTTON_EVENT_DOUBLE_PRESS) {
+            buzzerManager.mute();
+        }
+        
+        if (events & BUTTON_EVENT_HOLD) {
+            if (currentState != STATE_SLEEPING) {
+                LOG_I(TAG, "Button held - preparing for sleep");
+                signalEvent(EVT_SLEEP_REQUEST);
+            }
+        }
     }
 }
 
-void processAlerts() {
-    if (!currentSensorData.valid) {
+void prepareSleep() {
+    setState(STATE_PREPARING_SLEEP);
+    LOG_I(TAG, "State: Preparing for Sleep");
+    
+    // Stop the pipeline before tearing down the peripherals it uses; the
+    // tasks are suspended wherever they are, so stop supervising them first.
+    // The transport task may be mid-backfill on the flash log, so it parks
+    // itself instead.
+    watchdogManager.stop();
+    replayManager.stop();
+    vTaskSuspend(acquisitionTaskHandle);
+    vTaskSuspend(alertTaskHandle);
+    vTaskSuspend(uiTaskHandle);
+    xEventGroupSetBits(systemEvents, EVT_TRANSPORT_STOP);
+    EventBits_t parked = xEventGroupWaitBits(systemEvents, EVT_TRANSPORT_PARKED, pdTRUE, pdFALSE,
+                                             pdMS_TO_TICKS(TRANSPORT_STOP_TIMEOUT_MS));
+    if (!(parked & EVT_TRANSPORT_PARKED)) {
+        LOG_W(TAG, "Transport task did not park, suspending it");
+        vTaskSuspend(transportTaskHandle);
+    }
+    
+    respirationEngine.stop();
+    buzzerManager.stopAlert();
+    buzzerManager.playWelcomeSound();   // Plays out during the settle delay
+    bleManager.stop();
+    storageManager.sync();
+    flashLogManager.sync();
+    
+    retainedState.alert = currentAlert;
+    retainedState.lastReading = currentSensorData;
+    retainedState.magic = SYSTEM_STATE_MAGIC;
+    
+    vTaskDelay(pdMS_TO_TICKS(SLEEP_SETTLE_MS));
+    enterDeepSleep();
+}
+
+void processAlerts(const SensorData& data) {
+    if (!data.valid) {
         return;
     }
     
-    AlertLevel newAlert = sensorManager.getAlertLevel(currentSensorData.co2_ppm);
+    // The EWMA keeps single noisy readings from toggling the buzzer
+    SensorData smoothed = data;
+    smoothed.co2 = statsManager.smoothedCo2(data.co2);
+    AlertLevel newAlert = alertPolicy.update(smoothed);
     
     if (newAlert != currentAlert && newAlert != ALERT_NONE) {
         currentAlert = newAlert;
         buzzerManager.startAlert(newAlert);
         
-        Serial.printf("Alert Level: %d (CO2: %.1f ppm)\n", 
-                      (int)newAlert, currentSensorData.co2_ppm);
+        LOG_I(TAG, "Alert Level: %d (CO2: %u ppm, smoothed %u ppm)", 
+                      (int)newAlert, data.co2, smoothed.co2);
     } else if (newAlert == ALERT_NONE && currentAlert != ALERT_NONE) {
         currentAlert = ALERT_NONE;
         buzzerManager.stopAlert();
     }
 }
 
+// Runs every queued command in arrival order and acknowledges each one
 void handleBLECommands() {
-    BLECommand command = bleManager.getCommand();
-    
-    if (command != CMD_NONE) {
-        switch (command) {
-            case CMD_MUTE_BUZZER:
-                buzzerManager.mute();
-                Serial.println("Executed: Mute buzzer");
-                break;
-                
-            case CMD_FORCE_SLEEP:
-                Serial.println("Executed: Force sleep");
-                currentState = STATE_PREPARING_SLEEP;
-                break;
-                
-            case CMD_REQUEST_DATA:
-                Serial.println("Executed: Request data");
-                bleManager.sendSensorData(currentSensorData, currentAlert);
-                break;
-                
-            case CMD_RESET_ALERTS:
-                Serial.println("Executed: Reset alerts");
-                buzzerManager.stopAlert();
-                buzzerManager.unmute();
-                currentAlert = ALERT_NONE;
-                break;
-                
-            default:
-                break;
+    bleManager.sendRejections();
+    
+    CommandFrame frame;
+    while (bleManager.nextCommand(frame)) {
+        bleManager.acknowledge(frame, executeCommand(frame));
+    }
+}
+
+CommandStatus executeCommand(const CommandFrame& frame) {
+    switch (frame.opcode) {
+        case CMD_MUTE_BUZZER:
+            buzzerManager.mute();
+            LOG_D(TAG, "Executed: Mute buzzer");
+            break;
+            
+        case CMD_FORCE_SLEEP:
+            LOG_D(TAG, "Executed: Force sleep");
+            signalEvent(EVT_SLEEP_REQUEST);
+            break;
+            
+        case CMD_REQUEST_DATA:
+            LOG_D(TAG, "Executed: Request data");
+            bleManager.flushBatch();
+            bleManager.sendSensorData(currentSensorData, currentAlert);
+            break;
+            
+        case CMD_RESET_ALERTS:
+            LOG_D(TAG, "Executed: Reset alerts");
+            buzzerManager.stopAlert();
+            buzzerManager.unmute();
+            alertPolicy.reset();
+            currentAlert = ALERT_NONE;
+            break;
+            
+        case CMD_STREAM_BATCH:
+            LOG_D(TAG, "Executed: Stream batched packets");
+            bleManager.setStreamFormat(STREAM_FORMAT_BATCH);
+            break;
+            
+        case CMD_STREAM_DELTA:
+            LOG_D(TAG, "Executed: Stream delta frames");
+            bleManager.setStreamFormat(STREAM_FORMAT_DELTA);
+            break;
+            
+        case CMD_STREAM_SUMMARY:
+            LOG_D(TAG, "Executed: Stream summaries only");
+            bleManager.setStreamFormat(STREAM_FORMAT_SUMMARY);
+            break;
+            
+        case CMD_BACKFILL:
+            LOG_D(TAG, "Executed: Backfill history");
+            bleManager.startBackfill(frame.argument);
+            break;
+            
+        case CMD_SET_SAMPLE_PERIOD:
+            // 0 hands the period back to the adaptive sampler
+            if (frame.argument != 0 &&
+                (frame.argument < SAMPLE_PERIOD_MIN_MS || frame.argument > SAMPLE_PERIOD_MAX_MS)) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            adaptiveSampler.setFixedPeriod((uint16_t)frame.argument);
+            LOG_I(TAG, "Sample period %s %u ms", frame.argument ? "fixed at" : "adaptive, now",
+                          frame.argument ? frame.argument : adaptiveSampler.period());
+            break;
+            
+        case CMD_SET_BATCH_SIZE:
+            if (frame.argument > UINT8_MAX || !bleManager.setBatchSize((uint8_t)frame.argument)) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            LOG_I(TAG, "Batch size set to %u samples", frame.argument);
+            break;
+            
+        case CMD_REPLAY:
+            if ((frame.argument >> 16) > REPLAY_FAST) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            if (!replayManager.start((uint16_t)frame.argument, (ReplaySpeed)(frame.argument >> 16))) {
+                return COMMAND_BUSY;
+            }
+            break;
+            
+        case CMD_STOP_REPLAY:
+            LOG_D(TAG, "Executed: Stop replay");
+            replayManager.stop();
+            break;
+            
+        case CMD_BENCHMARK:
+            if (!bleManager.startBenchmark((uint16_t)frame.argument, (uint16_t)(frame.argument >> 16))) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            break;
+            
+        case CMD_STOP_BENCHMARK:
+            LOG_D(TAG, "Executed: Stop link benchmark");
+            bleManager.stopBenchmark();
+            break;
+            
+        case CMD_CAPTURE:
+            if (!respirationEngine.isReady() || frame.argument > UINT32_MAX / 1000) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            bleManager.stopCaptureTransfer();
+            if (!captureManager.start(frame.argument * 1000)) {
+                return COMMAND_BUSY;
+            }
+            break;
+            
+        case CMD_SEND_CAPTURE:
+            if (captureManager.getState() == CAPTURE_RUNNING) {
+                return COMMAND_BUSY;
+            }
+            if (!bleManager.startCaptureTransfer(frame.argument)) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            break;
+            
+        case CMD_STOP_CAPTURE:
+            LOG_D(TAG, "Executed: Stop capture");
+            captureManager.stop();
+            bleManager.stopCaptureTransfer();
+            break;
+            
+        case CMD_TIME_SYNC: {
+            uint64_t epochMs = ((uint64_t)frame.argumentHigh << 32) | frame.argument;
+            if (epochMs == 0) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            timeSyncManager.setEpoch(epochMs);
+            LOG_D(TAG, "Executed: Time sync");
+            break;
         }
-        
-        bleManager.clearCommand();
+            
+        case CMD_PING:
+            bleManager.sendPong(frame);
+            break;
+            
+        case CMD_BROADCAST:
+            if (frame.argument > 1) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            bleManager.setBroadcast(frame.argument == 1);
+            LOG_D(TAG, "Executed: Broadcast %s", frame.argument ? "on" : "off");
+            break;
+            
+        case CMD_SET_PROFILE:
+            if (frame.argument >= BLE_PROFILE_COUNT ||
+                !bleManager.setProfile((BLEProfile)frame.argument)) {
+                return COMMAND_INVALID_ARGUMENT;
+            }
+            break;
+            
+        default:
+            return COMMAND_UNKNOWN;
     }
+    return COMMAND_OK;
 }
 
 void enterDeepSleep() {    
@@ -218,10 +689,9 @@ void enterDeepSleep() {
         delay(100);
     }
     
-    Serial.println("Button released, proceeding to sleep");
-    buzzerManager.playWelcomeSound();
-    Serial.flush();
+    LOG_I(TAG, "Button released, proceeding to sleep");
+    logManager.flush();
     
     // Enter deep sleep
     esp_deep_sleep_start();
-}
\ No newline at end of file
+}
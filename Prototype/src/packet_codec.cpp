@@ -0,0 +1,236 @@
+#include "packet_codec.h"
+
+#include <string.h>
+
+void encodeSensorPacket(const SensorData& data, AlertLevel alertLevel, SensorPacket& packet) {
+    packet.co2 = data.co2;
+    packet.humidity = data.humidity;
+    packet.temperature = data.temperature;
+    packet.alert = (uint8_t)alertLevel;
+    packet.status = (data.valid ? SENSOR_STATUS_VALID : 0) | (data.replayed ? SENSOR_STATUS_REPLAYED : 0);
+    packet.timestamp = (uint32_t)(data.timestamp / 1000); // seconds since boot at capture
+    packet.sequence = data.sequence;
+    packet.breathRate = data.breathRate;
+    packet.inhaleMs = data.inhale_ms;
+    packet.exhaleMs = data.exhale_ms;
+
+    // Whatever the clock reading is, it has to fall inside the packet's second
+    int64_t micros = data.captureUs - (int64_t)packet.timestamp * 1000000;
+    packet.captureMicros = (data.captureUs >= 0 && micros >= 0 && micros < 1000000) ?
+                           (uint32_t)micros : SENSOR_MICROS_UNKNOWN;
+}
+
+void decodeSensorPacket(const SensorPacket& packet, SensorData& data) {
+    data.co2 = packet.co2;
+    data.humidity = packet.humidity;
+    data.temperature = packet.temperature;
+    data.valid = (packet.status & SENSOR_STATUS_VALID) != 0;
+    data.replayed = (packet.status & SENSOR_STATUS_REPLAYED) != 0;
+    data.timestamp = (unsigned long)packet.timestamp * 1000;
+    data.captureUs = packet.captureMicros != SENSOR_MICROS_UNKNOWN ?
+                     (int64_t)packet.timestamp * 1000000 + packet.captureMicros : -1;
+    data.sequence = packet.sequence;
+    data.breathRate = packet.breathRate;
+    data.inhale_ms = packet.inhaleMs;
+    data.exhale_ms = packet.exhaleMs;
+}
+
+// Reads decimal digits from data[i] on; false if the value overflows 32 bits
+static bool decodeDecimal(const uint8_t* data, size_t length, size_t& i, uint32_t& value) {
+    value = 0;
+    for (; i < length && data[i] >= '0' && data[i] <= '9'; i++) {
+        uint32_t digit = data[i] - '0';
+        if (value > (UINT32_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+// "<opcode>" or "<opcode>:<argument>" in decimal, and nothing else
+static bool decodeTextCommand(const uint8_t* data, size_t length, CommandFrame& frame) {
+    uint32_t value;
+    size_t i = 0;
+    if (!decodeDecimal(data, length, i, value) || value == 0 || value > UINT8_MAX) {
+        return false;
+    }
+    frame.opcode = (uint8_t)value;
+
+    if (i < length && data[i] == ':') {
+        i++;
+        if (!decodeDecimal(data, length, i, value)) {
+            return false;
+        }
+        frame.argument = value;
+    }
+    return i == length;
+}
+
+bool decodeCommandFrame(const uint8_t* data, size_t length, CommandFrame& frame) {
+    memset(&frame, 0, sizeof(frame));
+    if (data == nullptr || length == 0) {
+        return false;
+    }
+
+    if (data[0] >= '0' && data[0] <= '9') {
+        return decodeTextCommand(data, length, frame);
+    }
+
+    if (length < 2 || length > COMMAND_FRAME_MAX_LENGTH || data[0] == 0) {
+        return false;
+    }
+    frame.opcode = data[0];
+    frame.requestId = data[1];
+    for (size_t i = 2; i < length && i < 6; i++) {
+        frame.argument |= (uint32_t)data[i] << (8 * (i - 2));
+    }
+    for (size_t i = 6; i < length; i++) {
+        frame.argumentHigh |= (uint32_t)data[i] << (8 * (i - 6));
+    }
+    return true;
+}
+
+size_t encodeBarePacket(const SensorPacket& packet, size_t payload, uint8_t* out) {
+    size_t length = payload >= SENSOR_PACKET_RESPIRATION_SIZE ? SENSOR_PACKET_RESPIRATION_SIZE :
+                    payload >= SENSOR_PACKET_LEGACY_SIZE ? SENSOR_PACKET_LEGACY_SIZE : 0;
+    memcpy(out, &packet, length);
+    return length;
+}
+
+// A bare 26-byte packet could not be told apart from a one-sample delta
+// frame, and entrySize lets older apps skip the capture micros
+size_t encodeLiveFrame(const SensorPacket& packet, size_t payload, uint8_t* out) {
+    if (payload < LIVE_FRAME_MAX_SIZE) {
+        return encodeBarePacket(packet, payload, out);
+    }
+    BatchHeader header = {BLE_FRAME_BATCH, 1, sizeof(SensorPacket), 0, packet.sequence};
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), &packet, sizeof(packet));
+    return LIVE_FRAME_MAX_SIZE;
+}
+
+size_t encodeBroadcast(const SensorPacket& packet, bool connected, uint8_t* out) {
+    BroadcastSummary summary;
+    summary.version = BROADCAST_VERSION;
+    summary.flags = (packet.alert & 0x0F) | (connected ? BROADCAST_FLAG_CONNECTED : 0);
+    summary.co2 = packet.co2;
+    summary.breathRate = packet.breathRate;
+    summary.temperature = packet.temperature;
+    summary.humidity = packet.humidity;
+    summary.sequence = packet.sequence;
+
+    // AD structures: length (type and data), type, data
+    size_t n = 0;
+    out[n++] = 2;
+    out[n++] = 0x01;                    // Flags
+    out[n++] = 0x06;                    // LE general discoverable, no BR/EDR
+    out[n++] = 3 + sizeof(summary);
+    out[n++] = 0xFF;                    // Manufacturer specific data
+    out[n++] = BLE_BROADCAST_COMPANY_ID & 0xFF;
+    out[n++] = BLE_BROADCAST_COMPANY_ID >> 8;
+    memcpy(out + n, &summary, sizeof(summary));
+    return n + sizeof(summary);
+}
+
+size_t writeVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+size_t readVarint(const uint8_t* in, size_t length, uint32_t& value) {
+    value = 0;
+    for (size_t n = 0; n < length && n < 5; n++) {
+        value |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+DeltaEncoder::DeltaEncoder() {
+    buffer = nullptr;
+    capacity = 0;
+    periodMs = 0;
+    reset();
+}
+
+void DeltaEncoder::begin(uint8_t* frameBuffer, size_t frameCapacity, uint16_t samplePeriodMs) {
+    buffer = frameBuffer;
+    capacity = frameCapacity;
+    periodMs = samplePeriodMs;
+    reset();
+}
+
+void DeltaEncoder::reset() {
+    used = 0;
+    sampleCount = 0;
+    firstSequence = 0;
+    firstTimestampMs = 0;
+    memset(&previous, 0, sizeof(previous));
+}
+
+bool DeltaEncoder::append(const SensorPacket& packet, uint32_t timestampMs) {
+    if (buffer == nullptr) {
+        return false;
+    }
+
+    if (sampleCount == 0) {
+        if (capacity < sizeof(DeltaHeader) + sizeof(DeltaKeyframe)) {
+            return false;
+        }
+
+        firstSequence = packet.sequence;
+        firstTimestampMs = timestampMs;
+
+        DeltaKeyframe key;
+        key.co2 = packet.co2;
+        key.humidity = packet.humidity;
+        key.temperature = packet.temperature;
+        key.alert = packet.alert;
+        key.status = packet.status;
+        key.breathRate = packet.breathRate;
+        key.inhaleMs = packet.inhaleMs;
+        key.exhaleMs = packet.exhaleMs;
+        memcpy(buffer + sizeof(DeltaHeader), &key, sizeof(key));
+        used = sizeof(DeltaHeader) + sizeof(key);
+    } else {
+        if (sampleCount == UINT8_MAX || used + MAX_SAMPLE_SIZE > capacity) {
+            return false;
+        }
+        if (packet.sequence != firstSequence + sampleCount) {
+            return false;
+        }
+
+        int32_t drift = (int32_t)(timestampMs - (firstTimestampMs + (uint32_t)sampleCount * periodMs));
+        if (drift > periodMs / 2 || -drift > periodMs / 2) {
+            return false;
+        }
+
+        used += writeVarint(buffer + used, zigzagEncode((int32_t)packet.co2 - previous.co2));
+        used += writeVarint(buffer + used, zigzagEncode((int32_t)packet.humidity - previous.humidity));
+        used += writeVarint(buffer + used, zigzagEncode((int32_t)packet.temperature - previous.temperature));
+        used += writeVarint(buffer + used, zigzagEncode((int32_t)packet.breathRate - previous.breathRate));
+        used += writeVarint(buffer + used, zigzagEncode((int32_t)packet.inhaleMs - previous.inhaleMs));
+        used += writeVarint(buffer + used, zigzagEncode((int32_t)packet.exhaleMs - previous.exhaleMs));
+        buffer[used++] = (uint8_t)((packet.alert & 0x0F) | (packet.status << 4));
+    }
+
+    previous = packet;
+    sampleCount++;
+
+    DeltaHeader header;
+    header.type = BLE_FRAME_DELTA;
+    header.count = sampleCount;
+    header.periodMs = periodMs;
+    header.firstSequence = firstSequence;
+    header.firstTimestampMs = firstTimestampMs;
+    memcpy(buffer, &header, sizeof(header));
+    return true;
+}
@@ -0,0 +1,58 @@
+#include "power.h"
+#include "log.h"
+#include "button.h"
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+static const char TAG[] = "power";
+
+PowerManager powerManager;
+
+PowerManager::PowerManager() {
+    lightSleepEnabled = false;
+}
+
+bool PowerManager::begin() {
+#if defined(CONFIG_PM_ENABLE) && defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_pm_config_t pmConfig = {};
+#else
+    esp_pm_config_esp32_t pmConfig = {};
+#endif
+    pmConfig.max_freq_mhz = POWER_MAX_CPU_MHZ;
+    pmConfig.min_freq_mhz = POWER_MIN_CPU_MHZ;
+    pmConfig.light_sleep_enable = true;
+
+    esp_err_t err = esp_pm_configure(&pmConfig);
+    if (err != ESP_OK) {
+        LOG_E(TAG, "Failed to enable light sleep (%d)", err);
+        return false;
+    }
+
+    // Timers wake the chip on their own; the pins have to be armed
+    enableWakeSources();
+    lightSleepEnabled = true;
+    LOG_I(TAG, "Automatic light sleep enabled");
+    return true;
+#else
+    LOG_I(TAG, "Light sleep not available in this build");
+    return false;
+#endif
+}
+
+// Light sleep only wakes on level-triggered GPIOs, which is why the button
+// and ENS160 interrupts are level-triggered too
+void PowerManager::enableWakeSources() {
+    buttonManager.enableWakeup();
+#if ENS160_INT_PIN >= 0
+    gpio_wakeup_enable((gpio_num_t)ENS160_INT_PIN, GPIO_INTR_LOW_LEVEL);
+#endif
+    esp_sleep_enable_gpio_wakeup();
+}
+
+bool PowerManager::isLightSleepEnabled() {
+    return lightSleepEnabled;
+}
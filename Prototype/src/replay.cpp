@@ -0,0 +1,164 @@
+#include "replay.h"
+#include "alert_policy.h"
+
+ReplaySource replaySource;
+
+ReplaySource::ReplaySource() : active(false), inputDone(true), abandoned(false),
+                               played(0), delivered(0) {
+    speed = REPLAY_REALTIME;
+    periodMs = SENSOR_READ_INTERVAL_MS;
+    havePending = false;
+    started = false;
+    underruns = 0;
+    lastDeliveryMs = 0;
+    for (int i = 0; i < REPLAY_LEVELS; i++) {
+        conditionMs[i] = UINT32_MAX;
+        raisedMs[i] = UINT32_MAX;
+    }
+}
+
+bool ReplaySource::open(ReplaySpeed pace, uint16_t samplePeriodMs) {
+    if (active.load()) {
+        return false;
+    }
+
+    speed = pace;
+    periodMs = samplePeriodMs ? samplePeriodMs : SENSOR_READ_INTERVAL_MS;
+    havePending = false;
+    started = false;
+    underruns = 0;
+    lastDeliveryMs = 0;
+    for (int i = 0; i < REPLAY_LEVELS; i++) {
+        conditionMs[i] = UINT32_MAX;
+        raisedMs[i] = UINT32_MAX;
+    }
+    played.store(0);
+    delivered.store(0);
+    abandoned.store(false);
+    inputDone.store(false);
+    active.store(true);     // Last, so the acquisition task sees a complete session
+    return true;
+}
+
+void ReplaySource::stop() {
+    if (active.load()) {
+        abandoned.store(true);
+        inputDone.store(true);
+    }
+}
+
+bool ReplaySource::feed(const SensorPacket& packet) {
+    if (!active.load() || abandoned.load()) {
+        return false;
+    }
+    return records.push(packet);
+}
+
+bool ReplaySource::startReading() {
+    return active.load();
+}
+
+// Records sharing a recorded second (the log keeps whole seconds) are spread
+// by the session's sample period, so timestamps stay strictly increasing
+uint32_t ReplaySource::recordTimeMs(const SensorPacket& packet) {
+    if (started && packet.timestamp == lastSecond) {
+        subsecondMs = min(subsecondMs + periodMs, (uint32_t)999);
+    } else {
+        subsecondMs = 0;
+    }
+    lastSecond = packet.timestamp;
+    return packet.timestamp * 1000 + subsecondMs;
+}
+
+bool ReplaySource::takeNext() {
+    if (!records.pop(next)) {
+        return false;
+    }
+    nextRecordMs = recordTimeMs(next);
+    if (!started) {
+        started = true;
+        firstRecordMs = nextRecordMs;
+        startedMs = millis();
+    }
+    releaseAtMs = startedMs + (nextRecordMs - firstRecordMs);
+    havePending = true;
+    return true;
+}
+
+ReadStatus ReplaySource::pollReading(SensorData& data) {
+    if (abandoned.load()) {
+        SensorPacket discarded;
+        while (records.pop(discarded)) {
+        }
+        havePending = false;
+        active.store(false);
+        return READ_FAILED;
+    }
+
+    if (!havePending && !takeNext()) {
+        // The feeder pushes its last record before finishing, so look once more
+        if (inputDone.load() && !takeNext()) {
+            active.store(false);
+            return READ_FAILED;
+        }
+        if (!havePending) {
+            underruns++;
+            return READ_PENDING;
+        }
+    }
+
+    if (speed == REPLAY_REALTIME && (int32_t)(releaseAtMs - (uint32_t)millis()) > 0) {
+        return READ_PENDING;
+    }
+
+    decodeSensorPacket(next, data);
+    data.timestamp = nextRecordMs;
+    data.captureUs = -1;            // Recorded clock, not this boot's
+    data.replayed = true;
+    havePending = false;
+
+    // When the raw readings first called for each level, to time the pipeline's response
+    AlertLevel level = AlertPolicy::classify(data);
+    for (int i = ALERT_LOW; i <= level; i++) {
+        if (conditionMs[i] == UINT32_MAX) {
+            conditionMs[i] = nextRecordMs;
+        }
+    }
+    played.fetch_add(1);
+    return READ_COMPLETE;
+}
+
+TickType_t ReplaySource::nextPollDelay() {
+    if (!havePending) {
+        return pdMS_TO_TICKS(REPLAY_POLL_MS);
+    }
+    if (speed == REPLAY_FAST) {
+        return 0;
+    }
+    int32_t remaining = (int32_t)(releaseAtMs - (uint32_t)millis());
+    return remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+}
+
+void ReplaySource::noteDelivered(const SensorData& data, AlertLevel alertLevel) {
+    for (int i = ALERT_LOW; i <= alertLevel; i++) {
+        if (raisedMs[i] == UINT32_MAX) {
+            raisedMs[i] = (uint32_t)data.timestamp;
+        }
+    }
+    lastDeliveryMs = millis();
+    delivered.fetch_add(1);
+}
+
+ReplayReport ReplaySource::getReport() const {
+    ReplayReport result;
+    result.played = played.load();
+    result.delivered = delivered.load();
+    result.underruns = underruns;
+    result.elapsedMs = (started && result.delivered > 0) ? lastDeliveryMs - startedMs : 0;
+    for (int i = 0; i < REPLAY_LEVELS; i++) {
+        bool seen = conditionMs[i] != UINT32_MAX && raisedMs[i] != UINT32_MAX;
+        result.alertLatencyMs[i] = seen ? raisedMs[i] - conditionMs[i] : UINT32_MAX;
+    }
+    result.alertLatencyMs[ALERT_NONE] = 0;
+    return result;
+}
@@ -0,0 +1,129 @@
+#include "replay.h"
+#include "storage.h"
+#include "log.h"
+
+static const char TAG[] = "replay";
+
+ReplayManager replayManager;
+
+ReplayManager::ReplayManager() {
+    taskHandle = nullptr;
+    input = REPLAY_INPUT_SD;
+    path[0] = '\0';
+    stopRequested = false;
+}
+
+bool ReplayManager::begin() {
+    if (xTaskCreatePinnedToCore(readerTask, "replay", TASK_REPLAY_STACK, this,
+                                TASK_REPLAY_PRIO, &taskHandle, TASK_REPLAY_CORE) != pdPASS) {
+        LOG_E(TAG, "Failed to create replay task!");
+        taskHandle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ReplayManager::start(uint16_t session, ReplaySpeed speed) {
+    if (taskHandle == nullptr || replaySource.isActive()) {
+        return false;
+    }
+
+    uint16_t periodMs = SENSOR_READ_INTERVAL_MS;
+    if (session == 0) {
+        input = REPLAY_INPUT_SERIAL;
+    } else {
+        input = REPLAY_INPUT_SD;
+        snprintf(path, sizeof(path), "/session_%04u.bin", session);
+        StorageFileHeader header;
+        if (!storageManager.readHeader(path, header)) {
+            LOG_W(TAG, "No session log %s", path);
+            return false;
+        }
+        periodMs = (uint16_t)header.samplePeriodMs;
+    }
+
+    if (!replaySource.open(speed, periodMs)) {
+        return false;
+    }
+    stopRequested = false;
+    xTaskNotifyGive(taskHandle);
+    LOG_I(TAG, "Replaying %s %s", input == REPLAY_INPUT_SERIAL ? "serial input" : path,
+          speed == REPLAY_FAST ? "as fast as possible" : "in real time");
+    return true;
+}
+
+void ReplayManager::stop() {
+    stopRequested = true;
+    replaySource.stop();
+}
+
+void ReplayManager::readerTask(void* param) {
+    ReplayManager* self = static_cast<ReplayManager*>(param);
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (self->input == REPLAY_INPUT_SERIAL) {
+            self->readSerial();
+        } else {
+            self->readSession();
+        }
+        replaySource.finish();
+    }
+}
+
+// Waits for queue space; the reader runs below the pipeline, so playback
+// never waits on it while records are buffered
+static bool feedRecord(const SensorPacket& packet, volatile bool& stopRequested) {
+    while (!replaySource.feed(packet)) {
+        if (stopRequested) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(REPLAY_POLL_MS));
+    }
+    return true;
+}
+
+void ReplayManager::readSession() {
+    SensorPacket chunk[REPLAY_READ_CHUNK];
+    uint32_t fromSequence = 0;
+
+    while (!stopRequested) {
+        size_t count = storageManager.readRange(path, fromSequence, chunk, REPLAY_READ_CHUNK);
+        if (count == 0) {
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!feedRecord(chunk[i], stopRequested)) {
+                return;
+            }
+        }
+        fromSequence = chunk[count - 1].sequence + 1;
+    }
+}
+
+// REPLAY_SERIAL_SYNC then one little-endian SensorPacket per record, and
+// REPLAY_SERIAL_END after the last; anything else is skipped to resynchronise
+void ReplayManager::readSerial() {
+    SensorPacket packet;
+
+    while (!stopRequested) {
+        if (Serial.available() <= 0) {
+            vTaskDelay(pdMS_TO_TICKS(REPLAY_POLL_MS));
+            continue;
+        }
+        int marker = Serial.read();
+        if (marker == REPLAY_SERIAL_END) {
+            return;
+        }
+        if (marker != REPLAY_SERIAL_SYNC) {
+            continue;
+        }
+        if (Serial.readBytes((uint8_t*)&packet, sizeof(packet)) != sizeof(packet)) {
+            LOG_W(TAG, "Truncated replay record");
+            continue;
+        }
+        if (!feedRecord(packet, stopRequested)) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,240 @@
+#include "respiration.h"
+#include "log.h"
+#include "diagnostics.h"
+#include "capture.h"
+#include "watchdog.h"
+
+static const char TAG[] = "resp";
+
+RespirationEngine respirationEngine;
+
+// BMP280 registers
+#define BMP280_REG_CALIBRATION  0x88
+#define BMP280_REG_CHIP_ID      0xD0
+#define BMP280_REG_CTRL_MEAS    0xF4
+#define BMP280_REG_CONFIG       0xF5
+#define BMP280_REG_DATA         0xF7    // Pressure then temperature, 20 bits each
+#define BMP280_CHIP_ID          0x58
+
+#define RESPIRATION_STATE_MAGIC 0x52455350  // "RESP"
+
+// BMP280 trim read on the first boot; the sensor stays configured in
+// normal mode while the ESP32 deep sleeps
+struct RespirationRetainedState {
+    uint32_t magic;
+    Bmp280Calibration calibration;
+};
+
+RTC_DATA_ATTR static RespirationRetainedState rtcRespirationState;
+
+// Normal mode, temperature x1 (compensation only), pressure x4
+#define BMP280_CTRL_MEAS_VALUE  0x2F
+// 0.5 ms standby, IIR filter off (filtering is done in software)
+#define BMP280_CONFIG_VALUE     0x00
+
+// Published state is written on each breath and read by the acquisition task
+static portMUX_TYPE respirationLock = portMUX_INITIALIZER_UNLOCKED;
+
+RespirationEngine::RespirationEngine()
+    : bmp(BMP280_I2C_ADDRESS, I2C_PRIORITY_HIGH), detector(RESPIRATION_PERIOD_MS) {
+    memset(&calibration, 0, sizeof(calibration));
+    timer = nullptr;
+    taskHandle = nullptr;
+    initialized = false;
+    published = detector.state();
+    overruns = 0;
+    readErrors = 0;
+}
+
+bool RespirationEngine::begin(bool warmBoot) {
+    if (!bmp.begin() || !configureSensor(warmBoot)) {
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(samplingTask, "respiration", TASK_RESPIRATION_STACK, this,
+                                TASK_RESPIRATION_PRIO, &taskHandle,
+                                TASK_RESPIRATION_CORE) != pdPASS) {
+        LOG_E(TAG, "Failed to create respiration task!");
+        return false;
+    }
+    diagnosticsManager.registerTask(DIAG_TASK_RESPIRATION, taskHandle);
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = timerCallback;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "respiration";
+    if (esp_timer_create(&timerArgs, &timer) != ESP_OK ||
+        esp_timer_start_periodic(timer, RESPIRATION_PERIOD_MS * 1000ULL) != ESP_OK) {
+        LOG_E(TAG, "Failed to start respiration timer!");
+        return false;
+    }
+
+    initialized = true;
+    return true;
+}
+
+void RespirationEngine::timerCallback(void* arg) {
+    RespirationEngine* self = (RespirationEngine*)arg;
+    xTaskNotifyGive(self->taskHandle);
+}
+
+void RespirationEngine::samplingTask(void* param) {
+    RespirationEngine* self = (RespirationEngine*)param;
+
+    for (;;) {
+        watchdogManager.idle(DIAG_TASK_RESPIRATION);
+        // More than one pending tick means the previous sample ran long
+        uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        watchdogManager.busy(DIAG_TASK_RESPIRATION);
+        if (ticks > 1) {
+            self->overruns += ticks - 1;
+            captureManager.recordMissing(ticks - 1);
+        }
+
+        int32_t pressure;
+        if (!self->readPressure(pressure)) {
+            self->readErrors++;
+            captureManager.recordMissing(1);
+            continue;
+        }
+        captureManager.record(pressure);
+
+        if (self->detector.process(pressure)) {
+            portENTER_CRITICAL(&respirationLock);
+            self->published = self->detector.state();
+            portEXIT_CRITICAL(&respirationLock);
+        } else if (self->detector.state().breathsPerMinuteX10 == 0 &&
+                   self->published.breathsPerMinuteX10 != 0) {
+            // Breathing stopped long enough for the rate to reset
+            portENTER_CRITICAL(&respirationLock);
+            self->published.breathsPerMinuteX10 = 0;
+            portEXIT_CRITICAL(&respirationLock);
+        }
+    }
+}
+
+bool RespirationEngine::configureSensor(bool warmBoot) {
+    // A warm boot only has to confirm the sensor is still sampling
+    uint8_t ctrlMeas = 0;
+    if (warmBoot && rtcRespirationState.magic == RESPIRATION_STATE_MAGIC &&
+        bmp.readRegisters(BMP280_REG_CTRL_MEAS, &ctrlMeas, 1) &&
+        ctrlMeas == BMP280_CTRL_MEAS_VALUE) {
+        calibration = rtcRespirationState.calibration;
+        LOG_I(TAG, "BMP280 resumed without reconfiguration");
+        return true;
+    }
+
+    uint8_t chipId = 0;
+    if (!bmp.readRegisters(BMP280_REG_CHIP_ID, &chipId, 1) || chipId != BMP280_CHIP_ID) {
+        LOG_W(TAG, "BMP280 not found, respiration disabled");
+        return false;
+    }
+
+    // Continuous conversions so every read returns a fresh sample without waiting
+    if (!readCalibration() ||
+        !bmp.writeRegister(BMP280_REG_CONFIG, BMP280_CONFIG_VALUE) ||
+        !bmp.writeRegister(BMP280_REG_CTRL_MEAS, BMP280_CTRL_MEAS_VALUE)) {
+        LOG_E(TAG, "Failed to configure BMP280!");
+        return false;
+    }
+
+    rtcRespirationState.calibration = calibration;
+    rtcRespirationState.magic = RESPIRATION_STATE_MAGIC;
+    LOG_I(TAG, "BMP280 sensor initialized");
+    return true;
+}
+
+bool RespirationEngine::readCalibration() {
+    uint8_t raw[24];
+    if (!bmp.readRegisters(BMP280_REG_CALIBRATION, raw, sizeof(raw))) {
+        return false;
+    }
+
+    // Little-endian words in register order
+    uint16_t words[12];
+    for (int i = 0; i < 12; i++) {
+        words[i] = raw[2 * i] | (raw[2 * i + 1] << 8);
+    }
+    calibration.t1 = words[0];
+    calibration.t2 = (int16_t)words[1];
+    calibration.t3 = (int16_t)words[2];
+    calibration.p1 = words[3];
+    calibration.p2 = (int16_t)words[4];
+    calibration.p3 = (int16_t)words[5];
+    calibration.p4 = (int16_t)words[6];
+    calibration.p5 = (int16_t)words[7];
+    calibration.p6 = (int16_t)words[8];
+    calibration.p7 = (int16_t)words[9];
+    calibration.p8 = (int16_t)words[10];
+    calibration.p9 = (int16_t)words[11];
+    return calibration.p1 != 0;
+}
+
+// Burst-reads pressure and temperature and applies the datasheet's integer
+// compensation. Result is pascals in Q28.4, the detector's input format.
+bool RespirationEngine::readPressure(int32_t& pressureX16) {
+    uint8_t raw[6];
+    if (!bmp.readRegisters(BMP280_REG_DATA, raw, sizeof(raw))) {
+        return false;
+    }
+
+    int32_t adcP = ((int32_t)raw[0] << 12) | ((int32_t)raw[1] << 4) | (raw[2] >> 4);
+    int32_t adcT = ((int32_t)raw[3] << 12) | ((int32_t)raw[4] << 4) | (raw[5] >> 4);
+    if (adcP == 0x80000) {
+        return false;   // Pressure measurement skipped
+    }
+
+    const Bmp280Calibration& c = calibration;
+    int32_t t1 = ((((adcT >> 3) - ((int32_t)c.t1 << 1))) * c.t2) >> 11;
+    int32_t t2 = (((((adcT >> 4) - (int32_t)c.t1) * ((adcT >> 4) - (int32_t)c.t1)) >> 12) * c.t3) >> 14;
+    int32_t tFine = t1 + t2;
+
+    int64_t var1 = (int64_t)tFine - 128000;
+    int64_t var2 = var1 * var1 * c.p6;
+    var2 = var2 + ((var1 * c.p5) << 17);
+    var2 = var2 + ((int64_t)c.p4 << 35);
+    var1 = ((var1 * var1 * c.p3) >> 8) + ((var1 * c.p2) << 12);
+    var1 = ((((int64_t)1 << 47) + var1) * c.p1) >> 33;
+    if (var1 == 0) {
+        return false;
+    }
+
+    int64_t p = 1048576 - adcP;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = ((int64_t)c.p9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = ((int64_t)c.p8 * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + ((int64_t)c.p7 << 4);
+
+    // p is Q24.8 pascals
+    pressureX16 = (int32_t)(p >> 4);
+    return true;
+}
+
+bool RespirationEngine::isReady() {
+    return initialized;
+}
+
+RespirationState RespirationEngine::getState() {
+    portENTER_CRITICAL(&respirationLock);
+    RespirationState state = published;
+    portEXIT_CRITICAL(&respirationLock);
+    return state;
+}
+
+void RespirationEngine::fillSensorData(SensorData& data) {
+    RespirationState state = getState();
+    data.breathRate = state.breathsPerMinuteX10;
+    data.inhale_ms = state.inhaleMs;
+    data.exhale_ms = state.exhaleMs;
+}
+
+uint32_t RespirationEngine::getOverruns() {
+    return overruns;
+}
+
+void RespirationEngine::stop() {
+    if (timer != nullptr) {
+        esp_timer_stop(timer);
+    }
+}
@@ -0,0 +1,62 @@
+#include "sampler.h"
+
+AdaptiveSampler adaptiveSampler;
+
+AdaptiveSampler::AdaptiveSampler() {
+    fixedPeriodMs = 0;
+    reset();
+}
+
+void AdaptiveSampler::reset() {
+    periodMs = SENSOR_READ_INTERVAL_MS;
+    primed = false;
+    lastCo2 = 0;
+    lastTimeMs = 0;
+    slopePpmPerMin = 0;
+    calmSamples = 0;
+}
+
+void AdaptiveSampler::setFixedPeriod(uint16_t period) {
+    fixedPeriodMs = period;
+}
+
+uint16_t AdaptiveSampler::targetPeriod(AlertLevel level) {
+    if (level >= ALERT_MEDIUM || slopePpmPerMin >= SAMPLER_FAST_SLOPE) {
+        return SAMPLE_PERIOD_MIN_MS;
+    }
+    if (level == ALERT_LOW || slopePpmPerMin >= SAMPLER_ACTIVE_SLOPE) {
+        return SAMPLE_PERIOD_ACTIVE_MS;
+    }
+    return SAMPLE_PERIOD_IDLE_MS;
+}
+
+// Integer ppm/min throughout: a step of at most 65535 ppm times 60000
+// still fits 32 bits, and the result saturates at UINT16_MAX
+uint16_t AdaptiveSampler::update(uint16_t co2Ppm, AlertLevel level, uint32_t timestampMs) {
+    if (primed && timestampMs != lastTimeMs) {
+        uint32_t step = co2Ppm > lastCo2 ? co2Ppm - lastCo2 : lastCo2 - co2Ppm;
+        step = step > SAMPLER_NOISE_PPM ? step - SAMPLER_NOISE_PPM : 0;
+        uint32_t instant = step * 60000UL / (uint32_t)(timestampMs - lastTimeMs);
+        if (instant > UINT16_MAX) {
+            instant = UINT16_MAX;
+        }
+        // Rises register at once; the average only decays gradually
+        slopePpmPerMin = instant > slopePpmPerMin ? (uint16_t)instant
+                                                  : (uint16_t)((slopePpmPerMin + instant) / 2);
+    }
+    primed = true;
+    lastCo2 = co2Ppm;
+    lastTimeMs = timestampMs;
+
+    uint16_t target = targetPeriod(level);
+    if (target <= periodMs) {
+        periodMs = target;
+        calmSamples = 0;
+    } else if (++calmSamples >= SAMPLER_CALM_SAMPLES) {
+        periodMs = target;
+        calmSamples = 0;
+    }
+
+    uint16_t fixed = fixedPeriodMs;
+    return fixed != 0 ? fixed : periodMs;
+}
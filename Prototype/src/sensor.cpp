@@ -1,127 +1,349 @@
 #include "sensor.h"
+#include "log.h"
+#include "events.h"
+#include <hal/gpio_ll.h>
+#include <esp_timer.h>
+
+static const char TAG[] = "sensor";
 
 SensorManager sensorManager;
 
-SensorManager::SensorManager() : ens160(0x53) {
+// ENS160 registers
+#define ENS160_REG_OPMODE       0x10
+#define ENS160_REG_CONFIG       0x11
+#define ENS160_REG_STATUS       0x20    // Followed by AQI, TVOC and eCO2
+#define ENS160_CONFIG_DATA_INT  0x23    // INT asserted (active low, push-pull) on new data
+#define ENS160_STATUS_NEWDAT    0x02
+
+// AHT21 trigger command and busy flag
+#define AHT21_CMD_TRIGGER       0xAC
+#define AHT21_STATUS_BUSY       0x80
+
+#define SENSOR_STATE_MAGIC      0x53454E53  // "SENS"
+
+// The sensors stay powered through deep sleep, so their configuration
+// outlives the ESP32's; this records that it was completed
+struct SensorRetainedState {
+    uint32_t magic;
+};
+
+RTC_DATA_ATTR static SensorRetainedState rtcSensorState;
+
+volatile bool SensorManager::ens160DataReady = false;
+
+SensorManager::SensorManager()
+    : ens160(ENS160_I2C_ADDRESS),
+      ahtDevice(AHT21_I2C_ADDRESS, I2C_PRIORITY_NORMAL),
+      ens160Device(ENS160_I2C_ADDRESS, I2C_PRIORITY_LOW) {
     initialized = false;
     lastReadTime = 0;
-    lastReading = {0, 0, 0, false, 0};
+    lastReading = SensorData{};
+    readInProgress = false;
+    dataReadyInterrupt = false;
+    ahtDone = false;
+    ahtTriggerTime = 0;
+    readStartTime = 0;
+    ahtHumidity = 0;
+    ahtTemperature = 0;
 }
 
-bool SensorManager::begin() {
-    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+bool SensorManager::begin(bool warmBoot) {
+    // Wire is started by the bus manager; the drivers below use it
+    // directly only while setting the sensors up
+    if (!ahtDevice.begin() || !ens160Device.begin()) {
+        return false;
+    }
+
+    if (warmBoot && resumeFromSleep()) {
+        LOG_I(TAG, "Sensors resumed without reconfiguration");
+    } else {
+        rtcSensorState.magic = 0;
+        if (!configureSensors()) {
+            return false;
+        }
+        rtcSensorState.magic = SENSOR_STATE_MAGIC;
+    }
+
+    dataReadyInterrupt = configureDataReadyInterrupt();
+    if (!dataReadyInterrupt) {
+        LOG_E(TAG, "Failed to configure ENS160 interrupt, polling status instead");
+    }
     
+    initialized = true;
+    return true;
+}
+
+// Cold start: reset and calibrate both sensors
+bool SensorManager::configureSensors() {
     // Initialize AHT21 sensor for humidity and temperature
     if (!aht.begin(&Wire)) {
         return false;
     }
-    Serial.println("AHT21 sensor initialized");
+    LOG_I(TAG, "AHT21 sensor initialized");
     
     // Initialize ENS160 sensor for CO2
     if (!ens160.begin()) {
         return false;
     }
-    Serial.println("ENS160 sensor initialized");
+    LOG_I(TAG, "ENS160 sensor initialized");
     
     ens160.setMode(ENS160_OPMODE_RESET);
     delay(100);
     if (!ens160.setMode(ENS160_OPMODE_STD)) {
-        Serial.println("Failed to set ENS160 operating mode!");
+        LOG_E(TAG, "Failed to set ENS160 operating mode!");
         return false;
     }
     delay(500); // Give sensor time to stabilize
-    
-    initialized = true;
     return true;
 }
 
+// After a deep sleep wake the ENS160 is still in standard mode and the
+// AHT21 still calibrated, unless they lost power; one register read tells
+bool SensorManager::resumeFromSleep() {
+    if (rtcSensorState.magic != SENSOR_STATE_MAGIC) {
+        return false;
+    }
+    uint8_t mode = 0;
+    return ens160Device.readRegisters(ENS160_REG_OPMODE, &mode, 1) && mode == ENS160_OPMODE_STD;
+}
+
 bool SensorManager::readSensors(SensorData& data) {
     if (!initialized) {
-        Serial.println("Sensors not initialized!");
+        LOG_E(TAG, "Sensors not initialized!");
         data.valid = false;
         return false;
     }
     
-    // Check if enough time has passed since last reading
+    // The ENS160 has nothing newer within its one-second update period
     unsigned long currentTime = millis();
-    if (currentTime - lastReadTime < SENSOR_READ_INTERVAL_MS && lastReading.valid) {
+    if (currentTime - lastReadTime < SAMPLE_PERIOD_MIN_MS && lastReading.valid) {
         data = lastReading;
         return true;
     }
-    
-    // Read from AHT21 (humidity and temperature)
-    sensors_event_t humidity, temp;
-    if (!aht.getEvent(&humidity, &temp)) {
-        Serial.println("Failed to read AHT21 sensor!");
+
+    if (!startReading()) {
         data.valid = false;
         return false;
     }
-    
-    // Read from ENS160 (CO2)
-    if (!ens160.measure(true)) {
-        Serial.println("ENS160 measurement failed!");
-        data.valid = false;
+
+    // Callers other than the acquisition task are not notified by the ISR,
+    // so wait in short steps
+    ReadStatus status;
+    while ((status = pollReading(data)) == READ_PENDING) {
+        TickType_t wait = nextPollDelay();
+        vTaskDelay(max((TickType_t)1, min(wait, (TickType_t)pdMS_TO_TICKS(ENS160_POLL_INTERVAL_MS))));
+    }
+    return status == READ_COMPLETE;
+}
+
+// Triggers the AHT21 conversion and arms the ENS160 data-ready wait.
+// Returns immediately; completion is reported by pollReading().
+bool SensorManager::startReading() {
+    if (!initialized) {
+        LOG_E(TAG, "Sensors not initialized!");
         return false;
     }
-    
-    // Check if data is available
-    if (!ens160.available()) {
-        Serial.println("ENS160 data not available!");
-        data.valid = false;
+
+    if (!triggerAht()) {
+        LOG_E(TAG, "Failed to trigger AHT21 conversion!");
         return false;
     }
-    
-    // Get ENS160 readings
-    uint16_t eco2 = ens160.geteCO2();
-    uint16_t tvoc = ens160.getTVOC();
-    uint8_t aqi = ens160.getAQI();
-    
+
+    unsigned long now = millis();
+    ahtTriggerTime = now;
+    readStartTime = now;
+    ahtDone = false;
+    readInProgress = true;
+    return true;
+}
+
+ReadStatus SensorManager::pollReading(SensorData& data) {
+    if (!readInProgress) {
+        data.valid = false;
+        return READ_FAILED;
+    }
+
+    unsigned long now = millis();
+
+    // AHT21 result is fetched once its conversion time has elapsed
+    if (!ahtDone) {
+        if (now - ahtTriggerTime < AHT21_CONVERSION_MS) {
+            return READ_PENDING;
+        }
+        ReadStatus ahtStatus = readAht(ahtHumidity, ahtTemperature);
+        if (ahtStatus == READ_FAILED) {
+            LOG_E(TAG, "Failed to read AHT21 sensor!");
+            readInProgress = false;
+            data.valid = false;
+            return READ_FAILED;
+        }
+        if (ahtStatus == READ_PENDING) {
+            // Still converting, check again after another conversion time
+            ahtTriggerTime = now;
+            return pendingOrTimeout(now, data);
+        }
+        ahtDone = true;
+    }
+
+    if (dataReadyInterrupt) {
+        if (!ens160DataReady) {
+            return pendingOrTimeout(now, data);
+        }
+        ens160DataReady = false;
+    }
+
+    // Status, AQI, TVOC and eCO2 in one burst
+    uint8_t ensData[6];
+    bool ensRead = ens160Device.readRegisters(ENS160_REG_STATUS, ensData, sizeof(ensData));
+    if (dataReadyInterrupt) {
+        // The read deasserts INT, so the interrupt can be armed again
+        gpio_intr_enable((gpio_num_t)ENS160_INT_PIN);
+    }
+    // The sample's capture time is the moment its registers were read
+    int64_t captureUs = esp_timer_get_time();
+    if (!ensRead) {
+        LOG_E(TAG, "ENS160 read failed!");
+        readInProgress = false;
+        data.valid = false;
+        return READ_FAILED;
+    }
+    if (!(ensData[0] & ENS160_STATUS_NEWDAT)) {
+        return pendingOrTimeout(now, data);
+    }
+
     // Populate sensor data structure
-    data.co2_ppm = eco2;
-    data.humidity_percent = humidity.relative_humidity;
-    data.temperature_celsius = temp.temperature;
+    data.co2 = ensData[4] | (ensData[5] << 8);
+    data.humidity = ahtHumidity;
+    data.temperature = ahtTemperature;
     data.valid = true;
-    data.timestamp = currentTime;
+    data.replayed = false;
+    data.timestamp = (unsigned long)(captureUs / 1000);
+    data.captureUs = captureUs;
+    readInProgress = false;
     
     // Store as last reading
     lastReading = data;
-    lastReadTime = currentTime;
+    lastReadTime = now;
     
     // Print readings for debugging
-    Serial.printf("CO2: %.1f ppm, Humidity: %.1f%%, Temperature: %.1f°C\n", 
-                  data.co2_ppm, data.humidity_percent, data.temperature_celsius);
+    LOG_D(TAG, "CO2: %u ppm, Humidity: %d.%d%%, Temperature: %d.%d°C", 
+                  data.co2, data.humidity / 10, abs(data.humidity % 10),
+                  data.temperature / 10, abs(data.temperature % 10));
     
+    return READ_COMPLETE;
+}
+
+// Ticks until pollReading() can make progress, portMAX_DELAY while idle
+TickType_t SensorManager::nextPollDelay() {
+    if (!readInProgress) {
+        return portMAX_DELAY;
+    }
+
+    unsigned long now = millis();
+    if (!ahtDone) {
+        unsigned long converting = now - ahtTriggerTime;
+        if (converting < AHT21_CONVERSION_MS) {
+            return pdMS_TO_TICKS(AHT21_CONVERSION_MS - converting);
+        }
+        return 0;
+    }
+
+    if (!dataReadyInterrupt) {
+        return pdMS_TO_TICKS(ENS160_POLL_INTERVAL_MS);
+    }
+    if (ens160DataReady) {
+        return 0;
+    }
+    unsigned long waited = now - readStartTime;
+    if (waited >= ENS160_DATA_TIMEOUT_MS) {
+        return 0;
+    }
+    return pdMS_TO_TICKS(ENS160_DATA_TIMEOUT_MS - waited);
+}
+
+ReadStatus SensorManager::pendingOrTimeout(unsigned long now, SensorData& data) {
+    if (now - readStartTime < ENS160_DATA_TIMEOUT_MS) {
+        return READ_PENDING;
+    }
+    LOG_W(TAG, "ENS160 data not available!");
+    readInProgress = false;
+    data.valid = false;
+    return READ_FAILED;
+}
+
+bool SensorManager::configureDataReadyInterrupt() {
+#if ENS160_INT_PIN >= 0
+    if (!ens160Device.writeRegister(ENS160_REG_CONFIG, ENS160_CONFIG_DATA_INT)) {
+        return false;
+    }
+
+    // Level-triggered so new data can wake the chip from light sleep; the
+    // ISR disarms itself until the result has been read
+    pinMode(ENS160_INT_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(ENS160_INT_PIN), ens160ISR, ONLOW);
     return true;
+#else
+    return false;
+#endif
+}
+
+void IRAM_ATTR SensorManager::ens160ISR() {
+#if ENS160_INT_PIN >= 0
+    gpio_ll_intr_disable(&GPIO, (gpio_num_t)ENS160_INT_PIN);
+#endif
+    ens160DataReady = true;
+
+    // Wake the acquisition task so the result is read as soon as it exists
+    if (acquisitionTaskHandle != nullptr) {
+        BaseType_t higherPriorityWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(acquisitionTaskHandle, &higherPriorityWoken);
+        portYIELD_FROM_ISR(higherPriorityWoken);
+    }
+}
+
+// Starts an AHT21 measurement without waiting for it to finish
+bool SensorManager::triggerAht() {
+    const uint8_t command[3] = {AHT21_CMD_TRIGGER, 0x33, 0x00};
+    return ahtDevice.write(command, sizeof(command));
+}
+
+// Reads a finished AHT21 measurement: status, 20-bit humidity, 20-bit temperature
+ReadStatus SensorManager::readAht(int16_t& humidity, int16_t& temperature) {
+    uint8_t raw[6];
+    if (!ahtDevice.read(raw, sizeof(raw))) {
+        return READ_FAILED;
+    }
+
+    if (raw[0] & AHT21_STATUS_BUSY) {
+        return READ_PENDING;
+    }
+
+    uint32_t rawHumidity = ((uint32_t)raw[1] << 12) | ((uint32_t)raw[2] << 4) | (raw[3] >> 4);
+    uint32_t rawTemperature = ((uint32_t)(raw[3] & 0x0F) << 16) | ((uint32_t)raw[4] << 8) | raw[5];
+    // Straight to tenths: RH = raw / 2^20 * 100 %, T = raw / 2^20 * 200 - 50 C
+    humidity = (int16_t)((rawHumidity * 1000) >> 20);
+    temperature = (int16_t)((int32_t)((rawTemperature * 2000) >> 20) - 500);
+    return READ_COMPLETE;
 }
 
 bool SensorManager::isReady() {
-    return initialized && ens160.available();
+    return initialized;
 }
 
 void SensorManager::reset() {
     lastReadTime = 0;
     lastReading.valid = false;
+    readInProgress = false;
+    ens160DataReady = false;
     
     if (initialized) {
         // Reset ENS160 if needed
-        ens160.setMode(ENS160_OPMODE_RESET);
+        ens160Device.writeRegister(ENS160_REG_OPMODE, ENS160_OPMODE_RESET);
         delay(100);
-        ens160.setMode(ENS160_OPMODE_STD);
+        ens160Device.writeRegister(ENS160_REG_OPMODE, ENS160_OPMODE_STD);
     }
 }
 
 SensorData SensorManager::getLastReading() {
     return lastReading;
 }
-
-AlertLevel SensorManager::getAlertLevel(float co2_ppm) {
-    if (co2_ppm <= CO2_THRESHOLD_LOW) {
-        return ALERT_NONE;
-    } else if (co2_ppm <= CO2_THRESHOLD_MED) {
-        return ALERT_LOW;
-    } else if (co2_ppm <= CO2_THRESHOLD_HIGH) {
-        return ALERT_MEDIUM;
-    } else {
-        return ALERT_HIGH;
-    }
-}
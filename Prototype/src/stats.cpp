@@ -0,0 +1,107 @@
+#include "stats.h"
+#include "log.h"
+
+#include <string.h>
+
+static const char TAG[] = "stats";
+
+StatsManager statsManager;
+
+StatsManager::StatsManager() {
+    reset();
+}
+
+void StatsManager::reset() {
+    co2Window.reset();
+    humidityWindow.reset();
+    temperatureWindow.reset();
+    memset(&summary, 0, sizeof(summary));
+    summaryInterval = 0;
+    summaryCount = 0;
+    co2Sum = 0;
+    humiditySum = 0;
+    temperatureSum = 0;
+}
+
+void StatsManager::add(const SensorData& data) {
+    if (!data.valid) {
+        return;
+    }
+    uint32_t timeMs = (uint32_t)data.timestamp;
+    co2Window.push(data.co2, timeMs);
+    humidityWindow.push(data.humidity, timeMs);
+    temperatureWindow.push(data.temperature, timeMs);
+}
+
+void StatsManager::summarise(const SensorData& data, AlertLevel alertLevel) {
+    if (!data.valid) {
+        return;
+    }
+
+    uint32_t interval = (uint32_t)data.timestamp / STATS_SUMMARY_PERIOD_MS;
+    if (summaryCount > 0 && interval != summaryInterval) {
+        closeSummary();
+    }
+
+    uint16_t co2 = data.co2;
+    int16_t humidity = data.humidity;
+    int16_t temperature = data.temperature;
+
+    if (summaryCount == 0) {
+        summaryInterval = interval;
+        memset(&summary, 0, sizeof(summary));
+        summary.type = BLE_FRAME_SUMMARY;
+        summary.startTime = interval * (STATS_SUMMARY_PERIOD_MS / 1000);
+        summary.firstSequence = data.sequence;
+        summary.co2Min = summary.co2Max = co2;
+        summary.humidityMin = summary.humidityMax = humidity;
+        summary.temperatureMin = summary.temperatureMax = temperature;
+    }
+
+    summaryCount++;
+    co2Sum += co2;
+    humiditySum += humidity;
+    temperatureSum += temperature;
+    summary.co2Min = min(summary.co2Min, co2);
+    summary.co2Max = max(summary.co2Max, co2);
+    summary.humidityMin = min(summary.humidityMin, humidity);
+    summary.humidityMax = max(summary.humidityMax, humidity);
+    summary.temperatureMin = min(summary.temperatureMin, temperature);
+    summary.temperatureMax = max(summary.temperatureMax, temperature);
+    if ((uint8_t)alertLevel > summary.peakAlert) {
+        summary.peakAlert = (uint8_t)alertLevel;
+    }
+}
+
+void StatsManager::closeSummary() {
+    int32_t count = (int32_t)summaryCount;
+    int32_t rate = co2Window.ratePerMinute();
+
+    summary.count = (uint8_t)min(summaryCount, (uint32_t)UINT8_MAX);
+    summary.co2Mean = (uint16_t)(co2Sum / count);
+    summary.humidityMean = (int16_t)(humiditySum / count);
+    summary.temperatureMean = (int16_t)(temperatureSum / count);
+    summary.co2Rate = (int16_t)(rate > INT16_MAX ? INT16_MAX : (rate < INT16_MIN ? INT16_MIN : rate));
+
+    LOG_I(TAG, "Summary t=%us n=%u CO2 %u/%u/%u ppm (%d ppm/min), RH %d.%d%%, T %d.%dC, alert %u",
+          summary.startTime, summary.count, summary.co2Min, summary.co2Mean, summary.co2Max,
+          summary.co2Rate, summary.humidityMean / 10, abs(summary.humidityMean % 10),
+          summary.temperatureMean / 10, abs(summary.temperatureMean % 10), summary.peakAlert);
+
+    if (!summaries.push(summary)) {
+        LOG_W(TAG, "Summary queue full, dropping summary");
+    }
+
+    summaryCount = 0;
+    co2Sum = 0;
+    humiditySum = 0;
+    temperatureSum = 0;
+}
+
+bool StatsManager::nextSummary(SummaryRecord& record) {
+    return summaries.pop(record);
+}
+
+uint16_t StatsManager::smoothedCo2(uint16_t fallback) const {
+    return co2Window.empty() ? fallback : (uint16_t)co2Window.ewma();
+}
@@ -0,0 +1,359 @@
+#include "storage.h"
+#include "log.h"
+#include "diagnostics.h"
+#include "watchdog.h"
+#include "time_sync.h"
+
+static const char TAG[] = "storage";
+
+StorageManager storageManager;
+
+StorageManager::StorageManager() : spi(VSPI) {
+    ready = false;
+    path[0] = '\0';
+    summaryPath[0] = '\0';
+    active = nullptr;
+    activeMissedBase = 0;
+    blocksWritten = 0;
+    recordsWritten = 0;
+    summariesWritten = 0;
+    droppedRecords = 0;
+    fileLock = nullptr;
+    flushTaskHandle = nullptr;
+}
+
+bool StorageManager::begin() {
+    spi.begin(SD_SCLK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
+
+    if (!SD.begin(SD_CS_PIN, spi)) {
+        LOG_W(TAG, "SD card mount failed, logging disabled");
+        return false;
+    }
+
+    if (SD.cardType() == CARD_NONE) {
+        LOG_W(TAG, "No SD card attached, logging disabled");
+        return false;
+    }
+
+    fileLock = xSemaphoreCreateMutex();
+    if (fileLock == nullptr || !openSession()) {
+        return false;
+    }
+
+    for (int i = 0; i < STORAGE_BLOCK_BUFFERS; i++) {
+        freeBlocks.push(&blocks[i]);
+    }
+
+    if (xTaskCreatePinnedToCore(flushTask, "storage", TASK_STORAGE_STACK, this,
+                                TASK_STORAGE_PRIO, &flushTaskHandle,
+                                TASK_STORAGE_CORE) != pdPASS) {
+        LOG_E(TAG, "Failed to create storage task!");
+        return false;
+    }
+    diagnosticsManager.registerTask(DIAG_TASK_STORAGE, flushTaskHandle);
+
+    ready = true;
+    LOG_I(TAG, "Logging to %s (%d records per block)",
+                  path, (int)STORAGE_RECORDS_PER_BLOCK);
+    return true;
+}
+
+// Creates the next free /session_NNNN.bin and writes its header sector.
+// Its summary file is optional; the samples are logged without it.
+bool StorageManager::openSession() {
+    uint16_t index;
+    for (index = 1; index < 10000; index++) {
+        snprintf(path, sizeof(path), "/session_%04u.bin", index);
+        if (!SD.exists(path)) {
+            break;
+        }
+    }
+
+    file = SD.open(path, FILE_WRITE);
+    if (!file) {
+        LOG_E(TAG, "Failed to create %s", path);
+        return false;
+    }
+
+    snprintf(summaryPath, sizeof(summaryPath), "/session_%04u.sum", index);
+    summaryFile = SD.open(summaryPath, FILE_WRITE);
+    if (!summaryFile) {
+        LOG_W(TAG, "Failed to create %s, summaries not logged", summaryPath);
+    }
+
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    fileHeader.magic = STORAGE_FILE_MAGIC;
+    fileHeader.version = STORAGE_FORMAT_VERSION;
+    fileHeader.blockSize = STORAGE_BLOCK_SIZE;
+    fileHeader.recordSize = sizeof(SensorPacket);
+    fileHeader.recordsPerBlock = STORAGE_RECORDS_PER_BLOCK;
+    fileHeader.samplePeriodMs = SENSOR_READ_INTERVAL_MS;
+
+    return writeHeader();
+}
+
+// Copies one record into the active sector buffer; never blocks. Records
+// are dropped (and counted) if the card falls behind by a whole buffer.
+bool StorageManager::append(const SensorData& data, AlertLevel alertLevel) {
+    if (!ready) {
+        return false;
+    }
+
+    if (active == nullptr) {
+        if (!freeBlocks.pop(active)) {
+            droppedRecords++;
+            return false;
+        }
+        active->header.magic = STORAGE_BLOCK_MAGIC;
+        active->header.count = 0;
+        active->header.missedDeadlines = 0;
+        activeMissedBase = diagnosticsManager.getMissedDeadlines();
+    }
+
+    SensorPacket& record = active->records[active->header.count];
+    encodeSensorPacket(data, alertLevel, record);
+    if (active->header.count == 0) {
+        active->header.firstSequence = record.sequence;
+        active->header.firstTimestamp = record.timestamp;
+    }
+    active->header.count++;
+
+    if (active->header.count >= STORAGE_RECORDS_PER_BLOCK) {
+        sealActive();
+        fullBlocks.push(active);
+        active = nullptr;
+        xTaskNotifyGive(flushTaskHandle);
+    }
+    return true;
+}
+
+// Queues a closed summary interval for the flush task; never blocks
+bool StorageManager::appendSummary(const SummaryRecord& record) {
+    if (!ready || !summaryFile) {
+        return false;
+    }
+    if (!summaries.push(record)) {
+        droppedRecords++;
+        return false;
+    }
+    xTaskNotifyGive(flushTaskHandle);
+    return true;
+}
+
+// Stamps the active block with the deadlines missed while it filled
+void StorageManager::sealActive() {
+    uint32_t missed = diagnosticsManager.getMissedDeadlines() - activeMissedBase;
+    active->header.missedDeadlines = (uint16_t)min(missed, (uint32_t)UINT16_MAX);
+}
+
+void StorageManager::flushTask(void* param) {
+    StorageManager* self = (StorageManager*)param;
+    StorageBlock* block;
+
+    // sync() drains the same queues, so each block is popped, written and
+    // handed back under fileLock; that keeps one consumer and one producer
+    // at a time
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            xSemaphoreTake(self->fileLock, portMAX_DELAY);
+            bool popped = self->fullBlocks.pop(block);
+            if (popped) {
+                self->writeBlock(block);
+                if (self->blocksWritten % STORAGE_HEADER_INTERVAL == 0) {
+                    self->writeHeader();
+                }
+                self->freeBlocks.push(block);
+            } else {
+                self->writeSummaries();
+            }
+            xSemaphoreGive(self->fileLock);
+            if (!popped) {
+                break;
+            }
+        }
+    }
+}
+
+// Caller holds fileLock (or runs before the flush task starts)
+bool StorageManager::writeBlock(const StorageBlock* block) {
+    if (!file.seek(STORAGE_BLOCK_SIZE * (blocksWritten + 1))) {
+        return false;
+    }
+    if (file.write((const uint8_t*)block, STORAGE_BLOCK_SIZE) != STORAGE_BLOCK_SIZE) {
+        LOG_E(TAG, "SD write failed, logging disabled");
+        ready = false;
+        return false;
+    }
+
+    if (blocksWritten == 0) {
+        fileHeader.firstSequence = block->header.firstSequence;
+    }
+    blocksWritten++;
+    recordsWritten += block->header.count;
+    return true;
+}
+
+// Caller holds fileLock. A failed write loses the summary only; the
+// sample log carries on.
+void StorageManager::writeSummaries() {
+    SummaryRecord record;
+    bool wrote = false;
+    while (summaries.pop(record)) {
+        if (summaryFile.write((const uint8_t*)&record, sizeof(record)) != sizeof(record)) {
+            LOG_E(TAG, "SD summary write failed");
+            droppedRecords++;
+            continue;
+        }
+        summariesWritten++;
+        wrote = true;
+    }
+    if (wrote) {
+        summaryFile.flush();
+    }
+}
+
+// Caller holds fileLock (or runs before the flush task starts)
+bool StorageManager::writeHeader() {
+    fileHeader.blockCount = blocksWritten;
+    fileHeader.recordCount = recordsWritten;
+    fileHeader.missedDeadlines = diagnosticsManager.getMissedDeadlines();
+    fileHeader.watchdogRestarts = watchdogManager.getRestarts();
+    fileHeader.wedgedTask = watchdogManager.getLastWedgedTask();
+    fileHeader.epochOffsetUs = timeSyncManager.epochOffsetUs();
+    fileHeader.summaryCount = summariesWritten;
+
+    if (!file.seek(0) ||
+        file.write((const uint8_t*)&fileHeader, sizeof(fileHeader)) != sizeof(fileHeader)) {
+        LOG_E(TAG, "SD header write failed");
+        return false;
+    }
+    file.flush();
+    return true;
+}
+
+// Writes everything buffered, including a partial block. Only call once the
+// appending task has stopped (e.g. before deep sleep); the flush task may
+// still be running, and fileLock keeps it off the block queues meanwhile.
+void StorageManager::sync() {
+    if (!ready) {
+        return;
+    }
+
+    xSemaphoreTake(fileLock, portMAX_DELAY);
+
+    StorageBlock* block;
+    while (fullBlocks.pop(block)) {
+        writeBlock(block);
+        freeBlocks.push(block);
+    }
+    if (active != nullptr && active->header.count > 0) {
+        sealActive();
+        writeBlock(active);
+        freeBlocks.push(active);
+        active = nullptr;
+    }
+    writeSummaries();
+    writeHeader();
+
+    xSemaphoreGive(fileLock);
+}
+
+bool StorageManager::isReady() {
+    return ready;
+}
+
+uint32_t StorageManager::getDroppedRecords() {
+    return droppedRecords;
+}
+
+const char* StorageManager::sessionPath() {
+    return path;
+}
+
+// Header of a session file, false if it is missing or not in this format
+bool StorageManager::readHeader(const char* sessionFile, StorageFileHeader& header) {
+    if (fileLock == nullptr) {
+        return false;
+    }
+
+    xSemaphoreTake(fileLock, portMAX_DELAY);
+    bool ok = false;
+    File reader = SD.open(sessionFile, FILE_READ);
+    if (reader) {
+        ok = reader.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+             header.magic == STORAGE_FILE_MAGIC && header.blockSize == STORAGE_BLOCK_SIZE &&
+             header.recordSize == sizeof(SensorPacket);
+        reader.close();
+    }
+    xSemaphoreGive(fileLock);
+    return ok;
+}
+
+// Reads up to maxRecords records starting at fromSequence from a session
+// file. Blocks are located by binary search on their headers, so the cost
+// is O(log blocks) sector reads plus the records returned.
+size_t StorageManager::readRange(const char* sessionFile, uint32_t fromSequence,
+                                 SensorPacket* out, size_t maxRecords) {
+    if (fileLock == nullptr) {
+        return 0;
+    }
+
+    xSemaphoreTake(fileLock, portMAX_DELAY);
+    size_t copied = 0;
+
+    File reader = SD.open(sessionFile, FILE_READ);
+    if (!reader) {
+        xSemaphoreGive(fileLock);
+        return 0;
+    }
+
+    StorageFileHeader header;
+    if (reader.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != STORAGE_FILE_MAGIC || header.blockSize != STORAGE_BLOCK_SIZE ||
+        header.recordSize != sizeof(SensorPacket)) {
+        reader.close();
+        xSemaphoreGive(fileLock);
+        return 0;
+    }
+
+    // The header count may lag behind; the file size is authoritative
+    uint32_t blockCount = (reader.size() / STORAGE_BLOCK_SIZE) - 1;
+
+    // Find the last block whose first sequence is <= fromSequence
+    uint32_t low = 0;
+    uint32_t high = blockCount;
+    while (high - low > 1) {
+        uint32_t mid = low + (high - low) / 2;
+        reader.seek(STORAGE_BLOCK_SIZE * (mid + 1));
+        reader.read((uint8_t*)&scratch.header, sizeof(scratch.header));
+        if (scratch.header.firstSequence <= fromSequence) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (uint32_t index = low; index < blockCount && copied < maxRecords; index++) {
+        reader.seek(STORAGE_BLOCK_SIZE * (index + 1));
+        if (reader.read((uint8_t*)&scratch, STORAGE_BLOCK_SIZE) != STORAGE_BLOCK_SIZE ||
+            scratch.header.magic != STORAGE_BLOCK_MAGIC) {
+            break;
+        }
+
+        uint16_t count = scratch.header.count;
+        if (count > STORAGE_RECORDS_PER_BLOCK) {
+            count = STORAGE_RECORDS_PER_BLOCK;
+        }
+        for (uint16_t i = 0; i < count && copied < maxRecords; i++) {
+            if (scratch.records[i].sequence >= fromSequence) {
+                out[copied++] = scratch.records[i];
+            }
+        }
+    }
+
+    reader.close();
+    xSemaphoreGive(fileLock);
+    return copied;
+}
@@ -0,0 +1,35 @@
+#include "time_sync.h"
+#include "log.h"
+#include <sys/time.h>
+#include <esp_timer.h>
+
+static const char TAG[] = "time";
+
+TimeSyncManager timeSyncManager;
+
+// Any earlier system time is the clock counting up from an unset boot
+#define TIME_SYNC_MIN_EPOCH_S   1700000000
+
+void TimeSyncManager::setEpoch(uint64_t epochMs) {
+    struct timeval now;
+    now.tv_sec = (time_t)(epochMs / 1000);
+    now.tv_usec = (suseconds_t)(epochMs % 1000) * 1000;
+    int64_t before = epochOffsetUs();
+    settimeofday(&now, nullptr);
+
+    if (before != 0) {
+        LOG_I(TAG, "Clock adjusted by %lld us", (long long)(epochOffsetUs() - before));
+    } else {
+        LOG_I(TAG, "Clock set to %u", (uint32_t)now.tv_sec);
+    }
+}
+
+int64_t TimeSyncManager::epochOffsetUs() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    int64_t timerUs = esp_timer_get_time();
+    if (now.tv_sec < TIME_SYNC_MIN_EPOCH_S) {
+        return 0;
+    }
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec - timerUs;
+}
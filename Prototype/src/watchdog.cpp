@@ -0,0 +1,113 @@
+#include "watchdog.h"
+#include "log.h"
+#include <esp_task_wdt.h>
+#include <esp_system.h>
+
+static const char TAG[] = "watchdog";
+
+WatchdogManager watchdogManager;
+
+#define WATCHDOG_MAGIC 0x57444F47   // "WDOG"
+
+// Survives the restart the watchdog causes; cleared on power-on
+struct WatchdogRecord {
+    uint32_t magic;
+    uint16_t restarts;
+    uint8_t wedgedTask;
+};
+
+RTC_NOINIT_ATTR static WatchdogRecord watchdogRecord;
+
+static const char* const taskNames[DIAG_TASK_COUNT] = {
+    "acquisition", "alert", "transport", "ui", "respiration", "storage", "i2c", "log"
+};
+
+WatchdogManager::WatchdogManager() {
+    for (int i = 0; i < DIAG_TASK_COUNT; i++) {
+        busySinceMs[i] = 0;
+    }
+    taskHandle = nullptr;
+    wedged = DIAG_TASK_COUNT;
+}
+
+bool WatchdogManager::begin() {
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (watchdogRecord.magic != WATCHDOG_MAGIC || reason == ESP_RST_POWERON) {
+        watchdogRecord.magic = WATCHDOG_MAGIC;
+        watchdogRecord.restarts = 0;
+        watchdogRecord.wedgedTask = DIAG_TASK_COUNT;
+    } else if (reason == ESP_RST_TASK_WDT) {
+        LOG_W(TAG, "Restarted by the watchdog (%u since power-on), last wedged task: %s",
+              watchdogRecord.restarts,
+              watchdogRecord.wedgedTask < DIAG_TASK_COUNT ? taskNames[watchdogRecord.wedgedTask] : "none");
+    }
+
+    // Reconfigures the watchdog the Arduino core already started; IDF 5
+    // takes a config and refuses to init a running watchdog twice
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_task_wdt_config_t wdtConfig = {};
+    wdtConfig.timeout_ms = WATCHDOG_TIMEOUT_S * 1000;
+    wdtConfig.trigger_panic = true;
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+    wdtConfig.idle_core_mask |= BIT(0);
+#endif
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+    wdtConfig.idle_core_mask |= BIT(1);
+#endif
+    esp_err_t err = esp_task_wdt_reconfigure(&wdtConfig);
+#else
+    esp_err_t err = esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true);
+#endif
+    if (err != ESP_OK) {
+        LOG_E(TAG, "Failed to configure the task watchdog!");
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(supervisorTask, "watchdog", TASK_WATCHDOG_STACK, this,
+                                TASK_WATCHDOG_PRIO, &taskHandle,
+                                TASK_WATCHDOG_CORE) != pdPASS) {
+        LOG_E(TAG, "Failed to create watchdog task!");
+        return false;
+    }
+    return true;
+}
+
+void WatchdogManager::supervisorTask(void* param) {
+    WatchdogManager* self = (WatchdogManager*)param;
+    esp_task_wdt_add(nullptr);
+
+    for (;;) {
+        uint32_t now = millis();
+        for (uint8_t i = 0; i < DIAG_TASK_COUNT && self->wedged == DIAG_TASK_COUNT; i++) {
+            uint32_t since = self->busySinceMs[i];
+            if (since != 0 && now - since > WATCHDOG_STAGE_LIMIT_MS) {
+                self->wedged = i;
+                watchdogRecord.restarts++;
+                watchdogRecord.wedgedTask = i;
+                LOG_E(TAG, "%s task busy for %u ms, restarting", taskNames[i], now - since);
+            }
+        }
+
+        // Once a task is wedged, the task watchdog takes it from here
+        if (self->wedged == DIAG_TASK_COUNT) {
+            esp_task_wdt_reset();
+        }
+        vTaskDelay(pdMS_TO_TICKS(WATCHDOG_CHECK_MS));
+    }
+}
+
+// Before deep sleep: the pipeline tasks are suspended wherever they are
+void WatchdogManager::stop() {
+    if (taskHandle != nullptr) {
+        esp_task_wdt_delete(taskHandle);
+        vTaskSuspend(taskHandle);
+    }
+}
+
+uint16_t WatchdogManager::getRestarts() {
+    return watchdogRecord.restarts;
+}
+
+uint8_t WatchdogManager::getLastWedgedTask() {
+    return watchdogRecord.wedgedTask;
+}
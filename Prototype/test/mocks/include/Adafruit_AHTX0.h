@@ -0,0 +1,14 @@
+#ifndef MOCK_ADAFRUIT_AHTX0_H
+#define MOCK_ADAFRUIT_AHTX0_H
+
+#include <Wire.h>
+
+#define AHTX0_I2CADDR_DEFAULT   0x38
+
+// Setup-time driver; only checks that the (simulated) sensor answers
+class Adafruit_AHTX0 {
+public:
+    bool begin(TwoWire* wire = &Wire, int32_t sensorId = 0, uint8_t address = AHTX0_I2CADDR_DEFAULT);
+};
+
+#endif // MOCK_ADAFRUIT_AHTX0_H
@@ -0,0 +1,67 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+// Minimal Arduino-ESP32 core for host builds. Time only moves when the code
+// under test delays or a test calls mockAdvanceMillis(), so runs are
+// deterministic and conversion waits cost nothing.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+
+using std::min;
+using std::max;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+
+#define LOW             0x0
+#define HIGH            0x1
+
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define PULLUP          0x04
+#define INPUT_PULLUP    0x05
+#define PULLDOWN        0x08
+#define INPUT_PULLDOWN  0x09
+
+#define RISING          0x01
+#define FALLING         0x02
+#define CHANGE          0x03
+#define ONLOW           0x04
+#define ONHIGH          0x05
+
+#define digitalPinToInterrupt(pin)  (pin)
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+// No PSRAM on the host; callers fall back to their internal buffers
+bool psramFound();
+void* ps_malloc(size_t size);
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+// Test controls
+void mockAdvanceMillis(uint32_t ms);
+void mockSetPinLevel(uint8_t pin, int level);   // Drives an input, firing its interrupt
+void mockReset();                               // Clock to zero, pins released
+
+#endif // MOCK_ARDUINO_H
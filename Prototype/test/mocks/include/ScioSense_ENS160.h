@@ -0,0 +1,22 @@
+#ifndef MOCK_SCIOSENSE_ENS160_H
+#define MOCK_SCIOSENSE_ENS160_H
+
+#include <Wire.h>
+
+#define ENS160_OPMODE_DEP_SLEEP 0x00
+#define ENS160_OPMODE_IDLE      0x01
+#define ENS160_OPMODE_STD       0x02
+#define ENS160_OPMODE_RESET     0xF0
+
+// Setup-time driver; mode changes are written to the simulated sensor
+class ScioSense_ENS160 {
+private:
+    uint8_t address;
+
+public:
+    ScioSense_ENS160(uint8_t slaveAddress);
+    bool begin(bool debug = false);
+    bool setMode(uint8_t mode);
+};
+
+#endif // MOCK_SCIOSENSE_ENS160_H
@@ -0,0 +1,59 @@
+#ifndef MOCK_WIRE_H
+#define MOCK_WIRE_H
+
+#include <Arduino.h>
+
+#define MOCK_WIRE_BUFFER_SIZE   128
+#define MOCK_WIRE_MAX_TARGETS   8
+
+// A simulated device on the mock bus. write() receives everything between
+// beginTransmission and endTransmission; read() fills a requestFrom().
+class MockI2CTarget {
+public:
+    virtual ~MockI2CTarget() {}
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+    virtual size_t read(uint8_t* buffer, size_t length) = 0;
+};
+
+class TwoWire {
+private:
+    struct Slot {
+        uint8_t address;
+        MockI2CTarget* target;
+    };
+
+    Slot targets[MOCK_WIRE_MAX_TARGETS];
+    uint8_t targetCount;
+    uint8_t txAddress;
+    uint8_t txBuffer[MOCK_WIRE_BUFFER_SIZE];
+    size_t txLength;
+    uint8_t rxBuffer[MOCK_WIRE_BUFFER_SIZE];
+    size_t rxLength;
+    size_t rxIndex;
+    uint32_t transactions;
+
+    MockI2CTarget* find(uint8_t address);
+
+public:
+    TwoWire();
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    void setClock(uint32_t frequency);
+    void setTimeOut(uint16_t timeoutMs);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t value);
+    size_t write(const uint8_t* data, size_t length);
+    uint8_t endTransmission(bool sendStop = true);
+    size_t requestFrom(uint16_t address, size_t length, bool sendStop = true);
+    int available();
+    int read();
+    size_t readBytes(uint8_t* buffer, size_t length);
+
+    // Test controls
+    void attach(uint8_t address, MockI2CTarget* target);
+    void detachAll();
+    uint32_t getTransactions();
+};
+
+extern TwoWire Wire;
+
+#endif // MOCK_WIRE_H
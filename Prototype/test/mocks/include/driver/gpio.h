@@ -0,0 +1,23 @@
+#ifndef MOCK_DRIVER_GPIO_H
+#define MOCK_DRIVER_GPIO_H
+
+#include <stdint.h>
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE = 1,
+    GPIO_INTR_NEGEDGE = 2,
+    GPIO_INTR_ANYEDGE = 3,
+    GPIO_INTR_LOW_LEVEL = 4,
+    GPIO_INTR_HIGH_LEVEL = 5
+} gpio_int_type_t;
+
+// Re-arming a level interrupt whose level is still present fires it again,
+// as on the chip
+void gpio_intr_enable(gpio_num_t pin);
+void gpio_intr_disable(gpio_num_t pin);
+void gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type);
+
+#endif // MOCK_DRIVER_GPIO_H
@@ -0,0 +1,9 @@
+#ifndef MOCK_ESP_TIMER_H
+#define MOCK_ESP_TIMER_H
+
+#include <stdint.h>
+
+// Mock clock in microseconds (see mockAdvanceMillis in Arduino.h)
+int64_t esp_timer_get_time();
+
+#endif // MOCK_ESP_TIMER_H
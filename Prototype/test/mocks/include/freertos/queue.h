@@ -0,0 +1,8 @@
+#ifndef MOCK_FREERTOS_QUEUE_H
+#define MOCK_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* QueueHandle_t;
+
+#endif // MOCK_FREERTOS_QUEUE_H
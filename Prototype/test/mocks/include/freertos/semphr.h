@@ -0,0 +1,13 @@
+#ifndef MOCK_FREERTOS_SEMPHR_H
+#define MOCK_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef void* SemaphoreHandle_t;
+
+typedef struct {
+    uint8_t storage[16];
+} StaticSemaphore_t;
+
+#endif // MOCK_FREERTOS_SEMPHR_H
@@ -0,0 +1,22 @@
+#ifndef MOCK_HAL_GPIO_LL_H
+#define MOCK_HAL_GPIO_LL_H
+
+#include "driver/gpio.h"
+
+typedef struct {
+    int unused;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+static inline void gpio_ll_intr_disable(gpio_dev_t* hw, gpio_num_t pin) {
+    (void)hw;
+    gpio_intr_disable(pin);
+}
+
+static inline void gpio_ll_set_intr_type(gpio_dev_t* hw, gpio_num_t pin, gpio_int_type_t type) {
+    (void)hw;
+    gpio_set_intr_type(pin, type);
+}
+
+#endif // MOCK_HAL_GPIO_LL_H
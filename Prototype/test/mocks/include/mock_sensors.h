@@ -0,0 +1,41 @@
+#ifndef MOCK_SENSORS_H
+#define MOCK_SENSORS_H
+
+#include <Wire.h>
+
+// AHT21: 0xAC starts a conversion that reports busy for conversionMs;
+// the 6-byte result encodes whatever humidity/temperature are set
+class MockAht21 : public MockI2CTarget {
+private:
+    unsigned long triggerTime;
+    bool triggered;
+
+public:
+    float humidity;
+    float temperature;
+    uint32_t conversionMs;
+
+    MockAht21();
+    bool write(const uint8_t* data, size_t length);
+    size_t read(uint8_t* buffer, size_t length);
+};
+
+// ENS160 register file. publish() latches a new result, sets NEWDAT and,
+// when CONFIG enables it, pulls the INT pin low until the status is read.
+class MockEns160 : public MockI2CTarget {
+private:
+    uint8_t registers[256];
+    uint8_t pointer;
+    int interruptPin;
+
+    bool interruptEnabled();
+
+public:
+    explicit MockEns160(int intPin = -1);
+    bool write(const uint8_t* data, size_t length);
+    size_t read(uint8_t* buffer, size_t length);
+    void publish(uint16_t eco2, uint16_t tvoc, uint8_t aqi);
+    uint8_t opMode();
+};
+
+#endif // MOCK_SENSORS_H
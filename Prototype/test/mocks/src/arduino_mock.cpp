@@ -0,0 +1,209 @@
+#include <Arduino.h>
+#include <hal/gpio_ll.h>
+
+#define MOCK_PIN_COUNT  40
+
+struct MockPin {
+    int level;
+    void (*isr)(void);
+    gpio_int_type_t type;
+    bool enabled;
+};
+
+gpio_dev_t GPIO;
+
+static uint64_t clockUs = 0;
+static uint32_t notifications = 0;
+static MockPin pins[MOCK_PIN_COUNT];
+
+// Level interrupts fire for as long as the level persists and they are armed
+static void evaluate(int pin) {
+    MockPin& p = pins[pin];
+    if (!p.enabled || p.isr == nullptr) {
+        return;
+    }
+    bool active = (p.type == GPIO_INTR_LOW_LEVEL && p.level == LOW) ||
+                  (p.type == GPIO_INTR_HIGH_LEVEL && p.level == HIGH);
+    if (active) {
+        p.isr();
+    }
+}
+
+void mockReset() {
+    clockUs = 0;
+    notifications = 0;
+    for (int i = 0; i < MOCK_PIN_COUNT; i++) {
+        pins[i].level = HIGH;
+        pins[i].isr = nullptr;
+        pins[i].type = GPIO_INTR_DISABLE;
+        pins[i].enabled = false;
+    }
+}
+
+void mockAdvanceMillis(uint32_t ms) {
+    clockUs += (uint64_t)ms * 1000;
+}
+
+void mockSetPinLevel(uint8_t pin, int level) {
+    if (pin >= MOCK_PIN_COUNT) {
+        return;
+    }
+    pins[pin].level = level;
+    evaluate(pin);
+}
+
+unsigned long millis() {
+    return (unsigned long)(clockUs / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)clockUs;
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)clockUs;
+}
+
+void delay(uint32_t ms) {
+    mockAdvanceMillis(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+    clockUs += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < MOCK_PIN_COUNT ? pins[pin].level : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < MOCK_PIN_COUNT) {
+        pins[pin].level = value;
+    }
+}
+
+bool psramFound() {
+    return false;
+}
+
+void* ps_malloc(size_t size) {
+    return malloc(size);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+    if (pin >= MOCK_PIN_COUNT) {
+        return;
+    }
+    pins[pin].isr = isr;
+    pins[pin].type = (gpio_int_type_t)mode;
+    pins[pin].enabled = true;
+    evaluate(pin);
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (pin < MOCK_PIN_COUNT) {
+        pins[pin].isr = nullptr;
+        pins[pin].enabled = false;
+    }
+}
+
+void gpio_intr_enable(gpio_num_t pin) {
+    if (pin >= 0 && pin < MOCK_PIN_COUNT) {
+        pins[pin].enabled = true;
+        evaluate(pin);
+    }
+}
+
+void gpio_intr_disable(gpio_num_t pin) {
+    if (pin >= 0 && pin < MOCK_PIN_COUNT) {
+        pins[pin].enabled = false;
+    }
+}
+
+void gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) {
+    if (pin >= 0 && pin < MOCK_PIN_COUNT) {
+        pins[pin].type = type;
+        evaluate(pin);
+    }
+}
+
+// FreeRTOS: blocking calls return at once after advancing the clock
+
+void vTaskDelay(TickType_t ticks) {
+    mockAdvanceMillis(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    if (task != nullptr) {
+        notifications++;
+    }
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityWoken) {
+    xTaskNotifyGive(task);
+    if (higherPriorityWoken != nullptr) {
+        *higherPriorityWoken = pdFALSE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    (void)clearOnExit;
+    if (notifications > 0) {
+        uint32_t taken = notifications;
+        notifications = 0;
+        return taken;
+    }
+    if (ticks != portMAX_DELAY) {
+        mockAdvanceMillis(ticks);
+    }
+    return 0;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    (void)task;
+    return 0;
+}
+
+uint32_t mockNotificationCount() {
+    return notifications;
+}
+
+static EventBits_t eventGroup;
+
+EventGroupHandle_t xEventGroupCreate() {
+    eventGroup = 0;
+    return &eventGroup;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    *group |= bits;
+    return *group;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = *group;
+    *group &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit,
+                                BaseType_t waitForAll, TickType_t ticks) {
+    EventBits_t current = *group;
+    bool satisfied = waitForAll ? (current & bits) == bits : (current & bits) != 0;
+    if (!satisfied && ticks != portMAX_DELAY) {
+        mockAdvanceMillis(ticks);
+    }
+    if (satisfied && clearOnExit) {
+        *group &= ~bits;
+    }
+    return current;
+}
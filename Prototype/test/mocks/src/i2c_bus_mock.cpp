@@ -0,0 +1,118 @@
+#include "i2c_bus.h"
+
+// Host replacement for src/i2c_bus.cpp: there is no bus task, every request
+// runs on the caller against the mock Wire, so costs measured on the host
+// exclude queueing and context switches.
+
+I2CBusManager i2cBusManager;
+
+I2CDevice::I2CDevice(uint8_t address, I2CPriority priority) {
+    memset(&request, 0, sizeof(request));
+    request.address = address;
+    this->priority = priority;
+}
+
+bool I2CDevice::begin() {
+    request.done = (SemaphoreHandle_t)&doneBuffer;
+    return true;
+}
+
+bool I2CDevice::submit() {
+    return request.done != nullptr && i2cBusManager.enqueue(&request, priority) && request.success;
+}
+
+bool I2CDevice::write(const uint8_t* data, uint8_t length) {
+    if (length > I2C_MAX_WRITE_SIZE) {
+        return false;
+    }
+    memcpy(request.writeData, data, length);
+    request.writeLength = length;
+    request.readLength = 0;
+    request.readBuffer = nullptr;
+    return submit();
+}
+
+bool I2CDevice::writeRegister(uint8_t reg, uint8_t value) {
+    uint8_t data[2] = {reg, value};
+    return write(data, sizeof(data));
+}
+
+bool I2CDevice::read(uint8_t* buffer, uint8_t length) {
+    request.writeLength = 0;
+    request.readLength = length;
+    request.readBuffer = buffer;
+    return submit();
+}
+
+bool I2CDevice::readRegisters(uint8_t reg, uint8_t* buffer, uint8_t length) {
+    request.writeData[0] = reg;
+    request.writeLength = 1;
+    request.readLength = length;
+    request.readBuffer = buffer;
+    return submit();
+}
+
+I2CBusManager::I2CBusManager() {
+    for (int i = 0; i < I2C_PRIORITY_COUNT; i++) {
+        queues[i] = nullptr;
+    }
+    taskHandle = nullptr;
+    initialized = false;
+    transactions = 0;
+    errors = 0;
+}
+
+bool I2CBusManager::begin() {
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, I2C_CLOCK_HZ);
+    initialized = true;
+    return true;
+}
+
+bool I2CBusManager::enqueue(I2CRequest* request, I2CPriority priority) {
+    (void)priority;
+    if (!initialized) {
+        return false;
+    }
+    execute(request);
+    return true;
+}
+
+bool I2CBusManager::nextRequest(I2CRequest*& request) {
+    (void)request;
+    return false;
+}
+
+void I2CBusManager::execute(I2CRequest* request) {
+    bool ok = true;
+
+    if (request->writeLength > 0) {
+        Wire.beginTransmission(request->address);
+        Wire.write(request->writeData, request->writeLength);
+        ok = Wire.endTransmission(request->readLength == 0) == 0;
+    }
+
+    if (ok && request->readLength > 0) {
+        size_t received = Wire.requestFrom((uint16_t)request->address,
+                                           (size_t)request->readLength, true);
+        ok = received == request->readLength &&
+             Wire.readBytes(request->readBuffer, request->readLength) == request->readLength;
+    }
+
+    transactions++;
+    if (!ok) {
+        errors++;
+    }
+    request->success = ok;
+}
+
+void I2CBusManager::busTask(void* param) {
+    (void)param;
+}
+
+uint32_t I2CBusManager::getTransactions() {
+    return transactions;
+}
+
+uint32_t I2CBusManager::getErrors() {
+    return errors;
+}
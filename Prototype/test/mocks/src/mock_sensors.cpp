@@ -0,0 +1,104 @@
+#include "mock_sensors.h"
+
+#define AHT21_STATUS_BUSY       0x80
+#define AHT21_STATUS_CALIBRATED 0x08
+
+#define ENS160_REG_OPMODE       0x10
+#define ENS160_REG_CONFIG       0x11
+#define ENS160_REG_STATUS       0x20
+#define ENS160_REG_DATA_AQI     0x21
+#define ENS160_REG_DATA_TVOC    0x22
+#define ENS160_REG_DATA_ECO2    0x24
+#define ENS160_CONFIG_INTEN     0x01
+#define ENS160_STATUS_NEWDAT    0x02
+
+MockAht21::MockAht21() {
+    triggerTime = 0;
+    triggered = false;
+    humidity = 45.0f;
+    temperature = 22.5f;
+    conversionMs = 80;
+}
+
+bool MockAht21::write(const uint8_t* data, size_t length) {
+    if (length > 0 && data[0] == 0xAC) {
+        triggerTime = millis();
+        triggered = true;
+    }
+    return true;
+}
+
+size_t MockAht21::read(uint8_t* buffer, size_t length) {
+    uint8_t raw[6];
+    bool busy = triggered && millis() - triggerTime < conversionMs;
+    uint32_t h = (uint32_t)(humidity * 1048576.0f / 100.0f);
+    uint32_t t = (uint32_t)((temperature + 50.0f) * 1048576.0f / 200.0f);
+    raw[0] = AHT21_STATUS_CALIBRATED | (busy ? AHT21_STATUS_BUSY : 0);
+    raw[1] = (uint8_t)(h >> 12);
+    raw[2] = (uint8_t)(h >> 4);
+    raw[3] = (uint8_t)(((h & 0x0F) << 4) | ((t >> 16) & 0x0F));
+    raw[4] = (uint8_t)(t >> 8);
+    raw[5] = (uint8_t)t;
+
+    size_t count = min(length, sizeof(raw));
+    memcpy(buffer, raw, count);
+    return count;
+}
+
+MockEns160::MockEns160(int intPin) {
+    memset(registers, 0, sizeof(registers));
+    pointer = 0;
+    interruptPin = intPin;
+}
+
+bool MockEns160::interruptEnabled() {
+    return interruptPin >= 0 && (registers[ENS160_REG_CONFIG] & ENS160_CONFIG_INTEN);
+}
+
+bool MockEns160::write(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return true;
+    }
+    pointer = data[0];
+    for (size_t i = 1; i < length; i++) {
+        registers[pointer++] = data[i];
+    }
+    if (registers[ENS160_REG_OPMODE] == 0xF0) {
+        // Reset returns to deep sleep with the result registers cleared
+        memset(registers, 0, sizeof(registers));
+    }
+    return true;
+}
+
+size_t MockEns160::read(uint8_t* buffer, size_t length) {
+    bool statusRead = false;
+    for (size_t i = 0; i < length; i++) {
+        if (pointer == ENS160_REG_STATUS) {
+            statusRead = true;
+        }
+        buffer[i] = registers[pointer++];
+    }
+    if (statusRead) {
+        registers[ENS160_REG_STATUS] &= ~ENS160_STATUS_NEWDAT;
+        if (interruptPin >= 0) {
+            mockSetPinLevel(interruptPin, HIGH);
+        }
+    }
+    return length;
+}
+
+void MockEns160::publish(uint16_t eco2, uint16_t tvoc, uint8_t aqi) {
+    registers[ENS160_REG_DATA_AQI] = aqi;
+    registers[ENS160_REG_DATA_TVOC] = (uint8_t)tvoc;
+    registers[ENS160_REG_DATA_TVOC + 1] = (uint8_t)(tvoc >> 8);
+    registers[ENS160_REG_DATA_ECO2] = (uint8_t)eco2;
+    registers[ENS160_REG_DATA_ECO2 + 1] = (uint8_t)(eco2 >> 8);
+    registers[ENS160_REG_STATUS] |= ENS160_STATUS_NEWDAT;
+    if (interruptEnabled()) {
+        mockSetPinLevel(interruptPin, LOW);
+    }
+}
+
+uint8_t MockEns160::opMode() {
+    return registers[ENS160_REG_OPMODE];
+}
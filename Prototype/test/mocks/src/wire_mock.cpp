@@ -0,0 +1,132 @@
+#include <Wire.h>
+#include <Adafruit_AHTX0.h>
+#include <ScioSense_ENS160.h>
+
+TwoWire Wire;
+
+TwoWire::TwoWire() {
+    targetCount = 0;
+    txAddress = 0;
+    txLength = 0;
+    rxLength = 0;
+    rxIndex = 0;
+    transactions = 0;
+}
+
+MockI2CTarget* TwoWire::find(uint8_t address) {
+    for (uint8_t i = 0; i < targetCount; i++) {
+        if (targets[i].address == address) {
+            return targets[i].target;
+        }
+    }
+    return nullptr;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    (void)sda;
+    (void)scl;
+    (void)frequency;
+    return true;
+}
+
+void TwoWire::setClock(uint32_t frequency) {
+    (void)frequency;
+}
+
+void TwoWire::setTimeOut(uint16_t timeoutMs) {
+    (void)timeoutMs;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    txAddress = address;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+    return write(&value, 1);
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t length) {
+    size_t count = min(length, sizeof(txBuffer) - txLength);
+    memcpy(txBuffer + txLength, data, count);
+    txLength += count;
+    return count;
+}
+
+// 0 on success, 2 (address NACK) when nothing answers, as the core reports
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    (void)sendStop;
+    transactions++;
+    MockI2CTarget* target = find(txAddress);
+    if (target == nullptr) {
+        return 2;
+    }
+    return target->write(txBuffer, txLength) ? 0 : 3;
+}
+
+size_t TwoWire::requestFrom(uint16_t address, size_t length, bool sendStop) {
+    (void)sendStop;
+    transactions++;
+    rxIndex = 0;
+    rxLength = 0;
+    MockI2CTarget* target = find((uint8_t)address);
+    if (target == nullptr) {
+        return 0;
+    }
+    rxLength = target->read(rxBuffer, min(length, sizeof(rxBuffer)));
+    return rxLength;
+}
+
+int TwoWire::available() {
+    return (int)(rxLength - rxIndex);
+}
+
+int TwoWire::read() {
+    return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+size_t TwoWire::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = min(length, rxLength - rxIndex);
+    memcpy(buffer, rxBuffer + rxIndex, count);
+    rxIndex += count;
+    return count;
+}
+
+void TwoWire::attach(uint8_t address, MockI2CTarget* target) {
+    if (targetCount < MOCK_WIRE_MAX_TARGETS) {
+        targets[targetCount].address = address;
+        targets[targetCount].target = target;
+        targetCount++;
+    }
+}
+
+void TwoWire::detachAll() {
+    targetCount = 0;
+}
+
+uint32_t TwoWire::getTransactions() {
+    return transactions;
+}
+
+bool Adafruit_AHTX0::begin(TwoWire* wire, int32_t sensorId, uint8_t address) {
+    (void)sensorId;
+    wire->beginTransmission(address);
+    return wire->endTransmission() == 0;
+}
+
+ScioSense_ENS160::ScioSense_ENS160(uint8_t slaveAddress) {
+    address = slaveAddress;
+}
+
+bool ScioSense_ENS160::begin(bool debug) {
+    (void)debug;
+    Wire.beginTransmission(address);
+    return Wire.endTransmission() == 0;
+}
+
+bool ScioSense_ENS160::setMode(uint8_t mode) {
+    const uint8_t command[2] = {0x10, mode};
+    Wire.beginTransmission(address);
+    Wire.write(command, sizeof(command));
+    return Wire.endTransmission() == 0;
+}
@@ -0,0 +1,730 @@
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "config.h"
+#include "sensor.h"
+#include "alert_policy.h"
+#include "packet_codec.h"
+#include "breath_detector.h"
+#include "sampler.h"
+#include "stats.h"
+#include "replay.h"
+#include "capture.h"
+#include "history.h"
+#include "mock_sensors.h"
+
+// Per-sample cost of the firmware hot paths, measured on the host against
+// the mocks. Each benchmark prints "BENCH <name> <ns per sample>", which
+// scripts/bench.py records and compares with earlier runs. The tests also
+// check the results, so a benchmark never times a broken path.
+
+#define BENCH_PIPELINE_SAMPLES  2000
+#define BENCH_CODEC_SAMPLES     200000
+#define BENCH_FILTER_SAMPLES    500000
+#define BENCH_REPLAY_SAMPLES    20000
+#define BENCH_FILTER_PERIOD_MS  20      // 50 Hz pressure stream
+#define BENCH_BREATH_PERIOD_MS  4000    // 15 breaths per minute
+
+typedef std::chrono::steady_clock BenchClock;
+
+static MockAht21 aht21;
+static MockEns160 ens160(ENS160_INT_PIN);
+static volatile uint32_t sink;      // Keeps results observable under -O2
+
+static double nsPerSample(BenchClock::time_point start, uint32_t samples) {
+    double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+    return ns / samples;
+}
+
+static void report(const char* name, double ns) {
+    printf("BENCH %s %.1f\n", name, ns);
+}
+
+// Same sequence as acquisitionTask, with waits replaced by clock advances
+static bool acquire(SensorData& data, uint16_t co2) {
+    if (!sensorManager.startReading()) {
+        return false;
+    }
+    ens160.publish(co2, 120, 2);    // The result lands while the AHT21 converts
+
+    ReadStatus status;
+    while ((status = sensorManager.pollReading(data)) == READ_PENDING) {
+        mockAdvanceMillis(max((TickType_t)1, sensorManager.nextPollDelay()));
+    }
+    mockAdvanceMillis(SENSOR_READ_INTERVAL_MS);
+    return status == READ_COMPLETE;
+}
+
+// Slow random walk, so deltas stay in the one- and two-byte varint range
+static uint16_t nextCo2(uint32_t i) {
+    return (uint16_t)(800 + (i * 37) % 700);
+}
+
+static SensorPacket samplePacket(uint32_t i) {
+    SensorData data = {};
+    data.co2 = nextCo2(i);
+    data.humidity = (int16_t)(400 + i % 50);
+    data.temperature = (int16_t)(210 + i % 30);
+    data.valid = true;
+    data.timestamp = i * SENSOR_READ_INTERVAL_MS;
+    data.sequence = i;
+    SensorPacket packet;
+    encodeSensorPacket(data, ALERT_NONE, packet);
+    return packet;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_sensor_setup() {
+    mockReset();
+    Wire.attach(AHT21_I2C_ADDRESS, &aht21);
+    Wire.attach(ENS160_I2C_ADDRESS, &ens160);
+
+    TEST_ASSERT_TRUE(i2cBusManager.begin());
+    TEST_ASSERT_TRUE(sensorManager.begin());
+    TEST_ASSERT_EQUAL_UINT8(ENS160_OPMODE_STD, ens160.opMode());
+
+    SensorData data;
+    TEST_ASSERT_TRUE(acquire(data, 950));
+    TEST_ASSERT_TRUE(data.valid);
+    TEST_ASSERT_EQUAL_UINT16(950, data.co2);
+    TEST_ASSERT_INT16_WITHIN(1, (int16_t)(aht21.humidity * 10), data.humidity);
+    TEST_ASSERT_INT16_WITHIN(1, (int16_t)(aht21.temperature * 10), data.temperature);
+}
+
+void bench_acquisition() {
+    SensorData data;
+    uint32_t failures = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_PIPELINE_SAMPLES; i++) {
+        if (!acquire(data, nextCo2(i))) {
+            failures++;
+        }
+    }
+    report("acquisition", nsPerSample(start, BENCH_PIPELINE_SAMPLES));
+
+    TEST_ASSERT_EQUAL_UINT32(0, failures);
+    TEST_ASSERT_EQUAL_UINT32(0, i2cBusManager.getErrors());
+}
+
+static SensorData alertSample(uint16_t co2, uint32_t timeMs) {
+    SensorData data = {};
+    data.co2 = co2;
+    data.humidity = 450;
+    data.temperature = 220;
+    data.valid = true;
+    data.timestamp = timeMs;
+    return data;
+}
+
+void bench_alert() {
+    AlertPolicy policy;
+    uint32_t levels = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_CODEC_SAMPLES; i++) {
+        levels += policy.update(alertSample((uint16_t)(i % 45000), i * SENSOR_READ_INTERVAL_MS));
+    }
+    report("alert", nsPerSample(start, BENCH_CODEC_SAMPLES));
+    sink = levels;
+
+    TEST_ASSERT_EQUAL(ALERT_NONE, AlertPolicy::classify(alertSample(CO2_THRESHOLD_LOW, 0)));
+    TEST_ASSERT_EQUAL(ALERT_HIGH, AlertPolicy::classify(alertSample(CO2_THRESHOLD_HIGH + 1, 0)));
+    TEST_ASSERT_EQUAL(ALERT_CRITICAL, AlertPolicy::classify(alertSample(CO2_THRESHOLD_CRITICAL + 1, 0)));
+}
+
+void test_alert_hysteresis() {
+    AlertPolicy policy;
+    uint32_t now = 0;
+
+    // A reading just over the threshold only raises after the dwell time
+    TEST_ASSERT_EQUAL(ALERT_NONE, policy.update(alertSample(CO2_THRESHOLD_LOW + 50, now)));
+    now += 5000;
+    TEST_ASSERT_EQUAL(ALERT_NONE, policy.update(alertSample(CO2_THRESHOLD_LOW + 50, now)));
+    now += 5000;
+    TEST_ASSERT_EQUAL(ALERT_LOW, policy.update(alertSample(CO2_THRESHOLD_LOW + 50, now)));
+
+    // Dipping under the threshold but inside the band keeps the level
+    now += 60000;
+    TEST_ASSERT_EQUAL(ALERT_LOW, policy.update(alertSample(CO2_THRESHOLD_LOW - 50, now)));
+    now += 1000;
+    TEST_ASSERT_EQUAL(ALERT_NONE, policy.update(alertSample(CO2_THRESHOLD_LOW - 150, now)));
+
+    // A critical reading raises at once; invalid samples change nothing
+    TEST_ASSERT_EQUAL(ALERT_CRITICAL, policy.update(alertSample(CO2_THRESHOLD_CRITICAL + 1, now)));
+    SensorData invalid = alertSample(0, now + 1000);
+    invalid.valid = false;
+    TEST_ASSERT_EQUAL(ALERT_CRITICAL, policy.update(invalid));
+
+    // Held for its minimum time even after the reading falls away
+    now += 1000;
+    TEST_ASSERT_EQUAL(ALERT_CRITICAL, policy.update(alertSample(800, now)));
+    now += 60000;
+    TEST_ASSERT_EQUAL(ALERT_NONE, policy.update(alertSample(800, now)));
+
+    // Heat rule: needs both temperature and humidity high
+    SensorData hot = alertSample(800, 0);
+    hot.temperature = 330;
+    TEST_ASSERT_EQUAL(ALERT_NONE, AlertPolicy::classify(hot));
+    hot.humidity = 750;
+    TEST_ASSERT_EQUAL(ALERT_LOW, AlertPolicy::classify(hot));
+}
+
+void bench_encode_packet() {
+    SensorData data = {};
+    data.co2 = 1234;
+    data.humidity = 456;
+    data.temperature = 234;
+    data.valid = true;
+    SensorPacket packet;
+    uint32_t checksum = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_CODEC_SAMPLES; i++) {
+        data.sequence = i;
+        encodeSensorPacket(data, ALERT_LOW, packet);
+        checksum += packet.co2 + packet.sequence;
+    }
+    report("encode_packet", nsPerSample(start, BENCH_CODEC_SAMPLES));
+    sink = checksum;
+
+    TEST_ASSERT_EQUAL_UINT16(1234, packet.co2);
+    TEST_ASSERT_EQUAL_INT16(456, packet.humidity);
+    TEST_ASSERT_EQUAL_INT16(234, packet.temperature);
+}
+
+void bench_delta_encoder() {
+    static SensorPacket packets[1024];
+    for (uint32_t i = 0; i < 1024; i++) {
+        packets[i] = samplePacket(i);
+    }
+
+    uint8_t frame[BLE_PREFERRED_MTU - BLE_ATT_HEADER_SIZE];
+    DeltaEncoder encoder;
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_CODEC_SAMPLES; i++) {
+        // Sequence numbers keep increasing while the values repeat
+        SensorPacket packet = packets[i & 1023];
+        packet.sequence = i;
+        uint32_t timestamp = i * SENSOR_READ_INTERVAL_MS;
+        if (encoder.count() == 0) {
+            encoder.begin(frame, sizeof(frame), SENSOR_READ_INTERVAL_MS);
+        }
+        if (!encoder.append(packet, timestamp)) {
+            bytes += encoder.length();
+            frames++;
+            encoder.begin(frame, sizeof(frame), SENSOR_READ_INTERVAL_MS);
+            encoder.append(packet, timestamp);
+        }
+    }
+    report("delta_append", nsPerSample(start, BENCH_CODEC_SAMPLES));
+    sink = bytes;
+
+    TEST_ASSERT_TRUE(frames > 0);
+    // Worth doing only if it beats raw 22-byte packets comfortably
+    TEST_ASSERT_TRUE(bytes / (double)(BENCH_CODEC_SAMPLES - encoder.count()) < sizeof(SensorPacket) / 2.0);
+}
+
+void bench_breath_detector() {
+    // Precomputed so the loop times the filter, not sin()
+    const uint32_t periodSamples = BENCH_BREATH_PERIOD_MS / BENCH_FILTER_PERIOD_MS;
+    static int32_t pressure[BENCH_BREATH_PERIOD_MS / BENCH_FILTER_PERIOD_MS];
+    for (uint32_t i = 0; i < periodSamples; i++) {
+        pressure[i] = 101325 * 16 + (int32_t)(20 * 16 * sin(2 * M_PI * i / periodSamples));
+    }
+
+    BreathDetector detector(BENCH_FILTER_PERIOD_MS);
+    uint32_t breaths = 0;
+    uint32_t index = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_FILTER_SAMPLES; i++) {
+        if (detector.process(pressure[index])) {
+            breaths++;
+        }
+        if (++index == periodSamples) {
+            index = 0;
+        }
+    }
+    report("breath_detector", nsPerSample(start, BENCH_FILTER_SAMPLES));
+    sink = breaths;
+
+    TEST_ASSERT_TRUE(breaths > 0);
+    TEST_ASSERT_UINT16_WITHIN(10, 150, detector.state().breathsPerMinuteX10);
+}
+
+void bench_adaptive_sampler() {
+    AdaptiveSampler sampler;
+    uint32_t periods = 0;
+    uint32_t time = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_CODEC_SAMPLES; i++) {
+        uint16_t period = sampler.update(nextCo2(i), ALERT_NONE, time);
+        time += period;
+        periods += period;
+    }
+    report("adaptive_sampler", nsPerSample(start, BENCH_CODEC_SAMPLES));
+    sink = periods;
+
+    // Steady and low: relaxes to the idle period after the calm samples
+    sampler.reset();
+    time = 0;
+    uint16_t period = 0;
+    for (int i = 0; i <= SAMPLER_CALM_SAMPLES; i++) {
+        period = sampler.update(600, ALERT_NONE, time);
+        time += period;
+    }
+    TEST_ASSERT_EQUAL_UINT16(SAMPLE_PERIOD_IDLE_MS, period);
+
+    // A fast rise switches to the minimum period on the next sample
+    period = sampler.update(600 + SAMPLER_NOISE_PPM + 100, ALERT_NONE, time);
+    TEST_ASSERT_EQUAL_UINT16(SAMPLE_PERIOD_MIN_MS, period);
+
+    // So does a medium alert, however steady
+    sampler.reset();
+    TEST_ASSERT_EQUAL_UINT16(SAMPLE_PERIOD_MIN_MS, sampler.update(6000, ALERT_MEDIUM, 0));
+
+    sampler.setFixedPeriod(3000);
+    TEST_ASSERT_EQUAL_UINT16(3000, sampler.update(6000, ALERT_MEDIUM, 1000));
+
+    // Whole ppm per minute above the noise floor, saturating on a spike
+    sampler.reset();
+    sampler.update(600, ALERT_NONE, 0);
+    sampler.update(600 + SAMPLER_NOISE_PPM + 90, ALERT_NONE, 30000);
+    TEST_ASSERT_EQUAL_UINT16(180, sampler.slope());
+    sampler.update(600 + SAMPLER_NOISE_PPM + 90, ALERT_NONE, 60000);
+    TEST_ASSERT_EQUAL_UINT16(90, sampler.slope());
+    sampler.update(60000, ALERT_NONE, 60001);
+    TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, sampler.slope());
+}
+
+void bench_sliding_window() {
+    SampleWindow window;
+    int64_t checksum = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_CODEC_SAMPLES; i++) {
+        window.push(nextCo2(i), i * SENSOR_READ_INTERVAL_MS);
+        checksum += window.mean() + window.min() + window.max() + window.ewma();
+    }
+    report("sliding_window", nsPerSample(start, BENCH_CODEC_SAMPLES));
+    sink = (uint32_t)checksum;
+
+    // Against a brute-force pass over the same last N values
+    int32_t lo = INT32_MAX, hi = INT32_MIN, sum = 0;
+    for (uint32_t i = BENCH_CODEC_SAMPLES - STATS_WINDOW_SAMPLES; i < BENCH_CODEC_SAMPLES; i++) {
+        int32_t value = nextCo2(i);
+        lo = min(lo, value);
+        hi = max(hi, value);
+        sum += value;
+    }
+    TEST_ASSERT_EQUAL_UINT32(STATS_WINDOW_SAMPLES, window.count());
+    TEST_ASSERT_EQUAL_INT32(lo, window.min());
+    TEST_ASSERT_EQUAL_INT32(hi, window.max());
+    TEST_ASSERT_EQUAL_INT32(sum / STATS_WINDOW_SAMPLES, window.mean());
+
+    // A steady 10 ppm per sample at one sample per second is 600 ppm/min
+    window.reset();
+    for (uint32_t i = 0; i < STATS_WINDOW_SAMPLES; i++) {
+        window.push(800 + 10 * i, i * 1000);
+    }
+    TEST_ASSERT_EQUAL_INT32(600, window.ratePerMinute());
+}
+
+void test_summaries() {
+    StatsManager stats;
+    SensorData data = {};
+    data.valid = true;
+    data.humidity = 450;
+    data.temperature = 220;
+
+    // Two intervals of samples every 10 s, then one sample to close the second
+    uint32_t samples = 2 * STATS_SUMMARY_PERIOD_MS / 10000;
+    for (uint32_t i = 0; i <= samples; i++) {
+        data.co2 = (uint16_t)(800 + (i % 6) * 20);
+        data.timestamp = i * 10000;
+        data.sequence = i;
+        stats.add(data);
+        stats.summarise(data, i == 3 ? ALERT_LOW : ALERT_NONE);
+    }
+
+    SummaryRecord first, second, none;
+    TEST_ASSERT_TRUE(stats.nextSummary(first));
+    TEST_ASSERT_TRUE(stats.nextSummary(second));
+    TEST_ASSERT_FALSE(stats.nextSummary(none));
+
+    TEST_ASSERT_EQUAL_UINT8(BLE_FRAME_SUMMARY, first.type);
+    TEST_ASSERT_EQUAL_UINT8(6, first.count);
+    TEST_ASSERT_EQUAL_UINT32(0, first.firstSequence);
+    TEST_ASSERT_EQUAL_UINT16(800, first.co2Min);
+    TEST_ASSERT_EQUAL_UINT16(900, first.co2Max);
+    TEST_ASSERT_EQUAL_UINT16(850, first.co2Mean);
+    TEST_ASSERT_EQUAL_INT16(450, first.humidityMean);
+    TEST_ASSERT_EQUAL_INT16(220, first.temperatureMax);
+    TEST_ASSERT_EQUAL_UINT8(ALERT_LOW, first.peakAlert);
+    TEST_ASSERT_EQUAL_UINT32(STATS_SUMMARY_PERIOD_MS / 1000, second.startTime);
+    TEST_ASSERT_EQUAL_UINT32(6, second.firstSequence);
+    TEST_ASSERT_EQUAL_UINT8(ALERT_NONE, second.peakAlert);
+}
+
+void bench_pipeline() {
+    uint8_t frame[BLE_PREFERRED_MTU - BLE_ATT_HEADER_SIZE];
+    DeltaEncoder encoder;
+    SensorData data;
+    uint32_t completed = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_PIPELINE_SAMPLES; i++) {
+        if (!acquire(data, nextCo2(i))) {
+            continue;
+        }
+        data.sequence = i;
+        AlertLevel level = alertPolicy.update(data);
+
+        SensorPacket packet;
+        encodeSensorPacket(data, level, packet);
+        if (encoder.count() == 0) {
+            encoder.begin(frame, sizeof(frame), SENSOR_READ_INTERVAL_MS);
+        }
+        if (!encoder.append(packet, data.timestamp)) {
+            encoder.begin(frame, sizeof(frame), SENSOR_READ_INTERVAL_MS);
+            encoder.append(packet, data.timestamp);
+        }
+        completed++;
+    }
+    report("pipeline", nsPerSample(start, BENCH_PIPELINE_SAMPLES));
+
+    TEST_ASSERT_EQUAL_UINT32(BENCH_PIPELINE_SAMPLES, completed);
+}
+
+// A recorded session, one record per second: CO2 climbs through every
+// alert level over 1000 s and falls back
+static SensorPacket recordedPacket(uint32_t i) {
+    uint32_t phase = i % 2000;
+    uint32_t rise = phase < 1000 ? phase : 2000 - phase;
+    SensorData data = alertSample((uint16_t)(600 + rise * 45), i * 1000);
+    data.sequence = i;
+    SensorPacket packet;
+    encodeSensorPacket(data, ALERT_NONE, packet);
+    return packet;
+}
+
+// Plays a session through the alert stage as fast as possible and returns
+// a checksum of the levels it produced
+static uint32_t replaySession(uint32_t samples) {
+    StatsManager stats;
+    AlertPolicy policy;
+    uint32_t fed = 0;
+    uint32_t checksum = 0;
+
+    if (!replaySource.open(REPLAY_FAST, SENSOR_READ_INTERVAL_MS)) {
+        return 0;
+    }
+    while (replaySource.startReading()) {
+        while (fed < samples && replaySource.feed(recordedPacket(fed))) {
+            fed++;
+        }
+        if (fed == samples) {
+            replaySource.finish();
+        }
+
+        SensorData data;
+        ReadStatus status = replaySource.pollReading(data);
+        if (status != READ_COMPLETE) {
+            continue;
+        }
+        stats.add(data);
+        SensorData smoothed = data;
+        smoothed.co2 = stats.smoothedCo2(data.co2);
+        AlertLevel level = policy.update(smoothed);
+        replaySource.noteDelivered(data, level);
+        checksum = checksum * 31 + level;
+    }
+    return checksum;
+}
+
+void bench_replay() {
+    BenchClock::time_point start = BenchClock::now();
+    uint32_t checksum = replaySession(BENCH_REPLAY_SAMPLES);
+    report("replay", nsPerSample(start, BENCH_REPLAY_SAMPLES));
+
+    ReplayReport result = replaySource.getReport();
+    TEST_ASSERT_EQUAL_UINT32(BENCH_REPLAY_SAMPLES, result.played);
+    TEST_ASSERT_EQUAL_UINT32(BENCH_REPLAY_SAMPLES, result.delivered);
+    TEST_ASSERT_TRUE(replaySource.isDrained());
+
+    // LOW waits out its dwell time; CRITICAL only lags the EWMA
+    TEST_ASSERT_TRUE(result.alertLatencyMs[ALERT_LOW] >= 10000);
+    TEST_ASSERT_TRUE(result.alertLatencyMs[ALERT_CRITICAL] < 10000);
+
+    // Same recording, same alerts
+    TEST_ASSERT_EQUAL_UINT32(checksum, replaySession(BENCH_REPLAY_SAMPLES));
+}
+
+void test_replay_pacing() {
+    mockReset();
+    TEST_ASSERT_TRUE(replaySource.open(REPLAY_REALTIME, 250));
+    SensorPacket second = recordedPacket(0);
+    TEST_ASSERT_TRUE(replaySource.feed(recordedPacket(0)));
+    TEST_ASSERT_TRUE(replaySource.feed(second));        // Same recorded second
+    TEST_ASSERT_TRUE(replaySource.feed(recordedPacket(1)));
+    replaySource.finish();
+
+    SensorData data;
+    TEST_ASSERT_EQUAL(READ_COMPLETE, replaySource.pollReading(data));
+    TEST_ASSERT_TRUE(data.replayed);
+    TEST_ASSERT_EQUAL_UINT32(0, data.timestamp);
+
+    TEST_ASSERT_EQUAL(READ_PENDING, replaySource.pollReading(data));
+    TEST_ASSERT_EQUAL_UINT32(250, replaySource.nextPollDelay());
+    mockAdvanceMillis(250);
+    TEST_ASSERT_EQUAL(READ_COMPLETE, replaySource.pollReading(data));
+    TEST_ASSERT_EQUAL_UINT32(250, data.timestamp);
+
+    TEST_ASSERT_EQUAL(READ_PENDING, replaySource.pollReading(data));
+    mockAdvanceMillis(750);
+    TEST_ASSERT_EQUAL(READ_COMPLETE, replaySource.pollReading(data));
+    TEST_ASSERT_EQUAL_UINT32(1000, data.timestamp);
+
+    TEST_ASSERT_EQUAL(READ_FAILED, replaySource.pollReading(data));
+    TEST_ASSERT_FALSE(replaySource.isActive());
+
+    // Streamed and backfilled replays stay marked as recorded data
+    SensorPacket packet;
+    encodeSensorPacket(data, ALERT_NONE, packet);
+    TEST_ASSERT_TRUE((packet.status & SENSOR_STATUS_REPLAYED) != 0);
+    SensorData decoded;
+    decodeSensorPacket(packet, decoded);
+    TEST_ASSERT_TRUE(decoded.replayed);
+    data.replayed = false;
+    encodeSensorPacket(data, ALERT_NONE, packet);
+    TEST_ASSERT_EQUAL_UINT8(0, packet.status & SENSOR_STATUS_REPLAYED);
+}
+
+void test_replay_history() {
+    TEST_ASSERT_TRUE(historyManager.begin());
+    SensorData data = {};
+    data.valid = true;
+    historyManager.record(data, ALERT_NONE);
+    uint32_t oldest = historyManager.oldestSequence();
+    uint32_t next = historyManager.nextSequence();
+
+    // A replay longer than the ring must not push live samples out
+    for (size_t i = 0; i < historyManager.capacity() + 1; i++) {
+        SensorData replayed = {};
+        replayed.replayed = true;
+        replayed.sequence = 1000 + i;
+        TEST_ASSERT_EQUAL_UINT32(1000 + i, historyManager.record(replayed, ALERT_NONE));
+        TEST_ASSERT_EQUAL_UINT32(1000 + i, replayed.sequence);
+    }
+    TEST_ASSERT_EQUAL_UINT32(oldest, historyManager.oldestSequence());
+    TEST_ASSERT_EQUAL_UINT32(next, historyManager.nextSequence());
+
+    SensorPacket packet;
+    TEST_ASSERT_TRUE(historyManager.read(next - 1, packet));
+    TEST_ASSERT_EQUAL_UINT8(0, packet.status & SENSOR_STATUS_REPLAYED);
+}
+
+void test_capture_transfer() {
+    TEST_ASSERT_TRUE(captureManager.begin());
+    TEST_ASSERT_TRUE(captureManager.start(100 * RESPIRATION_PERIOD_MS));
+    TEST_ASSERT_FALSE(captureManager.start(0));        // One capture at a time
+
+    uint8_t frame[BLE_PREFERRED_MTU - BLE_ATT_HEADER_SIZE];
+    uint32_t count;
+    TEST_ASSERT_EQUAL_UINT32(0, captureManager.buildFrame(0, frame, sizeof(frame), count));
+
+    // An overrun and a failed read keep their periods, so timestamps stay implied
+    captureManager.noteCo2(900);
+    for (int32_t i = 0; i < 40; i++) {
+        captureManager.record(1620000 + i);
+    }
+    captureManager.recordMissing(2);
+    for (int32_t i = 42; i < 120; i++) {
+        captureManager.record(1620000 + i);
+    }
+    TEST_ASSERT_EQUAL(CAPTURE_COMPLETE, captureManager.getState());
+    TEST_ASSERT_EQUAL_UINT32(100, captureManager.size());
+    TEST_ASSERT_EQUAL_UINT32(2, captureManager.getMissing());
+
+    // Walk the transfer the way a resumed app would, one full frame at a time
+    uint32_t offset = 0;
+    uint32_t frames = 0;
+    uint8_t flags = 0;
+    while (size_t length = captureManager.buildFrame(offset, frame, sizeof(frame), count)) {
+        CaptureHeader header;
+        memcpy(&header, frame, sizeof(header));
+        TEST_ASSERT_EQUAL_UINT8(BLE_FRAME_CAPTURE, header.type);
+        TEST_ASSERT_EQUAL_UINT32(offset, header.offset);
+        TEST_ASSERT_EQUAL_UINT32(100, header.total);
+        TEST_ASSERT_EQUAL_UINT32(sizeof(header) + count * sizeof(CaptureSample), length);
+
+        for (uint32_t i = 0; i < count; i++) {
+            CaptureSample sample;
+            memcpy(&sample, frame + sizeof(header) + i * sizeof(sample), sizeof(sample));
+            uint32_t index = offset + i;
+            if (index == 40 || index == 41) {
+                TEST_ASSERT_EQUAL_INT32(CAPTURE_SAMPLE_MISSING, sample.pressureX16);
+            } else {
+                TEST_ASSERT_EQUAL_INT32(1620000 + (int32_t)index, sample.pressureX16);
+            }
+            TEST_ASSERT_EQUAL_UINT16(900, sample.co2);
+        }
+        offset += count;
+        flags = header.flags;
+        frames++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, offset);
+    TEST_ASSERT_EQUAL_UINT8(CAPTURE_FLAG_LAST, flags);
+    uint32_t perFrame = (sizeof(frame) - sizeof(CaptureHeader)) / sizeof(CaptureSample);
+    TEST_ASSERT_EQUAL_UINT32((100 + perFrame - 1) / perFrame, frames);
+
+    // Stopping early keeps what was recorded
+    TEST_ASSERT_TRUE(captureManager.start(0));
+    captureManager.record(1);
+    captureManager.stop();
+    captureManager.record(2);
+    TEST_ASSERT_EQUAL(CAPTURE_COMPLETE, captureManager.getState());
+    TEST_ASSERT_EQUAL_UINT32(1, captureManager.size());
+}
+
+void test_text_commands() {
+    CommandFrame frame;
+    const char* resume = "7:4294967295";
+    TEST_ASSERT_TRUE(decodeCommandFrame((const uint8_t*)resume, strlen(resume), frame));
+    TEST_ASSERT_EQUAL_UINT8(7, frame.opcode);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, frame.argument);
+
+    // Overflow and trailing bytes are rejected rather than truncated
+    const char* rejected[] = {"4294967297", "7:4294967296", "1abc", "7:12x", "3 "};
+    for (const char* text : rejected) {
+        TEST_ASSERT_FALSE(decodeCommandFrame((const uint8_t*)text, strlen(text), frame));
+    }
+}
+
+void test_capture_timing() {
+    // A 64-bit argument spans both halves; a 6-byte write leaves the upper one 0
+    const uint8_t sync[] = {19, 7,  // CMD_TIME_SYNC
+                            0x78, 0x56, 0x34, 0x12, 0x9A, 0x01, 0, 0};
+    CommandFrame frame;
+    TEST_ASSERT_TRUE(decodeCommandFrame(sync, sizeof(sync), frame));
+    TEST_ASSERT_EQUAL_UINT32(0x12345678, frame.argument);
+    TEST_ASSERT_EQUAL_UINT32(0x19A, frame.argumentHigh);
+    TEST_ASSERT_TRUE(decodeCommandFrame(sync, 6, frame));
+    TEST_ASSERT_EQUAL_UINT32(0, frame.argumentHigh);
+    TEST_ASSERT_FALSE(decodeCommandFrame(sync, sizeof(sync) + 1, frame));
+
+    // The packet keeps the microseconds below its whole-second timestamp
+    SensorData data = {};
+    data.timestamp = 12345;
+    data.captureUs = 12345678;
+    SensorPacket packet;
+    encodeSensorPacket(data, ALERT_NONE, packet);
+    TEST_ASSERT_EQUAL_UINT32(12, packet.timestamp);
+    TEST_ASSERT_EQUAL_UINT32(345678, packet.captureMicros);
+
+    SensorData decoded;
+    decodeSensorPacket(packet, decoded);
+    TEST_ASSERT_TRUE(decoded.captureUs == 12345678);
+
+    data.captureUs = -1;
+    encodeSensorPacket(data, ALERT_NONE, packet);
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_MICROS_UNKNOWN, packet.captureMicros);
+    decodeSensorPacket(packet, decoded);
+    TEST_ASSERT_TRUE(decoded.captureUs == -1);
+
+    // Live samples keep the capture micros in a one-entry batch once the MTU
+    // allows it; at the default 23-byte MTU they go out as legacy packets
+    uint8_t live[LIVE_FRAME_MAX_SIZE];
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_PACKET_LEGACY_SIZE,
+                             encodeLiveFrame(packet, BLE_DEFAULT_MTU - BLE_ATT_HEADER_SIZE, live));
+    TEST_ASSERT_EQUAL_UINT32(LIVE_FRAME_MAX_SIZE, encodeLiveFrame(packet, BLE_PREFERRED_MTU - BLE_ATT_HEADER_SIZE, live));
+    TEST_ASSERT_EQUAL_UINT8(BLE_FRAME_BATCH, live[0]);
+    TEST_ASSERT_EQUAL_UINT8(1, live[1]);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(SensorPacket), live[2]);
+}
+
+void test_small_mtu_packets() {
+    SensorPacket packet = {};
+    packet.co2 = 950;
+    packet.sequence = 42;
+    packet.breathRate = 150;
+
+    // A delta keyframe cannot start in the default 20-byte payload
+    const size_t payload = BLE_DEFAULT_MTU - BLE_ATT_HEADER_SIZE;
+    uint8_t buffer[BLE_DEFAULT_MTU];
+    DeltaEncoder encoder;
+    encoder.begin(buffer, payload, 1000);
+    TEST_ASSERT_FALSE(encoder.append(packet, 0));
+    TEST_ASSERT_TRUE(payload < DELTA_FRAME_MIN_SIZE);
+
+    // The bare packet is cut to what the payload holds
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_PACKET_LEGACY_SIZE, encodeBarePacket(packet, payload, buffer));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY((const uint8_t*)&packet, buffer, SENSOR_PACKET_LEGACY_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_PACKET_RESPIRATION_SIZE,
+                             encodeBarePacket(packet, SENSOR_PACKET_RESPIRATION_SIZE, buffer));
+    TEST_ASSERT_EQUAL_UINT32(0, encodeBarePacket(packet, SENSOR_PACKET_LEGACY_SIZE - 1, buffer));
+}
+
+void test_broadcast_advertisement() {
+    SensorPacket packet = {};
+    packet.co2 = 1850;
+    packet.humidity = 456;
+    packet.temperature = -45;
+    packet.alert = ALERT_MEDIUM;
+    packet.sequence = 0x01020304;
+    packet.breathRate = 162;
+
+    uint8_t adv[BLE_ADV_MAX_LENGTH];
+    size_t length = encodeBroadcast(packet, true, adv);
+    TEST_ASSERT_EQUAL_UINT32(BROADCAST_MAX_LENGTH, length);
+
+    // Flags, then manufacturer data filling the rest of the payload
+    const uint8_t head[] = {2, 0x01, 0x06, (uint8_t)(length - 4), 0xFF,
+                            BLE_BROADCAST_COMPANY_ID & 0xFF, BLE_BROADCAST_COMPANY_ID >> 8};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(head, adv, sizeof(head));
+
+    BroadcastSummary summary;
+    memcpy(&summary, adv + sizeof(head), sizeof(summary));
+    TEST_ASSERT_EQUAL_UINT8(BROADCAST_VERSION, summary.version);
+    TEST_ASSERT_EQUAL_UINT8(ALERT_MEDIUM | BROADCAST_FLAG_CONNECTED, summary.flags);
+    TEST_ASSERT_EQUAL_UINT16(1850, summary.co2);
+    TEST_ASSERT_EQUAL_UINT16(162, summary.breathRate);
+    TEST_ASSERT_EQUAL_INT16(-45, summary.temperature);
+    TEST_ASSERT_EQUAL_INT16(456, summary.humidity);
+    TEST_ASSERT_EQUAL_UINT32(0x01020304, summary.sequence);
+
+    encodeBroadcast(packet, false, adv);
+    TEST_ASSERT_EQUAL_UINT8(ALERT_MEDIUM, adv[sizeof(head) + 1]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_sensor_setup);
+    RUN_TEST(bench_acquisition);
+    RUN_TEST(bench_alert);
+    RUN_TEST(test_alert_hysteresis);
+    RUN_TEST(bench_encode_packet);
+    RUN_TEST(bench_delta_encoder);
+    RUN_TEST(bench_breath_detector);
+    RUN_TEST(bench_adaptive_sampler);
+    RUN_TEST(bench_sliding_window);
+    RUN_TEST(test_summaries);
+    RUN_TEST(bench_pipeline);
+    RUN_TEST(bench_replay);
+    RUN_TEST(test_replay_pacing);
+    RUN_TEST(test_capture_transfer);
+    RUN_TEST(test_capture_timing);
+    RUN_TEST(test_broadcast_advertisement);
+    RUN_TEST(test_small_mtu_packets);
+    RUN_TEST(test_replay_history);
+    RUN_TEST(test_text_commands);
+    return UNITY_END();
+}
@@ -0,0 +1,64 @@
+import 'dart:typed_data';
+
+/// Latest sample a tag advertises in broadcast mode, read from the
+/// manufacturer data of its advertisements without connecting
+///
+/// uint16_t companyId;     // 0xFFFF
+/// uint8_t version;        // 1
+/// uint8_t flags;          // Alert level in the low nibble, bit 4: a phone is connected
+/// uint16_t co2;           // ppm
+/// uint16_t breathRate;    // Breaths per minute * 10, 0 if not measured
+/// int16_t temperature;    // * 10
+/// int16_t humidity;       // * 10
+/// uint32_t sequence;
+class BroadcastSummary {
+  static const int companyId = 0xFFFF;
+  static const int version = 1;
+  static const int frameSize = 16;
+  static const int connectedFlag = 0x10;
+
+  final int co2;
+  final double temperature;
+  final double humidity;
+  final int alert;
+  final int sequence;
+
+  /// True while another phone holds the tag's connection
+  final bool connected;
+
+  /// Null when the device has no breath rate yet
+  final double? breathsPerMinute;
+
+  const BroadcastSummary({
+    required this.co2,
+    required this.temperature,
+    required this.humidity,
+    required this.alert,
+    required this.sequence,
+    required this.connected,
+    this.breathsPerMinute,
+  });
+
+  /// Returns null if [manufacturerData] (company id first, as scanners
+  /// report it) is not a broadcast summary
+  static BroadcastSummary? parse(List<int> manufacturerData) {
+    if (manufacturerData.length != frameSize) {
+      return null;
+    }
+    final data = ByteData.sublistView(Uint8List.fromList(manufacturerData));
+    if (data.getUint16(0, Endian.little) != companyId || data.getUint8(2) != version) {
+      return null;
+    }
+    final flags = data.getUint8(3);
+    final breathRate = data.getUint16(6, Endian.little);
+    return BroadcastSummary(
+      co2: data.getUint16(4, Endian.little),
+      breathsPerMinute: breathRate > 0 ? breathRate / 10.0 : null,
+      temperature: data.getInt16(8, Endian.little) / 10.0,
+      humidity: data.getInt16(10, Endian.little) / 10.0,
+      alert: flags & 0x0F,
+      connected: (flags & connectedFlag) != 0,
+      sequence: data.getUint32(12, Endian.little),
+    );
+  }
+}
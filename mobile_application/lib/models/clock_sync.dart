@@ -0,0 +1,103 @@
+import 'dart:typed_data';
+
+/// The device's answer to a ping command, notified on the response
+/// characteristic just before the ping's acknowledgement
+///
+/// uint8_t type;           // 0xD2
+/// uint8_t requestId;
+/// uint8_t flags;          // Bit 0: epochOffsetUs is valid
+/// uint8_t reserved;
+/// uint32_t token;         // The ping's argument
+/// int64_t receivedUs;     // Device clock when the ping arrived
+/// int64_t sentUs;         // Device clock when the pong was sent
+/// int64_t epochOffsetUs;  // Device Unix time minus its clock
+class PongFrame {
+  static const int frameType = 0xD2;
+  static const int frameSize = 32;
+  static const int epochSetFlag = 0x01;
+
+  final int requestId;
+  final int token;
+  final int receivedUs;
+  final int sentUs;
+
+  /// Null until the device clock has been set with a time sync command
+  final int? epochOffsetUs;
+
+  const PongFrame(this.requestId, this.token, this.receivedUs, this.sentUs, this.epochOffsetUs);
+
+  /// Returns null if [bytes] is not a pong frame
+  static PongFrame? parse(List<int> bytes) {
+    if (bytes.length != frameSize || bytes[0] != frameType) {
+      return null;
+    }
+    final data = ByteData.sublistView(Uint8List.fromList(bytes));
+    return PongFrame(
+      data.getUint8(1),
+      data.getUint32(4, Endian.little),
+      data.getInt64(8, Endian.little),
+      data.getInt64(16, Endian.little),
+      (data.getUint8(2) & epochSetFlag) != 0 ? data.getInt64(24, Endian.little) : null,
+    );
+  }
+}
+
+/// Offset between the device clock (microseconds since boot) and the
+/// phone's clock, estimated NTP style from ping round trips. The round trip
+/// with the least time on the air gives the tightest bound, so only that
+/// one is kept.
+class ClockSync {
+  /// Phone time minus device time, in microseconds
+  int? offsetUs;
+
+  /// Air time of the round trip behind [offsetUs]; the offset is within
+  /// half of it
+  int? roundTripUs;
+
+  int samples = 0;
+
+  bool get isSynced => offsetUs != null;
+
+  /// Adds one round trip; [phoneSentUs] and [phoneReceivedUs] are phone
+  /// microseconds since the epoch around the ping write and the pong
+  void add(int phoneSentUs, int phoneReceivedUs, PongFrame pong) {
+    final roundTrip = (phoneReceivedUs - phoneSentUs) - (pong.sentUs - pong.receivedUs);
+    samples++;
+    if (roundTripUs != null && roundTrip >= roundTripUs!) {
+      return;
+    }
+    roundTripUs = roundTrip;
+    offsetUs = ((phoneSentUs - pong.receivedUs) + (phoneReceivedUs - pong.sentUs)) ~/ 2;
+  }
+
+  /// Phone time of a device timestamp, null until synced
+  DateTime? toPhoneTime(int deviceUs) {
+    final offset = offsetUs;
+    return offset != null ? DateTime.fromMicrosecondsSinceEpoch(deviceUs + offset) : null;
+  }
+}
+
+/// Running latency from sensor read to some point on the phone
+class LatencyStats {
+  int count = 0;
+  int totalUs = 0;
+  int maxUs = 0;
+
+  void add(int latencyUs) {
+    count++;
+    totalUs += latencyUs;
+    if (latencyUs > maxUs) {
+      maxUs = latencyUs;
+    }
+  }
+
+  double get meanMs => count > 0 ? totalUs / count / 1000.0 : 0;
+
+  double get maxMs => maxUs / 1000.0;
+
+  void reset() {
+    count = 0;
+    totalUs = 0;
+    maxUs = 0;
+  }
+}
@@ -0,0 +1,66 @@
+import 'dart:typed_data';
+
+import 'link_benchmark.dart';
+
+/// Missed stage deadlines and watchdog restarts the device reports on its
+/// diagnostics characteristic (DiagDeadlineStats, after the link section in
+/// snapshot version 4 and later)
+class DeviceDeadlineStats {
+  static const int minimumVersion = 4;
+  static const int headerSize = 4;
+
+  /// Firmware stage order: sensor read, alert, packet build, notify, sample lateness
+  static const List<String> stageNames = ['sensorRead', 'alert', 'packetBuild', 'notify', 'sampleLateness'];
+
+  /// Task order of the firmware's DiagTask
+  static const List<String> taskNames = [
+    'acquisition', 'alert', 'transport', 'ui', 'respiration', 'storage', 'i2c', 'log'
+  ];
+
+  final List<int> missed;
+  final int watchdogRestarts;
+
+  /// Name of the task behind the last watchdog restart, null if there was none
+  final String? wedgedTask;
+
+  const DeviceDeadlineStats(this.missed, this.watchdogRestarts, this.wedgedTask);
+
+  int get missedTotal => missed.fold(0, (sum, count) => sum + count);
+
+  /// Missed deadlines of one stage by its [stageNames] entry
+  int missedFor(String stage) {
+    final index = stageNames.indexOf(stage);
+    return index >= 0 && index < missed.length ? missed[index] : 0;
+  }
+
+  /// Finds the deadline section of a whole diagnostics snapshot; null if the
+  /// firmware is too old or the snapshot is truncated
+  static DeviceDeadlineStats? parseSnapshot(List<int> bytes) {
+    if (bytes.length < DeviceLinkStats.headerSize || bytes[0] < minimumVersion) {
+      return null;
+    }
+    final offset = DeviceLinkStats.sectionOffset(bytes) + DeviceLinkStats.sizeFor(bytes[0]);
+    if (bytes.length < offset + headerSize) {
+      return null;
+    }
+    final stageCount = bytes[offset];
+    if (bytes.length < offset + headerSize + stageCount * 4) {
+      return null;
+    }
+
+    final data = ByteData.sublistView(Uint8List.fromList(bytes.sublist(offset)));
+    final wedged = data.getUint8(1);
+    final missed = [for (var i = 0; i < stageCount; i++) data.getUint32(headerSize + i * 4, Endian.little)];
+    return DeviceDeadlineStats(
+      missed,
+      data.getUint16(2, Endian.little),
+      wedged < taskNames.length ? taskNames[wedged] : null,
+    );
+  }
+
+  @override
+  String toString() {
+    return 'DeviceDeadlineStats(missed: $missedTotal, watchdog restarts: $watchdogRestarts'
+        '${wedgedTask != null ? ', last wedged: $wedgedTask' : ''})';
+  }
+}
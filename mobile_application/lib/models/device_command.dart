@@ -0,0 +1,93 @@
+import 'dart:typed_data';
+
+/// Binary control command understood by the ESP32 firmware
+///
+/// Written to the control characteristic as
+/// uint8_t opcode; uint8_t requestId; uint32_t argument (little-endian),
+/// followed by the upper 32 bits for an argument that does not fit in them.
+/// The device acknowledges every command on the response characteristic
+/// with a [CommandResponse] carrying the same request id.
+class DeviceCommand {
+  static const int muteBuzzer = 1;
+  static const int forceSleep = 2;
+  static const int requestData = 3;
+  static const int resetAlerts = 4;
+  static const int streamBatch = 5;
+  static const int streamDelta = 6;
+  static const int backfill = 7;          // Argument: first sequence to resend
+  static const int setSamplePeriod = 8;   // Argument: 1000-60000 ms, 0 = adaptive
+  static const int setBatchSize = 9;      // Argument: samples per notification
+  static const int setProfile = 10;       // Argument: StreamingProfile index
+  static const int streamSummary = 11;    // Per-minute summaries instead of samples
+  static const int replay = 12;           // Argument: SD session number (0 = serial) | fast << 16
+  static const int stopReplay = 13;
+  static const int benchmark = 14;        // Argument: frame bytes (0 = MTU) | frames per second << 16
+  static const int stopBenchmark = 15;
+  static const int capture = 16;          // Argument: seconds of raw waveform, 0 = fill the buffer
+  static const int sendCapture = 17;      // Argument: first sample to send, to resume a transfer
+  static const int stopCapture = 18;
+  static const int timeSync = 19;         // Argument: Unix time in ms (64-bit)
+  static const int ping = 20;             // Argument: token echoed in the PongFrame
+  static const int broadcast = 21;        // Argument: 1 = latest sample in every advertisement, 0 = off
+
+  static const int frameSize = 6;
+  static const int longFrameSize = 10;
+
+  final int opcode;
+  final int requestId;
+  final int argument;
+
+  const DeviceCommand(this.opcode, {this.requestId = 0, this.argument = 0});
+
+  /// Encodes the command for a control characteristic write
+  List<int> encode() {
+    final long = argument > 0xFFFFFFFF;
+    final data = ByteData(long ? longFrameSize : frameSize);
+    data.setUint8(0, opcode);
+    data.setUint8(1, requestId & 0xFF);
+    data.setUint32(2, argument & 0xFFFFFFFF, Endian.little);
+    if (long) {
+      data.setUint32(6, argument >> 32, Endian.little);
+    }
+    return data.buffer.asUint8List().toList();
+  }
+}
+
+/// Connection profiles the device can stream with; the index is the
+/// firmware's BLEProfile value
+enum StreamingProfile {
+  /// Short connection interval and no batching, for live charts
+  live,
+
+  /// Device default
+  balanced,
+
+  /// Long interval with slave latency and large batches, for background logging
+  background,
+}
+
+/// Outcome reported by the device for one command
+enum CommandStatus { ok, unknown, invalidArgument, busy }
+
+/// Acknowledgement notified on the response characteristic
+class CommandResponse {
+  static const int frameType = 0xD1;
+  static const int frameSize = 4;
+
+  final int opcode;
+  final int requestId;
+  final CommandStatus status;
+
+  const CommandResponse(this.opcode, this.requestId, this.status);
+
+  /// Returns null if [bytes] is not a response frame
+  static CommandResponse? parse(List<int> bytes) {
+    if (bytes.length != frameSize || bytes[0] != frameType) {
+      return null;
+    }
+    if (bytes[3] >= CommandStatus.values.length) {
+      return null;
+    }
+    return CommandResponse(bytes[1], bytes[2], CommandStatus.values[bytes[3]]);
+  }
+}
@@ -0,0 +1,169 @@
+import 'dart:typed_data';
+
+/// Synthetic notification sent while the device runs its link benchmark
+///
+/// uint8_t type;       // 0xF1
+/// uint8_t flags;      // Reserved
+/// uint16_t length;    // Whole frame, header included
+/// uint32_t sequence;  // Frames the device's stack accepted before this one
+/// uint32_t sentUs;    // Device clock when the frame was sent
+///
+/// followed by filler bytes up to [length].
+class BenchmarkFrame {
+  static const int frameType = 0xF1;
+  static const int headerSize = 12;
+
+  final int length;
+  final int sequence;
+  final int sentUs;
+
+  const BenchmarkFrame(this.length, this.sequence, this.sentUs);
+
+  /// Returns null if [bytes] is not a complete benchmark frame
+  static BenchmarkFrame? parse(List<int> bytes) {
+    if (bytes.length < headerSize || bytes[0] != frameType) {
+      return null;
+    }
+    final data = ByteData.sublistView(Uint8List.fromList(bytes.sublist(0, headerSize)));
+    final length = data.getUint16(2, Endian.little);
+    if (length != bytes.length) {
+      return null;
+    }
+    return BenchmarkFrame(length, data.getUint32(4, Endian.little), data.getUint32(8, Endian.little));
+  }
+}
+
+/// What this phone received during one benchmark run
+class LinkBenchmarkStats {
+  int frames = 0;
+  int bytes = 0;
+
+  /// Frames the device sent that never arrived, from gaps in the sequence
+  int lost = 0;
+
+  /// Longest silence between two frames
+  Duration maxGap = Duration.zero;
+
+  int? _nextSequence;
+  DateTime? _first;
+  DateTime? _last;
+
+  void add(BenchmarkFrame frame, DateTime receivedAt) {
+    final expected = _nextSequence;
+    if (expected != null && frame.sequence > expected) {
+      lost += frame.sequence - expected;
+    }
+    _nextSequence = frame.sequence + 1;
+
+    final last = _last;
+    if (last != null && receivedAt.difference(last) > maxGap) {
+      maxGap = receivedAt.difference(last);
+    }
+    _first ??= receivedAt;
+    _last = receivedAt;
+    frames++;
+    bytes += frame.length;
+  }
+
+  Duration get elapsed => (_first != null && _last != null) ? _last!.difference(_first!) : Duration.zero;
+
+  double get bytesPerSecond => elapsed.inMicroseconds > 0 ? bytes * 1e6 / elapsed.inMicroseconds : 0;
+
+  double get framesPerSecond => elapsed.inMicroseconds > 0 ? frames * 1e6 / elapsed.inMicroseconds : 0;
+
+  @override
+  String toString() {
+    return 'LinkBenchmarkStats(frames: $frames, lost: $lost, '
+        '${bytesPerSecond.toStringAsFixed(0)} B/s, max gap: ${maxGap.inMilliseconds} ms)';
+  }
+}
+
+/// Link counters the device reports on its diagnostics characteristic
+/// (DiagLinkStats, appended to snapshot version 3 and later; version 5
+/// adds the dropped sample count)
+class DeviceLinkStats {
+  static const int minimumVersion = 3;
+  static const int headerSize = 36;
+  static const int size = 44;
+  static const int droppedVersion = 5;
+  static const int droppedSize = 48;
+
+  final int framesSent;
+  final int bytesSent;
+  final int notifyFailures;
+  final int notifyCongested;
+  final int queueDepth;
+  final int queueDepthMax;
+  final bool benchActive;
+  final int benchFrameSize;
+  final int benchRate;
+  final int benchBacklogMax;
+  final int benchFrames;
+  final int benchCongested;
+  final int benchElapsedMs;
+  final int benchBytesPerSecond;
+
+  /// Samples the device could not fit into any frame; 0 on older firmware
+  final int samplesDropped;
+
+  const DeviceLinkStats({
+    required this.framesSent,
+    required this.bytesSent,
+    required this.notifyFailures,
+    required this.notifyCongested,
+    required this.queueDepth,
+    required this.queueDepthMax,
+    required this.benchActive,
+    required this.benchFrameSize,
+    required this.benchRate,
+    required this.benchBacklogMax,
+    required this.benchFrames,
+    required this.benchCongested,
+    required this.benchElapsedMs,
+    required this.benchBytesPerSecond,
+    this.samplesDropped = 0,
+  });
+
+  /// Length of the link section in a snapshot of [version]
+  static int sizeFor(int version) => version >= droppedVersion ? droppedSize : size;
+
+  /// Where the link section starts, after the stage and task tables
+  static int sectionOffset(List<int> bytes) {
+    final stageCount = bytes[1];
+    final taskCount = bytes[2];
+    final bucketCount = bytes[3];
+    return headerSize + stageCount * (16 + 2 * bucketCount) + taskCount * 6;
+  }
+
+  /// Finds the link section of a whole diagnostics snapshot; null if the
+  /// firmware is too old or the snapshot is truncated
+  static DeviceLinkStats? parseSnapshot(List<int> bytes) {
+    if (bytes.length < headerSize || bytes[0] < minimumVersion) {
+      return null;
+    }
+    final offset = sectionOffset(bytes);
+    final length = sizeFor(bytes[0]);
+    if (bytes.length < offset + length) {
+      return null;
+    }
+
+    final data = ByteData.sublistView(Uint8List.fromList(bytes.sublist(offset, offset + length)));
+    return DeviceLinkStats(
+      framesSent: data.getUint32(0, Endian.little),
+      bytesSent: data.getUint32(4, Endian.little),
+      notifyFailures: data.getUint32(8, Endian.little),
+      notifyCongested: data.getUint32(12, Endian.little),
+      queueDepth: data.getUint16(16, Endian.little),
+      queueDepthMax: data.getUint16(18, Endian.little),
+      benchActive: data.getUint8(20) != 0,
+      benchFrameSize: data.getUint16(22, Endian.little),
+      benchRate: data.getUint16(24, Endian.little),
+      benchBacklogMax: data.getUint16(26, Endian.little),
+      benchFrames: data.getUint32(28, Endian.little),
+      benchCongested: data.getUint32(32, Endian.little),
+      benchElapsedMs: data.getUint32(36, Endian.little),
+      benchBytesPerSecond: data.getUint32(40, Endian.little),
+      samplesDropped: length >= droppedSize ? data.getUint32(44, Endian.little) : 0,
+    );
+  }
+}
@@ -1,4 +1,5 @@
 import 'dart:convert';
+import 'dart:math';
 import 'dart:typed_data';
 
 /// Represents sensor data received from the ESP32 BLE peripheral
@@ -9,12 +10,33 @@ class SensorData {
   final int alert;
   final DateTime timestamp;
 
+  /// Device sequence number, null for samples that did not come from a packet
+  final int? sequence;
+
+  /// Respiration metrics from the device barometer, null when not reported
+  final double? breathsPerMinute;
+  final int? inhaleMs;
+  final int? exhaleMs;
+
+  /// Device clock (microseconds since boot) when the sensor was read, null
+  /// when the firmware does not report it
+  final int? deviceCaptureUs;
+
+  /// Played back from a recorded session on the device, not measured
+  final bool replayed;
+
   SensorData({
     required this.co2,
     required this.humidity,
     required this.temperature,
     required this.alert,
     required this.timestamp,
+    this.sequence,
+    this.breathsPerMinute,
+    this.inhaleMs,
+    this.exhaleMs,
+    this.deviceCaptureUs,
+    this.replayed = false,
   });
 
   /// Creates a SensorData instance from a JSON map
@@ -141,6 +163,12 @@ class SensorData {
     double? temperature,
     int? alert,
     DateTime? timestamp,
+    int? sequence,
+    double? breathsPerMinute,
+    int? inhaleMs,
+    int? exhaleMs,
+    int? deviceCaptureUs,
+    bool? replayed,
   }) {
     return SensorData(
       co2: co2 ?? this.co2,
@@ -148,6 +176,12 @@ class SensorData {
       temperature: temperature ?? this.temperature,
       alert: alert ?? this.alert,
       timestamp: timestamp ?? this.timestamp,
+      sequence: sequence ?? this.sequence,
+      breathsPerMinute: breathsPerMinute ?? this.breathsPerMinute,
+      inhaleMs: inhaleMs ?? this.inhaleMs,
+      exhaleMs: exhaleMs ?? this.exhaleMs,
+      deviceCaptureUs: deviceCaptureUs ?? this.deviceCaptureUs,
+      replayed: replayed ?? this.replayed,
     );
   }
 
@@ -189,67 +223,356 @@ class SensorDataParser {
     }
   }
 
+  /// Size of one ESP32 SensorPacket in bytes; firmware with respiration
+  /// support appends three fields and sends [extendedPacketSize] bytes, and
+  /// firmware with capture timing appends the microseconds of the timestamp
+  /// and wraps even single packets in a batch frame once the MTU allows it
+  /// (before that they arrive bare, without the microseconds)
+  static const int packetSize = 16;
+  static const int extendedPacketSize = 22;
+  static const int timedPacketSize = 26;
+
+  /// SensorPacket status bits
+  static const int statusValid = 0x01;
+  static const int statusReplayed = 0x02;
+
+  /// captureMicros value of a sample whose capture time is unknown
+  static const int microsUnknown = 0xFFFFFFFF;
+
+  /// Frame type byte that starts a batched notification
+  static const int batchFrameType = 0xB1;
+
+  /// Size of the header that precedes the packets of a batched notification
+  static const int batchHeaderSize = 8;
+
+  /// Frame type byte that starts a backfill notification; its header has
+  /// the batch layout plus the device clock (uint32 seconds since boot)
+  static const int backfillFrameType = 0xB2;
+  static const int backfillHeaderSize = 12;
+
+  /// Frame type byte that starts a delta-compressed notification
+  static const int deltaFrameType = 0xC1;
+
+  /// Size of the delta frame header plus its keyframe
+  static const int deltaHeaderSize = 12;
+  static const int deltaKeyframeSize = 14;
+
+  /// Frame type byte of a per-interval summary record
+  static const int summaryFrameType = 0xE1;
+  static const int summaryFrameSize = 32;
+
   /// Parses raw bytes from ESP32 SensorPacket to a SensorData object
   /// 
-  /// ESP32 sends binary data in SensorPacket format (16 bytes total):
+  /// ESP32 sends binary data in SensorPacket format (16 or 22 bytes; the
+  /// 26-byte form only arrives inside batches, see [parseNotification]):
   /// uint16_t co2;           // CO2 in ppm (2 bytes)
   /// int16_t humidity;       // Humidity * 10 (2 bytes) 
   /// int16_t temperature;    // Temperature * 10 (2 bytes)
   /// uint8_t alert;          // Alert level (1 byte)
-  /// uint8_t status;         // Status flags (1 byte)
+  /// uint8_t status;         // Bit 0: sensors valid, bit 1: replayed from a recording (1 byte)
   /// uint32_t timestamp;     // Timestamp in seconds since boot (4 bytes)
   /// uint32_t sequence;      // Sequence number (4 bytes)
+  /// uint16_t breathRate;    // Breaths per minute * 10 (2 bytes, optional)
+  /// uint16_t inhaleMs;      // Last inhale duration (2 bytes, optional)
+  /// uint16_t exhaleMs;      // Last exhale duration (2 bytes, optional)
+  /// uint32_t captureMicros; // Microseconds past the timestamp (4 bytes, optional)
   static SensorData? parseFromBytes(List<int> bytes) {
     try {
       // Validate packet size
-      if (bytes.length != 16) {
-        print('Invalid binary packet size: expected 16 bytes, got ${bytes.length}');
+      if (bytes.length != packetSize && bytes.length != extendedPacketSize) {
+        print('Invalid binary packet size: expected $packetSize or $extendedPacketSize bytes, got ${bytes.length}');
         return null;
       }
       
       // Parse binary data (little-endian format)
       final ByteData byteData = Uint8List.fromList(bytes).buffer.asByteData();
+      final sensorData = _parsePacket(byteData, 0, bytes.length, DateTime.now());
       
-      final int co2 = byteData.getUint16(0, Endian.little);
-      final int humidityRaw = byteData.getInt16(2, Endian.little);
-      final int temperatureRaw = byteData.getInt16(4, Endian.little);
-      final int alert = byteData.getUint8(6);
-      // Status flags available at byteData.getUint8(7) if needed
-      // Skip timestamp and sequence for now - we use DateTime.now()
-      
-      // Convert scaled values back to doubles
-      final double humidity = humidityRaw / 10.0;
-      final double temperature = temperatureRaw / 10.0;
-      
-      // Validate ranges
-      if (co2 < 0 || co2 > 65535) {
-        print('CO2 value out of range: $co2');
-        return null;
+      if (sensorData != null) {
+        print('Parsed binary sensor data - CO2: ${sensorData.co2}ppm, Temp: ${sensorData.temperature}°C, Humidity: ${sensorData.humidity}%, Alert: ${sensorData.alert}');
       }
+      return sensorData;
       
-      if (humidity < 0 || humidity > 100) {
-        print('Humidity value out of range: $humidity');
-        return null;
+    } catch (e) {
+      print('Failed to parse binary sensor data: $e');
+      return null;
+    }
+  }
+
+  /// Parses a BLE notification carrying either one SensorPacket or a batch
+  ///
+  /// Batched notifications start with an 8-byte header followed by
+  /// `count` SensorPacket entries of `entrySize` bytes each:
+  /// uint8_t type;           // 0xB1
+  /// uint8_t count;          // Number of packets that follow
+  /// uint8_t entrySize;      // Size of each packet (16, 22 or 26)
+  /// uint8_t flags;          // Reserved
+  /// uint32_t firstSequence; // Sequence number of the first packet
+  ///
+  /// Returns an empty list if the frame is malformed.
+  static List<SensorData> parseNotification(List<int> bytes) {
+    if (bytes.length == packetSize || bytes.length == extendedPacketSize) {
+      final sensorData = parseFromBytes(bytes);
+      return sensorData != null ? [sensorData] : [];
+    }
+
+    if (bytes.isNotEmpty && bytes[0] == deltaFrameType) {
+      return _parseDeltaFrame(bytes);
+    }
+
+    if (bytes.isNotEmpty && bytes[0] == summaryFrameType) {
+      final summary = _parseSummaryFrame(bytes);
+      return summary != null ? [summary] : [];
+    }
+
+    try {
+      final bool isBackfill = bytes.isNotEmpty && bytes[0] == backfillFrameType;
+      final int headerSize = isBackfill ? backfillHeaderSize : batchHeaderSize;
+
+      if (bytes.length < headerSize || (bytes[0] != batchFrameType && !isBackfill)) {
+        print('Unknown notification frame: ${bytes.length} bytes');
+        return [];
       }
-      
-      if (alert < 0 || alert > 4) {
-        print('Alert value out of range: $alert');
-        return null;
+
+      final ByteData byteData = Uint8List.fromList(bytes).buffer.asByteData();
+      final int count = byteData.getUint8(1);
+      final int entrySize = byteData.getUint8(2);
+
+      if (entrySize < packetSize || bytes.length < headerSize + count * entrySize) {
+        print('Invalid batch frame: $count x $entrySize bytes in ${bytes.length} bytes');
+        return [];
       }
-      
-      print('Parsed binary sensor data - CO2: ${co2}ppm, Temp: ${temperature}°C, Humidity: ${humidity}%, Alert: $alert');
-      
-      return SensorData(
-        co2: co2.toDouble(),
-        humidity: humidity,
-        temperature: temperature,
-        alert: alert,
-        timestamp: DateTime.now(), // Use current time since ESP32 timestamp is relative
-      );
-      
+
+      // Packet timestamps are seconds since boot. Live batches are placed
+      // relative to their newest sample, captured just before the
+      // notification; backfill frames carry the device clock at send time.
+      final int lastOffset = headerSize + (count - 1) * entrySize;
+      final int referenceTime = isBackfill
+          ? byteData.getUint32(8, Endian.little)
+          : (count > 0 ? byteData.getUint32(lastOffset + 8, Endian.little) : 0);
+      final DateTime now = DateTime.now();
+
+      final samples = <SensorData>[];
+      for (int i = 0; i < count; i++) {
+        final int offset = headerSize + i * entrySize;
+        final int timestamp = byteData.getUint32(offset + 8, Endian.little);
+        final int age = max(0, referenceTime - timestamp);
+        final sensorData = _parsePacket(
+          byteData,
+          offset,
+          entrySize,
+          now.subtract(Duration(seconds: age)),
+        );
+        if (sensorData != null) {
+          samples.add(sensorData);
+        }
+      }
+
+      print('Parsed batch of ${samples.length} sensor samples');
+      return samples;
     } catch (e) {
-      print('Failed to parse binary sensor data: $e');
+      print('Failed to parse batch frame: $e');
+      return [];
+    }
+  }
+
+  /// Parses a delta-compressed notification
+  ///
+  /// Layout (little-endian):
+  /// uint8_t type;               // 0xC1
+  /// uint8_t count;              // Samples in the frame, keyframe included
+  /// uint16_t periodMs;          // Sample period used to imply timestamps
+  /// uint32_t firstSequence;     // Sequence number of the keyframe
+  /// uint32_t firstTimestampMs;  // Keyframe capture time, ms since boot
+  /// keyframe: uint16 co2, int16 humidity*10, int16 temperature*10,
+  ///           uint8 alert, uint8 status, uint16 breathRate*10,
+  ///           uint16 inhaleMs, uint16 exhaleMs
+  /// then per sample: zigzag varint deltas of co2, humidity, temperature,
+  /// breath rate, inhale and exhale followed by one flags byte
+  /// (alert | status << 4)
+  static List<SensorData> _parseDeltaFrame(List<int> bytes) {
+    try {
+      if (bytes.length < deltaHeaderSize + deltaKeyframeSize) {
+        print('Invalid delta frame: ${bytes.length} bytes');
+        return [];
+      }
+
+      final ByteData byteData = Uint8List.fromList(bytes).buffer.asByteData();
+      final int count = byteData.getUint8(1);
+      final int periodMs = byteData.getUint16(2, Endian.little);
+
+      int co2 = byteData.getUint16(deltaHeaderSize, Endian.little);
+      int humidityRaw = byteData.getInt16(deltaHeaderSize + 2, Endian.little);
+      int temperatureRaw = byteData.getInt16(deltaHeaderSize + 4, Endian.little);
+      int alert = byteData.getUint8(deltaHeaderSize + 6);
+      int status = byteData.getUint8(deltaHeaderSize + 7);
+      int breathRate = byteData.getUint16(deltaHeaderSize + 8, Endian.little);
+      int inhaleMs = byteData.getUint16(deltaHeaderSize + 10, Endian.little);
+      int exhaleMs = byteData.getUint16(deltaHeaderSize + 12, Endian.little);
+
+      // Timestamps are implied by the period; the newest sample is "now"
+      final DateTime now = DateTime.now();
+      DateTime timestampFor(int index) =>
+          now.subtract(Duration(milliseconds: (count - 1 - index) * periodMs));
+
+      final values = <List<int>>[
+        [co2, humidityRaw, temperatureRaw, alert, breathRate, inhaleMs, exhaleMs, status]
+      ];
+      int offset = deltaHeaderSize + deltaKeyframeSize;
+
+      for (int i = 1; i < count; i++) {
+        final deltas = <int>[];
+        for (int field = 0; field < 6; field++) {
+          int value = 0;
+          int shift = 0;
+          while (true) {
+            if (offset >= bytes.length) {
+              print('Truncated delta frame at sample $i');
+              return [];
+            }
+            final int byte = bytes[offset++];
+            value |= (byte & 0x7F) << shift;
+            shift += 7;
+            if ((byte & 0x80) == 0) break;
+          }
+          deltas.add((value >> 1) ^ -(value & 1));
+        }
+        if (offset >= bytes.length) {
+          print('Truncated delta frame at sample $i');
+          return [];
+        }
+        final int flags = bytes[offset++];
+
+        co2 += deltas[0];
+        humidityRaw += deltas[1];
+        temperatureRaw += deltas[2];
+        breathRate += deltas[3];
+        inhaleMs += deltas[4];
+        exhaleMs += deltas[5];
+        alert = flags & 0x0F;
+        status = flags >> 4;
+        values.add(
+            [co2, humidityRaw, temperatureRaw, alert, breathRate, inhaleMs, exhaleMs, status]);
+      }
+
+      final int firstSequence = byteData.getUint32(4, Endian.little);
+      final samples = <SensorData>[];
+      for (int i = 0; i < values.length; i++) {
+        final packet = ByteData(extendedPacketSize)
+          ..setUint16(0, values[i][0], Endian.little)
+          ..setInt16(2, values[i][1], Endian.little)
+          ..setInt16(4, values[i][2], Endian.little)
+          ..setUint8(6, values[i][3])
+          ..setUint8(7, values[i][7])
+          ..setUint32(12, (firstSequence + i) & 0xFFFFFFFF, Endian.little)
+          ..setUint16(16, values[i][4], Endian.little)
+          ..setUint16(18, values[i][5], Endian.little)
+          ..setUint16(20, values[i][6], Endian.little);
+        final sensorData =
+            _parsePacket(packet, 0, extendedPacketSize, timestampFor(i));
+        if (sensorData != null) {
+          samples.add(sensorData);
+        }
+      }
+
+      print('Parsed delta frame of ${samples.length} sensor samples');
+      return samples;
+    } catch (e) {
+      print('Failed to parse delta frame: $e');
+      return [];
+    }
+  }
+
+  /// Parses a summary record, sent once per interval instead of samples
+  /// when the device streams summaries only
+  ///
+  /// Layout (little-endian):
+  /// uint8_t type;               // 0xE1
+  /// uint8_t count;              // Samples aggregated
+  /// uint8_t peakAlert;          // Highest alert level in the interval
+  /// uint8_t flags;              // Reserved
+  /// uint32_t startTime;         // Seconds since boot
+  /// uint32_t firstSequence;
+  /// uint16 co2 mean, min, max; int16 co2 rate (ppm/min)
+  /// int16 humidity*10 mean, min, max; int16 temperature*10 mean, min, max
+  ///
+  /// The interval means become one sample with the peak alert level. It
+  /// carries no sequence number, so it never moves the backfill cursor.
+  static SensorData? _parseSummaryFrame(List<int> bytes) {
+    if (bytes.length < summaryFrameSize) {
+      print('Invalid summary frame: ${bytes.length} bytes');
+      return null;
+    }
+
+    final ByteData byteData = Uint8List.fromList(bytes).buffer.asByteData();
+    final int alert = byteData.getUint8(2);
+    final double humidity = byteData.getInt16(20, Endian.little) / 10.0;
+    if (alert > 4 || humidity < 0 || humidity > 100) {
+      print('Summary values out of range');
+      return null;
+    }
+
+    return SensorData(
+      co2: byteData.getUint16(12, Endian.little).toDouble(),
+      humidity: humidity,
+      temperature: byteData.getInt16(26, Endian.little) / 10.0,
+      alert: alert,
+      timestamp: DateTime.now(),
+    );
+  }
+
+  /// Decodes and validates one SensorPacket of [entrySize] bytes starting
+  /// at [offset]; respiration fields are read only from extended packets
+  static SensorData? _parsePacket(
+      ByteData byteData, int offset, int entrySize, DateTime timestamp) {
+    final int co2 = byteData.getUint16(offset, Endian.little);
+    final int humidityRaw = byteData.getInt16(offset + 2, Endian.little);
+    final int temperatureRaw = byteData.getInt16(offset + 4, Endian.little);
+    final int alert = byteData.getUint8(offset + 6);
+    final int status = byteData.getUint8(offset + 7);
+    // The caller converts the device timestamp into a DateTime
+    final int sequence = byteData.getUint32(offset + 12, Endian.little);
+    final bool hasRespiration = entrySize >= extendedPacketSize;
+    final int micros = entrySize >= timedPacketSize
+        ? byteData.getUint32(offset + 22, Endian.little)
+        : microsUnknown;
+    
+    // Convert scaled values back to doubles
+    final double humidity = humidityRaw / 10.0;
+    final double temperature = temperatureRaw / 10.0;
+    
+    // Validate ranges
+    if (co2 < 0 || co2 > 65535) {
+      print('CO2 value out of range: $co2');
+      return null;
+    }
+    
+    if (humidity < 0 || humidity > 100) {
+      print('Humidity value out of range: $humidity');
+      return null;
+    }
+    
+    if (alert < 0 || alert > 4) {
+      print('Alert value out of range: $alert');
       return null;
     }
+    
+    return SensorData(
+      co2: co2.toDouble(),
+      humidity: humidity,
+      temperature: temperature,
+      alert: alert,
+      timestamp: timestamp,
+      sequence: sequence,
+      breathsPerMinute: hasRespiration
+          ? byteData.getUint16(offset + 16, Endian.little) / 10.0
+          : null,
+      inhaleMs: hasRespiration ? byteData.getUint16(offset + 18, Endian.little) : null,
+      exhaleMs: hasRespiration ? byteData.getUint16(offset + 20, Endian.little) : null,
+      deviceCaptureUs: micros != microsUnknown
+          ? byteData.getUint32(offset + 8, Endian.little) * 1000000 + micros
+          : null,
+      replayed: (status & statusReplayed) != 0,
+    );
   }
 }
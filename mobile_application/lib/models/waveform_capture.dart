@@ -0,0 +1,102 @@
+import 'dart:typed_data';
+
+/// One notification of a raw waveform capture transfer
+///
+/// uint8_t type;       // 0xF2
+/// uint8_t count;      // Samples in this frame
+/// uint8_t entrySize;  // Bytes per sample (6)
+/// uint8_t flags;      // Bit 0: frame ends with the last sample
+/// uint16_t captureId; // Changes with every capture
+/// uint16_t periodMs;  // Spacing of the samples
+/// uint32_t offset;    // Index of the first sample
+/// uint32_t total;     // Samples in the capture
+///
+/// followed by [count] samples of int32 pressure (Pa * 16, int32 minimum for
+/// a missed period) and uint16 CO2 ppm.
+class CaptureFrame {
+  static const int frameType = 0xF2;
+  static const int headerSize = 16;
+  static const int sampleSize = 6;
+  static const int lastFlag = 0x01;
+  static const int missingPressure = -0x80000000;
+
+  final int captureId;
+  final int periodMs;
+  final int offset;
+  final int total;
+  final bool last;
+  final List<int> pressureX16;
+  final List<int> co2;
+
+  const CaptureFrame(this.captureId, this.periodMs, this.offset, this.total, this.last,
+      this.pressureX16, this.co2);
+
+  /// Returns null if [bytes] is not a complete capture frame
+  static CaptureFrame? parse(List<int> bytes) {
+    if (bytes.length < headerSize || bytes[0] != frameType) {
+      return null;
+    }
+    final data = ByteData.sublistView(Uint8List.fromList(bytes));
+    final count = data.getUint8(1);
+    final entrySize = data.getUint8(2);
+    if (entrySize < sampleSize || bytes.length < headerSize + count * entrySize) {
+      return null;
+    }
+
+    final pressure = <int>[];
+    final co2 = <int>[];
+    for (var i = 0; i < count; i++) {
+      final at = headerSize + i * entrySize;
+      pressure.add(data.getInt32(at, Endian.little));
+      co2.add(data.getUint16(at + 4, Endian.little));
+    }
+    return CaptureFrame(
+      data.getUint16(4, Endian.little),
+      data.getUint16(6, Endian.little),
+      data.getUint32(8, Endian.little),
+      data.getUint32(12, Endian.little),
+      (data.getUint8(3) & lastFlag) != 0,
+      pressure,
+      co2,
+    );
+  }
+}
+
+/// A capture reassembled from its frames. Frames must arrive in order; after
+/// a broken transfer, ask the device to resend from [nextOffset].
+class WaveformCapture {
+  int? captureId;
+  int periodMs = 0;
+  int total = 0;
+  final List<int> pressureX16 = [];
+  final List<int> co2 = [];
+
+  int get nextOffset => pressureX16.length;
+
+  bool get isComplete => total > 0 && pressureX16.length == total;
+
+  /// Periods the device could not read, stored as [CaptureFrame.missingPressure]
+  int get missing => pressureX16.where((p) => p == CaptureFrame.missingPressure).length;
+
+  /// Pressure of sample [i] in Pa, null for a missed period
+  double? pressurePa(int i) {
+    final value = pressureX16[i];
+    return value == CaptureFrame.missingPressure ? null : value / 16.0;
+  }
+
+  /// Adds a frame; false if it belongs to another capture or is out of order
+  bool add(CaptureFrame frame) {
+    if (captureId != null && frame.captureId != captureId) {
+      return false;
+    }
+    if (frame.offset != nextOffset) {
+      return false;
+    }
+    captureId = frame.captureId;
+    periodMs = frame.periodMs;
+    total = frame.total;
+    pressureX16.addAll(frame.pressureX16);
+    co2.addAll(frame.co2);
+    return true;
+  }
+}
@@ -79,6 +79,7 @@ class _DashboardScreenState extends State<DashboardScreen> {
     _sensorDataSubscription = bleService.sensorDataStream.listen((data) {
       if (mounted) {
         _addSensorData(data);
+        WidgetsBinding.instance.addPostFrameCallback((_) => bleService.noteRendered(data));
       }
     });
     
@@ -4,19 +4,29 @@ import 'dart:io';
 import 'dart:math';
 
 import 'package:flutter/foundation.dart';
+import 'package:flutter/widgets.dart';
 import 'package:flutter_reactive_ble/flutter_reactive_ble.dart';
 import 'package:permission_handler/permission_handler.dart';
 import 'package:shared_preferences/shared_preferences.dart';
 
+import '../models/broadcast_summary.dart';
+import '../models/clock_sync.dart';
+import '../models/deadline_stats.dart';
+import '../models/device_command.dart';
+import '../models/link_benchmark.dart';
 import '../models/sensor_data.dart';
+import '../models/waveform_capture.dart';
 
 /// BLE service for communicating with RespirationMonitor ESP32 devices
-class BleService extends ChangeNotifier {
+class BleService extends ChangeNotifier with WidgetsBindingObserver {
   static const String targetDeviceName = 'RespirationMonitor';
   static const String serviceUuid = '12345678-1234-1234-1234-123456789abc';
   static const String dataCharacteristicUuid = '87654321-4321-4321-4321-cba987654321';
   static const String controlCharacteristicUuid = '11111111-2222-3333-4444-555555555555';
+  static const String responseCharacteristicUuid = '11111111-2222-3333-4444-777777777777';
+  static const String diagCharacteristicUuid = '11111111-2222-3333-4444-666666666666';
   static const String lastConnectedDeviceKey = 'last_connected_device';
+  static const int preferredMtu = 247; // Matches BLE_PREFERRED_MTU on the ESP32
   
   final FlutterReactiveBle _ble = FlutterReactiveBle();
   final StreamController<SensorData> _sensorDataController = StreamController<SensorData>.broadcast();
@@ -26,6 +36,7 @@ class BleService extends ChangeNotifier {
   StreamSubscription<DiscoveredDevice>? _scanSubscription;
   StreamSubscription<ConnectionStateUpdate>? _connectionSubscription;
   StreamSubscription<List<int>>? _characteristicSubscription;
+  StreamSubscription<List<int>>? _responseSubscription;
   QualifiedCharacteristic? _controlCharacteristic;
   
   String? _connectedDeviceId;
@@ -34,6 +45,35 @@ class BleService extends ChangeNotifier {
   int _reconnectAttempts = 0;
   static const int maxReconnectAttempts = 3;
   Timer? _reconnectTimer;
+
+  // Newest sequence number seen per device, used to request a backfill of
+  // the samples the ESP32 recorded while we were disconnected
+  int? _lastSequence;
+  String? _lastSequenceDeviceId;
+
+  // Request ids for binary commands; the device echoes them in its responses
+  int _nextRequestId = 1;
+
+  // Live view while the app is in the foreground, background logging otherwise
+  StreamingProfile _profile = StreamingProfile.live;
+
+  // Receive-side counters while a link benchmark runs
+  LinkBenchmarkStats? _benchmark;
+
+  // Raw waveform capture being downloaded, kept across reconnects to resume
+  WaveformCapture? _capture;
+  Completer<WaveformCapture?>? _captureDone;
+
+  // Device clock offset from ping round trips, and the latency it lets us
+  // measure: sensor read to notification receipt, and to the frame that drew it
+  ClockSync? _clock;
+  final Map<int, Completer<(PongFrame, int)>> _pendingPings = {};
+  int _nextPingToken = 1;
+  final LatencyStats receiptLatency = LatencyStats();
+  final LatencyStats renderLatency = LatencyStats();
+
+  // Newest broadcast summary per tag seen by a fleet scan
+  final Map<String, BroadcastSummary> _fleet = {};
   
   // Streams for external consumption
   Stream<SensorData> get sensorDataStream => _sensorDataController.stream;
@@ -44,9 +84,11 @@ class BleService extends ChangeNotifier {
   bool get isScanning => _isScanning;
   BleConnectionState get connectionState => _connectionState;
   String? get connectedDeviceId => _connectedDeviceId;
+  Map<String, BroadcastSummary> get fleet => Map.unmodifiable(_fleet);
 
   @override
   void dispose() {
+    WidgetsBinding.instance.removeObserver(this);
     stopScan();
     _disconnect();
     _sensorDataController.close();
@@ -58,6 +100,8 @@ class BleService extends ChangeNotifier {
 
   /// Initialize BLE and request necessary permissions
   Future<bool> initialize() async {
+    WidgetsBinding.instance.removeObserver(this);
+    WidgetsBinding.instance.addObserver(this);
     try {
       // Check BLE status
       final bleStatus = await _ble.status;
@@ -179,6 +223,33 @@ class BleService extends ChangeNotifier {
     print('BLE scan stopped');
   }
 
+  /// Watch every tag in broadcast mode without connecting to any of them;
+  /// [fleet] holds each tag's newest sample. Runs until [stopScan].
+  void startFleetScan() {
+    if (_isScanning) return;
+
+    _isScanning = true;
+    notifyListeners();
+
+    _scanSubscription = _ble.scanForDevices(
+      withServices: [],
+      scanMode: ScanMode.lowLatency,
+      requireLocationServicesEnabled: false,
+    ).listen(
+      (device) {
+        final summary = BroadcastSummary.parse(device.manufacturerData);
+        if (summary == null || _fleet[device.id]?.sequence == summary.sequence) {
+          return;
+        }
+        _fleet[device.id] = summary;
+        notifyListeners();
+      },
+      onError: (error) {
+        print('Fleet scan error: $error');
+      },
+    );
+  }
+
   /// Debug method to scan and show all nearby BLE devices
   Future<void> startDebugScan() async {
     if (_isScanning) return;
@@ -245,10 +316,14 @@ class BleService extends ChangeNotifier {
               break;
             case DeviceConnectionState.connected:
               _connectedDeviceId = deviceId;
+              await _requestMtu(deviceId);
               await _setupCharacteristics(deviceId);
+              await _requestBackfill(deviceId);
+              await setStreamingProfile(_profile);
               _saveLastConnectedDevice(deviceId);
               _updateConnectionState(BleConnectionState.connected);
               _reconnectAttempts = 0; // Reset reconnect attempts on successful connection
+              unawaited(syncClock());
               break;
             case DeviceConnectionState.disconnecting:
               _updateConnectionState(BleConnectionState.disconnecting);
@@ -295,6 +370,17 @@ class BleService extends ChangeNotifier {
     });
   }
 
+  /// Negotiate a larger MTU so the ESP32 can send batched notifications
+  Future<void> _requestMtu(String deviceId) async {
+    try {
+      final mtu = await _ble.requestMtu(deviceId: deviceId, mtu: preferredMtu);
+      print('Negotiated MTU: $mtu');
+    } catch (e) {
+      // Not fatal: the ESP32 falls back to one packet per notification
+      print('MTU negotiation failed: $e');
+    }
+  }
+
   /// Setup BLE characteristics after connection
   Future<void> _setupCharacteristics(String deviceId) async {
     try {
@@ -311,7 +397,6 @@ class BleService extends ChangeNotifier {
       print('🔔 Subscribing to CONTROL characteristic for sensor data...');
       _characteristicSubscription = _ble.subscribeToCharacteristic(_controlCharacteristic!).listen(
         (data) {
-          print('🔔 CONTROL characteristic notification received! ${data.length} bytes');
           _handleNotificationData(data);
         },
         onError: (error) {
@@ -319,6 +404,30 @@ class BleService extends ChangeNotifier {
         },
       );
 
+      // Command acknowledgements
+      final responseCharacteristic = QualifiedCharacteristic(
+        serviceId: serviceUuidParsed,
+        characteristicId: Uuid.parse(responseCharacteristicUuid),
+        deviceId: deviceId,
+      );
+      _responseSubscription = _ble.subscribeToCharacteristic(responseCharacteristic).listen(
+        (data) {
+          final pong = PongFrame.parse(data);
+          if (pong != null) {
+            final receivedUs = DateTime.now().microsecondsSinceEpoch;
+            _pendingPings.remove(pong.token)?.complete((pong, receivedUs));
+            return;
+          }
+          final response = CommandResponse.parse(data);
+          if (response != null) {
+            print('Command ${response.opcode} (id ${response.requestId}): ${response.status.name}');
+          }
+        },
+        onError: (error) {
+          print('Response characteristic subscription error: $error');
+        },
+      );
+
       print('✅ BLE characteristics setup complete - listening on control characteristic');
     } catch (e) {
       print('Failed to setup characteristics: $e');
@@ -328,19 +437,261 @@ class BleService extends ChangeNotifier {
 
   /// Handle incoming notification data from the ESP32
   void _handleNotificationData(List<int> data) {
+    // Benchmark frames arrive hundreds of times a second; count them only
+    final frame = BenchmarkFrame.parse(data);
+    if (frame != null) {
+      _benchmark?.add(frame, DateTime.now());
+      return;
+    }
+
+    final captureFrame = CaptureFrame.parse(data);
+    if (captureFrame != null) {
+      _handleCaptureFrame(captureFrame);
+      return;
+    }
+
+    print('🔔 CONTROL characteristic notification received! ${data.length} bytes');
     try {
-      final sensorData = SensorDataParser.parseFromBytes(data);
-      if (sensorData != null) {
+      final samples = SensorDataParser.parseNotification(data);
+      final receivedUs = DateTime.now().microsecondsSinceEpoch;
+      if (samples.isEmpty) {
+        print('Failed to parse sensor data from notification');
+      }
+      for (final sensorData in samples) {
+        // Replayed samples carry the recording's sequence numbers, which
+        // say nothing about where the live backlog stands
+        final sequence = sensorData.replayed ? null : sensorData.sequence;
+        if (sequence != null && (_lastSequence == null || sequence > _lastSequence!)) {
+          _lastSequence = sequence;
+          _lastSequenceDeviceId = _connectedDeviceId;
+        }
+        final captured = _capturedAtUs(sensorData);
+        if (captured != null) {
+          receiptLatency.add(receivedUs - captured);
+        }
         _sensorDataController.add(sensorData);
         print('Received sensor data: $sensorData');
-      } else {
-        print('Failed to parse sensor data from notification');
       }
     } catch (e) {
       print('Error handling notification data: $e');
     }
   }
 
+  /// Ask the ESP32 to resend everything recorded after the last sample we saw
+  Future<void> _requestBackfill(String deviceId) async {
+    final lastSequence = _lastSequence;
+    if (lastSequence == null || _lastSequenceDeviceId != deviceId || _controlCharacteristic == null) {
+      return;
+    }
+
+    if (await sendDeviceCommand(DeviceCommand.backfill, argument: lastSequence + 1)) {
+      print('Requested backfill from sequence ${lastSequence + 1}');
+    }
+  }
+
+  /// Write a binary command to the ESP32; the device acknowledges it on the
+  /// response characteristic
+  Future<bool> sendDeviceCommand(int opcode, {int argument = 0}) async {
+    if (_controlCharacteristic == null) {
+      return false;
+    }
+
+    final command = DeviceCommand(opcode, requestId: _nextRequestId, argument: argument);
+    _nextRequestId = _nextRequestId == 0xFF ? 1 : _nextRequestId + 1;
+
+    try {
+      await _ble.writeCharacteristicWithResponse(
+        _controlCharacteristic!,
+        value: command.encode(),
+      );
+      return true;
+    } catch (e) {
+      print('Failed to send command $opcode: $e');
+      return false;
+    }
+  }
+
+  /// Fix the device sample period (1000-60000 ms); 0 lets the device adapt
+  /// it to the CO2 level and trend
+  Future<bool> setSamplePeriod(int periodMs) {
+    return sendDeviceCommand(DeviceCommand.setSamplePeriod, argument: periodMs);
+  }
+
+  /// Choose connection interval and batching on the device; remembered and
+  /// re-sent after a reconnect
+  Future<bool> setStreamingProfile(StreamingProfile profile) {
+    _profile = profile;
+    return sendDeviceCommand(DeviceCommand.setProfile, argument: profile.index);
+  }
+
+  @override
+  void didChangeAppLifecycleState(AppLifecycleState state) {
+    if (state == AppLifecycleState.resumed) {
+      setStreamingProfile(StreamingProfile.live);
+    } else if (state == AppLifecycleState.paused) {
+      setStreamingProfile(StreamingProfile.background);
+    }
+  }
+
+  /// Start the device's link benchmark: synthetic notifications of
+  /// [frameSize] bytes (0 fills the MTU) at [framesPerSecond] (0 sends as
+  /// fast as the link allows). Sample streaming pauses until it stops.
+  Future<bool> startLinkBenchmark({int frameSize = 0, int framesPerSecond = 0}) {
+    _benchmark = LinkBenchmarkStats();
+    return sendDeviceCommand(DeviceCommand.benchmark,
+        argument: (frameSize & 0xFFFF) | ((framesPerSecond & 0xFFFF) << 16));
+  }
+
+  /// Stop the link benchmark and return what this phone received
+  Future<LinkBenchmarkStats?> stopLinkBenchmark() async {
+    await sendDeviceCommand(DeviceCommand.stopBenchmark);
+    final stats = _benchmark;
+    _benchmark = null;
+    return stats;
+  }
+
+  /// Record [seconds] of the raw pressure and CO2 waveform on the device at
+  /// its full sampling rate (0 fills the device's buffer); fetch it with
+  /// [downloadWaveformCapture] once the time has passed
+  Future<bool> startWaveformCapture(int seconds) {
+    _capture = null;
+    return sendDeviceCommand(DeviceCommand.capture, argument: seconds);
+  }
+
+  /// Stop a running capture early, keeping what it recorded
+  Future<bool> stopWaveformCapture() {
+    return sendDeviceCommand(DeviceCommand.stopCapture);
+  }
+
+  /// Download the last completed capture. Calling it again after a
+  /// disconnect resumes from the first sample not yet received.
+  Future<WaveformCapture?> downloadWaveformCapture() async {
+    final capture = _capture ??= WaveformCapture();
+    if (capture.isComplete) {
+      return capture;
+    }
+    final done = _captureDone = Completer<WaveformCapture?>();
+    if (!await sendDeviceCommand(DeviceCommand.sendCapture, argument: capture.nextOffset)) {
+      _captureDone = null;
+      return null;
+    }
+    return done.future;
+  }
+
+  void _handleCaptureFrame(CaptureFrame frame) {
+    final capture = _capture;
+    if (capture == null) {
+      return;
+    }
+    if (!capture.add(frame)) {
+      // A new capture replaced the one we were resuming; start over
+      if (frame.captureId != capture.captureId && frame.offset == 0) {
+        _capture = WaveformCapture()..add(frame);
+      } else {
+        return;
+      }
+    }
+    if (frame.last && _capture!.isComplete) {
+      print('Waveform capture received: ${_capture!.total} samples, ${_capture!.missing} missing');
+      _captureDone?.complete(_capture);
+      _captureDone = null;
+    }
+  }
+
+  /// Have the connected tag put its latest sample in every advertisement,
+  /// so fleet scans on other phones see it; the device keeps this until it
+  /// restarts
+  Future<bool> setBroadcast(bool enabled) {
+    return sendDeviceCommand(DeviceCommand.broadcast, argument: enabled ? 1 : 0);
+  }
+
+  /// Estimate the device clock offset from [rounds] pings, then set the
+  /// device's Unix time so its SD sessions carry wall-clock time. Resets
+  /// the latency statistics, which are only meaningful against one offset.
+  Future<ClockSync?> syncClock({int rounds = 5}) async {
+    final clock = ClockSync();
+    for (var i = 0; i < rounds; i++) {
+      final token = _nextPingToken++;
+      final pong = _pendingPings[token] = Completer<(PongFrame, int)>();
+      final sentUs = DateTime.now().microsecondsSinceEpoch;
+      if (!await sendDeviceCommand(DeviceCommand.ping, argument: token)) {
+        _pendingPings.remove(token);
+        return null;
+      }
+      try {
+        final (frame, receivedUs) = await pong.future.timeout(const Duration(seconds: 2));
+        clock.add(sentUs, receivedUs, frame);
+      } on TimeoutException {
+        _pendingPings.remove(token);
+        if (clock.samples == 0) {
+          break;  // Firmware without ping support
+        }
+      }
+    }
+    if (!clock.isSynced) {
+      return null;
+    }
+
+    _clock = clock;
+    receiptLatency.reset();
+    renderLatency.reset();
+    print('Device clock offset ${clock.offsetUs} us (round trip ${clock.roundTripUs} us)');
+    await sendDeviceCommand(DeviceCommand.timeSync, argument: DateTime.now().millisecondsSinceEpoch);
+    return clock;
+  }
+
+  /// Call once [sample] has been drawn to record its end-to-end latency
+  void noteRendered(SensorData sample) {
+    final captured = _capturedAtUs(sample);
+    if (captured != null) {
+      renderLatency.add(DateTime.now().microsecondsSinceEpoch - captured);
+    }
+  }
+
+  /// Phone time of the sample's sensor read, null without a clock sync
+  int? _capturedAtUs(SensorData sample) {
+    final deviceUs = sample.deviceCaptureUs;
+    final clock = _clock;
+    if (deviceUs == null || clock == null) {
+      return null;
+    }
+    return clock.toPhoneTime(deviceUs)?.microsecondsSinceEpoch;
+  }
+
+  /// Read the device's notify, congestion and benchmark counters
+  Future<DeviceLinkStats?> readDeviceLinkStats() async {
+    final snapshot = await _readDiagnostics();
+    return snapshot != null ? DeviceLinkStats.parseSnapshot(snapshot) : null;
+  }
+
+  /// Read the device's missed stage deadlines and watchdog restarts
+  Future<DeviceDeadlineStats?> readDeviceDeadlineStats() async {
+    final snapshot = await _readDiagnostics();
+    return snapshot != null ? DeviceDeadlineStats.parseSnapshot(snapshot) : null;
+  }
+
+  Future<List<int>?> _readDiagnostics() async {
+    final deviceId = _connectedDeviceId;
+    if (deviceId == null) {
+      return null;
+    }
+    try {
+      return await _ble.readCharacteristic(QualifiedCharacteristic(
+        serviceId: Uuid.parse(serviceUuid),
+        characteristicId: Uuid.parse(diagCharacteristicUuid),
+        deviceId: deviceId,
+      ));
+    } catch (e) {
+      print('Failed to read diagnostics: $e');
+      return null;
+    }
+  }
+
+  /// Change how many samples the device packs into one notification
+  Future<bool> setBatchSize(int samples) {
+    return sendDeviceCommand(DeviceCommand.setBatchSize, argument: samples);
+  }
+
   /// Write a control command to the ESP32
   Future<bool> writeControlCommand(Map<String, dynamic> command) async {
     if (_controlCharacteristic == null || _connectionState != BleConnectionState.connected) {
@@ -418,6 +769,10 @@ class BleService extends ChangeNotifier {
   void _cleanup() {
     _characteristicSubscription?.cancel();
     _characteristicSubscription = null;
+    _responseSubscription?.cancel();
+    _responseSubscription = null;
+    _pendingPings.clear();
+    _clock = null;
     _connectionSubscription?.cancel();
     _connectionSubscription = null;
     _controlCharacteristic = null;
@@ -5,10 +5,18 @@
 // gestures. You can also use WidgetTester to find child widgets in the widget
 // tree, read text, and verify that the values of widget properties are correct.
 
+import 'dart:typed_data';
+
 import 'package:flutter_test/flutter_test.dart';
 
 import 'package:mobile_application/main.dart';
+import 'package:mobile_application/models/broadcast_summary.dart';
+import 'package:mobile_application/models/clock_sync.dart';
+import 'package:mobile_application/models/deadline_stats.dart';
+import 'package:mobile_application/models/device_command.dart';
+import 'package:mobile_application/models/link_benchmark.dart';
 import 'package:mobile_application/models/sensor_data.dart';
+import 'package:mobile_application/models/waveform_capture.dart';
 
 void main() {
   group('SensorData Model Tests', () {
@@ -210,6 +218,550 @@ void main() {
     });
   });
 
+  group('Binary Frame Parser Tests', () {
+    List<int> buildPacket(int co2, int humidityX10, int temperatureX10, int alert, int timestamp, int sequence) {
+      final data = ByteData(16);
+      data.setUint16(0, co2, Endian.little);
+      data.setInt16(2, humidityX10, Endian.little);
+      data.setInt16(4, temperatureX10, Endian.little);
+      data.setUint8(6, alert);
+      data.setUint8(7, 1);
+      data.setUint32(8, timestamp, Endian.little);
+      data.setUint32(12, sequence, Endian.little);
+      return data.buffer.asUint8List().toList();
+    }
+
+    test('should parse a single SensorPacket notification', () {
+      // Arrange
+      final bytes = buildPacket(850, 552, 243, 0, 10, 7);
+
+      // Act
+      final samples = SensorDataParser.parseNotification(bytes);
+
+      // Assert
+      expect(samples.length, equals(1));
+      expect(samples.first.co2, equals(850.0));
+      expect(samples.first.humidity, equals(55.2));
+      expect(samples.first.temperature, equals(24.3));
+    });
+
+    test('should mark samples replayed from a recording', () {
+      // Arrange: status bit 1 set on the second packet
+      final live = buildPacket(850, 552, 243, 0, 10, 7);
+      final replayed = buildPacket(850, 552, 243, 0, 10, 8)
+        ..[7] = SensorDataParser.statusValid | SensorDataParser.statusReplayed;
+
+      // Act
+      final liveSamples = SensorDataParser.parseNotification(live);
+      final replayedSamples = SensorDataParser.parseNotification(replayed);
+
+      // Assert
+      expect(liveSamples.single.replayed, isFalse);
+      expect(replayedSamples.single.replayed, isTrue);
+    });
+
+    test('should carry the replayed flag through delta frames', () {
+      // Arrange: a replayed keyframe, then a live sample with no changes
+      final data = ByteData(12 + 14 + 7)
+        ..setUint8(0, 0xC1)
+        ..setUint8(1, 2)
+        ..setUint16(2, 1000, Endian.little)
+        ..setUint32(4, 40, Endian.little)
+        ..setUint16(12, 900, Endian.little)
+        ..setInt16(14, 500, Endian.little)
+        ..setInt16(16, 220, Endian.little)
+        ..setUint8(19, SensorDataParser.statusValid | SensorDataParser.statusReplayed)
+        ..setUint8(12 + 14 + 6, SensorDataParser.statusValid << 4);
+
+      // Act
+      final samples = SensorDataParser.parseNotification(data.buffer.asUint8List().toList());
+
+      // Assert
+      expect(samples, hasLength(2));
+      expect(samples[0].replayed, isTrue);
+      expect(samples[1].replayed, isFalse);
+    });
+
+    test('should parse a batched notification', () {
+      // Arrange
+      final bytes = <int>[0xB1, 2, 16, 0, 7, 0, 0, 0]
+        ..addAll(buildPacket(850, 552, 243, 0, 10, 7))
+        ..addAll(buildPacket(1200, 560, 245, 1, 11, 8));
+
+      // Act
+      final samples = SensorDataParser.parseNotification(bytes);
+
+      // Assert
+      expect(samples.length, equals(2));
+      expect(samples[1].co2, equals(1200.0));
+      expect(samples[1].alert, equals(1));
+      expect(samples[0].timestamp.isBefore(samples[1].timestamp), isTrue);
+    });
+
+    test('should parse a delta-compressed notification', () {
+      // Arrange: keyframe (850 ppm, 55.2%, 24.3°C, 15.0 bpm, 1800/2200 ms)
+      // then deltas +3/-1/+1/+2/-100/0 and -2/0/0/0/0/0
+      final bytes = <int>[
+        0xC1, 3, 0xE8, 0x03, 7, 0, 0, 0, 0x10, 0x27, 0, 0, // header
+        0x52, 0x03, 0x28, 0x02, 0xF3, 0x00, 0, 1,           // keyframe
+        0x96, 0x00, 0x08, 0x07, 0x98, 0x08,                 // respiration
+        6, 1, 2, 4, 0xC7, 0x01, 0, 0x10,                    // sample 1
+        3, 0, 0, 0, 0, 0, 0x11,                             // sample 2
+      ];
+
+      // Act
+      final samples = SensorDataParser.parseNotification(bytes);
+
+      // Assert
+      expect(samples.length, equals(3));
+      expect(samples[1].co2, equals(853.0));
+      expect(samples[1].humidity, equals(55.1));
+      expect(samples[1].temperature, equals(24.4));
+      expect(samples[2].co2, equals(851.0));
+      expect(samples[2].alert, equals(1));
+      expect(samples[2].timestamp.difference(samples[0].timestamp).inMilliseconds, equals(2000));
+      expect(samples[0].breathsPerMinute, equals(15.0));
+      expect(samples[1].breathsPerMinute, equals(15.2));
+      expect(samples[1].inhaleMs, equals(1700));
+      expect(samples[2].exhaleMs, equals(2200));
+    });
+
+    test('should parse an extended SensorPacket with respiration fields', () {
+      // Arrange
+      final respiration = ByteData(6)
+        ..setUint16(0, 124, Endian.little)
+        ..setUint16(2, 1900, Endian.little)
+        ..setUint16(4, 2600, Endian.little);
+      final bytes = buildPacket(850, 552, 243, 0, 10, 7)
+        ..addAll(respiration.buffer.asUint8List());
+
+      // Act
+      final samples = SensorDataParser.parseNotification(bytes);
+
+      // Assert
+      expect(samples.length, equals(1));
+      expect(samples.first.co2, equals(850.0));
+      expect(samples.first.breathsPerMinute, equals(12.4));
+      expect(samples.first.inhaleMs, equals(1900));
+      expect(samples.first.exhaleMs, equals(2600));
+    });
+
+    test('should leave respiration fields empty for legacy packets', () {
+      // Act
+      final samples = SensorDataParser.parseNotification(buildPacket(850, 552, 243, 0, 10, 7));
+
+      // Assert
+      expect(samples.first.breathsPerMinute, isNull);
+    });
+
+    test('should parse a backfill notification against the device clock', () {
+      // Arrange: two samples captured at 100 s and 160 s, sent at 400 s
+      final bytes = <int>[0xB2, 2, 16, 0, 40, 0, 0, 0, 0x90, 0x01, 0, 0]
+        ..addAll(buildPacket(850, 552, 243, 0, 100, 40))
+        ..addAll(buildPacket(900, 552, 243, 0, 160, 41));
+
+      // Act
+      final samples = SensorDataParser.parseNotification(bytes);
+
+      // Assert
+      expect(samples.length, equals(2));
+      expect(samples[0].sequence, equals(40));
+      expect(samples[1].sequence, equals(41));
+      expect(samples[1].timestamp.difference(samples[0].timestamp).inSeconds, equals(60));
+      expect(DateTime.now().difference(samples[1].timestamp).inSeconds, closeTo(240, 1));
+    });
+
+    test('should parse a summary record as one averaged sample', () {
+      // Arrange: 6 samples, peak alert 1, CO2 800-900 (mean 850, +12 ppm/min),
+      // humidity 45.0%, temperature 21.8-22.2°C (mean 22.0)
+      final data = ByteData(32)
+        ..setUint8(0, 0xE1)
+        ..setUint8(1, 6)
+        ..setUint8(2, 1)
+        ..setUint32(4, 60, Endian.little)
+        ..setUint32(8, 6, Endian.little)
+        ..setUint16(12, 850, Endian.little)
+        ..setUint16(14, 800, Endian.little)
+        ..setUint16(16, 900, Endian.little)
+        ..setInt16(18, 12, Endian.little)
+        ..setInt16(20, 450, Endian.little)
+        ..setInt16(22, 450, Endian.little)
+        ..setInt16(24, 450, Endian.little)
+        ..setInt16(26, 220, Endian.little)
+        ..setInt16(28, 218, Endian.little)
+        ..setInt16(30, 222, Endian.little);
+
+      // Act
+      final samples = SensorDataParser.parseNotification(data.buffer.asUint8List().toList());
+
+      // Assert
+      expect(samples.length, equals(1));
+      expect(samples.first.co2, equals(850.0));
+      expect(samples.first.humidity, equals(45.0));
+      expect(samples.first.temperature, equals(22.0));
+      expect(samples.first.alert, equals(1));
+      expect(samples.first.sequence, isNull);
+    });
+
+    test('should reject a truncated batched notification', () {
+      // Arrange
+      final bytes = <int>[0xB1, 2, 16, 0, 7, 0, 0, 0]
+        ..addAll(buildPacket(850, 552, 243, 0, 10, 7));
+
+      // Act
+      final samples = SensorDataParser.parseNotification(bytes);
+
+      // Assert
+      expect(samples, isEmpty);
+    });
+  });
+
+  group('Binary Command Tests', () {
+    test('should encode a command with its request id and argument', () {
+      // Arrange
+      const command = DeviceCommand(DeviceCommand.backfill, requestId: 42, argument: 0x01020304);
+
+      // Act
+      final bytes = command.encode();
+
+      // Assert
+      expect(bytes, equals([7, 42, 0x04, 0x03, 0x02, 0x01]));
+    });
+
+    test('should parse a command response', () {
+      // Act
+      final response = CommandResponse.parse([0xD1, 8, 42, 2]);
+
+      // Assert
+      expect(response, isNotNull);
+      expect(response!.opcode, equals(DeviceCommand.setSamplePeriod));
+      expect(response.requestId, equals(42));
+      expect(response.status, equals(CommandStatus.invalidArgument));
+    });
+
+    test('should encode a streaming profile change', () {
+      // Act
+      final bytes = DeviceCommand(DeviceCommand.setProfile,
+              requestId: 3, argument: StreamingProfile.background.index)
+          .encode();
+
+      // Assert
+      expect(bytes, equals([10, 3, 2, 0, 0, 0]));
+    });
+
+    test('should reject frames that are not command responses', () {
+      expect(CommandResponse.parse([0xB1, 8, 42, 0]), isNull);
+      expect(CommandResponse.parse([0xD1, 8, 42]), isNull);
+      expect(CommandResponse.parse([0xD1, 8, 42, 9]), isNull);
+    });
+  });
+
+  group('Link Benchmark Tests', () {
+    List<int> benchmarkFrame(int sequence, int length) {
+      final data = ByteData(length)
+        ..setUint8(0, 0xF1)
+        ..setUint16(2, length, Endian.little)
+        ..setUint32(4, sequence, Endian.little)
+        ..setUint32(8, 123456, Endian.little);
+      return data.buffer.asUint8List().toList();
+    }
+
+    test('should parse a benchmark frame', () {
+      // Act
+      final frame = BenchmarkFrame.parse(benchmarkFrame(7, 244));
+
+      // Assert
+      expect(frame, isNotNull);
+      expect(frame!.sequence, equals(7));
+      expect(frame.length, equals(244));
+      expect(frame.sentUs, equals(123456));
+    });
+
+    test('should reject truncated benchmark frames', () {
+      final bytes = benchmarkFrame(7, 244);
+      expect(BenchmarkFrame.parse(bytes.sublist(0, 100)), isNull);
+      expect(BenchmarkFrame.parse([0xB1, ...bytes.sublist(1)]), isNull);
+    });
+
+    test('should count lost frames and throughput', () {
+      // Arrange
+      final stats = LinkBenchmarkStats();
+      final start = DateTime(2024);
+
+      // Act: frame 2 never arrives
+      stats.add(BenchmarkFrame.parse(benchmarkFrame(0, 100))!, start);
+      stats.add(BenchmarkFrame.parse(benchmarkFrame(1, 100))!, start.add(const Duration(milliseconds: 500)));
+      stats.add(BenchmarkFrame.parse(benchmarkFrame(3, 100))!, start.add(const Duration(seconds: 1)));
+
+      // Assert
+      expect(stats.frames, equals(3));
+      expect(stats.lost, equals(1));
+      expect(stats.bytesPerSecond, closeTo(300, 0.1));
+      expect(stats.maxGap, equals(const Duration(milliseconds: 500)));
+    });
+
+    test('should find the link section of a diagnostics snapshot', () {
+      // Arrange: 2 stages with 4 histogram buckets, 3 tasks
+      const offset = 36 + 2 * (16 + 8) + 3 * 6;
+      final data = ByteData(offset + 44)
+        ..setUint8(0, 3)
+        ..setUint8(1, 2)
+        ..setUint8(2, 3)
+        ..setUint8(3, 4)
+        ..setUint32(offset, 500, Endian.little)
+        ..setUint32(offset + 12, 9, Endian.little)
+        ..setUint8(offset + 20, 1)
+        ..setUint16(offset + 22, 244, Endian.little)
+        ..setUint32(offset + 40, 12000, Endian.little);
+      final bytes = data.buffer.asUint8List().toList();
+
+      // Act
+      final stats = DeviceLinkStats.parseSnapshot(bytes);
+
+      // Assert
+      expect(stats, isNotNull);
+      expect(stats!.framesSent, equals(500));
+      expect(stats.notifyCongested, equals(9));
+      expect(stats.benchActive, isTrue);
+      expect(stats.benchFrameSize, equals(244));
+      expect(stats.benchBytesPerSecond, equals(12000));
+      expect(stats.samplesDropped, equals(0));
+      expect(DeviceLinkStats.parseSnapshot([2, ...bytes.sublist(1)]), isNull);
+    });
+
+    test('should read the dropped sample count from version 5 snapshots', () {
+      // Arrange: no stages or tasks, the link section right after the header
+      final data = ByteData(DeviceLinkStats.headerSize + DeviceLinkStats.droppedSize)
+        ..setUint8(0, 5)
+        ..setUint32(DeviceLinkStats.headerSize + 44, 6, Endian.little);
+      final bytes = data.buffer.asUint8List().toList();
+
+      // Act
+      final stats = DeviceLinkStats.parseSnapshot(bytes);
+
+      // Assert
+      expect(stats!.samplesDropped, equals(6));
+      expect(DeviceLinkStats.parseSnapshot(bytes.sublist(0, bytes.length - 1)), isNull);
+    });
+
+    test('should find the deadline section after the link section', () {
+      // Arrange: 2 stages with 4 histogram buckets, 3 tasks, 5 deadline stages
+      const offset = 36 + 2 * (16 + 8) + 3 * 6 + 44;
+      final data = ByteData(offset + 4 + 5 * 4)
+        ..setUint8(0, 4)
+        ..setUint8(1, 2)
+        ..setUint8(2, 3)
+        ..setUint8(3, 4)
+        ..setUint8(offset, 5)
+        ..setUint8(offset + 1, 2)
+        ..setUint16(offset + 2, 1, Endian.little)
+        ..setUint32(offset + 4, 3, Endian.little)
+        ..setUint32(offset + 4 + 3 * 4, 7, Endian.little);
+      final bytes = data.buffer.asUint8List().toList();
+
+      // Act
+      final stats = DeviceDeadlineStats.parseSnapshot(bytes);
+
+      // Assert
+      expect(stats, isNotNull);
+      expect(stats!.missedFor('sensorRead'), equals(3));
+      expect(stats.missedFor('notify'), equals(7));
+      expect(stats.missedTotal, equals(10));
+      expect(stats.watchdogRestarts, equals(1));
+      expect(stats.wedgedTask, equals('transport'));
+      expect(DeviceDeadlineStats.parseSnapshot([3, ...bytes.sublist(1)]), isNull);
+      expect(DeviceDeadlineStats.parseSnapshot(bytes.sublist(0, offset + 8)), isNull);
+    });
+  });
+
+  group('Waveform Capture Tests', () {
+    List<int> captureFrame(int captureId, int offset, int total, List<int> pressure, {bool last = false}) {
+      final data = ByteData(16 + pressure.length * 6)
+        ..setUint8(0, 0xF2)
+        ..setUint8(1, pressure.length)
+        ..setUint8(2, 6)
+        ..setUint8(3, last ? 0x01 : 0)
+        ..setUint16(4, captureId, Endian.little)
+        ..setUint16(6, 20, Endian.little)
+        ..setUint32(8, offset, Endian.little)
+        ..setUint32(12, total, Endian.little);
+      for (var i = 0; i < pressure.length; i++) {
+        data.setInt32(16 + i * 6, pressure[i], Endian.little);
+        data.setUint16(20 + i * 6, 850, Endian.little);
+      }
+      return data.buffer.asUint8List().toList();
+    }
+
+    test('should parse a capture frame', () {
+      // Act
+      final frame = CaptureFrame.parse(captureFrame(3, 10, 12, [1620000, CaptureFrame.missingPressure], last: true));
+
+      // Assert
+      expect(frame, isNotNull);
+      expect(frame!.captureId, equals(3));
+      expect(frame.periodMs, equals(20));
+      expect(frame.offset, equals(10));
+      expect(frame.total, equals(12));
+      expect(frame.last, isTrue);
+      expect(frame.pressureX16, equals([1620000, CaptureFrame.missingPressure]));
+      expect(frame.co2, equals([850, 850]));
+    });
+
+    test('should reject truncated capture frames', () {
+      final bytes = captureFrame(3, 0, 2, [1, 2]);
+      expect(CaptureFrame.parse(bytes.sublist(0, bytes.length - 1)), isNull);
+      expect(CaptureFrame.parse([0xF1, ...bytes.sublist(1)]), isNull);
+    });
+
+    test('should resume a capture from the next missing sample', () {
+      // Arrange
+      final capture = WaveformCapture();
+
+      // Act: the second frame is resent after a reconnect
+      expect(capture.add(CaptureFrame.parse(captureFrame(5, 0, 4, [160, 176]))!), isTrue);
+      expect(capture.add(CaptureFrame.parse(captureFrame(5, 4, 4, [1]))!), isFalse);
+      expect(capture.nextOffset, equals(2));
+      expect(capture.add(CaptureFrame.parse(captureFrame(5, 2, 4, [CaptureFrame.missingPressure, 192], last: true))!), isTrue);
+
+      // Assert
+      expect(capture.isComplete, isTrue);
+      expect(capture.missing, equals(1));
+      expect(capture.pressurePa(0), equals(10.0));
+      expect(capture.pressurePa(2), isNull);
+      expect(capture.add(CaptureFrame.parse(captureFrame(6, 0, 4, [1]))!), isFalse);
+    });
+  });
+
+  group('Clock Sync Tests', () {
+    List<int> pong({required int token, required int receivedUs, required int sentUs, int? epochOffsetUs}) {
+      final data = ByteData(PongFrame.frameSize);
+      data.setUint8(0, PongFrame.frameType);
+      data.setUint8(1, 5);
+      data.setUint8(2, epochOffsetUs != null ? PongFrame.epochSetFlag : 0);
+      data.setUint32(4, token, Endian.little);
+      data.setInt64(8, receivedUs, Endian.little);
+      data.setInt64(16, sentUs, Endian.little);
+      data.setInt64(24, epochOffsetUs ?? 0, Endian.little);
+      return data.buffer.asUint8List().toList();
+    }
+
+    test('should encode a 64-bit time sync argument in a long frame', () {
+      // Act
+      final bytes = const DeviceCommand(DeviceCommand.timeSync, requestId: 1, argument: 0x0000019A12345678)
+          .encode();
+
+      // Assert
+      expect(bytes, equals([19, 1, 0x78, 0x56, 0x34, 0x12, 0x9A, 0x01, 0, 0]));
+    });
+
+    test('should parse a pong frame', () {
+      // Act
+      final frame = PongFrame.parse(pong(token: 77, receivedUs: 5000000, sentUs: 5000350));
+
+      // Assert
+      expect(frame, isNotNull);
+      expect(frame!.token, equals(77));
+      expect(frame.receivedUs, equals(5000000));
+      expect(frame.sentUs, equals(5000350));
+      expect(frame.epochOffsetUs, isNull);
+      expect(PongFrame.parse(pong(token: 1, receivedUs: 0, sentUs: 0).sublist(0, 31)), isNull);
+    });
+
+    test('should estimate the offset from the fastest round trip', () {
+      // Arrange: the device clock runs 1 s behind the phone, 20 ms each way
+      final clock = ClockSync();
+      final slow = PongFrame.parse(pong(token: 1, receivedUs: 60000, sentUs: 60500))!;
+      final fast = PongFrame.parse(pong(token: 2, receivedUs: 2020000, sentUs: 2020500))!;
+
+      // Act
+      clock.add(1000000, 1100500, slow);  // Asymmetric, 100 ms on the air
+      clock.add(3000000, 3040500, fast);
+
+      // Assert
+      expect(clock.samples, equals(2));
+      expect(clock.roundTripUs, equals(40000));
+      expect(clock.offsetUs, equals(1000000));
+      expect(clock.toPhoneTime(2020000)!.microsecondsSinceEpoch, equals(3020000));
+    });
+
+    test('should read capture micros from 26-byte batch entries', () {
+      // Arrange: a one-entry batch as sent for a single live sample
+      final data = ByteData(SensorDataParser.batchHeaderSize + SensorDataParser.timedPacketSize);
+      data.setUint8(0, SensorDataParser.batchFrameType);
+      data.setUint8(1, 1);
+      data.setUint8(2, SensorDataParser.timedPacketSize);
+      data.setUint32(4, 9, Endian.little);
+      data.setUint16(8, 800, Endian.little);
+      data.setInt16(10, 450, Endian.little);
+      data.setInt16(12, 215, Endian.little);
+      data.setUint32(16, 12, Endian.little);
+      data.setUint32(20, 9, Endian.little);
+      data.setUint32(30, 345678, Endian.little);
+
+      // Act
+      final samples = SensorDataParser.parseNotification(data.buffer.asUint8List().toList());
+
+      // Assert
+      expect(samples, hasLength(1));
+      expect(samples[0].sequence, equals(9));
+      expect(samples[0].deviceCaptureUs, equals(12345678));
+    });
+
+    test('should leave capture time unknown for older packets', () {
+      final samples = SensorDataParser.parseNotification(List<int>.filled(SensorDataParser.extendedPacketSize, 0));
+      expect(samples, hasLength(1));
+      expect(samples[0].deviceCaptureUs, isNull);
+    });
+  });
+
+  group('Broadcast Tests', () {
+    List<int> manufacturerData({int companyId = 0xFFFF, int version = 1, int flags = 0, int breathRate = 0}) {
+      final data = ByteData(BroadcastSummary.frameSize);
+      data.setUint16(0, companyId, Endian.little);
+      data.setUint8(2, version);
+      data.setUint8(3, flags);
+      data.setUint16(4, 1850, Endian.little);
+      data.setUint16(6, breathRate, Endian.little);
+      data.setInt16(8, -45, Endian.little);
+      data.setInt16(10, 456, Endian.little);
+      data.setUint32(12, 0x01020304, Endian.little);
+      return data.buffer.asUint8List().toList();
+    }
+
+    test('should encode the broadcast command', () {
+      expect(const DeviceCommand(DeviceCommand.broadcast, requestId: 3, argument: 1).encode(),
+          equals([21, 3, 1, 0, 0, 0]));
+    });
+
+    test('should parse a broadcast summary', () {
+      // Act
+      final summary = BroadcastSummary.parse(manufacturerData(flags: 0x12, breathRate: 162));
+
+      // Assert
+      expect(summary, isNotNull);
+      expect(summary!.co2, equals(1850));
+      expect(summary.breathsPerMinute, closeTo(16.2, 0.001));
+      expect(summary.temperature, closeTo(-4.5, 0.001));
+      expect(summary.humidity, closeTo(45.6, 0.001));
+      expect(summary.alert, equals(2));
+      expect(summary.connected, isTrue);
+      expect(summary.sequence, equals(0x01020304));
+    });
+
+    test('should report no breath rate before one is measured', () {
+      final summary = BroadcastSummary.parse(manufacturerData());
+      expect(summary!.breathsPerMinute, isNull);
+      expect(summary.connected, isFalse);
+    });
+
+    test('should ignore other manufacturer data', () {
+      expect(BroadcastSummary.parse(manufacturerData(companyId: 0x004C)), isNull);
+      expect(BroadcastSummary.parse(manufacturerData(version: 2)), isNull);
+      expect(BroadcastSummary.parse(manufacturerData().sublist(0, 15)), isNull);
+      expect(BroadcastSummary.parse([]), isNull);
+    });
+  });
+
   group('Control Command JSON Tests', () {
     test('should create correct mute command JSON', () {
       // Arrange